@@ -0,0 +1,189 @@
+//
+// Benchmarks of the audio hot paths: the PCM callbacks which run on the mixer thread, the
+// geometry update which runs for every pose, and loading the beacon assets. The results are
+// written to stdout as JSON, see BenchmarkHarness.h.
+//
+#include <cstring>
+#include <random>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <vector>
+
+#include "BenchmarkHarness.h"
+#include "AudioBeacon.h"
+#include "AudioEngine.h"
+#include "OfflineAudioBackend.h"
+
+using namespace soundscape;
+using namespace soundscape::benchmark;
+
+const double LISTENER_LATITUDE = 55.9473;
+const double LISTENER_LONGITUDE = -4.3112;
+
+// A looping source of silence, so that the geometry can be benchmarked with many more sources than
+// there's memory to load the beacon assets for.
+class SilentAudioSource : public BeaconAudioSource {
+public:
+    SilentAudioSource(const AudioEngine *ae, PositionedAudio *parent) : BeaconAudioSource(ae, parent) {}
+
+    AudioStreamFormat GetStreamFormat() const override
+    {
+        AudioStreamFormat format{};
+        format.sample_rate = 22050;
+        format.length = format.sample_rate * sizeof(int16_t);
+        format.loop = true;
+        format.decode_buffer_size = format.sample_rate / 10;
+        format.min_distance = 10.0f;
+        format.max_distance = 5000.0f;
+        return format;
+    }
+
+    void PcmReadCallback(void *data, unsigned int data_length) override
+    {
+        memset(data, 0, data_length);
+    }
+};
+
+class SilentAudio : public PositionedAudio {
+public:
+    SilentAudio(AudioEngine *engine, double latitude, double longitude)
+        : PositionedAudio(engine, latitude, longitude)
+    {
+        Init();
+    }
+
+protected:
+    bool CreateAudioSource() final
+    {
+        m_pAudioSource = std::make_unique<SilentAudioSource>(m_pEngine, this);
+        return false;
+    }
+};
+
+static std::unique_ptr<AudioEngine> CreateEngine()
+{
+    return std::make_unique<AudioEngine>(std::make_unique<OfflineAudioBackend>());
+}
+
+// Drain the engine's events and return the total size of the assets that were loaded
+static int64_t DrainAssetLoadedEvents(AudioEngine &engine)
+{
+    int64_t bytes = 0;
+    Event events[64];
+    size_t count;
+    while((count = engine.DrainEvents(events, 64)) > 0) {
+        for(size_t i = 0; i < count; ++i) {
+            if(events[i].type == EventType::AssetLoaded)
+                bytes += events[i].value;
+        }
+    }
+    return bytes;
+}
+
+// Copying from a beacon asset into the mixer's buffer, argument is the number of bytes
+BENCHMARK_WITH_ARGS(BeaconBuffer_Read, {256, 4410, 65536})
+{
+    OfflineAudioBackend backend;
+    BeaconBuffer buffer(&backend, "file:///android_asset/Classic/Classic_OnAxis.wav", 22.5);
+
+    auto length = static_cast<unsigned int>(state.GetArg());
+    std::vector<uint8_t> data(length);
+    unsigned long pos = 0;
+    while(state.KeepRunning()) {
+        pos += buffer.Read(data.data(), length, pos);
+        DoNotOptimize(data[0]);
+    }
+    state.SetBytesPerIteration(length);
+}
+
+// The beacon callback for each decode buffer, argument is how far off axis the listener is facing
+BENCHMARK_WITH_ARGS(BeaconBufferGroup_PcmReadCallback, {0, 45, 180})
+{
+    auto engine = CreateEngine();
+    auto parent = new SilentAudio(engine.get(), LISTENER_LATITUDE, LISTENER_LONGITUDE);
+    BeaconBufferGroup group(engine.get(), parent);
+    group.UpdateGeometry(static_cast<double>(state.GetArg()), 100);
+
+    auto length = group.GetStreamFormat().decode_buffer_size * static_cast<unsigned int>(sizeof(int16_t));
+    std::vector<uint8_t> data(length);
+    while(state.KeepRunning()) {
+        group.PcmReadCallback(data.data(), length);
+        DoNotOptimize(data[0]);
+    }
+    state.SetBytesPerIteration(length);
+}
+
+// The text to speech callback for each decode buffer, with the speech already waiting in the socket
+BENCHMARK(TtsAudioSource_PcmReadCallback)
+{
+    int sockets[2];
+    if(socketpair(AF_UNIX, SOCK_STREAM, 0, sockets) != 0) {
+        state.SetLabel("socketpair failed");
+        return;
+    }
+
+    auto engine = CreateEngine();
+    auto parent = new SilentAudio(engine.get(), LISTENER_LATITUDE, LISTENER_LONGITUDE);
+    TtsAudioSource tts(engine.get(), parent, sockets[0]);
+
+    auto length = tts.GetStreamFormat().decode_buffer_size * static_cast<unsigned int>(sizeof(int16_t));
+    std::vector<uint8_t> speech(length, 0x55);
+    std::vector<uint8_t> data(length);
+    while(state.KeepRunning()) {
+        state.PauseTiming();
+        if(write(sockets[1], speech.data(), speech.size()) != static_cast<ssize_t>(speech.size()))
+            state.SetLabel("short write");
+        state.ResumeTiming();
+
+        tts.PcmReadCallback(data.data(), length);
+        DoNotOptimize(data[0]);
+    }
+    state.SetBytesPerIteration(length);
+
+    close(sockets[0]);
+    close(sockets[1]);
+}
+
+// A pose update with sources scattered within 2km of the listener, argument is the number of sources
+BENCHMARK_WITH_ARGS(AudioEngine_UpdateGeometry, {1, 10, 100, 1000, 10000})
+{
+    auto engine = CreateEngine();
+
+    std::mt19937 random(1);
+    std::uniform_real_distribution<double> bearing(0.0, 360.0);
+    std::uniform_real_distribution<double> range(10.0, 2000.0);
+    for(long i = 0; i < state.GetArg(); ++i) {
+        double latitude, longitude;
+        getDestinationCoordinate(LISTENER_LATITUDE, LISTENER_LONGITUDE, bearing(random), range(random),
+                                 latitude, longitude);
+        new SilentAudio(engine.get(), latitude, longitude);
+    }
+
+    double heading = 0.0;
+    while(state.KeepRunning()) {
+        engine->UpdateGeometry(LISTENER_LATITUDE, LISTENER_LONGITUDE, heading);
+        heading = fmod(heading + 1.0, 360.0);
+    }
+    state.SetItemsPerIteration(static_cast<double>(state.GetArg()));
+}
+
+// Loading all of the assets for a beacon, argument is the index of its AudioEngine descriptor
+BENCHMARK_WITH_ARGS(AssetLoad, {0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12})
+{
+    auto engine = CreateEngine();
+    engine->SetBeaconType(static_cast<int>(state.GetArg()));
+    auto parent = new SilentAudio(engine.get(), LISTENER_LATITUDE, LISTENER_LONGITUDE);
+
+    int64_t bytes = 0;
+    while(state.KeepRunning()) {
+        BeaconBufferGroup group(engine.get(), parent);
+
+        state.PauseTiming();
+        bytes = DrainAssetLoadedEvents(*engine);
+        state.ResumeTiming();
+    }
+    state.SetBytesPerIteration(static_cast<double>(bytes));
+    state.SetLabel(engine->GetBeaconDescriptor()->m_Beacons[0].m_Filename);
+}
+
+BENCHMARK_MAIN()
@@ -0,0 +1,213 @@
+#pragma once
+
+//
+// Minimal benchmark harness for the native host benchmarks. Each benchmark source file builds
+// into its own executable which runs every BENCHMARK in the file and writes the results to stdout
+// as JSON, so that they can be stored and compared between versions. A summary is written to
+// stderr as it goes.
+//
+// Usage: <benchmark> [--filter=<substring>] [--min-time=<seconds>]
+//
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+#include <functional>
+#include <string>
+#include <vector>
+#include <unistd.h>
+
+namespace soundscape::benchmark {
+
+    class State {
+    public:
+        State(long arg, double min_time) : m_Arg(arg), m_MinTime(min_time) {}
+
+        // Call in a while loop around the code to be measured. The code is run in batches which
+        // double in size until the minimum time has been spent in it.
+        bool KeepRunning()
+        {
+            if(m_BatchRemaining > 0) {
+                --m_BatchRemaining;
+                return true;
+            }
+            auto now = Clock::now();
+            if(!m_Started) {
+                m_Started = true;
+                m_Start = now;
+            } else {
+                m_Iterations += m_BatchSize;
+                m_BatchSize *= 2;
+            }
+            if(GetElapsedSeconds(now) >= m_MinTime) {
+                m_Elapsed = GetElapsed(now);
+                return false;
+            }
+            m_BatchRemaining = m_BatchSize - 1;
+            return true;
+        }
+
+        // Exclude set up done inside the loop from the timing
+        void PauseTiming() { m_PauseStart = Clock::now(); }
+        void ResumeTiming() { m_Paused += Clock::now() - m_PauseStart; }
+
+        long GetArg() const { return m_Arg; }
+        void SetBytesPerIteration(double bytes) { m_BytesPerIteration = bytes; }
+        void SetItemsPerIteration(double items) { m_ItemsPerIteration = items; }
+        void SetLabel(const std::string &label) { m_Label = label; }
+
+        uint64_t GetIterations() const { return m_Iterations; }
+        double GetNsPerIteration() const
+        {
+            auto ns = std::chrono::duration<double, std::nano>(m_Elapsed).count();
+            return m_Iterations ? ns / static_cast<double>(m_Iterations) : 0.0;
+        }
+        double GetBytesPerIteration() const { return m_BytesPerIteration; }
+        double GetItemsPerIteration() const { return m_ItemsPerIteration; }
+        const std::string &GetLabel() const { return m_Label; }
+
+    private:
+        typedef std::chrono::steady_clock Clock;
+
+        Clock::duration GetElapsed(Clock::time_point now) const { return (now - m_Start) - m_Paused; }
+        double GetElapsedSeconds(Clock::time_point now) const
+        {
+            return std::chrono::duration<double>(GetElapsed(now)).count();
+        }
+
+        long m_Arg;
+        double m_MinTime;
+        bool m_Started = false;
+        uint64_t m_Iterations = 0;
+        uint64_t m_BatchSize = 1;
+        uint64_t m_BatchRemaining = 0;
+        Clock::time_point m_Start;
+        Clock::time_point m_PauseStart;
+        Clock::duration m_Paused = Clock::duration::zero();
+        Clock::duration m_Elapsed = Clock::duration::zero();
+        double m_BytesPerIteration = 0.0;
+        double m_ItemsPerIteration = 0.0;
+        std::string m_Label;
+    };
+
+    struct Benchmark {
+        std::string name;
+        std::vector<long> args;
+        std::function<void(State &)> function;
+    };
+
+    inline std::vector<Benchmark> &GetBenchmarks()
+    {
+        static std::vector<Benchmark> benchmarks;
+        return benchmarks;
+    }
+
+    struct BenchmarkRegistration {
+        BenchmarkRegistration(const char *name, std::vector<long> args,
+                              std::function<void(State &)> function)
+        {
+            GetBenchmarks().push_back({name, std::move(args), std::move(function)});
+        }
+    };
+
+    // Prevent the compiler from optimising away a value that's otherwise unused
+    template<typename T>
+    inline void DoNotOptimize(const T &value)
+    {
+        asm volatile("" : : "r,m"(value) : "memory");
+    }
+
+    inline void PrintJsonString(const std::string &value)
+    {
+        putchar('"');
+        for(auto c: value) {
+            if((c == '"') || (c == '\\'))
+                putchar('\\');
+            putchar(c);
+        }
+        putchar('"');
+    }
+
+    inline int RunAllBenchmarks(int argc, char **argv)
+    {
+        std::string filter;
+        double min_time = 0.5;
+        for(int i = 1; i < argc; ++i) {
+            if(strncmp(argv[i], "--filter=", 9) == 0)
+                filter = argv[i] + 9;
+            else if(strncmp(argv[i], "--min-time=", 11) == 0)
+                min_time = atof(argv[i] + 11);
+            else {
+                fprintf(stderr, "Usage: %s [--filter=<substring>] [--min-time=<seconds>]\n", argv[0]);
+                return 1;
+            }
+        }
+
+        char host[256] = "unknown";
+        gethostname(host, sizeof(host) - 1);
+        char date[32];
+        auto now = time(nullptr);
+        strftime(date, sizeof(date), "%Y-%m-%dT%H:%M:%SZ", gmtime(&now));
+
+        printf("{\n  \"context\": {\n");
+        printf("    \"executable\": ");
+        PrintJsonString(argv[0]);
+        printf(",\n    \"host\": ");
+        PrintJsonString(host);
+        printf(",\n    \"date\": \"%s\",\n", date);
+#ifdef NDEBUG
+        printf("    \"optimized\": true\n");
+#else
+        printf("    \"optimized\": false\n");
+#endif
+        printf("  },\n  \"benchmarks\": [");
+
+        bool first = true;
+        for(const auto &benchmark: GetBenchmarks()) {
+            auto args = benchmark.args.empty() ? std::vector<long>{0} : benchmark.args;
+            for(auto arg: args) {
+                auto name = benchmark.name;
+                if(!benchmark.args.empty())
+                    name += "/" + std::to_string(arg);
+                if(name.find(filter) == std::string::npos)
+                    continue;
+
+                State state(arg, min_time);
+                benchmark.function(state);
+
+                auto ns = state.GetNsPerIteration();
+                fprintf(stderr, "%-40s %14.1f ns %12llu iterations %s\n", name.c_str(), ns,
+                        static_cast<unsigned long long>(state.GetIterations()),
+                        state.GetLabel().c_str());
+
+                printf("%s\n    {\"name\": ", first ? "" : ",");
+                PrintJsonString(name);
+                printf(", \"iterations\": %llu, \"ns_per_iteration\": %.3f",
+                       static_cast<unsigned long long>(state.GetIterations()), ns);
+                if((state.GetBytesPerIteration() > 0.0) && (ns > 0.0))
+                    printf(", \"bytes_per_second\": %.0f", state.GetBytesPerIteration() * 1e9 / ns);
+                if((state.GetItemsPerIteration() > 0.0) && (ns > 0.0))
+                    printf(", \"items_per_second\": %.0f", state.GetItemsPerIteration() * 1e9 / ns);
+                if(!state.GetLabel().empty()) {
+                    printf(", \"label\": ");
+                    PrintJsonString(state.GetLabel());
+                }
+                printf("}");
+                first = false;
+            }
+        }
+        printf("\n  ]\n}\n");
+        return 0;
+    }
+}
+
+#define BENCHMARK(name) BENCHMARK_WITH_ARGS(name, {})
+
+// The benchmark is run once for each argument, which it gets from State::GetArg
+#define BENCHMARK_WITH_ARGS(name, ...) \
+    static void name(soundscape::benchmark::State &state); \
+    static soundscape::benchmark::BenchmarkRegistration name##_registration(#name, __VA_ARGS__, name); \
+    static void name(soundscape::benchmark::State &state)
+
+#define BENCHMARK_MAIN() \
+    int main(int argc, char **argv) { return soundscape::benchmark::RunAllBenchmarks(argc, argv); }
@@ -0,0 +1,190 @@
+//
+// Speed of the FeatureIndex spatial index, on made up tiles of the given numbers of features.
+// The features are short roads and POIs scattered over a 2km square, which at 10,000 features is
+// several times as dense as a zoom 16 tile in a city centre. The queries are from locations
+// scattered over the same square, and are compared with measuring the distance to every feature,
+// or testing every feature against the field of view, as TileUtils.kt does. Building the road
+// graph is measured too, as it's built alongside the index when a tile is loaded.
+//
+#include <random>
+#include <vector>
+
+#include "BenchmarkHarness.h"
+#include "FeatureIndex.h"
+#include "RoadGraph.h"
+
+using namespace soundscape;
+using namespace soundscape::benchmark;
+
+const double ORIGIN_LATITUDE = 55.9533;
+const double ORIGIN_LONGITUDE = -3.1883;
+const double SIZE_DEGREES = 0.018;
+
+static std::shared_ptr<FeatureCollection> MakeFeatures(long count)
+{
+    std::mt19937 random(42);
+    std::uniform_real_distribution<double> position(0.0, SIZE_DEGREES);
+    std::uniform_real_distribution<double> step(-0.0005, 0.0005);
+    std::uniform_int_distribution<uint32_t> length(2, 8);
+
+    auto features = std::make_shared<FeatureCollection>();
+    for(long index = 0; index < count; ++index) {
+        Feature feature;
+        feature.first_part = static_cast<uint32_t>(features->parts.size());
+        feature.part_count = 1;
+        auto latitude = ORIGIN_LATITUDE + position(random);
+        auto longitude = ORIGIN_LONGITUDE + position(random);
+        // A third of the features are roads, and the rest are POIs
+        uint32_t points = 1;
+        if(index % 3 == 0) {
+            feature.geometry = GeometryType::LineString;
+            feature.category = FeatureCategory::Road;
+            points = length(random);
+        } else {
+            feature.geometry = GeometryType::Point;
+            feature.category = FeatureCategory::Poi;
+        }
+        features->parts.push_back({static_cast<uint32_t>(features->latitudes.size()), points, 0});
+        for(uint32_t point = 0; point < points; ++point) {
+            features->latitudes.push_back(latitude);
+            features->longitudes.push_back(longitude);
+            latitude += step(random);
+            longitude += step(random);
+        }
+        features->features.push_back(feature);
+    }
+    return features;
+}
+
+// The square that the features are scattered over, as the tile's bounds
+static BoundingBox MakeBounds()
+{
+    BoundingBox bounds;
+    bounds.westLongitude = ORIGIN_LONGITUDE;
+    bounds.southLatitude = ORIGIN_LATITUDE;
+    bounds.eastLongitude = ORIGIN_LONGITUDE + SIZE_DEGREES;
+    bounds.northLatitude = ORIGIN_LATITUDE + SIZE_DEGREES;
+    return bounds;
+}
+
+static std::vector<std::pair<double, double>> MakeQueries()
+{
+    std::mt19937 random(7);
+    std::uniform_real_distribution<double> position(0.0, SIZE_DEGREES);
+    std::vector<std::pair<double, double>> queries(1024);
+    for(auto &query: queries)
+        query = {ORIGIN_LATITUDE + position(random), ORIGIN_LONGITUDE + position(random)};
+    return queries;
+}
+
+BENCHMARK_WITH_ARGS(FeatureIndex_Build, {1000, 10000})
+{
+    auto features = MakeFeatures(state.GetArg());
+    state.SetLabel(std::to_string(state.GetArg()) + " features");
+    while(state.KeepRunning()) {
+        FeatureIndex index(features, MakeBounds());
+        DoNotOptimize(index.GetSize());
+    }
+    state.SetItemsPerIteration(static_cast<double>(state.GetArg()));
+}
+
+BENCHMARK_WITH_ARGS(RoadGraph_Build, {1000, 10000})
+{
+    auto features = MakeFeatures(state.GetArg());
+    auto bounds = MakeBounds();
+    state.SetLabel(std::to_string(state.GetArg()) + " features");
+    while(state.KeepRunning()) {
+        RoadGraph graph(*features, bounds);
+        DoNotOptimize(graph.GetEdges().size());
+    }
+    state.SetItemsPerIteration(static_cast<double>(state.GetArg()));
+}
+
+BENCHMARK_WITH_ARGS(FeatureIndex_NearestRoad, {1000, 10000})
+{
+    FeatureIndex index(MakeFeatures(state.GetArg()), MakeBounds());
+    auto queries = MakeQueries();
+    state.SetLabel(std::to_string(state.GetArg()) + " features");
+    size_t query = 0;
+    NearestFeature nearest;
+    while(state.KeepRunning()) {
+        const auto &location = queries[query++ % queries.size()];
+        index.FindNearest(location.first, location.second,
+                          FeatureCategoryMask(FeatureCategory::Road), nearest);
+        DoNotOptimize(nearest.distance);
+    }
+}
+
+BENCHMARK_WITH_ARGS(FeatureIndex_Nearest10, {1000, 10000})
+{
+    FeatureIndex index(MakeFeatures(state.GetArg()), MakeBounds());
+    auto queries = MakeQueries();
+    state.SetLabel(std::to_string(state.GetArg()) + " features");
+    size_t query = 0;
+    std::vector<NearestFeature> nearest;
+    while(state.KeepRunning()) {
+        const auto &location = queries[query++ % queries.size()];
+        index.FindNearest(location.first, location.second, 10, ALL_FEATURE_CATEGORIES, nearest);
+        DoNotOptimize(nearest.size());
+    }
+}
+
+// Everything in a 90 degree field of view out to 100m
+BENCHMARK_WITH_ARGS(FeatureIndex_FieldOfView, {1000, 10000})
+{
+    FeatureIndex index(MakeFeatures(state.GetArg()), MakeBounds());
+    auto queries = MakeQueries();
+    state.SetLabel(std::to_string(state.GetArg()) + " features");
+    size_t query = 0;
+    std::vector<NearestFeature> found;
+    while(state.KeepRunning()) {
+        const auto &location = queries[query % queries.size()];
+        index.FindInFieldOfView(location.first, location.second, static_cast<double>(query++ % 360),
+                                90.0, 100.0, ALL_FEATURE_CATEGORIES, found);
+        DoNotOptimize(found.size());
+    }
+}
+
+// The same field of view by testing every feature against it
+BENCHMARK_WITH_ARGS(FeatureIndex_ScanFieldOfView, {1000, 10000})
+{
+    FeatureIndex index(MakeFeatures(state.GetArg()), MakeBounds());
+    auto queries = MakeQueries();
+    state.SetLabel(std::to_string(state.GetArg()) + " features");
+    auto count = static_cast<uint32_t>(index.GetFeatures().features.size());
+    size_t query = 0;
+    std::vector<NearestFeature> found;
+    while(state.KeepRunning()) {
+        const auto &location = queries[query % queries.size()];
+        auto heading = static_cast<double>(query++ % 360);
+        found.clear();
+        for(uint32_t feature = 0; feature < count; ++feature) {
+            auto distance = index.GetDistanceInFieldOfView(location.first, location.second, heading,
+                                                           90.0, feature);
+            if(distance <= 100.0)
+                found.push_back({feature, distance});
+        }
+        DoNotOptimize(found.size());
+    }
+}
+
+// The nearest road by measuring the distance to every road
+BENCHMARK_WITH_ARGS(FeatureIndex_ScanNearestRoad, {1000, 10000})
+{
+    FeatureIndex index(MakeFeatures(state.GetArg()), MakeBounds());
+    auto queries = MakeQueries();
+    state.SetLabel(std::to_string(state.GetArg()) + " features");
+    const auto &features = index.GetFeatures().features;
+    size_t query = 0;
+    while(state.KeepRunning()) {
+        const auto &location = queries[query++ % queries.size()];
+        auto nearest = std::numeric_limits<double>::infinity();
+        for(uint32_t feature = 0; feature < features.size(); ++feature) {
+            if(features[feature].category == FeatureCategory::Road)
+                nearest = std::min(nearest, index.GetDistance(location.first, location.second, feature));
+        }
+        DoNotOptimize(nearest);
+    }
+}
+
+BENCHMARK_MAIN()
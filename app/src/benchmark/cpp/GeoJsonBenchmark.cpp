@@ -0,0 +1,148 @@
+//
+// Parsing speed of GeoJsonParser over the tiles in the test data, in bytes per second of GeoJSON.
+// The collection is reused for every parse, as it would be for a stream of tiles. Clipping the
+// tiles, and loading all of them at once on different numbers of threads, are measured too.
+//
+// Loading a clipped tile from a binary tile file is measured in bytes per second of the GeoJSON
+// that it came from, so that it can be compared directly with parsing. The label has the sizes
+// of the GeoJSON and the file.
+//
+#include <cstdio>
+#include <fstream>
+#include <sstream>
+
+#include "BenchmarkHarness.h"
+#include "GeoJsonParser.h"
+#include "TileClipper.h"
+#include "TileFile.h"
+
+using namespace soundscape;
+using namespace soundscape::benchmark;
+
+struct Tile {
+    const char *name;
+    TileId tile;
+};
+static const Tile TILES[] = {
+    {"entrances.geojson", {32295, 21787, 16}},
+    {"intersection_cross1.geojson", {32291, 21807, 16}},
+    {"intersection_loop_back.geojson", {10551, 25431, 16}},
+    {"intersection_t2.geojson", {32287, 21802, 16}},
+    {"real.geojson", {32277, 21812, 16}}
+};
+
+static std::string ReadTile(const char *name)
+{
+    std::ifstream file(std::string(SOUNDSCAPE_TILE_DIRECTORY "/") + name, std::ios::binary);
+    std::stringstream contents;
+    contents << file.rdbuf();
+    return contents.str();
+}
+
+BENCHMARK_WITH_ARGS(GeoJsonParser_Parse, {0, 1, 2, 3, 4})
+{
+    auto name = TILES[state.GetArg()].name;
+    auto json = ReadTile(name);
+    state.SetLabel(name);
+    if(json.empty())
+        return;
+
+    GeoJsonParser parser;
+    FeatureCollection features;
+    while(state.KeepRunning()) {
+        features.Clear();
+        parser.Parse(json, features);
+        DoNotOptimize(features.features.size());
+    }
+    state.SetBytesPerIteration(static_cast<double>(json.size()));
+    state.SetItemsPerIteration(static_cast<double>(features.features.size()));
+}
+
+BENCHMARK_WITH_ARGS(TileClipper_ClipFeatures, {0, 1, 2, 3, 4})
+{
+    const auto &tile = TILES[state.GetArg()];
+    GeoJsonParser parser;
+    FeatureCollection features;
+    state.SetLabel(tile.name);
+    if(!parser.Parse(ReadTile(tile.name), features))
+        return;
+
+    auto box = tileToBoundingBox(tile.tile.x, tile.tile.y, tile.tile.zoom);
+    FeatureCollection clipped;
+    while(state.KeepRunning()) {
+        clipped.Clear();
+        ClipFeatures(features, box, clipped);
+        DoNotOptimize(clipped.features.size());
+    }
+    state.SetItemsPerIteration(static_cast<double>(features.features.size()));
+}
+
+// All of the tiles at once, on the given number of threads
+BENCHMARK_WITH_ARGS(TileClipper_LoadTiles, {1, 2, 4})
+{
+    std::vector<std::string> json;
+    for(const auto &tile: TILES)
+        json.push_back(ReadTile(tile.name));
+    std::vector<TileJson> tiles;
+    size_t bytes = 0;
+    for(size_t index = 0; index < json.size(); ++index) {
+        tiles.push_back({TILES[index].tile, json[index].data(), json[index].size()});
+        bytes += json[index].size();
+    }
+
+    FeatureStore store;
+    while(state.KeepRunning())
+        DoNotOptimize(LoadTiles(tiles.data(), tiles.size(), store, static_cast<unsigned>(state.GetArg())));
+    state.SetBytesPerIteration(static_cast<double>(bytes));
+}
+
+BENCHMARK_WITH_ARGS(TileFile_Encode, {0, 1, 2, 3, 4})
+{
+    const auto &tile = TILES[state.GetArg()];
+    GeoJsonParser parser;
+    FeatureCollection features;
+    state.SetLabel(tile.name);
+    if(!parser.Parse(ReadTile(tile.name), features))
+        return;
+    FeatureCollection clipped;
+    ClipFeatures(features, tileToBoundingBox(tile.tile.x, tile.tile.y, tile.tile.zoom), clipped);
+
+    std::vector<uint8_t> data;
+    while(state.KeepRunning()) {
+        EncodeTileFile(tile.tile, clipped, data);
+        DoNotOptimize(data.size());
+    }
+    state.SetItemsPerIteration(static_cast<double>(clipped.features.size()));
+}
+
+// Map the file and decode it into a collection which is reused, as parsing does
+BENCHMARK_WITH_ARGS(TileFile_Load, {0, 1, 2, 3, 4})
+{
+    const auto &tile = TILES[state.GetArg()];
+    auto json = ReadTile(tile.name);
+    GeoJsonParser parser;
+    FeatureCollection features;
+    state.SetLabel(tile.name);
+    if(!parser.Parse(json, features))
+        return;
+    FeatureCollection clipped;
+    ClipFeatures(features, tileToBoundingBox(tile.tile.x, tile.tile.y, tile.tile.zoom), clipped);
+    auto path = std::string(P_tmpdir) + "/GeoJsonBenchmark.sstf";
+    if(!WriteTileFile(path, tile.tile, clipped))
+        return;
+
+    TileFile file;
+    while(state.KeepRunning()) {
+        clipped.Clear();
+        if(file.Open(path))
+            file.Decode(clipped);
+        DoNotOptimize(clipped.features.size());
+    }
+    state.SetLabel(std::string(tile.name) + " json " + std::to_string(json.size()) +
+                   " file " + std::to_string(file.GetSize()));
+    remove(path.c_str());
+    state.SetBytesPerIteration(static_cast<double>(json.size()));
+    state.SetItemsPerIteration(static_cast<double>(clipped.features.size()));
+}
+
+BENCHMARK_MAIN()
@@ -0,0 +1,133 @@
+//
+// Accuracy and speed of each combination of formula and scalar type in GeoUtils.h. The accuracy
+// is measured against the double precision ellipsoidal formula, over several bands of distance
+// and from listener locations spread across the world.
+//
+#include <chrono>
+#include <cstdio>
+#include <random>
+#include <vector>
+
+#include "GeoUtils.h"
+
+struct Pair {
+    double lat1, lon1, lat2, lon2;
+};
+
+static std::vector<Pair> MakePairs(double min_range, double max_range, size_t count)
+{
+    std::mt19937 random(1234);
+    std::uniform_real_distribution<double> random_latitude(-80.0, 80.0);
+    std::uniform_real_distribution<double> random_longitude(-180.0, 180.0);
+    std::uniform_real_distribution<double> random_bearing(0.0, 360.0);
+    std::uniform_real_distribution<double> random_range(min_range, max_range);
+
+    std::vector<Pair> pairs(count);
+    for(auto &pair: pairs) {
+        pair.lat1 = random_latitude(random);
+        pair.lon1 = random_longitude(random);
+        getDestinationCoordinate(pair.lat1, pair.lon1, random_bearing(random), random_range(random),
+                                 pair.lat2, pair.lon2);
+        pair.lon2 = geo::wrapDegrees(pair.lon2);
+    }
+    return pairs;
+}
+
+// The errors are shown both against Ellipsoidal<double>, which includes the error from the model
+// of the earth, and against the same formula in double precision, which is only the error from
+// the scalar type.
+template<typename Formula, typename T>
+static void PrintAccuracy(const char *name, const std::vector<Pair> &pairs)
+{
+    double worst_distance = 0.0;
+    double worst_relative = 0.0;
+    double worst_bearing = 0.0;
+    double worst_precision_distance = 0.0;
+    double worst_precision_bearing = 0.0;
+    for(auto &pair: pairs) {
+        auto expected_distance = geo::distance<geo::Ellipsoidal>(pair.lat1, pair.lon1, pair.lat2, pair.lon2);
+        auto expected_bearing = geo::bearing<geo::Ellipsoidal>(pair.lat1, pair.lon1, pair.lat2, pair.lon2);
+        auto double_distance = geo::distance<Formula>(pair.lat1, pair.lon1, pair.lat2, pair.lon2);
+        auto double_bearing = geo::bearing<Formula>(pair.lat1, pair.lon1, pair.lat2, pair.lon2);
+
+        auto lat1 = static_cast<T>(pair.lat1), lon1 = static_cast<T>(pair.lon1);
+        auto lat2 = static_cast<T>(pair.lat2), lon2 = static_cast<T>(pair.lon2);
+        double d = geo::distance<Formula>(lat1, lon1, lat2, lon2);
+        double b = geo::bearing<Formula>(lat1, lon1, lat2, lon2);
+
+        auto error = std::fabs(d - expected_distance);
+        worst_distance = std::max(worst_distance, error);
+        worst_relative = std::max(worst_relative, error / expected_distance);
+        worst_bearing = std::max(worst_bearing, std::fabs(geo::wrapDegrees(b - expected_bearing)));
+        worst_precision_distance = std::max(worst_precision_distance, std::fabs(d - double_distance));
+        worst_precision_bearing = std::max(worst_precision_bearing,
+                                           std::fabs(geo::wrapDegrees(b - double_bearing)));
+    }
+    printf("  %-24s %12.4f %10.2e %10.5f %12.4f %10.5f\n", name,
+           worst_distance, worst_relative, worst_bearing,
+           worst_precision_distance, worst_precision_bearing);
+}
+
+template<typename Formula, typename T>
+static void PrintTiming(const char *name, const std::vector<Pair> &pairs)
+{
+    std::vector<T> coordinates;
+    for(auto &pair: pairs) {
+        coordinates.push_back(static_cast<T>(pair.lat1));
+        coordinates.push_back(static_cast<T>(pair.lon1));
+        coordinates.push_back(static_cast<T>(pair.lat2));
+        coordinates.push_back(static_cast<T>(pair.lon2));
+    }
+
+    const int REPEATS = 20;
+    volatile T sink = 0;
+    auto start = std::chrono::steady_clock::now();
+    for(int repeat = 0; repeat < REPEATS; ++repeat) {
+        T total = 0;
+        for(size_t i = 0; i < coordinates.size(); i += 4) {
+            total += geo::distance<Formula>(coordinates[i], coordinates[i + 1],
+                                            coordinates[i + 2], coordinates[i + 3]);
+            total += geo::bearing<Formula>(coordinates[i], coordinates[i + 1],
+                                           coordinates[i + 2], coordinates[i + 3]);
+        }
+        sink = sink + total;
+    }
+    auto elapsed = std::chrono::steady_clock::now() - start;
+    auto ns = std::chrono::duration<double, std::nano>(elapsed).count() / (REPEATS * pairs.size());
+    printf("  %-24s %10.1f ns\n", name, ns);
+}
+
+#define FOR_EACH_POLICY(function, pairs) \
+    function<geo::Equirectangular, float>("Equirectangular<float>", pairs); \
+    function<geo::Equirectangular, double>("Equirectangular<double>", pairs); \
+    function<geo::Haversine, float>("Haversine<float>", pairs); \
+    function<geo::Haversine, double>("Haversine<double>", pairs); \
+    function<geo::Ellipsoidal, float>("Ellipsoidal<float>", pairs); \
+    function<geo::Ellipsoidal, double>("Ellipsoidal<double>", pairs)
+
+int main()
+{
+    const double bands[][2] = {
+            {1.0, 10.0},
+            {10.0, 100.0},
+            {100.0, 1000.0},
+            {1000.0, 10000.0},
+            {10000.0, 100000.0},
+            {100000.0, 1000000.0},
+    };
+    const size_t PAIRS_PER_BAND = 10000;
+
+    printf("Worst errors compared with Ellipsoidal<double> and with the same formula in double\n");
+    for(auto &band: bands) {
+        printf("\n%.0fm to %.0fm\n", band[0], band[1]);
+        printf("  %-24s %12s %10s %10s %12s %10s\n", "policy",
+               "distance m", "relative", "bearing", "precision m", "bearing");
+        auto pairs = MakePairs(band[0], band[1], PAIRS_PER_BAND);
+        FOR_EACH_POLICY(PrintAccuracy, pairs);
+    }
+
+    printf("\nTime per distance and bearing\n");
+    auto pairs = MakePairs(1.0, 10000.0, PAIRS_PER_BAND);
+    FOR_EACH_POLICY(PrintTiming, pairs);
+    return 0;
+}
@@ -0,0 +1,297 @@
+//
+// Replays a GPX file through the engine faster than real time, for reproducible end to end
+// performance runs. The listener walks the track, or the route if there's no track, facing along
+// it with a slow head scan from side to side. A beacon is placed on the next point and when each
+// point is reached a synthesised callout is queued there, as in a route being followed.
+//
+// Each tick calls UpdateGeometry and then renders the tick's audio on the offline backend. The CPU
+// time of each, the timings of the stream callbacks made while rendering and the level of the
+// rendered audio are written to stdout as JSON. The audio can be written to a WAV file too, and
+// the engine's trace events to a Chrome trace event file for viewing in Perfetto.
+//
+// The motion to sound latency is measured on the offline clock, from each tick's pose to the
+// audio reflecting it. If a maximum is given and the 99th percentile latency of either the layer
+// switches or the listener updates is over it, the replay fails, so that it can be used as a test.
+//
+// Usage: GpxReplay [--gpx=<file>] [--output=<wav file>] [--duration=<seconds>] [--speed=<m/s>]
+//                  [--tick=<ms>] [--scan=<degrees>] [--beacon-type=<index>]
+//                  [--trace-events=<json file>] [--max-motion-latency=<ms>]
+//
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+#include <string>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <vector>
+
+#include "AudioBeacon.h"
+#include "AudioEngine.h"
+#include "BenchmarkHarness.h"
+#include "GpxFile.h"
+#include "OfflineAudioBackend.h"
+#include "Trace.h"
+#include "WavFile.h"
+
+using namespace soundscape;
+using namespace soundscape::benchmark;
+
+#ifndef SOUNDSCAPE_ASSET_DIRECTORY
+#define SOUNDSCAPE_ASSET_DIRECTORY "assets"
+#endif
+
+struct ReplayOptions {
+    std::string gpx = SOUNDSCAPE_ASSET_DIRECTORY "/Test.gpx";
+    std::string output;
+    std::string trace_events;
+    // Points without times are walked at the speed, or if that's not set, spaced so that the
+    // whole path takes the duration
+    double duration = 300.0;
+    double speed = 0.0;
+    double tick_ms = 50.0;
+    double scan_degrees = 30.0;
+    int beacon_type = 1;
+    // Zero for no maximum
+    double max_motion_latency_ms = 0.0;
+};
+
+static bool ParseOptions(int argc, char **argv, ReplayOptions &options)
+{
+    for(int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        auto equals = arg.find('=');
+        auto name = arg.substr(0, equals);
+        auto value = (equals == std::string::npos) ? std::string() : arg.substr(equals + 1);
+
+        if(name == "--gpx")
+            options.gpx = value;
+        else if(name == "--output")
+            options.output = value;
+        else if(name == "--duration")
+            options.duration = atof(value.c_str());
+        else if(name == "--speed")
+            options.speed = atof(value.c_str());
+        else if(name == "--tick")
+            options.tick_ms = atof(value.c_str());
+        else if(name == "--scan")
+            options.scan_degrees = atof(value.c_str());
+        else if(name == "--beacon-type")
+            options.beacon_type = atoi(value.c_str());
+        else if(name == "--trace-events")
+            options.trace_events = value;
+        else if(name == "--max-motion-latency")
+            options.max_motion_latency_ms = atof(value.c_str());
+        else
+            return false;
+    }
+    return (options.duration > 0.0) && (options.tick_ms > 0.0) && (options.speed >= 0.0);
+}
+
+static double ThreadCpuSeconds()
+{
+    timespec now{};
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &now);
+    return static_cast<double>(now.tv_sec) + static_cast<double>(now.tv_nsec) * 1e-9;
+}
+
+// Queue a callout at a location, with a tone standing in for the speech
+static void QueueCallout(AudioEngine &engine, double latitude, double longitude, int sample_rate)
+{
+    int sockets[2];
+    if(socketpair(AF_UNIX, SOCK_STREAM, 0, sockets) != 0)
+        return;
+
+    std::vector<int16_t> speech(static_cast<size_t>(sample_rate / 2));
+    for(size_t i = 0; i < speech.size(); ++i)
+        speech[i] = static_cast<int16_t>(8000.0 * sin(2.0 * M_PI * 440.0 * i / sample_rate));
+    auto bytes = static_cast<ssize_t>(speech.size() * sizeof(int16_t));
+    if(write(sockets[1], speech.data(), bytes) != bytes)
+        fprintf(stderr, "Short write of callout\n");
+    close(sockets[1]);
+
+    new TextToSpeech(&engine, latitude, longitude, sockets[0]);
+    close(sockets[0]);
+}
+
+// Mean, 50th and 99th percentile and maximum of a set of timings, in microseconds
+static void PrintTimings(const char *name, std::vector<double> seconds)
+{
+    double mean = 0.0, p50 = 0.0, p99 = 0.0, max = 0.0;
+    if(!seconds.empty()) {
+        std::sort(seconds.begin(), seconds.end());
+        for(auto value: seconds)
+            mean += value;
+        mean /= static_cast<double>(seconds.size());
+        p50 = seconds[seconds.size() / 2];
+        p99 = seconds[std::min(seconds.size() - 1, seconds.size() * 99 / 100)];
+        max = seconds.back();
+    }
+    printf("  \"%s\": {\"mean_us\": %.3f, \"p50_us\": %.3f, \"p99_us\": %.3f, \"max_us\": %.3f},\n",
+           name, mean * 1e6, p50 * 1e6, p99 * 1e6, max * 1e6);
+    fprintf(stderr, "%-16s mean %9.1f us  p50 %9.1f us  p99 %9.1f us  max %9.1f us\n",
+            name, mean * 1e6, p50 * 1e6, p99 * 1e6, max * 1e6);
+}
+
+static void PrintMotionLatency(const char *name, const LatencyHistogramSnapshot &latencies)
+{
+    printf("  \"%s\": {\"count\": %llu, \"p50_ms\": %.3f, \"p95_ms\": %.3f, \"p99_ms\": %.3f, \"max_ms\": %.3f},\n",
+           name, static_cast<unsigned long long>(latencies.count),
+           static_cast<double>(latencies.GetPercentile(50.0)) * 1e-6,
+           static_cast<double>(latencies.GetPercentile(95.0)) * 1e-6,
+           static_cast<double>(latencies.GetPercentile(99.0)) * 1e-6,
+           static_cast<double>(latencies.max) * 1e-6);
+    fprintf(stderr, "%-20s p50 %9.1f ms  p95 %9.1f ms  p99 %9.1f ms  max %9.1f ms\n",
+            name,
+            static_cast<double>(latencies.GetPercentile(50.0)) * 1e-6,
+            static_cast<double>(latencies.GetPercentile(95.0)) * 1e-6,
+            static_cast<double>(latencies.GetPercentile(99.0)) * 1e-6,
+            static_cast<double>(latencies.max) * 1e-6);
+}
+
+int main(int argc, char **argv)
+{
+    ReplayOptions options;
+    if(!ParseOptions(argc, argv, options)) {
+        fprintf(stderr, "Usage: %s [--gpx=<file>] [--output=<wav file>] [--duration=<seconds>] "
+                        "[--speed=<m/s>] [--tick=<ms>] [--scan=<degrees>] [--beacon-type=<index>] "
+                        "[--trace-events=<json file>] [--max-motion-latency=<ms>]\n",
+                argv[0]);
+        return 1;
+    }
+
+    GpxData gpx;
+    if(!ReadGpxFile(options.gpx, gpx))
+        return 1;
+    const auto &points = !gpx.track.empty() ? gpx.track :
+                         !gpx.route.empty() ? gpx.route : gpx.waypoints;
+    if(points.size() < 2) {
+        fprintf(stderr, "%s needs at least two points to replay\n", options.gpx.c_str());
+        return 1;
+    }
+
+    // Timing the path at 1m/s gives its length, from which the speed for the duration follows
+    GpxTimeline timeline(points, 1.0);
+    if(!timeline.HasTimes()) {
+        auto speed = (options.speed > 0.0) ? options.speed : timeline.GetDuration() / options.duration;
+        timeline = GpxTimeline(points, speed);
+    }
+    auto duration = std::min(timeline.GetDuration(), options.duration);
+
+    // Started before the engine so that the first beacon's creation is in the trace
+    if(!options.trace_events.empty() && !StartTraceEvents(options.trace_events.c_str())) {
+        fprintf(stderr, "Failed to open %s\n", options.trace_events.c_str());
+        return 1;
+    }
+
+    auto backend_owner = std::make_unique<OfflineAudioBackend>();
+    auto backend = backend_owner.get();
+    AudioEngine engine(std::move(backend_owner));
+    engine.SetBeaconType(options.beacon_type);
+    auto sample_rate = backend->GetSampleRate();
+
+    auto leg = timeline.GetLeg(0.0);
+    auto beacon = new Beacon(&engine, points[leg + 1].latitude, points[leg + 1].longitude);
+
+    auto tick = options.tick_ms / 1000.0;
+    auto ticks = static_cast<size_t>(ceil(duration / tick));
+    std::vector<double> update_seconds, render_seconds;
+    update_seconds.reserve(ticks);
+    render_seconds.reserve(ticks);
+    WavData wav;
+    wav.sample_rate = sample_rate;
+    wav.channels = OfflineAudioBackend::CHANNELS;
+    std::vector<int16_t> output;
+    double sum_squares = 0.0;
+    size_t rendered_frames = 0;
+    size_t callouts = 0;
+
+    auto start = std::chrono::steady_clock::now();
+    for(size_t i = 0; i < ticks; ++i) {
+        auto seconds = static_cast<double>(i) * tick;
+
+        // Arriving at a point moves the beacon on to the next one and calls out the arrival
+        auto current_leg = timeline.GetLeg(seconds);
+        if(current_leg != leg) {
+            leg = current_leg;
+            beacon->SetLocation(points[leg + 1].latitude, points[leg + 1].longitude);
+            QueueCallout(engine, points[leg].latitude, points[leg].longitude, sample_rate);
+            ++callouts;
+        }
+
+        double latitude, longitude, course;
+        timeline.GetPosition(seconds, latitude, longitude, course);
+        auto heading = course + options.scan_degrees * sin(2.0 * M_PI * seconds / 10.0);
+        heading = fmod(heading + 360.0, 360.0);
+
+        auto cpu_start = ThreadCpuSeconds();
+        engine.UpdateGeometry(latitude, longitude, heading);
+        auto cpu_updated = ThreadCpuSeconds();
+
+        auto frames = static_cast<size_t>(llround((seconds + tick) * sample_rate)) - rendered_frames;
+        output.resize(frames * OfflineAudioBackend::CHANNELS);
+        backend->Render(output.data(), frames);
+        render_seconds.push_back(ThreadCpuSeconds() - cpu_updated);
+        update_seconds.push_back(cpu_updated - cpu_start);
+
+        rendered_frames += frames;
+        for(auto sample: output)
+            sum_squares += static_cast<double>(sample) * sample;
+        if(!options.output.empty())
+            wav.samples.insert(wav.samples.end(), output.begin(), output.end());
+
+        // Drain the events as the app would
+        Event events[16];
+        while(engine.DrainEvents(events, 16) > 0) {
+        }
+    }
+    auto wall_seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    if(!options.trace_events.empty())
+        StopTraceEvents();
+
+    if(!options.output.empty() && !WriteWavFile(options.output, wav))
+        return 1;
+
+    auto audio_seconds = static_cast<double>(rendered_frames) / sample_rate;
+    auto rms = rendered_frames ? sqrt(sum_squares / (rendered_frames * OfflineAudioBackend::CHANNELS)) : 0.0;
+    auto reads = backend->GetStreamReadStats();
+    auto read_mean = reads.reads ? reads.total_seconds / static_cast<double>(reads.reads) : 0.0;
+    AudioStatsSnapshot stats;
+    engine.GetStats()->GetSnapshot(stats, false);
+    const auto &layer_latency = stats.motion[static_cast<size_t>(MotionPath::LayerSwitch)];
+    const auto &listener_latency = stats.motion[static_cast<size_t>(MotionPath::Listener)];
+
+    printf("{\n  \"gpx\": ");
+    PrintJsonString(options.gpx);
+    printf(",\n  \"points\": %zu,\n  \"timed\": %s,\n", points.size(), timeline.HasTimes() ? "true" : "false");
+    printf("  \"ticks\": %zu,\n  \"tick_ms\": %.1f,\n  \"callouts\": %zu,\n", ticks, options.tick_ms, callouts);
+    printf("  \"audio_seconds\": %.3f,\n  \"wall_seconds\": %.3f,\n  \"realtime_factor\": %.1f,\n",
+           audio_seconds, wall_seconds, wall_seconds > 0.0 ? audio_seconds / wall_seconds : 0.0);
+    PrintTimings("update_geometry", update_seconds);
+    PrintTimings("render", render_seconds);
+    printf("  \"stream_reads\": {\"count\": %llu, \"mean_us\": %.3f, \"max_us\": %.3f},\n",
+           static_cast<unsigned long long>(reads.reads), read_mean * 1e6, reads.max_seconds * 1e6);
+    PrintMotionLatency("layer_switch_latency", layer_latency);
+    PrintMotionLatency("listener_latency", listener_latency);
+    printf("  \"output_rms\": %.1f", rms);
+    if(!options.output.empty()) {
+        printf(",\n  \"output\": ");
+        PrintJsonString(options.output);
+    }
+    printf("\n}\n");
+
+    fprintf(stderr, "%.1fs of audio in %.2fs, %.0fx real time, %zu callouts, RMS %.1f\n",
+            audio_seconds, wall_seconds, wall_seconds > 0.0 ? audio_seconds / wall_seconds : 0.0,
+            callouts, rms);
+
+    if(options.max_motion_latency_ms > 0.0) {
+        auto max_ns = static_cast<uint64_t>(options.max_motion_latency_ms * 1e6);
+        if((layer_latency.GetPercentile(99.0) > max_ns) || (listener_latency.GetPercentile(99.0) > max_ns)) {
+            fprintf(stderr, "Motion to sound latency is over %.1f ms\n", options.max_motion_latency_ms);
+            return 1;
+        }
+    }
+    return 0;
+}
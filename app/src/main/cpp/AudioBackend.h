@@ -0,0 +1,95 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace soundscape {
+
+    // Positions are in metres in the engine's local frame. The coordinate system is left handed
+    // with y up, so east is x and north is z.
+    struct AudioVector {
+        float x;
+        float y;
+        float z;
+    };
+
+    // Format of a stream of mono PCM16 audio
+    struct AudioStreamFormat {
+        int sample_rate;
+        // Length in bytes that the stream reports, and whether it loops when it gets there
+        unsigned int length;
+        bool loop;
+        // Number of samples requested in each call to the stream's PcmReadCallback
+        unsigned int decode_buffer_size;
+        // Distances in metres over which the volume rolls off
+        float min_distance;
+        float max_distance;
+    };
+
+    // Audio which is generated on demand. PcmReadCallback is called from the mixer thread, so it
+    // mustn't block.
+    class AudioStream {
+    public:
+        virtual ~AudioStream() = default;
+
+        virtual AudioStreamFormat GetStreamFormat() const = 0;
+        virtual void PcmReadCallback(void *data, unsigned int data_length) = 0;
+    };
+
+    // A stream which is playing at a position. Destroying the channel stops it.
+    class IAudioChannel {
+    public:
+        virtual ~IAudioChannel() = default;
+
+        virtual void SetPosition(const AudioVector &position) = 0;
+    };
+
+    //
+    // The audio system underneath the AudioEngine. On Android this is FMOD, and on the host it's
+    // a backend which mixes the audio itself so that the engine can be tested and profiled
+    // without a device.
+    //
+    class IAudioBackend {
+    public:
+        virtual ~IAudioBackend() = default;
+
+        // Load an audio asset into memory as mono PCM16. The filename is an Android asset URL.
+        virtual bool LoadPcm(const std::string &filename, std::vector<uint8_t> &pcm) = 0;
+
+        // Start playing a stream. The stream must outlive the returned channel.
+        virtual std::unique_ptr<IAudioChannel> PlayStream(AudioStream *stream,
+                                                          const AudioVector &position) = 0;
+
+        virtual void SetListener(const AudioVector &position, const AudioVector &velocity,
+                                 const AudioVector &forward, const AudioVector &up) = 0;
+
+        // Called after each geometry update
+        virtual void Update() = 0;
+
+        // The percentage of real time being spent mixing and in the stream callbacks. Returns
+        // false if it isn't known yet.
+        virtual bool GetCpuUsage(float &dsp, float &stream) = 0;
+
+        // The backend clock in nanoseconds, which pose timestamps are on. On Android it's
+        // CLOCK_BOOTTIME, as used by SystemClock.elapsedRealtimeNanos, and offline it's the
+        // position of the audio rendered so far.
+        virtual uint64_t GetTime() = 0;
+
+        // The time on the backend clock at which the audio read by a stream callback being made
+        // now will be heard, or with no format, when a listener change made now will be heard
+        virtual uint64_t GetOutputTime(const AudioStreamFormat *format) = 0;
+
+        // Called on the mixer thread as it starts to mix each block, so it mustn't block. A
+        // listener change made before the call is in the block, which is heard at GetOutputTime
+        // with no format. Pass nullptr to stop the calls.
+        typedef void (*MixCallback)(void *context);
+        virtual void SetMixCallback(MixCallback callback, void *context) = 0;
+
+        // The size of the fixed pool which the backend allocates from, and the bytes allocated
+        // from it now and at most. Returns false if the backend allocates from the heap.
+        virtual bool GetMemoryUsage(size_t &pool, size_t &used, size_t &high_water) = 0;
+    };
+
+} // soundscape
@@ -1,5 +1,4 @@
 #include <string>
-#include <jni.h>
 
 #include "GeoUtils.h"
 #include "Trace.h"
@@ -7,83 +6,97 @@
 #include "AudioEngine.h"
 using namespace soundscape;
 
+// 0 is never a valid handle
+static std::atomic<int64_t> s_NextHandle(1);
+
 PositionedAudio::PositionedAudio(AudioEngine *engine,
                                  double latitude, double longitude)
-                :m_Eof(false)
+                :m_Eof(false),
+                 m_Handle(s_NextHandle++)
 {
     m_Latitude = latitude;
     m_Longitude = longitude;
 
     m_pEngine = engine;
-    m_pSystem = engine->GetFmodSystem();
 }
 
 PositionedAudio::~PositionedAudio() {
+    TRACE_SCOPE("DestroySource");
     TRACE("%s %p", __FUNCTION__, this);
     m_pEngine->RemoveBeacon(this);
 
-    if(m_pSound) {
-        auto result = m_pSound->release();
-        ERROR_CHECK(result);
-    }
+    // Stop the channel before the audio source that it reads from is destroyed
+    m_pChannel.reset();
 
     TRACE("%s %p done", __FUNCTION__, this);
 }
 
-void PositionedAudio::InitFmodSound() {
-    FMOD_RESULT result;
+void PositionedAudio::InitAudio() {
+    if(!m_pAudioSource)
+        return;
 
-    m_pAudioSource->CreateSound(m_pSystem, &m_pSound);
-
-    result = m_pSound->set3DMinMaxDistance(10.0f * FMOD_DISTANCE_FACTOR,
-                                           5000.0f * FMOD_DISTANCE_FACTOR);
-    ERROR_CHECK(result);
+    m_pChannel = m_pEngine->GetBackend()->PlayStream(m_pAudioSource.get(),
+                                                     m_pEngine->ToAudioPosition(m_Latitude, m_Longitude));
+}
 
-    result = m_pSound->setMode(FMOD_LOOP_NORMAL);
-    ERROR_CHECK(result);
+void PositionedAudio::UpdatePosition()
+{
+    // Queued audio which hasn't started playing yet has no channel
+    if(!m_pChannel)
+        return;
 
-    {
-        FMOD_VECTOR pos = {(float) m_Longitude, 0.0f, (float) m_Latitude};
-        FMOD_VECTOR vel = {0.0f, 0.0f, 0.0f};
+    m_pChannel->SetPosition(m_pEngine->ToAudioPosition(m_Latitude, m_Longitude));
+}
 
-        result = m_pSystem->playSound(m_pSound, nullptr, false, &m_pChannel);
-        ERROR_CHECK(result);
+void PositionedAudio::SetLocation(double latitude, double longitude)
+{
+    m_Latitude = latitude;
+    m_Longitude = longitude;
 
-        result = m_pChannel->set3DAttributes(&pos, &vel);
-        ERROR_CHECK(result);
-    }
+    // Queued audio which hasn't started playing yet will pick up the new location when it does
+    UpdatePosition();
 }
 
 void PositionedAudio::Init()
 {
+    TRACE_SCOPE("CreateSource");
     bool queued = CreateAudioSource();
 
     TRACE("%s %p", __FUNCTION__, this);
 
+    // With no audio source there's nothing to play, so finish straight away
+    if(!m_pAudioSource) {
+        TRACE_ERROR("Failed to create audio source - over memory budget");
+        Eof();
+        queued = false;
+    }
+
     if(!queued)
-        InitFmodSound();
+        InitAudio();
 
     m_pEngine->AddBeacon(this, queued);
 }
 
 void PositionedAudio::PlayNow()
 {
-    InitFmodSound();
+    InitAudio();
 }
 
-void PositionedAudio::UpdateGeometry(double heading, double latitude, double longitude) {
-    // Calculate how far off axis the beacon is given this new heading
+void PositionedAudio::PostEvent(EventType type, int64_t value)
+{
+    m_pEngine->PostEvent(type, m_Handle, value);
+}
 
-    // Calculate the beacon heading
-    auto beacon_heading = bearingFromTwoPoints(m_Latitude, m_Longitude, latitude, longitude);
-    auto degrees_off_axis = beacon_heading - heading;
+void PositionedAudio::UpdateGeometry(double heading, double bearing, double distance, uint64_t pose_time) {
+    // Calculate how far off axis the beacon is given this new heading
+    auto degrees_off_axis = bearing - heading;
     if(degrees_off_axis > 180)
         degrees_off_axis -= 360;
     else if(degrees_off_axis < -180)
         degrees_off_axis += 360;
 
-    int dist = (int)distance(latitude, longitude, m_Latitude, m_Longitude);
-    m_pAudioSource->UpdateGeometry(degrees_off_axis, dist);
+    if(m_pAudioSource)
+        m_pAudioSource->UpdateGeometry(degrees_off_axis, (int)distance, pose_time);
 
-    //TRACE("%f %f -> %f (%f %f), %dm", heading, beacon_heading, degrees_off_axis, lat_delta, long_delta, dist)
+    //TRACE("%f %f -> %f, %fm", heading, bearing, degrees_off_axis, distance)
 }
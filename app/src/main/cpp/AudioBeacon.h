@@ -6,14 +6,27 @@ namespace soundscape {
 
     class AudioEngine;
 
-    class PositionedAudio {
+    class PositionedAudio : public ArenaObject {
     public:
         PositionedAudio(AudioEngine *engine,
                         double latitude, double longitude);
 
         virtual ~PositionedAudio();
 
-        void UpdateGeometry(double heading, double latitude, double longitude);
+        // The handle that the client knows this audio by, in events and commands. Handles count
+        // up and are never reused, so a late event or command for audio which has gone can't be
+        // taken to be for new audio that happens to have been allocated at the same address.
+        int64_t GetHandle() const { return m_Handle; }
+
+        // Bearing is from the listener to the beacon in degrees and distance is in metres. These
+        // are calculated for all of the beacons at once by the AudioEngine. The pose time is as
+        // passed to AudioEngine::UpdateGeometry.
+        void UpdateGeometry(double heading, double bearing, double distance, uint64_t pose_time = 0);
+        void SetLocation(double latitude, double longitude);
+        double GetLatitude() const { return m_Latitude; }
+        double GetLongitude() const { return m_Longitude; }
+        // Update the audio channel position e.g. after the engine has moved its local frame
+        void UpdatePosition();
 
         // CreateAudioSource returns whether or not the audio source should
         // be placed in the list of queued beacons.
@@ -21,21 +34,21 @@ namespace soundscape {
         bool IsEof() { return m_Eof; }
         void Eof() { m_Eof = true; }
         void PlayNow();
+        void PostEvent(EventType type, int64_t value = 0);
 
     protected:
         void Init();
-        void InitFmodSound();
+        void InitAudio();
 
         // We're going to assume that the beacons are close enough that the earth is effectively flat
         double m_Latitude = 0.0;
         double m_Longitude = 0.0;
 
         std::atomic<bool> m_Eof;
+        const int64_t m_Handle;
 
         std::unique_ptr<BeaconAudioSource> m_pAudioSource;
-        FMOD::System *m_pSystem = nullptr;
-        FMOD::Sound *m_pSound = nullptr;
-        FMOD::Channel *m_pChannel = nullptr;
+        std::unique_ptr<IAudioChannel> m_pChannel;
         AudioEngine *m_pEngine;
     };
 
@@ -50,7 +63,7 @@ namespace soundscape {
     protected:
         bool CreateAudioSource() final
         {
-            m_pAudioSource = std::make_unique<BeaconBufferGroup>(m_pEngine, this);
+            m_pAudioSource.reset(new(m_pEngine->GetMemory()) BeaconBufferGroup(m_pEngine, this));
             // Not queued
             return false;
         }
@@ -68,7 +81,7 @@ namespace soundscape {
     protected:
         bool CreateAudioSource() final
         {
-            m_pAudioSource = std::make_unique<TtsAudioSource>(m_pEngine, this, m_TtsSocket);
+            m_pAudioSource.reset(new(m_pEngine->GetMemory()) TtsAudioSource(m_pEngine, this, m_TtsSocket));
             // Text to speech audio are queued to play one after the other
             return true;
         }
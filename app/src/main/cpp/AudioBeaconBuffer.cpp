@@ -1,43 +1,47 @@
 #include <unistd.h>
+#include <algorithm>
 #include <thread>
 #include <filesystem>
 #include <cassert>
-#include <android/log.h>
+#include <climits>
 #include <fcntl.h>
+#include <cstring>
 #include "GeoUtils.h"
 #include "Trace.h"
 #include <cmath>
-#include <jni.h>
 #include "AudioBeaconBuffer.h"
 #include "BeaconDescriptor.h"
 #include "AudioBeacon.h"
 
 using namespace soundscape;
 
-BeaconBuffer::BeaconBuffer(FMOD::System *system, const std::string &filename, double max_angle)
+// Distances in metres over which the volume of a source rolls off
+static const float MIN_DISTANCE = 10.0f;
+static const float MAX_DISTANCE = 5000.0f;
+
+BeaconBuffer::BeaconBuffer(IAudioBackend *backend, const std::string &filename, double max_angle,
+                           AudioMemory *memory)
             : m_MaxAngle(max_angle),
-              m_Name(filename)
+              m_Name(filename),
+              m_pMemory(memory)
 {
-        FMOD::Sound* sound;
-
-        auto result = system->createSound(filename.c_str(), FMOD_DEFAULT | FMOD_OPENONLY, nullptr, &sound);
-        ERROR_CHECK(result);
-
-        result = sound->getLength(&m_BufferSize, FMOD_TIMEUNIT_RAWBYTES);
-        ERROR_CHECK(result);
-
-        m_pBuffer = std::make_unique<unsigned char[]>(m_BufferSize);
-
-        unsigned int bytes_read;
-        result = sound->readData(m_pBuffer.get(), m_BufferSize, &bytes_read);
-        ERROR_CHECK(result);
-
-        result = sound->release();
-        ERROR_CHECK(result);
+        TRACE_SCOPE("AssetDecode");
+        if(!backend->LoadPcm(filename, m_Buffer))
+            TRACE_ERROR("Failed to load %s", filename.c_str());
+
+        // The size of the PCM isn't known until it's loaded, so it's given back straight away
+        // if it doesn't fit
+        m_Buffer.shrink_to_fit();
+        if(m_pMemory && !m_pMemory->Reserve(m_Buffer.capacity())) {
+            TRACE_ERROR("Failed to load %s - over memory budget", filename.c_str());
+            std::vector<uint8_t>().swap(m_Buffer);
+        }
 }
 
 BeaconBuffer::~BeaconBuffer() {
     TRACE("~BeaconBuffer");
+    if(m_pMemory)
+        m_pMemory->Release(m_Buffer.capacity());
 }
 
 bool BeaconBuffer::CheckIsActive(double degrees_off_axis) const
@@ -49,16 +53,24 @@ bool BeaconBuffer::CheckIsActive(double degrees_off_axis) const
 }
 
 unsigned int BeaconBuffer::Read(void *data, unsigned int data_length, unsigned long pos) {
-    unsigned int remainder = 0;
     auto *dest =(unsigned char *)data;
-    pos %= m_BufferSize;
-    if((m_BufferSize - pos) < data_length) {
-        remainder = data_length - (m_BufferSize - pos);
-        data_length = m_BufferSize - pos;
+    auto buffer_size = GetBufferSize();
+    if(buffer_size == 0) {
+        // The asset failed to load
+        memset(dest, 0, data_length);
+        return data_length;
+    }
+
+    // The assets in a group can be different lengths, so a read can wrap around the end of the
+    // buffer and carry on from the start.
+    pos %= buffer_size;
+    unsigned int copied = 0;
+    while(copied < data_length) {
+        auto length = std::min(data_length - copied, static_cast<unsigned int>(buffer_size - pos));
+        memcpy(dest + copied, m_Buffer.data() + pos, length);
+        copied += length;
+        pos = 0;
     }
-    memcpy(dest, m_pBuffer.get() + pos, data_length);
-    if(remainder)
-        memcpy(dest + data_length, m_pBuffer.get() + pos + data_length, remainder);
 
     return data_length;
 }
@@ -67,16 +79,25 @@ unsigned int BeaconBuffer::Read(void *data, unsigned int data_length, unsigned l
 //
 //
 BeaconBufferGroup::BeaconBufferGroup(const AudioEngine *ae, PositionedAudio *parent)
-: BeaconAudioSource(parent)
+: BeaconAudioSource(ae, parent),
+  m_pBackend(ae->GetBackend()),
+  m_pCurrentBuffer(nullptr),
+  m_SwitchPoseTime(0)
 {
     TRACE("Create BeaconBufferGroup %p", this);
     m_pDescription = ae->GetBeaconDescriptor();
 
-    auto system = ae->GetFmodSystem();
     for(const auto &asset: m_pDescription->m_Beacons) {
-        auto buffer = std::make_unique<BeaconBuffer>(system,
-                                                                  asset.m_Filename,
-                                                                 asset.m_MaxAngle);
+        auto memory = ae->GetMemory();
+        std::unique_ptr<BeaconBuffer> buffer(new(memory) BeaconBuffer(m_pBackend,
+                                                                       asset.m_Filename,
+                                                                       asset.m_MaxAngle,
+                                                                       memory));
+        if(!buffer) {
+            TRACE_ERROR("Failed to create BeaconBuffer - over memory budget");
+            break;
+        }
+        parent->PostEvent(EventType::AssetLoaded, buffer->GetBufferSize());
         m_pBuffers.push_back(std::move(buffer));
     }
 }
@@ -86,59 +107,84 @@ BeaconBufferGroup::~BeaconBufferGroup()
     TRACE("~BeaconBufferGroup %p", this);
 }
 
-void BeaconBufferGroup::CreateSound(FMOD::System *system, FMOD::Sound **sound)
+AudioStreamFormat BeaconBufferGroup::GetStreamFormat() const
 {
-    TRACE("BeaconBufferGroup CreateSound %p", this);
-
-    FMOD_CREATESOUNDEXINFO extra_info;
-    memset(&extra_info, 0, sizeof(FMOD_CREATESOUNDEXINFO));
-    extra_info.cbsize = sizeof(FMOD_CREATESOUNDEXINFO);  /* Required. */
-    extra_info.numchannels = 1;
-    extra_info.defaultfrequency = 44100;
-    extra_info.length = m_pBuffers[0]->GetBufferSize();                         /* Length of PCM data in bytes of whole song (for Sound::getLength) */
-    extra_info.decodebuffersize = extra_info.length / (2 * m_pDescription->m_BeatsInPhrase);       /* Chunk size of stream update in samples. This will be the amount of data passed to the user callback. */
-    extra_info.format = FMOD_SOUND_FORMAT_PCM16;                    /* Data format of sound. */
-    extra_info.pcmreadcallback = StaticPcmReadCallback;             /* User callback for reading. */
-    extra_info.userdata = this;
-
-    auto result = system->createSound(nullptr,
-                                      FMOD_OPENUSER | FMOD_LOOP_NORMAL | FMOD_3D |
-                                      FMOD_CREATESTREAM,
-                                      &extra_info,
-                                      sound);
-    ERROR_CHECK(result);
+    AudioStreamFormat format{};
+    format.sample_rate = 44100;
+    format.length = m_pBuffers.empty() ? 0 : m_pBuffers[0]->GetBufferSize();                     /* Length of PCM data in bytes of whole song */
+    format.loop = true;
+    format.decode_buffer_size = format.length / (2 * m_pDescription->m_BeatsInPhrase);  /* Chunk size of stream update in samples. This will be the amount of data passed to the user callback. */
+    format.min_distance = MIN_DISTANCE;
+    format.max_distance = MAX_DISTANCE;
+    return format;
 }
 
-void BeaconBufferGroup::UpdateCurrentBufferFromHeading()
+BeaconBuffer *BeaconBufferGroup::SelectBuffer(double degrees_off_axis) const
 {
     for(const auto &buffer: m_pBuffers)
     {
-        if(buffer->CheckIsActive(degreesOffAxis)) {
-            m_pCurrentBuffer = buffer.get();
-            break;
+        if(buffer->CheckIsActive(degrees_off_axis))
+            return buffer.get();
+    }
+    // If the buffers couldn't be created then there's nothing to play
+    return m_pBuffers.empty() ? nullptr : m_pBuffers[0].get();
+}
+
+void BeaconBufferGroup::UpdateGeometry(double degrees_off_axis, int distance, uint64_t pose_time)
+{
+    // The switch time is set before the new heading so that the mixer can't switch layer
+    // without seeing it
+    if(pose_time) {
+        auto current = m_pCurrentBuffer.load();
+        if(current && (SelectBuffer(degrees_off_axis) != current)) {
+            uint64_t no_switch = 0;
+            m_SwitchPoseTime.compare_exchange_strong(no_switch, pose_time);
+        } else {
+            m_SwitchPoseTime = 0;
         }
     }
-    if(m_pCurrentBuffer == nullptr)
-        m_pCurrentBuffer = m_pBuffers[0].get();
+    BeaconAudioSource::UpdateGeometry(degrees_off_axis, distance, pose_time);
 }
 
-FMOD_RESULT F_CALLBACK BeaconBufferGroup::PcmReadCallback(void *data, unsigned int data_length)
+void BeaconBufferGroup::PcmReadCallback(void *data, unsigned int data_length)
 {
-    UpdateCurrentBufferFromHeading();
+    TRACE_SCOPE("BeaconPcmRead");
+    CallbackTimer timer(m_pStats, AudioSourceType::Beacon);
+    auto previous = m_pCurrentBuffer.load();
+    auto current = SelectBuffer(degreesOffAxis);
+    m_pCurrentBuffer = current;
+
+    // This block is the first to be heard on the new layer
+    if(previous && (current != previous)) {
+        auto pose_time = m_SwitchPoseTime.exchange(0);
+        if(pose_time) {
+            auto format = GetStreamFormat();
+            auto output_time = m_pBackend->GetOutputTime(&format);
+            if(output_time >= pose_time)
+                m_pStats->RecordMotionLatency(MotionPath::LayerSwitch, output_time - pose_time);
+        }
+    }
+
+    // An asset which failed to load plays as silence
+    if(!current) {
+        timer.Padded();
+        memset(data, 0, data_length);
+        return;
+    }
+    if(current->GetBufferSize() == 0)
+        timer.Padded();
 
-    unsigned int bytes_read = m_pCurrentBuffer->Read(data, data_length, m_BytePos);
+    unsigned int bytes_read = current->Read(data, data_length, m_BytePos);
     m_BytePos += bytes_read;
     //TRACE("BBG callback %d: %u @ %lu", m_CurrentBuffer, bytes_read, m_BytePos);
-
-    return FMOD_OK;
 }
 
 //
 //
 //
 
-TtsAudioSource::TtsAudioSource(const AudioEngine *ae MAYBE_UNUSED, PositionedAudio *parent, int tts_socket)
-              : BeaconAudioSource(parent)
+TtsAudioSource::TtsAudioSource(const AudioEngine *ae, PositionedAudio *parent, int tts_socket)
+              : BeaconAudioSource(ae, parent)
 
 {
     // The file descriptor is owned by the object in Kotlin, so use a duplicate.
@@ -154,37 +200,32 @@ TtsAudioSource::~TtsAudioSource()
     close(m_TtsSocket);
 }
 
-void TtsAudioSource::CreateSound(FMOD::System *system, FMOD::Sound **sound)
+AudioStreamFormat TtsAudioSource::GetStreamFormat() const
 {
-    FMOD_CREATESOUNDEXINFO extra_info;
-
-    memset(&extra_info, 0, sizeof(FMOD_CREATESOUNDEXINFO));
-    extra_info.cbsize = sizeof(FMOD_CREATESOUNDEXINFO);
-
-    extra_info.numchannels = 1;
-    extra_info.defaultfrequency = 22050;
-    extra_info.length = extra_info.defaultfrequency;
-    extra_info.decodebuffersize = extra_info.defaultfrequency / 10;
-
-    extra_info.format = FMOD_SOUND_FORMAT_PCM16;                    /* Data format of sound. */
-    extra_info.pcmreadcallback = StaticPcmReadCallback;             /* User callback for reading. */
-    extra_info.userdata = this;
-
-    auto result = system->createSound(nullptr,
-                                      FMOD_OPENUSER | FMOD_LOOP_OFF | FMOD_3D |
-                                      FMOD_CREATESTREAM,
-                                      &extra_info,
-                                      sound);
-    ERROR_CHECK(result);
-
+    AudioStreamFormat format{};
+    format.sample_rate = 22050;
+    // The length of the speech isn't known, so the stream is as long as it can be and it's the
+    // end of the data on the socket which finishes it
+    format.length = (UINT_MAX / sizeof(int16_t)) * sizeof(int16_t);
+    format.loop = false;
+    format.decode_buffer_size = format.sample_rate / 10;
+    format.min_distance = MIN_DISTANCE;
+    format.max_distance = MAX_DISTANCE;
+    return format;
 }
-FMOD_RESULT F_CALLBACK TtsAudioSource::PcmReadCallback(void *data, unsigned int data_length)
+
+void TtsAudioSource::PcmReadCallback(void *data, unsigned int data_length)
 {
     // The text to speech data is sent over a socket from Kotlin. The socket is closed on the
     // Kotlin end when the speech has been fully synthesised. However, the onDone appears to be
     // unreliable and so we also timeout if no data is read after TIMEOUT_READS_WITHOUT_DATA calls.
 #define TIMEOUT_READS_WITHOUT_DATA 10
 
+    // Silence after the end of the speech isn't counted as padding, only running out of data
+    // before the end is.
+    TRACE_SCOPE("TtsPcmRead");
+    CallbackTimer timer(m_pStats, AudioSourceType::TextToSpeech);
+
     ssize_t total_bytes_read = 0;
     ssize_t bytes_read;
     auto write_ptr = (unsigned char *)data;
@@ -195,17 +236,22 @@ FMOD_RESULT F_CALLBACK TtsAudioSource::PcmReadCallback(void *data, unsigned int
             if(total_bytes_read == 0) {
                 TRACE("TTS EOF");
                 m_pParent->Eof();
-                return FMOD_ERR_FILE_EOF;
+                memset(data, 0, data_length);
+                return;
             }
             break;
         }
         else if(bytes_read == -1) {
             // No data - socket is non-blocking
+            timer.Padded();
             ++m_ReadsWithoutData;
+            if(m_ReadsWithoutData == 1)
+                m_pParent->PostEvent(EventType::Underrun);
             if(m_ReadsWithoutData > TIMEOUT_READS_WITHOUT_DATA) {
                 TRACE("TTS Timed out");
                 m_pParent->Eof();
-                return FMOD_ERR_FILE_EOF;
+                memset(write_ptr, 0, data_length);
+                return;
             }
             break;
         }
@@ -218,23 +264,14 @@ FMOD_RESULT F_CALLBACK TtsAudioSource::PcmReadCallback(void *data, unsigned int
 
     //TRACE("TTS callback %zd/%u", total_bytes_read, data_length);
     memset(write_ptr, 0, data_length);
-
-    return FMOD_OK;
 }
 
 
 //
 //
 //
-FMOD_RESULT F_CALLBACK BeaconAudioSource::StaticPcmReadCallback(FMOD_SOUND* sound, void *data, unsigned int data_length) {
-    BeaconAudioSource *bg;
-    ((FMOD::Sound*)sound)->getUserData((void **)&bg);
-    bg->PcmReadCallback(data, data_length);
-
-    return FMOD_OK;
-}
-
-void BeaconAudioSource::UpdateGeometry(double degrees_off_axis, int distance MAYBE_UNUSED)
+void BeaconAudioSource::UpdateGeometry(double degrees_off_axis, int distance MAYBE_UNUSED,
+                                       uint64_t pose_time MAYBE_UNUSED)
 {
     degreesOffAxis = degrees_off_axis;
 }
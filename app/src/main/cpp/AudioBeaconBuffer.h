@@ -1,53 +1,52 @@
 #pragma once
 
-#include "fmod.hpp"
-#include "fmod.h"
 #include <string>
 #include <atomic>
+#include <vector>
 
+#include "AudioBackend.h"
 #include "AudioEngine.h"
 #include "BeaconDescriptor.h"
 
 namespace soundscape {
 
-    class BeaconBuffer {
+    class BeaconBuffer : public ArenaObject {
     public:
-        BeaconBuffer(FMOD::System *system,
+        // The PCM is charged to the memory budget if there is one, and if it doesn't fit then
+        // the buffer is left empty and plays as silence
+        BeaconBuffer(IAudioBackend *backend,
                      const std::string &filename,
-                     double max_angle);
+                     double max_angle,
+                     AudioMemory *memory = nullptr);
 
         virtual ~BeaconBuffer();
 
         unsigned int Read(void *data, unsigned int data_length, unsigned long pos);
 
-        unsigned int GetBufferSize() const { return m_BufferSize; }
+        unsigned int GetBufferSize() const { return static_cast<unsigned int>(m_Buffer.size()); }
         bool CheckIsActive(double degrees_off_axis) const;
 
     private:
         double m_MaxAngle;
         std::string m_Name;
+        AudioMemory *m_pMemory;
 
-        unsigned int m_BufferSize = 0;
-        std::unique_ptr<unsigned char[]> m_pBuffer;
+        std::vector<uint8_t> m_Buffer;
     };
 
-    class BeaconAudioSource {
+    class BeaconAudioSource : public AudioStream, public ArenaObject {
     public:
-        explicit BeaconAudioSource(PositionedAudio *parent) :
+        BeaconAudioSource(const AudioEngine *ae, PositionedAudio *parent) :
             m_pParent(parent),
+            m_pStats(ae->GetStats()),
             degreesOffAxis(0){}
         virtual ~BeaconAudioSource() = default;
 
-        virtual void CreateSound(FMOD::System *system, FMOD::Sound **sound) = 0;
-        virtual FMOD_RESULT F_CALLBACK PcmReadCallback(void *data, unsigned int data_length) = 0;
-
-        void UpdateGeometry(double degrees_off_axis, int distance);
+        virtual void UpdateGeometry(double degrees_off_axis, int distance, uint64_t pose_time = 0);
 
     protected:
         PositionedAudio *m_pParent;
-
-        static FMOD_RESULT F_CALLBACK
-        StaticPcmReadCallback(FMOD_SOUND *sound, void *data, unsigned int data_length);
+        AudioStats *m_pStats;
 
         std::atomic<double> degreesOffAxis;
     };
@@ -57,16 +56,22 @@ namespace soundscape {
         BeaconBufferGroup(const AudioEngine *ae, PositionedAudio *parent);
         ~BeaconBufferGroup() override;
 
-        void CreateSound(FMOD::System *system, FMOD::Sound **sound) override;
-        FMOD_RESULT F_CALLBACK PcmReadCallback(void *data, unsigned int data_length) override;
+        AudioStreamFormat GetStreamFormat() const override;
+        void PcmReadCallback(void *data, unsigned int data_length) override;
+        void UpdateGeometry(double degrees_off_axis, int distance, uint64_t pose_time = 0) override;
 
     private:
-        void UpdateCurrentBufferFromHeading();
+        BeaconBuffer *SelectBuffer(double degrees_off_axis) const;
 
+        IAudioBackend *m_pBackend;
         const BeaconDescriptor *m_pDescription;
         std::vector< std::unique_ptr<BeaconBuffer> > m_pBuffers;
-        BeaconBuffer * m_pCurrentBuffer = nullptr;
+        std::atomic<BeaconBuffer *> m_pCurrentBuffer;
         unsigned long m_BytePos = 0;
+
+        // The time of the first pose which called for a different layer than the one playing, or
+        // zero if the layer that's playing is the right one
+        std::atomic<uint64_t> m_SwitchPoseTime;
     };
 
     class TtsAudioSource : public BeaconAudioSource {
@@ -74,8 +79,8 @@ namespace soundscape {
         TtsAudioSource(const AudioEngine *ae, PositionedAudio *parent, int tts_socket);
         ~TtsAudioSource() override;
 
-        void CreateSound(FMOD::System *system, FMOD::Sound **sound) override;
-        FMOD_RESULT F_CALLBACK PcmReadCallback(void *data, unsigned int data_length) override;
+        AudioStreamFormat GetStreamFormat() const override;
+        void PcmReadCallback(void *data, unsigned int data_length) override;
 
     private:
         int m_TtsSocket;
@@ -0,0 +1,176 @@
+#include <cmath>
+
+#include "AudioCommands.h"
+#include "Trace.h"
+
+using namespace soundscape;
+
+static size_t GetCommandSize(uint32_t opcode)
+{
+    switch(static_cast<CommandOpcode>(opcode)) {
+        case CommandOpcode::CreateBeacon:       return sizeof(CreateBeaconCommand);
+        case CommandOpcode::CreateTextToSpeech: return sizeof(CreateTextToSpeechCommand);
+        case CommandOpcode::Destroy:            return sizeof(DestroyCommand);
+        case CommandOpcode::Move:               return sizeof(MoveCommand);
+        case CommandOpcode::Pose:               return sizeof(PoseCommand);
+    }
+    return 0;
+}
+
+static bool IsValidLocation(double latitude, double longitude)
+{
+    // The comparisons are false for NaN, so that's rejected too
+    return (latitude >= -90.0) && (latitude <= 90.0) &&
+           (longitude >= -180.0) && (longitude <= 180.0);
+}
+
+bool CommandList::Parse(uint8_t *data, size_t length)
+{
+    m_pData = data;
+    m_Offsets.clear();
+
+    size_t offset = 0;
+    while(offset < length) {
+        if((length - offset) < sizeof(CommandHeader)) {
+            TRACE_ERROR("Command list truncated header at %zu", offset);
+            return false;
+        }
+        CommandHeader header;
+        memcpy(&header, data + offset, sizeof(header));
+
+        auto expected_size = GetCommandSize(header.opcode);
+        if(expected_size == 0) {
+            TRACE_ERROR("Command list unknown opcode %u at %zu", header.opcode, offset);
+            return false;
+        }
+        if((header.size != expected_size) || ((length - offset) < expected_size)) {
+            TRACE_ERROR("Command list bad size %u for opcode %u at %zu", header.size, header.opcode, offset);
+            return false;
+        }
+        m_Offsets.push_back(offset);
+
+        bool valid = true;
+        switch(static_cast<CommandOpcode>(header.opcode)) {
+            case CommandOpcode::CreateBeacon: {
+                auto command = Get<CreateBeaconCommand>(m_Offsets.size() - 1);
+                valid = IsValidLocation(command.latitude, command.longitude);
+                break;
+            }
+            case CommandOpcode::CreateTextToSpeech: {
+                auto command = Get<CreateTextToSpeechCommand>(m_Offsets.size() - 1);
+                valid = IsValidLocation(command.latitude, command.longitude) &&
+                        (command.tts_socket >= 0);
+                break;
+            }
+            case CommandOpcode::Destroy: {
+                auto command = Get<DestroyCommand>(m_Offsets.size() - 1);
+                valid = (command.handle != 0);
+                break;
+            }
+            case CommandOpcode::Move: {
+                auto command = Get<MoveCommand>(m_Offsets.size() - 1);
+                valid = (command.handle != 0) &&
+                        IsValidLocation(command.latitude, command.longitude);
+                break;
+            }
+            case CommandOpcode::Pose: {
+                auto command = Get<PoseCommand>(m_Offsets.size() - 1);
+                valid = IsValidLocation(command.latitude, command.longitude) &&
+                        std::isfinite(command.heading);
+                break;
+            }
+        }
+        if(!valid) {
+            TRACE_ERROR("Command list invalid arguments for opcode %u at %zu", header.opcode, offset);
+            return false;
+        }
+
+        offset += expected_size;
+    }
+    return true;
+}
+
+CommandOpcode CommandList::GetOpcode(size_t index) const
+{
+    CommandHeader header;
+    memcpy(&header, m_pData + m_Offsets[index], sizeof(header));
+    return static_cast<CommandOpcode>(header.opcode);
+}
+
+void CommandList::SetHandle(size_t index, int64_t handle)
+{
+    size_t handle_offset;
+    if(GetOpcode(index) == CommandOpcode::CreateBeacon)
+        handle_offset = offsetof(CreateBeaconCommand, handle);
+    else
+        handle_offset = offsetof(CreateTextToSpeechCommand, handle);
+
+    memcpy(m_pData + m_Offsets[index] + handle_offset, &handle, sizeof(handle));
+}
+
+//
+//
+//
+template<class T> size_t CommandListBuilder::Append(const T &command)
+{
+    auto offset = m_Data.size();
+    m_Data.resize(offset + sizeof(T));
+    memcpy(m_Data.data() + offset, &command, sizeof(T));
+    return offset;
+}
+
+size_t CommandListBuilder::CreateBeacon(double latitude, double longitude)
+{
+    CreateBeaconCommand command = {
+            {static_cast<uint32_t>(CommandOpcode::CreateBeacon), sizeof(CreateBeaconCommand)},
+            latitude, longitude, 0
+    };
+    auto offset = Append(command);
+    m_HandleOffsets.push_back(offset + offsetof(CreateBeaconCommand, handle));
+    return m_HandleOffsets.size() - 1;
+}
+
+size_t CommandListBuilder::CreateTextToSpeech(double latitude, double longitude, int tts_socket)
+{
+    CreateTextToSpeechCommand command = {
+            {static_cast<uint32_t>(CommandOpcode::CreateTextToSpeech), sizeof(CreateTextToSpeechCommand)},
+            latitude, longitude, tts_socket, 0, 0
+    };
+    auto offset = Append(command);
+    m_HandleOffsets.push_back(offset + offsetof(CreateTextToSpeechCommand, handle));
+    return m_HandleOffsets.size() - 1;
+}
+
+void CommandListBuilder::Destroy(int64_t handle)
+{
+    DestroyCommand command = {
+            {static_cast<uint32_t>(CommandOpcode::Destroy), sizeof(DestroyCommand)},
+            handle
+    };
+    Append(command);
+}
+
+void CommandListBuilder::Move(int64_t handle, double latitude, double longitude)
+{
+    MoveCommand command = {
+            {static_cast<uint32_t>(CommandOpcode::Move), sizeof(MoveCommand)},
+            handle, latitude, longitude
+    };
+    Append(command);
+}
+
+void CommandListBuilder::Pose(double latitude, double longitude, double heading)
+{
+    PoseCommand command = {
+            {static_cast<uint32_t>(CommandOpcode::Pose), sizeof(PoseCommand)},
+            latitude, longitude, heading
+    };
+    Append(command);
+}
+
+int64_t CommandListBuilder::GetHandle(size_t index) const
+{
+    int64_t handle;
+    memcpy(&handle, m_Data.data() + m_HandleOffsets[index], sizeof(handle));
+    return handle;
+}
@@ -0,0 +1,127 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <cstring>
+#include <vector>
+
+namespace soundscape {
+
+    //
+    // Binary command list which lets a client batch up beacon creation, destruction, moves and
+    // listener pose updates and submit them to the AudioEngine in a single call. From Kotlin the
+    // list is built in a direct ByteBuffer by AudioCommandBuffer, and from host C++ it can be
+    // built with CommandListBuilder.
+    //
+    // Each record starts with a CommandHeader whose size is the total size of the record in bytes.
+    // All fields are in native byte order and every record is a multiple of 8 bytes long. Create
+    // commands have a handle field which is filled in with the new audio handle once the list has
+    // been applied.
+    //
+    enum class CommandOpcode : uint32_t {
+        CreateBeacon = 1,
+        CreateTextToSpeech = 2,
+        Destroy = 3,
+        Move = 4,
+        Pose = 5,
+    };
+
+    struct CommandHeader {
+        uint32_t opcode;
+        uint32_t size;
+    };
+
+    struct CreateBeaconCommand {
+        CommandHeader header;
+        double latitude;
+        double longitude;
+        int64_t handle;
+    };
+
+    struct CreateTextToSpeechCommand {
+        CommandHeader header;
+        double latitude;
+        double longitude;
+        int32_t tts_socket;
+        int32_t reserved;
+        int64_t handle;
+    };
+
+    struct DestroyCommand {
+        CommandHeader header;
+        int64_t handle;
+    };
+
+    struct MoveCommand {
+        CommandHeader header;
+        int64_t handle;
+        double latitude;
+        double longitude;
+    };
+
+    struct PoseCommand {
+        CommandHeader header;
+        double latitude;
+        double longitude;
+        double heading;
+    };
+
+    // The record sizes are duplicated in AudioCommandBuffer.kt
+    static_assert(sizeof(CreateBeaconCommand) == 32);
+    static_assert(sizeof(CreateTextToSpeechCommand) == 40);
+    static_assert(sizeof(DestroyCommand) == 16);
+    static_assert(sizeof(MoveCommand) == 32);
+    static_assert(sizeof(PoseCommand) == 32);
+
+    class CommandList {
+    public:
+        // Parse walks the whole buffer and checks that every record is well formed. It returns
+        // false if any of them are not, in which case none of the commands should be applied.
+        bool Parse(uint8_t *data, size_t length);
+
+        size_t GetCount() const { return m_Offsets.size(); }
+        CommandOpcode GetOpcode(size_t index) const;
+
+        // Commands are copied out of the buffer as it's not guaranteed to be suitably aligned
+        template<class T> T Get(size_t index) const;
+
+        // Write the handle for a created beacon back into its command record
+        void SetHandle(size_t index, int64_t handle);
+
+    private:
+        uint8_t *m_pData = nullptr;
+        std::vector<size_t> m_Offsets;
+    };
+
+    template<class T> T CommandList::Get(size_t index) const
+    {
+        T command;
+        memcpy(&command, m_pData + m_Offsets[index], sizeof(T));
+        return command;
+    }
+
+    // Helper for building command lists from C++ e.g. from a host test harness
+    class CommandListBuilder {
+    public:
+        size_t CreateBeacon(double latitude, double longitude);
+        size_t CreateTextToSpeech(double latitude, double longitude, int tts_socket);
+        void Destroy(int64_t handle);
+        void Move(int64_t handle, double latitude, double longitude);
+        void Pose(double latitude, double longitude, double heading);
+
+        // Returns the handle filled in by the AudioEngine for a create command. The index is the
+        // value returned when the create command was added.
+        int64_t GetHandle(size_t index) const;
+
+        uint8_t *GetData() { return m_Data.data(); }
+        size_t GetLength() const { return m_Data.size(); }
+        void Clear() { m_Data.clear(); m_HandleOffsets.clear(); }
+
+    private:
+        template<class T> size_t Append(const T &command);
+
+        std::vector<uint8_t> m_Data;
+        std::vector<size_t> m_HandleOffsets;
+    };
+
+} // soundscape
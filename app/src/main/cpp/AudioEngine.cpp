@@ -1,13 +1,17 @@
 #include "AudioEngine.h"
 #include "AudioBeacon.h"
+#include "AudioCommands.h"
+#include "GeoBatch.h"
 #include "GeoUtils.h"
 #include "Trace.h"
 
+#include <algorithm>
+#include <pthread.h>
+#include <set>
 #include <thread>
 #include <memory>
 #include <mutex>
-#include <android/log.h>
-#include <jni.h>
+#include <vector>
 
 namespace soundscape {
 
@@ -126,108 +130,106 @@ const BeaconDescriptor AudioEngine::msc_BeaconDescriptors[] =
         }
 };
 
-#if 0
-    static FMOD_RESULT F_CALLBACK LoggingCallback(FMOD_DEBUG_FLAGS flags,
-                                                  const char *file,
-                                                  int line,
-                                                  const char *func,
-                                                  const char *message)
-    {
-        TRACE("%d of %s: %s", line, file, message);
-        return FMOD_OK;
-    }
-#endif
-
-    AudioEngine::AudioEngine() noexcept
-               : m_BeaconTypeIndex(1) {
-        FMOD_RESULT result;
-
+    AudioEngine::AudioEngine(std::unique_ptr<IAudioBackend> backend) noexcept
+               : m_pMemory(std::make_unique<AudioMemory>()),
+                 m_pBackend(std::move(backend)),
+                 m_pStats(std::make_unique<AudioStats>()),
+                 m_pFeatureStore(std::make_unique<FeatureStore>()),
+                 m_pTileCache(std::make_unique<TileCache>()),
+                 m_pTileWorkingSet(std::make_unique<TileWorkingSet>(*m_pFeatureStore, *m_pTileCache)),
+                 m_BeaconTypeIndex(1),
+                 m_ControlThreadRunning(false),
+                 m_EventsNotified(false) {
         TRACE("%s %p", __FUNCTION__, this);
-
-        // Create a System object and initialize
-        FMOD::System *system;
-        FMOD::System_Create(&system);
-        m_pSystem = system;
-
-        result = m_pSystem->setSoftwareFormat(22050, FMOD_SPEAKERMODE_SURROUND, 0);
-        ERROR_CHECK(result);
-
-        result = m_pSystem->init(32, FMOD_INIT_NORMAL, nullptr);
-        ERROR_CHECK(result);
-
-        result = m_pSystem->set3DSettings(1.0, FMOD_DISTANCE_FACTOR, 1.0f);
-        ERROR_CHECK(result);
-#if 0
-        int numdrivers = 0;
-        result = m_pSystem->getNumDrivers(&numdrivers);
-        ERROR_CHECK(result);
-        for(int id = 0; id < numdrivers; ++id) {
-            char name[256];
-            FMOD_GUID guid;
-            int systemrate;
-            FMOD_SPEAKERMODE speakermode;
-            int speakermodechannels;
-
-            result = m_pSystem->getDriverInfo(id,
-                    name,
-                    sizeof(name),
-                    &guid,
-                    &systemrate,
-                    &speakermode,
-                    &speakermodechannels);
-            ERROR_CHECK(result);
-
-            TRACE("Audio driver: %s  %d %d %d", name, systemrate, speakermode, speakermodechannels);
-        }
-#endif
+        m_pTileWorkingSet->SetMissingCallback([this](size_t missing) {
+            PostEvent(EventType::TilesMissing, 0, static_cast<int64_t>(missing));
+        });
+        m_pBackend->SetMixCallback(&AudioEngine::MixCallback, this);
     }
 
     AudioEngine::~AudioEngine() {
 
         TRACE("%s %p", __FUNCTION__, this);
 
+        StopControlThread();
+        // The working set posts events, so it has to stop before the event queue goes
+        m_pTileWorkingSet->Stop();
+
         {
             std::lock_guard<std::recursive_mutex> guard(m_BeaconsMutex);
+            // Nothing in the queue should start playing as the engine goes
+            m_QueuedBeacons.clear();
             // Deleting the PositionedAudio calls RemoveBeacon which removes it from m_Beacons
             while(!m_Beacons.empty())
             {
-                delete *m_Beacons.begin();
+                delete m_Beacons.begin()->second;
             }
         }
 
-        TRACE("System release");
-        auto result = m_pSystem->release();
-        ERROR_CHECK(result);
-        m_pSystem = nullptr;
+        m_pBackend->SetMixCallback(nullptr, nullptr);
+        m_pBackend.reset();
+    }
+
+    void AudioEngine::GetMemoryStats(MemoryStats &stats) const {
+        m_pMemory->GetStats(stats);
+        if(!m_pBackend->GetMemoryUsage(stats.backend_pool, stats.backend_used, stats.backend_high_water)) {
+            stats.backend_pool = 0;
+            stats.backend_used = 0;
+            stats.backend_high_water = 0;
+        }
     }
 
     void
     AudioEngine::UpdateGeometry(double listenerLatitude, double listenerLongitude,
                                 double listenerHeading) {
-        const FMOD_VECTOR up = {0.0f, 1.0f, 0.0f};
-
-        // Set listener position
-        FMOD_VECTOR listener_position;
-        listener_position.x = static_cast<float>(listenerLongitude);
-        listener_position.y = 0.0f;
-        listener_position.z = static_cast<float>(listenerLatitude);
+        UpdateGeometry(listenerLatitude, listenerLongitude, listenerHeading, m_pBackend->GetTime());
+    }
 
-        // ********* NOTE ******* READ NEXT COMMENT!!!!!
-        // vel = how far we moved last FRAME (m/f), then time compensate it to SECONDS (m/s).
-        // TODO: replace INTERFACE_UPDATE_TIME with calculated time difference
-        const int INTERFACE_UPDATE_TIME = 50;
+    void
+    AudioEngine::UpdateGeometry(double listenerLatitude, double listenerLongitude,
+                                double listenerHeading, uint64_t poseTime) {
+        TRACE_SCOPE("UpdateGeometry");
+        const AudioVector up = {0.0f, 1.0f, 0.0f};
 
-        FMOD_VECTOR vel;
-        vel.x = static_cast<float>((listener_position.x - m_LastPos.x) * (1000.0 / INTERFACE_UPDATE_TIME));
-        vel.y = static_cast<float>((listener_position.y - m_LastPos.y) * (1000.0 / INTERFACE_UPDATE_TIME));
-        vel.z = static_cast<float>((listener_position.z - m_LastPos.z) * (1000.0 / INTERFACE_UPDATE_TIME));
+        // Poses closer together than this don't give a meaningful velocity
+        const uint64_t MIN_VELOCITY_INTERVAL = 1000000;
 
-        // store pos for next time
-        m_LastPos = listener_position;
+        // Set listener position. The local frame can move when the listener does, so both the
+        // current and last positions are converted in the current frame.
+        AudioVector listener_position;
+        AudioVector vel;
+        {
+            std::lock_guard<std::recursive_mutex> guard(m_BeaconsMutex);
+            UpdateLocalFrame(listenerLatitude, listenerLongitude);
+
+            listener_position = ToAudioPosition(listenerLatitude, listenerLongitude);
+
+            // The velocity is in m/s from the distance and time between the last two new poses.
+            // Repeats of a pose, which have no time, keep the velocity that it had rather than
+            // making it drop to zero.
+            auto store = (poseTime != 0) && !m_HaveLastPosition;
+            if((poseTime != 0) && m_HaveLastPosition &&
+               (poseTime >= m_LastPoseTime + MIN_VELOCITY_INTERVAL)) {
+                auto last_position = ToAudioPosition(m_LastLatitude, m_LastLongitude);
+                auto seconds = static_cast<double>(poseTime - m_LastPoseTime) / 1e9;
+                m_ListenerVelocity.x = static_cast<float>((listener_position.x - last_position.x) / seconds);
+                m_ListenerVelocity.z = static_cast<float>((listener_position.z - last_position.z) / seconds);
+                store = true;
+            }
+            if(store) {
+                m_HaveLastPosition = true;
+                m_LastLatitude = listenerLatitude;
+                m_LastLongitude = listenerLongitude;
+                m_LastPoseTime = poseTime;
+            }
+            vel = m_ListenerVelocity;
+        }
+        m_pTileCache->SetLocation(listenerLatitude, listenerLongitude);
+        m_pTileWorkingSet->SetLocation(listenerLatitude, listenerLongitude);
 
         // Set listener direction
         auto rads = static_cast<float>((listenerHeading * M_PI) / 180.0);
-        FMOD_VECTOR forward = {sin(rads), 0.0f, cos(rads)};
+        AudioVector forward = {std::sin(rads), 0.0f, std::cos(rads)};
 
         //TRACE("heading: %d %f, %f %f", heading, rads, forward.x, forward.z)
         {
@@ -236,7 +238,7 @@ const BeaconDescriptor AudioEngine::msc_BeaconDescriptors[] =
             // 1. Check for any EOF and delete those Beacons. If the beacon was in the list of
             //    queued beacons, then we should also start playback of the next queued beacon if
             //    there is one.
-            // 2. Update the listener location and heading in each active Beacon. This allows
+            // 2. Update the listener location and heading in each remaining Beacon. This allows
             //    beacons to switch the audio being played when the listener is pointing away from
             //    the beacon.
             //
@@ -244,34 +246,77 @@ const BeaconDescriptor AudioEngine::msc_BeaconDescriptors[] =
             auto it = m_Beacons.begin();
             bool start_next = false;
             while(it != m_Beacons.end()) {
-                if((*it)->IsEof()) {
-                    if(*m_QueuedBeacons.begin() == *it) {
+                auto beacon = it->second;
+                if(beacon->IsEof()) {
+                    if(!m_QueuedBeacons.empty() && (*m_QueuedBeacons.begin() == beacon)) {
                         // The EOF is from the head of the list of queued beacons so start the next one
                         m_QueuedBeacons.pop_front();
                         start_next = true;
                     }
 
                     TRACE("Remove EOF beacon");
-                    delete *it;
+                    PostEvent(EventType::SourceFinished, it->first);
+                    delete beacon;
                     it = m_Beacons.begin();
                     continue;
                 }
 
-                (*it)->UpdateGeometry(listenerHeading, listenerLatitude, listenerLongitude);
                 ++it;
             }
             if(start_next && !m_QueuedBeacons.empty())
             {
                 TRACE("PlayNow on next queued beacon");
                 (*m_QueuedBeacons.begin())->PlayNow();
+                PostEvent(EventType::QueueAdvanced, (*m_QueuedBeacons.begin())->GetHandle());
+            }
+
+            // The bearings and distances are calculated for all of the beacons in one batch. The
+            // vectors are members so that they only allocate when the number of beacons grows.
+            auto count = m_Beacons.size();
+            m_GeometrySources.clear();
+            for(const auto &beacon: m_Beacons)
+                m_GeometrySources.push_back(beacon.second);
+            m_GeometryLatitudes.resize(count);
+            m_GeometryLongitudes.resize(count);
+            m_GeometryBearings.resize(count);
+            m_GeometryDistances.resize(count);
+            for(size_t i = 0; i < count; ++i) {
+                m_GeometryLatitudes[i] = m_GeometrySources[i]->GetLatitude();
+                m_GeometryLongitudes[i] = m_GeometrySources[i]->GetLongitude();
             }
+            BatchBearingAndDistance(listenerLatitude, listenerLongitude,
+                                    m_GeometryLatitudes.data(), m_GeometryLongitudes.data(), count,
+                                    m_GeometryBearings.data(), m_GeometryDistances.data());
+            for(size_t i = 0; i < count; ++i)
+                m_GeometrySources[i]->UpdateGeometry(listenerHeading,
+                                                     m_GeometryBearings[i],
+                                                     m_GeometryDistances[i],
+                                                     poseTime);
         }
 
-        auto result = m_pSystem->set3DListenerAttributes(0, &listener_position, &vel, &forward, &up);
-        ERROR_CHECK(result);
+        m_pBackend->SetListener(listener_position, vel, forward, up);
+        m_pBackend->Update();
 
-        result = m_pSystem->update();
-        ERROR_CHECK(result);
+        // The latency is recorded when the mixer starts on the first block with the new listener
+        // in it. Setting the time after the update means that if the mixer starts a block in
+        // between, the latency is counted to the block after, so it's never under estimated.
+        if(poseTime)
+            m_ListenerPoseTime = poseTime;
+
+        float dsp_cpu, stream_cpu;
+        if(m_pBackend->GetCpuUsage(dsp_cpu, stream_cpu))
+            m_pStats->RecordCpuUsage(dsp_cpu, stream_cpu);
+    }
+
+    void AudioEngine::MixCallback(void *context)
+    {
+        auto engine = static_cast<AudioEngine *>(context);
+        auto pose_time = engine->m_ListenerPoseTime.exchange(0);
+        if(pose_time) {
+            auto output_time = engine->m_pBackend->GetOutputTime(nullptr);
+            if(output_time >= pose_time)
+                engine->m_pStats->RecordMotionLatency(MotionPath::Listener, output_time - pose_time);
+        }
     }
 
     void AudioEngine::SetBeaconType(int beaconType)
@@ -284,7 +329,7 @@ const BeaconDescriptor AudioEngine::msc_BeaconDescriptors[] =
             //  to reinitialize Beacons with the new beacon type.
             return;
         }
-        TRACE("BeaconType failed, invalid type: %d", beaconType);
+        TRACE_ERROR("BeaconType failed, invalid type: %d", beaconType);
     }
 
     const BeaconDescriptor *AudioEngine::GetBeaconDescriptor() const
@@ -295,13 +340,14 @@ const BeaconDescriptor AudioEngine::msc_BeaconDescriptors[] =
     void AudioEngine::AddBeacon(PositionedAudio *beacon, bool queued)
     {
         std::lock_guard<std::recursive_mutex> guard(m_BeaconsMutex);
-        m_Beacons.insert(beacon);
+        m_Beacons[beacon->GetHandle()] = beacon;
         TRACE("AddBeacon -> %zu beacons", m_Beacons.size());
         if(queued)
         {
             if(m_QueuedBeacons.empty()) {
                 TRACE("First beacon in queue - PlayNow");
                 beacon->PlayNow();
+                PostEvent(EventType::QueueAdvanced, beacon->GetHandle());
             }
             m_QueuedBeacons.push_back(beacon);
             TRACE("Queue of %zu", m_QueuedBeacons.size());
@@ -311,116 +357,227 @@ const BeaconDescriptor AudioEngine::msc_BeaconDescriptors[] =
     void AudioEngine::RemoveBeacon(PositionedAudio *beacon)
     {
         std::lock_guard<std::recursive_mutex> guard(m_BeaconsMutex);
-        m_Beacons.erase(beacon);
+        m_Beacons.erase(beacon->GetHandle());
+
+        // A queued beacon which is destroyed before it reaches EOF has to come out of the queue
+        // too, and if it was the one playing then the next one starts. The client is told that
+        // it's finished in the same way as when it reaches EOF so that it can stop waiting on it.
+        auto queued = std::find(m_QueuedBeacons.begin(), m_QueuedBeacons.end(), beacon);
+        if(queued != m_QueuedBeacons.end()) {
+            bool was_playing = (queued == m_QueuedBeacons.begin());
+            m_QueuedBeacons.erase(queued);
+            PostEvent(EventType::SourceFinished, beacon->GetHandle());
+            if(was_playing && !m_QueuedBeacons.empty()) {
+                TRACE("PlayNow on next queued beacon");
+                (*m_QueuedBeacons.begin())->PlayNow();
+                PostEvent(EventType::QueueAdvanced, (*m_QueuedBeacons.begin())->GetHandle());
+            }
+        }
 
         TRACE("RemoveBeacon -> %zu beacons", m_Beacons.size());
     }
 
+    void AudioEngine::UpdateLocalFrame(double listenerLatitude, double listenerLongitude)
+    {
+        // Once the listener is this far from the origin, move the origin to the listener. Audio
+        // positions are floats, so this keeps the precision of positions around the listener to
+        // well under a millimetre.
+        const double REORIGIN_DISTANCE = 500.0;
+
+        if(m_LocalFrame.IsValid()) {
+            double east, north;
+            m_LocalFrame.ToLocal(listenerLatitude, listenerLongitude, east, north);
+            if(((east * east) + (north * north)) < (REORIGIN_DISTANCE * REORIGIN_DISTANCE))
+                return;
+        }
 
+        TRACE("Move local frame origin to %f %f", listenerLatitude, listenerLongitude);
+        m_LocalFrame.SetOrigin(listenerLatitude, listenerLongitude);
+        for(const auto &beacon: m_Beacons)
+            beacon.second->UpdatePosition();
+    }
 
-} // soundscape
+    AudioVector AudioEngine::ToAudioPosition(double latitude, double longitude)
+    {
+        std::lock_guard<std::recursive_mutex> guard(m_BeaconsMutex);
 
-extern "C"
-JNIEXPORT jlong JNICALL
-Java_com_scottishtecharmy_soundscape_audio_NativeAudioEngine_create(JNIEnv *env MAYBE_UNUSED, jobject thiz MAYBE_UNUSED) {
-    auto ae = std::make_unique<soundscape::AudioEngine>();
+        // Until we have a listener position, use the first location we're asked about as the
+        // origin. It will be moved as soon as the listener position is known if it's too far.
+        if(!m_LocalFrame.IsValid())
+            m_LocalFrame.SetOrigin(latitude, longitude);
 
-    if (not ae) {
-        TRACE("Failed to create audio engine");
-        ae.reset(nullptr);
+        // The coordinate system is left handed with y up, so east is x and north is z
+        double east, north;
+        m_LocalFrame.ToLocal(latitude, longitude, east, north);
+        return {static_cast<float>(east), 0.0f, static_cast<float>(north)};
     }
 
-    return reinterpret_cast<jlong>(ae.release());
-}
-
-extern "C"
-JNIEXPORT void JNICALL
-Java_com_scottishtecharmy_soundscape_audio_NativeAudioEngine_destroy(JNIEnv *env MAYBE_UNUSED,
-                                                                     jobject thiz MAYBE_UNUSED,
-                                                                     jlong engine_handle) {
-    auto* ae =
-            reinterpret_cast<soundscape::AudioEngine*>(engine_handle);
-    delete ae;
-}
-
-extern "C"
-JNIEXPORT void JNICALL
-Java_com_scottishtecharmy_soundscape_audio_NativeAudioEngine_updateGeometry(JNIEnv *env MAYBE_UNUSED,
-                                                                           jobject thiz MAYBE_UNUSED,
-                                                                           jlong engine_handle,
-                                                                           jdouble latitude,
-                                                                           jdouble longitude,
-                                                                           jdouble heading) {
-    auto* ae =
-            reinterpret_cast<soundscape::AudioEngine*>(engine_handle);
-
-    if (ae) {
-        ae->UpdateGeometry(latitude, longitude, heading);
-    } else {
-        TRACE("UpdateGeometry failed - no AudioEngine");
+    bool AudioEngine::DestroyAudio(int64_t handle)
+    {
+        std::lock_guard<std::recursive_mutex> guard(m_BeaconsMutex);
+        auto it = m_Beacons.find(handle);
+        if(it == m_Beacons.end())
+            return false;
+
+        // Deleting the PositionedAudio calls RemoveBeacon which removes it from m_Beacons
+        delete it->second;
+        return true;
     }
-}
-extern "C"
-JNIEXPORT void JNICALL
-Java_com_scottishtecharmy_soundscape_audio_NativeAudioEngine_setBeaconType(JNIEnv *env MAYBE_UNUSED, jobject thiz MAYBE_UNUSED,
-                                                                          jlong engine_handle,
-                                                                          jint beacon_type) {
-    auto* ae =
-            reinterpret_cast<soundscape::AudioEngine*>(engine_handle);
-
-    if (ae) {
-        ae->SetBeaconType(beacon_type);
-    } else {
-        TRACE("SetBeaconType failed - no AudioEngine");
+
+    int AudioEngine::SubmitCommands(uint8_t *data, size_t length)
+    {
+        TRACE_SCOPE("SubmitCommands");
+        CommandList commands;
+        if(!commands.Parse(data, length))
+            return -1;
+
+        // Holding the lock across validation and application means that UpdateGeometry sees
+        // either none or all of the commands.
+        std::lock_guard<std::recursive_mutex> guard(m_BeaconsMutex);
+
+        // Check that every handle refers to a live beacon before changing anything
+        std::set<int64_t> destroyed;
+        for(size_t index = 0; index < commands.GetCount(); ++index) {
+            int64_t handle;
+            auto opcode = commands.GetOpcode(index);
+            if(opcode == CommandOpcode::Destroy)
+                handle = commands.Get<DestroyCommand>(index).handle;
+            else if(opcode == CommandOpcode::Move)
+                handle = commands.Get<MoveCommand>(index).handle;
+            else
+                continue;
+
+            if((m_Beacons.find(handle) == m_Beacons.end()) ||
+               (destroyed.find(handle) != destroyed.end())) {
+                TRACE("SubmitCommands rejected, unknown handle %lld", static_cast<long long>(handle));
+                return -1;
+            }
+            if(opcode == CommandOpcode::Destroy)
+                destroyed.insert(handle);
+        }
+
+        // Only the most recent pose matters, so apply it once after everything else
+        bool have_pose = false;
+        PoseCommand pose{};
+        for(size_t index = 0; index < commands.GetCount(); ++index) {
+            switch(commands.GetOpcode(index)) {
+                case CommandOpcode::CreateBeacon: {
+                    auto command = commands.Get<CreateBeaconCommand>(index);
+                    auto beacon = new(m_pMemory.get()) Beacon(this, command.latitude, command.longitude);
+                    if(beacon == nullptr)
+                        TRACE_ERROR("Failed to create beacon - over memory budget");
+                    commands.SetHandle(index, beacon ? beacon->GetHandle() : 0);
+                    break;
+                }
+                case CommandOpcode::CreateTextToSpeech: {
+                    auto command = commands.Get<CreateTextToSpeechCommand>(index);
+                    auto tts = new(m_pMemory.get()) TextToSpeech(this, command.latitude, command.longitude,
+                                                                 command.tts_socket);
+                    if(tts == nullptr)
+                        TRACE_ERROR("Failed to create text to speech - over memory budget");
+                    commands.SetHandle(index, tts ? tts->GetHandle() : 0);
+                    break;
+                }
+                case CommandOpcode::Destroy: {
+                    auto command = commands.Get<DestroyCommand>(index);
+                    delete m_Beacons[command.handle];
+                    break;
+                }
+                case CommandOpcode::Move: {
+                    auto command = commands.Get<MoveCommand>(index);
+                    m_Beacons[command.handle]->SetLocation(command.latitude, command.longitude);
+                    break;
+                }
+                case CommandOpcode::Pose:
+                    pose = commands.Get<PoseCommand>(index);
+                    have_pose = true;
+                    break;
+            }
+        }
+        if(have_pose)
+            UpdateGeometry(pose.latitude, pose.longitude, pose.heading);
+
+        return static_cast<int>(commands.GetCount());
+    }
+
+    void AudioEngine::RegisterPoseMailbox(void *memory)
+    {
+        StopControlThread();
+
+        m_pPoseMailbox = std::make_unique<PoseMailbox>(memory);
+        m_ControlThreadRunning = true;
+        m_ControlThread = std::thread(&AudioEngine::ControlThread, this);
     }
-}
-
-extern "C"
-JNIEXPORT jlong JNICALL
-Java_com_scottishtecharmy_soundscape_audio_NativeAudioEngine_createNativeBeacon(JNIEnv *env MAYBE_UNUSED,
-                                                                               jobject thiz MAYBE_UNUSED,
-                                                                               jlong engine_handle,
-                                                                               jdouble latitude,
-                                                                               jdouble longitude) {
-    auto* ae = reinterpret_cast<soundscape::AudioEngine*>(engine_handle);
-    if(ae) {
-
-        auto beacon = std::make_unique<soundscape::Beacon>(ae, latitude, longitude);
-        if (not beacon) {
-            TRACE("Failed to create audio beacon");
-            beacon.reset(nullptr);
+
+    void AudioEngine::StopControlThread()
+    {
+        if(m_ControlThread.joinable()) {
+            m_ControlThreadRunning = false;
+            m_ControlThread.join();
         }
-        return reinterpret_cast<jlong>(beacon.release());
     }
-    return 0L;
-}
-
-extern "C"
-JNIEXPORT void JNICALL
-Java_com_scottishtecharmy_soundscape_audio_NativeAudioEngine_destroyNativeBeacon(JNIEnv *env MAYBE_UNUSED,
-                                                                                jobject thiz MAYBE_UNUSED,
-                                                                                jlong beacon_handle) {
-    auto beacon = reinterpret_cast<soundscape::Beacon*>(beacon_handle);
-    delete beacon;
-}
-
-extern "C"
-JNIEXPORT jlong JNICALL
-Java_com_scottishtecharmy_soundscape_audio_NativeAudioEngine_createNativeTextToSpeech(JNIEnv *env MAYBE_UNUSED,
-                                                                                     jobject thiz MAYBE_UNUSED,
-                                                                                     jlong engine_handle,
-                                                                                     jdouble latitude,
-                                                                                     jdouble longitude,
-                                                                                     jint tts_socket) {
-    auto* ae = reinterpret_cast<soundscape::AudioEngine*>(engine_handle);
-    if(ae) {
-
-        auto tts = std::make_unique<soundscape::TextToSpeech>(ae, latitude, longitude, tts_socket);
-        if (not tts) {
-            TRACE("Failed to create text to speech");
-            tts.reset(nullptr);
+
+    void AudioEngine::ControlThread()
+    {
+        // Match the 50Hz rate at which the orientation sensor delivers updates
+        const auto CONTROL_PERIOD = std::chrono::milliseconds(20);
+
+        // Named so that it can be picked out on a trace timeline
+        pthread_setname_np(pthread_self(), "AudioControl");
+        TRACE("ControlThread started");
+        bool have_pose = false;
+        Pose pose{};
+        while(m_ControlThreadRunning) {
+            // Only the latest pose is read, however many were written since the last time around.
+            // Once we have a pose keep updating with it so that EOF beacons are still tidied up
+            // and the backend is updated when the listener isn't moving. The motion to sound
+            // latency is only measured from new poses, which are timestamped by the client.
+            uint64_t pose_time = 0;
+            if(m_pPoseMailbox->Read(pose)) {
+                have_pose = true;
+                pose_time = (pose.timestamp > 0) ? static_cast<uint64_t>(pose.timestamp) : m_pBackend->GetTime();
+            }
+
+            if(have_pose)
+                UpdateGeometry(pose.latitude, pose.longitude, pose.heading, pose_time);
+
+            NotifyEvents();
+
+            std::this_thread::sleep_for(CONTROL_PERIOD);
         }
-        return reinterpret_cast<jlong>(tts.release());
+        TRACE("ControlThread exiting");
+    }
+
+    void AudioEngine::SetEventCallback(EventCallback callback, void *context)
+    {
+        m_EventCallback = callback;
+        m_pEventCallbackContext = context;
+    }
+
+    void AudioEngine::PostEvent(EventType type, int64_t handle, int64_t value)
+    {
+        // This can be called on the mixer thread, so no tracing here
+        m_Events.Push({type, handle, value});
+    }
+
+    size_t AudioEngine::DrainEvents(Event *events, size_t max_events)
+    {
+        // Clear the flag first so that any events posted while we're draining are notified
+        m_EventsNotified = false;
+
+        size_t count = 0;
+        while((count < max_events) && m_Events.Pop(events[count]))
+            ++count;
+
+        return count;
+    }
+
+    void AudioEngine::NotifyEvents()
+    {
+        // Only notify once until the client drains the queue
+        if(m_EventCallback && !m_Events.IsEmpty() && !m_EventsNotified.exchange(true))
+            m_EventCallback(m_pEventCallbackContext);
     }
-    return 0L;
-}
\ No newline at end of file
+
+
+} // soundscape
@@ -1,23 +1,51 @@
 #pragma once
 
-#include <set>
+#include <atomic>
 #include <list>
+#include <map>
+#include <memory>
 #include <thread>
 #include <mutex>
-#include "fmod.hpp"
-#include "fmod.h"
+#include <vector>
+#include "AudioBackend.h"
+#include "AudioMemory.h"
+#include "AudioStats.h"
 #include "BeaconDescriptor.h"
+#include "EventQueue.h"
+#include "FeatureStore.h"
+#include "GeoUtils.h"
+#include "PoseMailbox.h"
+#include "TileCache.h"
+#include "TileWorkingSet.h"
 
 namespace soundscape {
 
     class PositionedAudio;
     class AudioEngine {
     public:
-        AudioEngine() noexcept;
+        explicit AudioEngine(std::unique_ptr<IAudioBackend> backend) noexcept;
         ~AudioEngine();
 
+        // The pose is taken to have been captured now
         void UpdateGeometry(double listenerLatitude, double listenerLongitude, double listenerHeading);
-        FMOD::System * GetFmodSystem() const { return m_pSystem; };
+        // The pose time is when the pose was captured, on the backend clock. It's used to measure
+        // the motion to sound latency, and is zero if the pose isn't new and so shouldn't be.
+        void UpdateGeometry(double listenerLatitude, double listenerLongitude, double listenerHeading,
+                            uint64_t poseTime);
+        IAudioBackend * GetBackend() const { return m_pBackend.get(); };
+        // The audio sources record their stream callback timings here
+        AudioStats *GetStats() const { return m_pStats.get(); }
+        // The audio sources and their assets are allocated from here, see AudioMemory.h
+        AudioMemory *GetMemory() const { return m_pMemory.get(); }
+        // The engine's memory and the backend's pool
+        void GetMemoryStats(MemoryStats &stats) const;
+        // The features of the loaded map tiles, see TileClipper.h
+        FeatureStore *GetFeatureStore() const { return m_pFeatureStore.get(); }
+        // The on-disk cache of tiles, which is closed until the client opens it
+        TileCache *GetTileCache() const { return m_pTileCache.get(); }
+        // Keeps the tiles around the listener loaded once the client starts it. It posts a
+        // TilesMissing event when there are tiles for the client to fetch.
+        TileWorkingSet *GetTileWorkingSet() const { return m_pTileWorkingSet.get(); }
 
         void SetBeaconType(int beaconType);
         const BeaconDescriptor *GetBeaconDescriptor() const;
@@ -25,16 +53,81 @@ namespace soundscape {
         void AddBeacon(PositionedAudio *beacon, bool queued = false);
         void RemoveBeacon(PositionedAudio *beacon);
 
+        // Destroy audio created by a client, returning false if the handle isn't one of our beacons
+        bool DestroyAudio(int64_t handle);
+
+        // Convert a location into audio coordinates in metres relative to the local frame origin
+        AudioVector ToAudioPosition(double latitude, double longitude);
+
+        // Validate and apply a binary command list (see AudioCommands.h) in one go. Returns the
+        // number of commands applied, or -1 if the list was rejected and nothing was changed.
+        int SubmitCommands(uint8_t *data, size_t length);
+
+        // Register memory shared with the client into which it writes the latest listener pose
+        // (see PoseMailbox.h). A control thread polls the mailbox and calls UpdateGeometry so
+        // that pose updates don't require any calls into the engine.
+        void RegisterPoseMailbox(void *memory);
+
+        // Events are posted from any engine thread and drained by the client in batches. If an
+        // event callback is set, the control thread calls it when there are new events waiting to
+        // be drained. The callback must be set before the pose mailbox is registered.
+        typedef void (*EventCallback)(void *context);
+        void SetEventCallback(EventCallback callback, void *context);
+        void *GetEventCallbackContext() const { return m_pEventCallbackContext; }
+        // The handle is the source's PositionedAudio::GetHandle, or 0 for events from the engine
+        void PostEvent(EventType type, int64_t handle, int64_t value = 0);
+        size_t DrainEvents(Event *events, size_t max_events);
+
     private:
-        FMOD::System * m_pSystem;
-        FMOD_VECTOR m_LastPos = {0.0f, 0.0f, 0.0f};
+        // Records the latency of the last listener pose as the mixer starts the block it's in
+        static void MixCallback(void *context);
+
+        void ControlThread();
+        void StopControlThread();
+        void NotifyEvents();
+        void UpdateLocalFrame(double listenerLatitude, double listenerLongitude);
+
+        // Declared first so that it's destroyed after everything which was allocated from it
+        std::unique_ptr<AudioMemory> m_pMemory;
+        std::unique_ptr<IAudioBackend> m_pBackend;
+        std::unique_ptr<AudioStats> m_pStats;
+        std::unique_ptr<FeatureStore> m_pFeatureStore;
+        std::unique_ptr<TileCache> m_pTileCache;
+        std::unique_ptr<TileWorkingSet> m_pTileWorkingSet;
+
+        // Audio positions are in metres in a local frame whose origin follows the listener
+        LocalFrame m_LocalFrame;
+        bool m_HaveLastPosition = false;
+        double m_LastLatitude = 0.0;
+        double m_LastLongitude = 0.0;
+        uint64_t m_LastPoseTime = 0;
+        AudioVector m_ListenerVelocity = {0.0f, 0.0f, 0.0f};
+        // The time of the pose last passed to the backend, until the mixer picks it up
+        std::atomic<uint64_t> m_ListenerPoseTime{0};
 
         const static BeaconDescriptor msc_BeaconDescriptors[];
         std::atomic<int> m_BeaconTypeIndex;
 
         std::recursive_mutex m_BeaconsMutex;
-        std::set<PositionedAudio *> m_Beacons;
+        // Keyed by handle, so in the order that they were created
+        std::map<int64_t, PositionedAudio *> m_Beacons;
         std::list<PositionedAudio *> m_QueuedBeacons;
+
+        // Structure of arrays for the batched bearing and distance calculation in UpdateGeometry
+        std::vector<PositionedAudio *> m_GeometrySources;
+        std::vector<double> m_GeometryLatitudes;
+        std::vector<double> m_GeometryLongitudes;
+        std::vector<float> m_GeometryBearings;
+        std::vector<float> m_GeometryDistances;
+
+        std::unique_ptr<PoseMailbox> m_pPoseMailbox;
+        std::thread m_ControlThread;
+        std::atomic<bool> m_ControlThreadRunning;
+
+        EventQueue m_Events;
+        EventCallback m_EventCallback = nullptr;
+        void *m_pEventCallbackContext = nullptr;
+        std::atomic<bool> m_EventsNotified;
     };
 
 } // soundscape
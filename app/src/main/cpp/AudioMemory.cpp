@@ -0,0 +1,199 @@
+#include <algorithm>
+#include <cstdlib>
+#include <new>
+
+#include "AudioMemory.h"
+#include "Trace.h"
+
+using namespace soundscape;
+
+// In front of every block, saying where it came from so that it can be freed without knowing
+struct AudioMemory::BlockHeader {
+    // Null for blocks from a plain new
+    AudioMemory *memory;
+    // SIZE_CLASSES for blocks on the heap
+    uint32_t size_class;
+    // The bytes charged for the block, including this header
+    uint32_t size;
+};
+
+AudioMemory::AudioMemory(size_t budget, size_t arena_size)
+    : m_Budget(budget),
+      m_Used(0),
+      m_HighWater(0),
+      m_Refused(0)
+{
+    static_assert(sizeof(BlockHeader) <= HEADER_SIZE, "Header too large");
+    static_assert(HEADER_SIZE % alignof(std::max_align_t) == 0, "Blocks would be misaligned");
+
+    // Each size class gets an equal share of the arena, in whole blocks of the largest class
+    size_t class_size = (arena_size / SIZE_CLASSES) & ~(MAX_BLOCK - 1);
+    m_ArenaSize = class_size * SIZE_CLASSES;
+    m_pArena = std::make_unique<uint8_t[]>(m_ArenaSize);
+    for(size_t index = 0; index < SIZE_CLASSES; ++index) {
+        auto &size_class = m_Classes[index];
+        size_class.start = m_pArena.get() + (index * class_size);
+        size_class.next = size_class.start;
+        size_class.end = size_class.start + class_size;
+    }
+
+    // The arena is always there, so it's charged even if it doesn't fit in the budget
+    m_Used = m_ArenaSize;
+    m_HighWater = m_ArenaSize;
+}
+
+AudioMemory::~AudioMemory()
+{
+    if(m_ArenaUsed != 0)
+        TRACE_ERROR("AudioMemory destroyed with %zu bytes still allocated", m_ArenaUsed);
+}
+
+size_t AudioMemory::GetSizeClass(size_t size)
+{
+    size_t block = MIN_BLOCK;
+    for(size_t index = 0; index < SIZE_CLASSES; ++index) {
+        if(size <= block)
+            return index;
+        block <<= 1;
+    }
+    return SIZE_CLASSES;
+}
+
+void *AudioMemory::Allocate(size_t size)
+{
+    auto total = size + HEADER_SIZE;
+    auto size_class = GetSizeClass(total);
+    BlockHeader *header = nullptr;
+    if(size_class < SIZE_CLASSES) {
+        std::lock_guard<std::mutex> guard(m_ArenaMutex);
+        auto &blocks = m_Classes[size_class];
+        if(blocks.free) {
+            header = reinterpret_cast<BlockHeader *>(blocks.free);
+            blocks.free = blocks.free->next;
+        } else if(blocks.next < blocks.end) {
+            header = reinterpret_cast<BlockHeader *>(blocks.next);
+            blocks.next += MIN_BLOCK << size_class;
+        }
+
+        if(header) {
+            m_ArenaUsed += MIN_BLOCK << size_class;
+            m_ArenaHighWater = std::max(m_ArenaHighWater, m_ArenaUsed);
+            header->size = static_cast<uint32_t>(MIN_BLOCK << size_class);
+        } else {
+            // The class is full, so fall back to the heap
+            ++m_Overflows;
+        }
+    } else {
+        std::lock_guard<std::mutex> guard(m_ArenaMutex);
+        ++m_Overflows;
+    }
+
+    if(header == nullptr) {
+        if((total > UINT32_MAX) || !Reserve(total))
+            return nullptr;
+        header = static_cast<BlockHeader *>(std::malloc(total));
+        if(header == nullptr) {
+            Release(total);
+            return nullptr;
+        }
+        size_class = SIZE_CLASSES;
+        header->size = static_cast<uint32_t>(total);
+    }
+
+    header->memory = this;
+    header->size_class = static_cast<uint32_t>(size_class);
+    return reinterpret_cast<uint8_t *>(header) + HEADER_SIZE;
+}
+
+void AudioMemory::Free(void *block)
+{
+    if(block == nullptr)
+        return;
+
+    auto header = reinterpret_cast<BlockHeader *>(static_cast<uint8_t *>(block) - HEADER_SIZE);
+    if(header->memory)
+        header->memory->ReturnBlock(header);
+    else
+        ::operator delete(header);
+}
+
+void AudioMemory::ReturnBlock(BlockHeader *header)
+{
+    auto size = header->size;
+    if(header->size_class == SIZE_CLASSES) {
+        std::free(header);
+        Release(size);
+        return;
+    }
+
+    std::lock_guard<std::mutex> guard(m_ArenaMutex);
+    auto free_block = reinterpret_cast<FreeBlock *>(header);
+    auto &blocks = m_Classes[header->size_class];
+    free_block->next = blocks.free;
+    blocks.free = free_block;
+    m_ArenaUsed -= size;
+}
+
+bool AudioMemory::Reserve(size_t bytes)
+{
+    auto used = m_Used.load();
+    size_t new_used;
+    do {
+        new_used = used + bytes;
+        if(new_used > m_Budget.load()) {
+            ++m_Refused;
+            TRACE_WARNING("AudioMemory refused %zu bytes, %zu of %zu used", bytes, used, m_Budget.load());
+            return false;
+        }
+    } while(!m_Used.compare_exchange_weak(used, new_used));
+
+    auto high_water = m_HighWater.load();
+    while((new_used > high_water) && !m_HighWater.compare_exchange_weak(high_water, new_used)) {
+    }
+    return true;
+}
+
+void AudioMemory::Release(size_t bytes)
+{
+    m_Used -= bytes;
+}
+
+void AudioMemory::GetStats(MemoryStats &stats) const
+{
+    stats.budget = m_Budget;
+    stats.used = m_Used;
+    stats.high_water = m_HighWater;
+    stats.refused = m_Refused;
+
+    std::lock_guard<std::mutex> guard(m_ArenaMutex);
+    stats.arena_size = m_ArenaSize;
+    stats.arena_used = m_ArenaUsed;
+    stats.arena_high_water = m_ArenaHighWater;
+    stats.overflows = m_Overflows;
+}
+
+void *ArenaObject::operator new(size_t size, AudioMemory *memory) noexcept
+{
+    if(memory == nullptr)
+        return nullptr;
+    return memory->Allocate(size);
+}
+
+void *ArenaObject::operator new(size_t size)
+{
+    auto header = static_cast<AudioMemory::BlockHeader *>(::operator new(size + AudioMemory::HEADER_SIZE));
+    header->memory = nullptr;
+    header->size_class = AudioMemory::SIZE_CLASSES;
+    header->size = 0;
+    return reinterpret_cast<uint8_t *>(header) + AudioMemory::HEADER_SIZE;
+}
+
+void ArenaObject::operator delete(void *block) noexcept
+{
+    AudioMemory::Free(block);
+}
+
+void ArenaObject::operator delete(void *block, AudioMemory *memory MAYBE_UNUSED) noexcept
+{
+    AudioMemory::Free(block);
+}
@@ -0,0 +1,115 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+
+namespace soundscape {
+
+    struct MemoryStats {
+        // The engine's budget, and the bytes charged to it now and at most. The arena is charged
+        // in full when it's created, and the asset PCM and any blocks which didn't fit in the
+        // arena are charged as they're allocated.
+        size_t budget = 0;
+        size_t used = 0;
+        size_t high_water = 0;
+        // Allocations which were refused because they would have gone over the budget
+        uint64_t refused = 0;
+
+        // How much of the arena is in use, and how many allocations had to go to the heap
+        // because they were too large or their size class was full
+        size_t arena_size = 0;
+        size_t arena_used = 0;
+        size_t arena_high_water = 0;
+        uint64_t overflows = 0;
+
+        // The backend's own fixed pool, which is zero if it allocates from the heap
+        size_t backend_pool = 0;
+        size_t backend_used = 0;
+        size_t backend_high_water = 0;
+    };
+
+    //
+    // The memory for an AudioEngine's objects. Blocks come from an arena which is allocated up
+    // front and split into size classes, each with its own free list, so that creating and
+    // destroying audio sources doesn't go to malloc. Everything is charged to a budget which
+    // allocations are refused beyond. Allocation takes a lock, so it mustn't be done from the
+    // mixer thread, which never needs to.
+    //
+    class AudioMemory {
+    public:
+        static const size_t DEFAULT_BUDGET = 64 * 1024 * 1024;
+        static const size_t DEFAULT_ARENA_SIZE = 256 * 1024;
+
+        // Sizes of the blocks in each class, including the header in front of each block
+        static const size_t MIN_BLOCK = 64;
+        static const size_t SIZE_CLASSES = 5;
+        static const size_t MAX_BLOCK = MIN_BLOCK << (SIZE_CLASSES - 1);
+
+        explicit AudioMemory(size_t budget = DEFAULT_BUDGET, size_t arena_size = DEFAULT_ARENA_SIZE);
+        ~AudioMemory();
+
+        // Returns nullptr if the allocation would go over the budget
+        void *Allocate(size_t size);
+        // Free a block from Allocate or from ArenaObject's operator new
+        static void Free(void *block);
+
+        // Charge memory which is allocated elsewhere to the budget, returning false if it would
+        // go over it
+        bool Reserve(size_t bytes);
+        void Release(size_t bytes);
+
+        // Lowering the budget below what's in use only refuses allocations until enough is freed
+        void SetBudget(size_t budget) { m_Budget = budget; }
+        void GetStats(MemoryStats &stats) const;
+
+    private:
+        friend class ArenaObject;
+        struct BlockHeader;
+        // Big enough for the BlockHeader and keeping the blocks after it aligned
+        static const size_t HEADER_SIZE = 16;
+
+        struct FreeBlock {
+            FreeBlock *next;
+        };
+        struct SizeClass {
+            uint8_t *start = nullptr;
+            uint8_t *next = nullptr;
+            uint8_t *end = nullptr;
+            FreeBlock *free = nullptr;
+        };
+
+        static size_t GetSizeClass(size_t size);
+        void ReturnBlock(BlockHeader *header);
+
+        std::atomic<size_t> m_Budget;
+        std::atomic<size_t> m_Used;
+        std::atomic<size_t> m_HighWater;
+        std::atomic<uint64_t> m_Refused;
+
+        std::unique_ptr<uint8_t[]> m_pArena;
+        size_t m_ArenaSize;
+        mutable std::mutex m_ArenaMutex;
+        SizeClass m_Classes[SIZE_CLASSES];
+        size_t m_ArenaUsed = 0;
+        size_t m_ArenaHighWater = 0;
+        uint64_t m_Overflows = 0;
+    };
+
+    //
+    // Base for the engine's objects so that they can be allocated from its AudioMemory with
+    // new(memory) T(...). If that returns nullptr the engine's budget is used up. Objects created
+    // with a plain new come from the heap and aren't charged to any budget, and either kind can be
+    // deleted as usual.
+    //
+    class ArenaObject {
+    public:
+        static void *operator new(size_t size, AudioMemory *memory) noexcept;
+        static void *operator new(size_t size);
+        static void operator delete(void *block) noexcept;
+        static void operator delete(void *block, AudioMemory *memory) noexcept;
+    };
+
+} // soundscape
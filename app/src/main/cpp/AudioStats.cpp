@@ -0,0 +1,112 @@
+#include <algorithm>
+#include <cmath>
+
+#include "AudioStats.h"
+
+using namespace soundscape;
+
+size_t LatencyHistogramSnapshot::GetBucket(uint64_t nanoseconds)
+{
+    if(nanoseconds < SUB_BUCKETS)
+        return static_cast<size_t>(nanoseconds);
+
+    // The top SUB_BUCKET_BITS + 1 bits of the value pick the bucket within its power of two
+    int exponent = 63 - __builtin_clzll(nanoseconds);
+    if(exponent > MAX_EXPONENT)
+        return BUCKETS - 1;
+    int shift = exponent - SUB_BUCKET_BITS;
+    auto sub_bucket = static_cast<size_t>(nanoseconds >> shift) - SUB_BUCKETS;
+    return SUB_BUCKETS + (static_cast<size_t>(shift) * SUB_BUCKETS) + sub_bucket;
+}
+
+uint64_t LatencyHistogramSnapshot::GetBucketLimit(size_t bucket)
+{
+    if(bucket < SUB_BUCKETS)
+        return bucket;
+
+    auto shift = (bucket - SUB_BUCKETS) / SUB_BUCKETS;
+    auto sub_bucket = (bucket - SUB_BUCKETS) % SUB_BUCKETS;
+    return ((SUB_BUCKETS + sub_bucket) << shift) + (uint64_t(1) << shift) - 1;
+}
+
+uint64_t LatencyHistogramSnapshot::GetPercentile(double percentile) const
+{
+    if(count == 0)
+        return 0;
+
+    auto target = static_cast<uint64_t>(std::ceil(std::clamp(percentile, 0.0, 100.0) * count / 100.0));
+    target = std::max<uint64_t>(target, 1);
+
+    uint64_t total = 0;
+    for(size_t bucket = 0; bucket < BUCKETS; ++bucket) {
+        total += counts[bucket];
+        if(total >= target)
+            return std::min(GetBucketLimit(bucket), max);
+    }
+    return max;
+}
+
+LatencyHistogram::LatencyHistogram()
+    : m_Max(0)
+{
+    for(auto &count: m_Counts)
+        count.store(0, std::memory_order_relaxed);
+}
+
+void LatencyHistogram::GetSnapshot(LatencyHistogramSnapshot &snapshot, bool reset)
+{
+    snapshot.count = 0;
+    for(size_t bucket = 0; bucket < LatencyHistogramSnapshot::BUCKETS; ++bucket) {
+        if(reset)
+            snapshot.counts[bucket] = m_Counts[bucket].exchange(0, std::memory_order_relaxed);
+        else
+            snapshot.counts[bucket] = m_Counts[bucket].load(std::memory_order_relaxed);
+        snapshot.count += snapshot.counts[bucket];
+    }
+    if(reset)
+        snapshot.max = m_Max.exchange(0, std::memory_order_relaxed);
+    else
+        snapshot.max = m_Max.load(std::memory_order_relaxed);
+}
+
+AudioStats::AudioStats()
+    : m_DspCpu(0.0f),
+      m_StreamCpu(0.0f),
+      m_PeakDspCpu(0.0f),
+      m_PeakStreamCpu(0.0f)
+{
+}
+
+void AudioStats::RecordCpuUsage(float dsp, float stream)
+{
+    m_DspCpu.store(dsp, std::memory_order_relaxed);
+    m_StreamCpu.store(stream, std::memory_order_relaxed);
+    if(dsp > m_PeakDspCpu.load(std::memory_order_relaxed))
+        m_PeakDspCpu.store(dsp, std::memory_order_relaxed);
+    if(stream > m_PeakStreamCpu.load(std::memory_order_relaxed))
+        m_PeakStreamCpu.store(stream, std::memory_order_relaxed);
+}
+
+void AudioStats::GetSnapshot(AudioStatsSnapshot &snapshot, bool reset)
+{
+    for(size_t type = 0; type < m_Callbacks.size(); ++type) {
+        m_Callbacks[type].durations.GetSnapshot(snapshot.callbacks[type].durations, reset);
+        if(reset)
+            snapshot.callbacks[type].padded = m_Callbacks[type].padded.exchange(0, std::memory_order_relaxed);
+        else
+            snapshot.callbacks[type].padded = m_Callbacks[type].padded.load(std::memory_order_relaxed);
+    }
+
+    for(size_t path = 0; path < m_Motion.size(); ++path)
+        m_Motion[path].GetSnapshot(snapshot.motion[path], reset);
+
+    snapshot.dsp_cpu = m_DspCpu.load(std::memory_order_relaxed);
+    snapshot.stream_cpu = m_StreamCpu.load(std::memory_order_relaxed);
+    if(reset) {
+        snapshot.peak_dsp_cpu = m_PeakDspCpu.exchange(0.0f, std::memory_order_relaxed);
+        snapshot.peak_stream_cpu = m_PeakStreamCpu.exchange(0.0f, std::memory_order_relaxed);
+    } else {
+        snapshot.peak_dsp_cpu = m_PeakDspCpu.load(std::memory_order_relaxed);
+        snapshot.peak_stream_cpu = m_PeakStreamCpu.load(std::memory_order_relaxed);
+    }
+}
@@ -0,0 +1,173 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+
+namespace soundscape {
+
+    // The types of audio source whose stream callbacks are timed separately
+    enum class AudioSourceType {
+        Beacon = 0,
+        TextToSpeech = 1,
+        Count
+    };
+
+    // The ways in which a change in the listener's pose is heard. A beacon switches to the layer
+    // for the new heading in the next block that it reads, and the listener position and
+    // orientation are picked up by the mixer after the backend is updated.
+    enum class MotionPath {
+        LayerSwitch = 0,
+        Listener = 1,
+        Count
+    };
+
+    //
+    // The buckets of a LatencyHistogram, copied out so that percentiles can be calculated from
+    // them. Values below 16ns have a bucket each, and above that each power of two is split into
+    // 16 buckets, so that any value is within about 6% of the bucket that it's counted in, as with
+    // an HDR histogram with one significant figure.
+    //
+    struct LatencyHistogramSnapshot {
+        static const int SUB_BUCKET_BITS = 4;
+        static const int SUB_BUCKETS = 1 << SUB_BUCKET_BITS;
+        // Values up to 2^37ns, which is over two minutes, larger values are counted in the last bucket
+        static const int MAX_EXPONENT = 36;
+        static const size_t BUCKETS = SUB_BUCKETS * (MAX_EXPONENT - SUB_BUCKET_BITS + 2);
+
+        static size_t GetBucket(uint64_t nanoseconds);
+        // The largest value that's counted in the bucket
+        static uint64_t GetBucketLimit(size_t bucket);
+
+        // Returns the value which the given percentage of the values are at or below, or zero if
+        // there are no values.
+        uint64_t GetPercentile(double percentile) const;
+
+        std::array<uint64_t, BUCKETS> counts{};
+        uint64_t count = 0;
+        uint64_t max = 0;
+    };
+
+    //
+    // Histogram of durations in nanoseconds. Recording is wait-free so that it can be done from
+    // the mixer thread, and it can be read from any other thread.
+    //
+    class LatencyHistogram {
+    public:
+        LatencyHistogram();
+
+        void Record(uint64_t nanoseconds)
+        {
+            m_Counts[LatencyHistogramSnapshot::GetBucket(nanoseconds)].fetch_add(1, std::memory_order_relaxed);
+            auto max = m_Max.load(std::memory_order_relaxed);
+            while((nanoseconds > max) &&
+                  !m_Max.compare_exchange_weak(max, nanoseconds, std::memory_order_relaxed)) {
+            }
+        }
+
+        // Copy the histogram and optionally clear it. Values recorded while this is happening may
+        // be in either the snapshot or the cleared histogram, but aren't lost.
+        void GetSnapshot(LatencyHistogramSnapshot &snapshot, bool reset);
+
+    private:
+        std::array<std::atomic<uint64_t>, LatencyHistogramSnapshot::BUCKETS> m_Counts;
+        std::atomic<uint64_t> m_Max;
+    };
+
+    struct CallbackStatsSnapshot {
+        LatencyHistogramSnapshot durations;
+        // Callbacks which had to fill some of the buffer with silence because the audio wasn't
+        // there yet
+        uint64_t padded = 0;
+    };
+
+    struct AudioStatsSnapshot {
+        std::array<CallbackStatsSnapshot, static_cast<size_t>(AudioSourceType::Count)> callbacks;
+
+        // Time from a pose being captured to the audio which reflects it being heard
+        std::array<LatencyHistogramSnapshot, static_cast<size_t>(MotionPath::Count)> motion;
+
+        // Percentage of real time spent mixing and in the stream callbacks, as last sampled from
+        // the backend and the peak since the stats were last reset
+        float dsp_cpu = 0.0f;
+        float stream_cpu = 0.0f;
+        float peak_dsp_cpu = 0.0f;
+        float peak_stream_cpu = 0.0f;
+    };
+
+    //
+    // Statistics on how well the engine is keeping the mixer fed. The audio sources record how
+    // long each of their stream callbacks took and the motion to sound latency of layer switches,
+    // and the engine samples the backend CPU usage and the listener latency on each geometry
+    // update.
+    //
+    class AudioStats {
+    public:
+        AudioStats();
+
+        // Called from the mixer thread
+        void RecordCallback(AudioSourceType type, uint64_t nanoseconds, bool padded)
+        {
+            auto &callbacks = m_Callbacks[static_cast<size_t>(type)];
+            callbacks.durations.Record(nanoseconds);
+            if(padded)
+                callbacks.padded.fetch_add(1, std::memory_order_relaxed);
+        }
+
+        void RecordMotionLatency(MotionPath path, uint64_t nanoseconds)
+        {
+            m_Motion[static_cast<size_t>(path)].Record(nanoseconds);
+        }
+
+        void RecordCpuUsage(float dsp, float stream);
+
+        // Resetting clears the histograms, counters and peaks so that the next snapshot covers
+        // the time since this one
+        void GetSnapshot(AudioStatsSnapshot &snapshot, bool reset);
+
+    private:
+        struct CallbackStats {
+            CallbackStats() : padded(0) {}
+
+            LatencyHistogram durations;
+            std::atomic<uint64_t> padded;
+        };
+        std::array<CallbackStats, static_cast<size_t>(AudioSourceType::Count)> m_Callbacks;
+        std::array<LatencyHistogram, static_cast<size_t>(MotionPath::Count)> m_Motion;
+
+        std::atomic<float> m_DspCpu;
+        std::atomic<float> m_StreamCpu;
+        std::atomic<float> m_PeakDspCpu;
+        std::atomic<float> m_PeakStreamCpu;
+    };
+
+    // Times a stream callback from construction to destruction and records it in the stats
+    class CallbackTimer {
+    public:
+        CallbackTimer(AudioStats *stats, AudioSourceType type)
+            : m_pStats(stats),
+              m_Type(type),
+              m_Start(std::chrono::steady_clock::now())
+        {
+        }
+
+        ~CallbackTimer()
+        {
+            auto duration = std::chrono::steady_clock::now() - m_Start;
+            m_pStats->RecordCallback(m_Type,
+                                     static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(duration).count()),
+                                     m_Padded);
+        }
+
+        // The callback filled some of its buffer with silence
+        void Padded() { m_Padded = true; }
+
+    private:
+        AudioStats *m_pStats;
+        AudioSourceType m_Type;
+        std::chrono::steady_clock::time_point m_Start;
+        bool m_Padded = false;
+    };
+
+} // soundscape
@@ -0,0 +1,111 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+namespace soundscape {
+
+    // The values are duplicated in NativeAudioEngine.kt
+    enum class EventType : int64_t {
+        SourceFinished = 1,     // The audio has finished and the source has been destroyed
+        QueueAdvanced = 2,      // Queued audio has started playing
+        Underrun = 3,           // A source had no data when the mixer asked for it
+        AssetLoaded = 4,        // A beacon asset has been loaded, value is its size in bytes
+        TilesMissing = 5,       // Tiles around the listener couldn't be loaded, value is how many
+    };
+
+    struct Event {
+        EventType type;
+        int64_t handle;
+        int64_t value;
+    };
+
+    //
+    // Bounded lock-free queue of events from the engine to its client. Events can be pushed from
+    // any thread including the FMOD mixer thread, so pushing never allocates or blocks. If the
+    // queue is full the event is dropped and counted rather than waiting for the client to catch
+    // up. The design is Dmitry Vyukov's bounded MPMC queue, with a sequence number in each cell
+    // so that producers and consumers only contend on their own index.
+    //
+    class EventQueue {
+    public:
+        EventQueue()
+        {
+            for(size_t i = 0; i < CAPACITY; ++i)
+                m_Cells[i].sequence.store(i, std::memory_order_relaxed);
+        }
+
+        bool Push(const Event &event)
+        {
+            Cell *cell;
+            auto position = m_EnqueuePosition.load(std::memory_order_relaxed);
+            for(;;) {
+                cell = &m_Cells[position & MASK];
+                auto sequence = cell->sequence.load(std::memory_order_acquire);
+                auto difference = static_cast<intptr_t>(sequence) - static_cast<intptr_t>(position);
+                if(difference == 0) {
+                    if(m_EnqueuePosition.compare_exchange_weak(position, position + 1,
+                                                               std::memory_order_relaxed))
+                        break;
+                } else if(difference < 0) {
+                    m_Dropped.fetch_add(1, std::memory_order_relaxed);
+                    return false;
+                } else {
+                    position = m_EnqueuePosition.load(std::memory_order_relaxed);
+                }
+            }
+            cell->event = event;
+            cell->sequence.store(position + 1, std::memory_order_release);
+            return true;
+        }
+
+        bool Pop(Event &event)
+        {
+            Cell *cell;
+            auto position = m_DequeuePosition.load(std::memory_order_relaxed);
+            for(;;) {
+                cell = &m_Cells[position & MASK];
+                auto sequence = cell->sequence.load(std::memory_order_acquire);
+                auto difference = static_cast<intptr_t>(sequence) - static_cast<intptr_t>(position + 1);
+                if(difference == 0) {
+                    if(m_DequeuePosition.compare_exchange_weak(position, position + 1,
+                                                               std::memory_order_relaxed))
+                        break;
+                } else if(difference < 0) {
+                    return false;
+                } else {
+                    position = m_DequeuePosition.load(std::memory_order_relaxed);
+                }
+            }
+            event = cell->event;
+            cell->sequence.store(position + MASK + 1, std::memory_order_release);
+            return true;
+        }
+
+        bool IsEmpty() const
+        {
+            return m_EnqueuePosition.load(std::memory_order_acquire) ==
+                   m_DequeuePosition.load(std::memory_order_acquire);
+        }
+
+        uint64_t GetDroppedCount() const { return m_Dropped.load(std::memory_order_relaxed); }
+
+        const static size_t CAPACITY = 256;
+
+    private:
+        const static size_t MASK = CAPACITY - 1;
+        static_assert((CAPACITY & MASK) == 0, "Capacity must be a power of two");
+
+        struct Cell {
+            std::atomic<size_t> sequence;
+            Event event;
+        };
+
+        Cell m_Cells[CAPACITY];
+        alignas(64) std::atomic<size_t> m_EnqueuePosition{0};
+        alignas(64) std::atomic<size_t> m_DequeuePosition{0};
+        std::atomic<uint64_t> m_Dropped{0};
+    };
+
+} // soundscape
@@ -0,0 +1,44 @@
+#pragma once
+
+#include <cstdint>
+#include <string_view>
+
+namespace soundscape {
+
+    //
+    // What a tile feature is to the callout code, from its feature_type and feature_value. These
+    // follow the filters in TileUtils.kt which split a tile into roads, paths, intersections,
+    // entrances and POIs, except that bus stops and crossings get their own categories rather
+    // than being left out of the roads.
+    //
+    enum class FeatureCategory : uint8_t {
+        Poi = 0,
+        Road,
+        Path,
+        Intersection,
+        Entrance,
+        BusStop,
+        Crossing,
+        Count
+    };
+
+    inline FeatureCategory GetFeatureCategory(std::string_view type, std::string_view value)
+    {
+        if(type == "highway") {
+            if(value == "gd_intersection")
+                return FeatureCategory::Intersection;
+            if((value == "footway") || (value == "path") || (value == "cycleway") ||
+               (value == "bridleway"))
+                return FeatureCategory::Path;
+            if(value == "bus_stop")
+                return FeatureCategory::BusStop;
+            if(value == "crossing")
+                return FeatureCategory::Crossing;
+            return FeatureCategory::Road;
+        }
+        if(type == "gd_entrance_list")
+            return FeatureCategory::Entrance;
+        return FeatureCategory::Poi;
+    }
+
+} // soundscape
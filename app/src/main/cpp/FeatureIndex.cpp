@@ -0,0 +1,476 @@
+#include <algorithm>
+#include <cmath>
+
+#include "FeatureIndex.h"
+
+using namespace soundscape;
+
+// The number of children of each node. Tiles have a few thousand features at most, so this
+// keeps the tree to three or four levels while the children of a node fit in a few cache lines.
+static const size_t NODE_SIZE = 16;
+
+// The position along a Hilbert curve of order 16 of a point on a 65536 x 65536 grid
+static uint32_t HilbertIndex(uint32_t x, uint32_t y)
+{
+    const uint32_t n = 1u << 16;
+    uint32_t index = 0;
+    for(uint32_t s = n >> 1; s > 0; s >>= 1) {
+        uint32_t rx = (x & s) ? 1 : 0;
+        uint32_t ry = (y & s) ? 1 : 0;
+        index += s * s * ((3 * rx) ^ ry);
+        if(ry == 0) {
+            if(rx == 1) {
+                x = n - 1 - x;
+                y = n - 1 - y;
+            }
+            std::swap(x, y);
+        }
+    }
+    return index;
+}
+
+//
+// What a query looks at from the listener: either everything around them, or a wedge which is
+// split in two if it's more than 180 degrees wide, so that each half is the intersection of two
+// half-planes. Coordinates are relative to the listener.
+//
+struct FeatureIndex::View {
+    struct Wedge {
+        // Unit vectors along the left and right edges
+        double left_x;
+        double left_y;
+        double right_x;
+        double right_y;
+
+        // Positive on the inside of each edge
+        double Left(double x, double y) const { return left_y * x - left_x * y; }
+        double Right(double x, double y) const { return right_x * y - right_y * x; }
+    };
+
+    double x = 0.0;
+    double y = 0.0;
+    // No wedges means everything is in view
+    size_t wedge_count = 0;
+    Wedge wedges[2] = {};
+
+    void SetWedge(double heading, double width)
+    {
+        wedge_count = 0;
+        if(width >= 360.0)
+            return;
+        width = std::max(width, 0.0);
+        if(width <= 180.0) {
+            AddWedge(heading, width);
+        } else {
+            AddWedge(heading - width / 4.0, width / 2.0);
+            AddWedge(heading + width / 4.0, width / 2.0);
+        }
+    }
+
+    bool Contains(double px, double py) const
+    {
+        px -= x;
+        py -= y;
+        for(size_t index = 0; index < wedge_count; ++index) {
+            const auto &wedge = wedges[index];
+            if((wedge.Left(px, py) >= 0.0) && (wedge.Right(px, py) >= 0.0))
+                return true;
+        }
+        return wedge_count == 0;
+    }
+
+    // The squared distance to the nearest point of the line segment from 1 to 2 which is in view,
+    // or infinity if none of it is
+    double SquaredSegmentDistance(double x1, double y1, double x2, double y2) const
+    {
+        x1 -= x;
+        y1 -= y;
+        x2 -= x;
+        y2 -= y;
+        if(wedge_count == 0)
+            return SquaredSegmentDistance(x1, y1, x2, y2, 0.0, 1.0);
+
+        auto nearest = std::numeric_limits<double>::infinity();
+        for(size_t index = 0; index < wedge_count; ++index) {
+            // Clip the segment to the inside of both edges
+            const auto &wedge = wedges[index];
+            auto t0 = 0.0;
+            auto t1 = 1.0;
+            auto inside = Clip(wedge.Left(x1, y1), wedge.Left(x2, y2), t0, t1) &&
+                          Clip(wedge.Right(x1, y1), wedge.Right(x2, y2), t0, t1);
+            if(inside)
+                nearest = std::min(nearest, SquaredSegmentDistance(x1, y1, x2, y2, t0, t1));
+        }
+        return nearest;
+    }
+
+    // Whether any of the box might be in view. Boxes which are outside one edge of every wedge
+    // aren't.
+    template<typename Box>
+    bool Overlaps(const Box &box) const
+    {
+        double xs[2] = {box.min_x - x, box.max_x - x};
+        double ys[2] = {box.min_y - y, box.max_y - y};
+        for(size_t index = 0; index < wedge_count; ++index) {
+            const auto &wedge = wedges[index];
+            auto left = false;
+            auto right = false;
+            for(auto corner_x: xs) {
+                for(auto corner_y: ys) {
+                    left = left || (wedge.Left(corner_x, corner_y) >= 0.0);
+                    right = right || (wedge.Right(corner_x, corner_y) >= 0.0);
+                }
+            }
+            if(left && right)
+                return true;
+        }
+        return wedge_count == 0;
+    }
+
+private:
+    void AddWedge(double heading, double width)
+    {
+        auto left = toRadians(heading - width / 2.0);
+        auto right = toRadians(heading + width / 2.0);
+        wedges[wedge_count++] = {sin(left), cos(left), sin(right), cos(right)};
+    }
+
+    // Limit the range t0 to t1 along a segment to where a linear function which is f1 at the
+    // start and f2 at the end is positive, returning false if it's empty
+    static bool Clip(double f1, double f2, double &t0, double &t1)
+    {
+        if(f1 < 0.0) {
+            if(f2 < 0.0)
+                return false;
+            t0 = std::max(t0, f1 / (f1 - f2));
+        } else if(f2 < 0.0) {
+            t1 = std::min(t1, f1 / (f1 - f2));
+        }
+        return t0 <= t1;
+    }
+
+    // The squared distance from the origin to the part of the segment from 1 to 2 between t0
+    // and t1
+    static double SquaredSegmentDistance(double x1, double y1, double x2, double y2,
+                                         double t0, double t1)
+    {
+        auto dx = x2 - x1;
+        auto dy = y2 - y1;
+        auto length = dx * dx + dy * dy;
+        auto t = t0;
+        if(length > 0.0)
+            t = std::clamp(-(x1 * dx + y1 * dy) / length, t0, t1);
+        auto ex = x1 + t * dx;
+        auto ey = y1 + t * dy;
+        return ex * ex + ey * ey;
+    }
+};
+
+// The squared distance from a point to the nearest point of a box, which is 0 inside it
+template<typename Box>
+static double SquaredBoxDistance(double x, double y, const Box &box)
+{
+    auto dx = std::max({box.min_x - x, 0.0, x - box.max_x});
+    auto dy = std::max({box.min_y - y, 0.0, y - box.max_y});
+    return dx * dx + dy * dy;
+}
+
+FeatureIndex::FeatureIndex(std::shared_ptr<const FeatureCollection> features,
+                           const BoundingBox &bounds)
+            : m_pFeatures(std::move(features))
+{
+    const auto &collection = *m_pFeatures;
+    if(collection.latitudes.empty())
+        return;
+
+    // Project around the centre of the tile, so that a feature which reaches far outside it
+    // doesn't move the origin away from where the queries are
+    m_OriginLatitude = (bounds.southLatitude + bounds.northLatitude) / 2.0;
+    m_OriginLongitude = (bounds.westLongitude + bounds.eastLongitude) / 2.0;
+    m_MetresPerDegreeLatitude = EARTH_RADIUS_METERS * DEGREES_TO_RADIANS;
+    m_MetresPerDegreeLongitude = m_MetresPerDegreeLatitude * cos(toRadians(m_OriginLatitude));
+
+    // A leaf for each feature which has any coordinates
+    std::vector<Entry> leaves;
+    leaves.reserve(collection.features.size());
+    for(uint32_t index = 0; index < collection.features.size(); ++index) {
+        const auto &feature = collection.features[index];
+        Entry leaf = {std::numeric_limits<double>::infinity(), std::numeric_limits<double>::infinity(),
+                      -std::numeric_limits<double>::infinity(), -std::numeric_limits<double>::infinity(),
+                      index, 0, static_cast<uint8_t>(FeatureCategoryMask(feature.category))};
+        for(uint32_t part = 0; part < feature.part_count; ++part) {
+            const auto &geometry = collection.parts[feature.first_part + part];
+            for(uint32_t coordinate = geometry.first_coordinate;
+                coordinate < geometry.first_coordinate + geometry.coordinate_count;
+                ++coordinate) {
+                double x, y;
+                ToLocal(collection.latitudes[coordinate], collection.longitudes[coordinate], x, y);
+                leaf.min_x = std::min(leaf.min_x, x);
+                leaf.min_y = std::min(leaf.min_y, y);
+                leaf.max_x = std::max(leaf.max_x, x);
+                leaf.max_y = std::max(leaf.max_y, y);
+            }
+        }
+        if(leaf.min_x <= leaf.max_x)
+            leaves.push_back(leaf);
+    }
+    m_ItemCount = leaves.size();
+    if(leaves.empty())
+        return;
+
+    // Sort the leaves along the Hilbert curve over the tile. Features whose centres are outside
+    // it are put on the nearest edge.
+    double min_x, min_y, max_x, max_y;
+    ToLocal(bounds.southLatitude, bounds.westLongitude, min_x, min_y);
+    ToLocal(bounds.northLatitude, bounds.eastLongitude, max_x, max_y);
+    auto scale_x = (max_x > min_x) ? 65535.0 / (max_x - min_x) : 0.0;
+    auto scale_y = (max_y > min_y) ? 65535.0 / (max_y - min_y) : 0.0;
+    std::vector<std::pair<uint32_t, uint32_t>> order(leaves.size());
+    for(uint32_t index = 0; index < leaves.size(); ++index) {
+        const auto &leaf = leaves[index];
+        auto x = std::clamp(((leaf.min_x + leaf.max_x) / 2.0 - min_x) * scale_x, 0.0, 65535.0);
+        auto y = std::clamp(((leaf.min_y + leaf.max_y) / 2.0 - min_y) * scale_y, 0.0, 65535.0);
+        order[index] = {HilbertIndex(static_cast<uint32_t>(x), static_cast<uint32_t>(y)), index};
+    }
+    std::sort(order.begin(), order.end());
+
+    // The leaves then each level of nodes in turn, until there's only the root
+    auto total = leaves.size();
+    for(auto count = leaves.size(); count > 1; count = (count + NODE_SIZE - 1) / NODE_SIZE)
+        total += (count + NODE_SIZE - 1) / NODE_SIZE;
+    m_Entries.reserve(total);
+    for(const auto &item: order)
+        m_Entries.push_back(leaves[item.second]);
+
+    size_t level_start = 0;
+    size_t level_end = m_Entries.size();
+    while(level_end - level_start > 1) {
+        for(auto first = level_start; first < level_end; first += NODE_SIZE) {
+            auto count = std::min(NODE_SIZE, level_end - first);
+            Entry node = m_Entries[first];
+            node.index = static_cast<uint32_t>(first);
+            node.child_count = static_cast<uint16_t>(count);
+            for(auto child = first + 1; child < first + count; ++child) {
+                const auto &entry = m_Entries[child];
+                node.min_x = std::min(node.min_x, entry.min_x);
+                node.min_y = std::min(node.min_y, entry.min_y);
+                node.max_x = std::max(node.max_x, entry.max_x);
+                node.max_y = std::max(node.max_y, entry.max_y);
+                node.categories |= entry.categories;
+            }
+            m_Entries.push_back(node);
+        }
+        level_start = level_end;
+        level_end = m_Entries.size();
+    }
+}
+
+double FeatureIndex::GetSquaredDistance(const View &view, uint32_t index) const
+{
+    const auto &collection = *m_pFeatures;
+    const auto &feature = collection.features[index];
+    auto polygon = (feature.geometry == GeometryType::Polygon) ||
+                   (feature.geometry == GeometryType::MultiPolygon);
+    auto line = polygon || (feature.geometry == GeometryType::LineString) ||
+                (feature.geometry == GeometryType::MultiLineString);
+
+    auto nearest = std::numeric_limits<double>::infinity();
+    // Whether the listener is inside a polygon by the even-odd rule over all of the rings. The
+    // polygons of a MultiPolygon don't overlap, so this is the same as testing each in turn.
+    auto inside = false;
+    for(uint32_t part = 0; part < feature.part_count; ++part) {
+        const auto &geometry = collection.parts[feature.first_part + part];
+        if(geometry.coordinate_count == 0)
+            continue;
+        auto first = geometry.first_coordinate;
+        auto last = first + geometry.coordinate_count - 1;
+
+        double x1, y1;
+        ToLocal(collection.latitudes[first], collection.longitudes[first], x1, y1);
+        // A line of one point is the point, and a ring is closed whether or not its last
+        // coordinate repeats the first
+        auto end = polygon ? last + 1 : std::max(last, first + 1);
+        for(auto coordinate = first; line && (coordinate < end); ++coordinate) {
+            auto next = (coordinate == last) ? first : coordinate + 1;
+            double x2, y2;
+            ToLocal(collection.latitudes[next], collection.longitudes[next], x2, y2);
+            nearest = std::min(nearest, view.SquaredSegmentDistance(x1, y1, x2, y2));
+            if(polygon && ((y1 > view.y) != (y2 > view.y)) &&
+               (view.x < x1 + (view.y - y1) * (x2 - x1) / (y2 - y1)))
+                inside = !inside;
+            x1 = x2;
+            y1 = y2;
+        }
+        for(auto coordinate = first; !line && (coordinate <= last); ++coordinate) {
+            ToLocal(collection.latitudes[coordinate], collection.longitudes[coordinate], x1, y1);
+            if(view.Contains(x1, y1))
+                nearest = std::min(nearest, (x1 - view.x) * (x1 - view.x) + (y1 - view.y) * (y1 - view.y));
+        }
+    }
+    return inside ? 0.0 : nearest;
+}
+
+double FeatureIndex::GetDistance(double latitude, double longitude, uint32_t feature) const
+{
+    View view;
+    ToLocal(latitude, longitude, view.x, view.y);
+    return sqrt(GetSquaredDistance(view, feature));
+}
+
+double FeatureIndex::GetDistanceInFieldOfView(double latitude, double longitude, double heading,
+                                              double width, uint32_t feature) const
+{
+    View view;
+    ToLocal(latitude, longitude, view.x, view.y);
+    view.SetWedge(heading, width);
+    return sqrt(GetSquaredDistance(view, feature));
+}
+
+bool FeatureIndex::FindNearest(double latitude, double longitude, uint32_t categories,
+                               NearestFeature &nearest, double max_distance) const
+{
+    std::vector<NearestFeature> found;
+    FindNearest(latitude, longitude, 1, categories, found, max_distance);
+    if(found.empty())
+        return false;
+    nearest = found.front();
+    return true;
+}
+
+void FeatureIndex::FindNearest(double latitude, double longitude, size_t count, uint32_t categories,
+                               std::vector<NearestFeature> &nearest, double max_distance) const
+{
+    nearest.clear();
+    if(m_Entries.empty() || (count == 0) || !(m_Entries.back().categories & categories))
+        return;
+
+    View view;
+    ToLocal(latitude, longitude, view.x, view.y);
+    auto bound = max_distance * max_distance;
+
+    // Entries in order of the squared distance to their boxes, or for leaves which have been
+    // refined, to their features. A refined leaf is never further than its box, so when one comes
+    // off the queue, nothing after it can be any nearer.
+    struct Candidate {
+        double distance;
+        uint32_t entry;
+        bool refined;
+    };
+    auto further = [](const Candidate &a, const Candidate &b) { return a.distance > b.distance; };
+    std::vector<Candidate> queue;
+    queue.reserve(4 * NODE_SIZE);
+    // The nearest count of the features refined so far, furthest first. Once there are count of
+    // them, nothing further away than the furthest needs to go on the queue.
+    std::vector<double> refined;
+    refined.reserve(count);
+    auto root = static_cast<uint32_t>(m_Entries.size() - 1);
+    queue.push_back({SquaredBoxDistance(view.x, view.y, m_Entries[root]), root, false});
+
+    while(!queue.empty()) {
+        std::pop_heap(queue.begin(), queue.end(), further);
+        auto candidate = queue.back();
+        queue.pop_back();
+        if(candidate.distance > bound)
+            break;
+
+        const auto &entry = m_Entries[candidate.entry];
+        if(candidate.refined) {
+            nearest.push_back({entry.index, sqrt(candidate.distance)});
+            if(nearest.size() == count)
+                break;
+        } else if(entry.child_count == 0) {
+            candidate.distance = GetSquaredDistance(view, entry.index);
+            candidate.refined = true;
+            if(candidate.distance > bound)
+                continue;
+            queue.push_back(candidate);
+            std::push_heap(queue.begin(), queue.end(), further);
+
+            if(refined.size() == count) {
+                std::pop_heap(refined.begin(), refined.end());
+                refined.pop_back();
+            }
+            refined.push_back(candidate.distance);
+            std::push_heap(refined.begin(), refined.end());
+            if(refined.size() == count)
+                bound = refined.front();
+        } else {
+            for(uint32_t child = entry.index; child < entry.index + entry.child_count; ++child) {
+                if(!(m_Entries[child].categories & categories))
+                    continue;
+                auto distance = SquaredBoxDistance(view.x, view.y, m_Entries[child]);
+                if(distance > bound)
+                    continue;
+                queue.push_back({distance, child, false});
+                std::push_heap(queue.begin(), queue.end(), further);
+            }
+        }
+    }
+}
+
+void FeatureIndex::FindInFieldOfView(double latitude, double longitude, double heading, double width,
+                                     double range, uint32_t categories,
+                                     std::vector<NearestFeature> &features) const
+{
+    features.clear();
+    if(m_Entries.empty())
+        return;
+
+    View view;
+    ToLocal(latitude, longitude, view.x, view.y);
+    view.SetWedge(heading, width);
+    auto range_squared = range * range;
+
+    std::vector<uint32_t> stack;
+    stack.reserve(4 * NODE_SIZE);
+    stack.push_back(static_cast<uint32_t>(m_Entries.size() - 1));
+    while(!stack.empty()) {
+        const auto &entry = m_Entries[stack.back()];
+        stack.pop_back();
+        if(!(entry.categories & categories) ||
+           (SquaredBoxDistance(view.x, view.y, entry) > range_squared) || !view.Overlaps(entry))
+            continue;
+
+        if(entry.child_count == 0) {
+            auto distance = GetSquaredDistance(view, entry.index);
+            if(distance <= range_squared)
+                features.push_back({entry.index, sqrt(distance)});
+        } else {
+            for(uint32_t child = entry.index; child < entry.index + entry.child_count; ++child)
+                stack.push_back(child);
+        }
+    }
+    std::sort(features.begin(), features.end(), [](const NearestFeature &a, const NearestFeature &b) {
+        return a.distance < b.distance;
+    });
+}
+
+void FeatureIndex::Search(const BoundingBox &box, uint32_t categories,
+                          std::vector<uint32_t> &features) const
+{
+    if(m_Entries.empty())
+        return;
+
+    double min_x, min_y, max_x, max_y;
+    ToLocal(box.southLatitude, box.westLongitude, min_x, min_y);
+    ToLocal(box.northLatitude, box.eastLongitude, max_x, max_y);
+
+    std::vector<uint32_t> stack;
+    stack.reserve(4 * NODE_SIZE);
+    stack.push_back(static_cast<uint32_t>(m_Entries.size() - 1));
+    while(!stack.empty()) {
+        const auto &entry = m_Entries[stack.back()];
+        stack.pop_back();
+        if(!(entry.categories & categories) ||
+           (entry.max_x < min_x) || (entry.min_x > max_x) ||
+           (entry.max_y < min_y) || (entry.min_y > max_y))
+            continue;
+
+        if(entry.child_count == 0) {
+            features.push_back(entry.index);
+        } else {
+            for(uint32_t child = entry.index; child < entry.index + entry.child_count; ++child)
+                stack.push_back(child);
+        }
+    }
+}
@@ -0,0 +1,119 @@
+#pragma once
+
+#include <cstdint>
+#include <limits>
+#include <memory>
+#include <vector>
+
+#include "GeoJsonParser.h"
+#include "GeoUtils.h"
+
+namespace soundscape {
+
+    // A set of FeatureCategory values for filtering queries
+    inline constexpr uint32_t FeatureCategoryMask(FeatureCategory category)
+    {
+        return 1u << static_cast<uint32_t>(category);
+    }
+    constexpr uint32_t ALL_FEATURE_CATEGORIES = (1u << static_cast<uint32_t>(FeatureCategory::Count)) - 1;
+
+    struct NearestFeature {
+        // The index of the feature in the collection, and its distance in metres
+        uint32_t feature;
+        double distance;
+    };
+
+    //
+    // Packed Hilbert R-tree over the features of a tile, so that the nearest road, intersection
+    // or POI can be found without looking at every feature as the functions in TileUtils.kt do.
+    //
+    // The tree is built once, when the tile is loaded, and can't be changed. Each feature's
+    // bounding box is a leaf, with the leaves sorted by the Hilbert curve position of their
+    // centres so that features near each other are in the same nodes, and each level of nodes is
+    // packed full from the level below. The nodes are in one array, and each one has a mask of
+    // the categories beneath it so that a query for roads skips the parts of the tree with only
+    // POIs in them.
+    //
+    // Distances are measured on an equirectangular projection around the centre of the tile,
+    // which is within 0.1% of the haversine distance for features within a few kilometres of it.
+    // The nearest features are found best first, in order of the distance to their bounding
+    // boxes, and that distance is refined to the exact distance to the feature's geometry: to its
+    // nearest point, the nearest point on its lines, or the nearest point on the boundary of its
+    // polygons, or zero if the location is inside one. Features with no geometry aren't indexed.
+    //
+    class FeatureIndex {
+    public:
+        // The bounds are the tile's, which the projection is centred on and the Hilbert curve
+        // covers. Features which stick out of them are still indexed.
+        FeatureIndex(std::shared_ptr<const FeatureCollection> features, const BoundingBox &bounds);
+
+        const FeatureCollection &GetFeatures() const { return *m_pFeatures; }
+        // The number of features in the tree
+        size_t GetSize() const { return m_ItemCount; }
+
+        // The nearest feature in one of the categories, returning false if there isn't one within
+        // max_distance metres
+        bool FindNearest(double latitude, double longitude, uint32_t categories,
+                         NearestFeature &nearest,
+                         double max_distance = std::numeric_limits<double>::infinity()) const;
+        // Replace the contents of nearest with up to count features nearest first
+        void FindNearest(double latitude, double longitude, size_t count, uint32_t categories,
+                         std::vector<NearestFeature> &nearest,
+                         double max_distance = std::numeric_limits<double>::infinity()) const;
+
+        // Replace the contents of features with those in one of the categories which are in the
+        // listener's field of view, nearest first. It's a wedge width degrees wide centred on the
+        // heading, out to range metres, and a feature is in it if any of its geometry is, or if
+        // the listener is inside one of its polygons. The distance is to the nearest point of the
+        // feature which is in view. Nodes of the tree are culled by whether their boxes are in
+        // range and overlap the wedge, which makes this much cheaper than testing each feature
+        // against a triangle as the FOV functions in TileUtils.kt do.
+        void FindInFieldOfView(double latitude, double longitude, double heading, double width,
+                               double range, uint32_t categories,
+                               std::vector<NearestFeature> &features) const;
+
+        // Append the features whose bounding boxes overlap the box
+        void Search(const BoundingBox &box, uint32_t categories,
+                    std::vector<uint32_t> &features) const;
+
+        // The distance in metres from the location to a feature, as used by the queries, and to
+        // the nearest part of it in the field of view, which is infinity if none of it is
+        double GetDistance(double latitude, double longitude, uint32_t feature) const;
+        double GetDistanceInFieldOfView(double latitude, double longitude, double heading,
+                                        double width, uint32_t feature) const;
+
+    private:
+        // A leaf, which is a feature, or a node of the tree
+        struct Entry {
+            double min_x;
+            double min_y;
+            double max_x;
+            double max_y;
+            // The feature for a leaf, and the first child for a node
+            uint32_t index;
+            // The number of children, which is 0 for a leaf
+            uint16_t child_count;
+            uint8_t categories;
+        };
+
+        void ToLocal(double latitude, double longitude, double &x, double &y) const
+        {
+            x = (longitude - m_OriginLongitude) * m_MetresPerDegreeLongitude;
+            y = (latitude - m_OriginLatitude) * m_MetresPerDegreeLatitude;
+        }
+        struct View;
+        // The squared distance from the listener to the nearest point of the feature in view
+        double GetSquaredDistance(const View &view, uint32_t feature) const;
+
+        std::shared_ptr<const FeatureCollection> m_pFeatures;
+        double m_OriginLatitude = 0.0;
+        double m_OriginLongitude = 0.0;
+        double m_MetresPerDegreeLatitude = 0.0;
+        double m_MetresPerDegreeLongitude = 0.0;
+
+        // The leaves and then each level of nodes, ending with the root
+        std::vector<Entry> m_Entries;
+        size_t m_ItemCount = 0;
+    };
+
+} // soundscape
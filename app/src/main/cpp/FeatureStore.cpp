@@ -0,0 +1,231 @@
+#include <algorithm>
+
+#include "FeatureStore.h"
+
+using namespace soundscape;
+
+void FeatureStore::AddTile(const TileId &tile, std::shared_ptr<const FeatureCollection> features)
+{
+    // Build the index and road graph before taking the lock, so that tiles loaded in parallel
+    // are built in parallel too
+    auto bounds = tileToBoundingBox(tile.x, tile.y, tile.zoom);
+    auto graph = std::make_shared<const RoadGraph>(*features, bounds);
+    auto index = std::make_shared<const FeatureIndex>(std::move(features), bounds);
+    std::lock_guard<std::mutex> guard(m_Mutex);
+    m_Tiles[tile.GetKey()] = {tile, std::move(index), std::move(graph)};
+}
+
+bool FeatureStore::RemoveTile(const TileId &tile)
+{
+    std::lock_guard<std::mutex> guard(m_Mutex);
+    return m_Tiles.erase(tile.GetKey()) != 0;
+}
+
+std::shared_ptr<const FeatureCollection> FeatureStore::GetTile(const TileId &tile) const
+{
+    std::lock_guard<std::mutex> guard(m_Mutex);
+    auto it = m_Tiles.find(tile.GetKey());
+    if(it == m_Tiles.end())
+        return nullptr;
+    // The collection shares ownership with the index
+    return {it->second.index, &it->second.index->GetFeatures()};
+}
+
+std::shared_ptr<const FeatureIndex> FeatureStore::GetIndex(const TileId &tile) const
+{
+    std::lock_guard<std::mutex> guard(m_Mutex);
+    auto it = m_Tiles.find(tile.GetKey());
+    if(it == m_Tiles.end())
+        return nullptr;
+    return it->second.index;
+}
+
+std::shared_ptr<const RoadGraph> FeatureStore::GetRoadGraph(const TileId &tile) const
+{
+    std::lock_guard<std::mutex> guard(m_Mutex);
+    auto it = m_Tiles.find(tile.GetKey());
+    if(it == m_Tiles.end())
+        return nullptr;
+    return it->second.graph;
+}
+
+// Sort the features from all of the tiles nearest first, and move up to count of them into
+// unique. A line or polygon which crosses into more than one tile is in each of them, so it's
+// only taken from the tile in which it's nearest, going by its OSM id and category.
+static void MergeTileFeatures(std::vector<TileFeature> &merged, size_t count,
+                              std::vector<TileFeature> &unique)
+{
+    std::sort(merged.begin(), merged.end(), [](const TileFeature &a, const TileFeature &b) {
+        return a.distance < b.distance;
+    });
+
+    unique.clear();
+    std::unordered_map<int64_t, uint64_t> seen;
+    for(auto &feature: merged) {
+        if(unique.size() == count)
+            break;
+        const auto &collection = feature.index->GetFeatures();
+        const auto &details = collection.features[feature.feature];
+        if((details.osm_id_count != 0) && (details.geometry != GeometryType::Point) &&
+           (details.geometry != GeometryType::MultiPoint)) {
+            auto key = collection.osm_ids[details.first_osm_id] * 8 + static_cast<int64_t>(details.category);
+            auto tile = seen.emplace(key, feature.tile.GetKey()).first->second;
+            if(tile != feature.tile.GetKey())
+                continue;
+        }
+        unique.push_back(std::move(feature));
+    }
+}
+
+std::vector<FeatureStore::Tile> FeatureStore::GetTiles() const
+{
+    std::lock_guard<std::mutex> guard(m_Mutex);
+    std::vector<Tile> tiles;
+    tiles.reserve(m_Tiles.size());
+    for(const auto &tile: m_Tiles)
+        tiles.push_back(tile.second);
+    return tiles;
+}
+
+void FeatureStore::FindNearest(double latitude, double longitude, size_t count, uint32_t categories,
+                               std::vector<TileFeature> &nearest, double max_distance) const
+{
+    nearest.clear();
+    if(count == 0)
+        return;
+    auto tiles = GetTiles();
+
+    // Take the nearest features from every tile and merge them. If leaving out the duplicates
+    // leaves too few, and a tile might have more, go round again asking for more from each.
+    std::vector<NearestFeature> found;
+    std::vector<TileFeature> merged;
+    for(auto wanted = count; ; wanted *= 2) {
+        merged.clear();
+        auto more = false;
+        for(const auto &tile: tiles) {
+            tile.index->FindNearest(latitude, longitude, wanted, categories, found, max_distance);
+            more = more || (found.size() == wanted);
+            for(const auto &feature: found)
+                merged.push_back({tile.id, tile.index, feature.feature, feature.distance});
+        }
+        MergeTileFeatures(merged, count, nearest);
+        if(!more || (nearest.size() == count))
+            return;
+    }
+}
+
+void FeatureStore::FindInFieldOfView(double latitude, double longitude, double heading, double width,
+                                     double range, uint32_t categories,
+                                     std::vector<TileFeature> &features) const
+{
+    std::vector<NearestFeature> found;
+    std::vector<TileFeature> merged;
+    for(const auto &tile: GetTiles()) {
+        tile.index->FindInFieldOfView(latitude, longitude, heading, width, range, categories, found);
+        for(const auto &feature: found)
+            merged.push_back({tile.id, tile.index, feature.feature, feature.distance});
+    }
+    MergeTileFeatures(merged, merged.size(), features);
+}
+
+// How far apart the ends of a road at a tile edge can be in the two tiles, in metres. They're
+// worked out from the same segment and tile edge, so they're normally the same point.
+static const double BORDER_TOLERANCE = 0.5;
+// The most tiles a road is followed across, in case one goes back and forth along a tile edge
+static const int MAX_BORDER_CROSSINGS = 8;
+
+bool FeatureStore::GetIntersectionRoads(const TileId &tile, uint32_t feature,
+                                        std::vector<IntersectionRoad> &roads) const
+{
+    roads.clear();
+    auto tiles = GetTiles();
+    auto it = std::find_if(tiles.begin(), tiles.end(), [&](const Tile &loaded) {
+        return loaded.id == tile;
+    });
+    if(it == tiles.end())
+        return false;
+    const auto &graph = *it->graph;
+    auto node_index = graph.GetIntersectionNode(feature);
+    if(node_index == NO_ROAD_NODE)
+        return false;
+
+    const auto &node = graph.GetNodes()[node_index];
+    for(uint32_t leg_index = 0; leg_index < node.leg_count; ++leg_index) {
+        const auto &leg = graph.GetLegs()[node.first_leg + leg_index];
+        const auto &edge = graph.GetEdges()[leg.edge];
+
+        // Follow the road across tile edges until it reaches a node that's not on one
+        const auto *end_tile = &*it;
+        const auto *end_node = &graph.GetNodes()[leg.node];
+        auto length = edge.length;
+        for(int crossing = 0; (crossing < MAX_BORDER_CROSSINGS) &&
+                              (end_node->type == RoadNodeType::Border) && (edge.osm_id != 0); ++crossing) {
+            const Tile *next_tile = nullptr;
+            auto next_node = NO_ROAD_NODE;
+            for(const auto &other: tiles) {
+                if(&other == end_tile)
+                    continue;
+                next_node = other.graph->FindBorderNode(edge.osm_id, end_node->latitude,
+                                                        end_node->longitude, BORDER_TOLERANCE);
+                if(next_node != NO_ROAD_NODE) {
+                    next_tile = &other;
+                    break;
+                }
+            }
+            if(next_tile == nullptr)
+                break;
+
+            // The border node's edge in the next tile that's the same road
+            const auto &next_graph = *next_tile->graph;
+            const auto &border = next_graph.GetNodes()[next_node];
+            const RoadLeg *next_leg = nullptr;
+            for(uint32_t other_leg = 0; other_leg < border.leg_count; ++other_leg) {
+                const auto &candidate = next_graph.GetLegs()[border.first_leg + other_leg];
+                if(next_graph.GetEdges()[candidate.edge].osm_id == edge.osm_id) {
+                    next_leg = &candidate;
+                    break;
+                }
+            }
+            if(next_leg == nullptr)
+                break;
+            length += next_graph.GetEdges()[next_leg->edge].length;
+            end_tile = next_tile;
+            end_node = &next_graph.GetNodes()[next_leg->node];
+        }
+
+        IntersectionRoad road;
+        road.feature = edge.feature;
+        road.osm_id = edge.osm_id;
+        road.bearing = leg.bearing;
+        road.length = length;
+        road.end_latitude = end_node->latitude;
+        road.end_longitude = end_node->longitude;
+        road.end_type = end_node->type;
+        road.end_tile = end_tile->id;
+        road.end_feature = (end_node->type == RoadNodeType::Intersection) ? end_node->feature : UINT32_MAX;
+        roads.push_back(road);
+    }
+    return !roads.empty();
+}
+
+std::vector<TileId> FeatureStore::GetTileIds() const
+{
+    std::lock_guard<std::mutex> guard(m_Mutex);
+    std::vector<TileId> ids;
+    ids.reserve(m_Tiles.size());
+    for(const auto &tile: m_Tiles)
+        ids.push_back(tile.second.id);
+    return ids;
+}
+
+size_t FeatureStore::GetTileCount() const
+{
+    std::lock_guard<std::mutex> guard(m_Mutex);
+    return m_Tiles.size();
+}
+
+void FeatureStore::Clear()
+{
+    std::lock_guard<std::mutex> guard(m_Mutex);
+    m_Tiles.clear();
+}
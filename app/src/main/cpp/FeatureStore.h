@@ -0,0 +1,139 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+#include "FeatureIndex.h"
+#include "GeoJsonParser.h"
+#include "RoadGraph.h"
+
+namespace soundscape {
+
+    // A slippy map tile
+    struct TileId {
+        int x = 0;
+        int y = 0;
+        int zoom = 0;
+
+        bool operator==(const TileId &other) const
+        {
+            return (x == other.x) && (y == other.y) && (zoom == other.zoom);
+        }
+        // Unique for zoom levels up to 24
+        uint64_t GetKey() const
+        {
+            return (static_cast<uint64_t>(zoom) << 48) | (static_cast<uint64_t>(x) << 24) |
+                   static_cast<uint64_t>(y);
+        }
+
+        // The tile's quadkey, which has two bits for each zoom level that say which quarter of
+        // the tile above it is in, as a number with the zoom in the top byte. Tiles which are
+        // near each other mostly have quadkeys which are near each other too.
+        uint64_t GetQuadKey() const
+        {
+            uint64_t key = 0;
+            for(int level = zoom - 1; level >= 0; --level) {
+                key = (key << 2) | (static_cast<uint64_t>((y >> level) & 1) << 1) |
+                      static_cast<uint64_t>((x >> level) & 1);
+            }
+            return (static_cast<uint64_t>(zoom) << 56) | key;
+        }
+        static TileId FromQuadKey(uint64_t key)
+        {
+            TileId tile;
+            tile.zoom = static_cast<int>(key >> 56);
+            for(int level = tile.zoom - 1; level >= 0; --level) {
+                auto digit = (key >> (level * 2)) & 3;
+                tile.x = (tile.x << 1) | static_cast<int>(digit & 1);
+                tile.y = (tile.y << 1) | static_cast<int>(digit >> 1);
+            }
+            return tile;
+        }
+    };
+
+    // A feature found in one of the tiles of a FeatureStore
+    struct TileFeature {
+        TileId tile;
+        std::shared_ptr<const FeatureIndex> index;
+        uint32_t feature;
+        double distance;
+    };
+
+    // A road leaving an intersection, see FeatureStore::GetIntersectionRoads
+    struct IntersectionRoad {
+        // The road feature in the intersection's tile, and its OSM id
+        uint32_t feature;
+        int64_t osm_id;
+        // The direction in which it leaves the intersection, see RoadLeg
+        double bearing;
+        // The length in metres along it to the next node, which is in end_tile. The node's
+        // intersection feature is end_feature if it's an intersection. A Border node is where the
+        // road runs into a tile that isn't loaded.
+        double length;
+        double end_latitude;
+        double end_longitude;
+        RoadNodeType end_type;
+        TileId end_tile;
+        uint32_t end_feature;
+    };
+
+    //
+    // The features of the tiles that the engine has loaded, each clipped to its tile. A tile is
+    // added whole and can't be changed afterwards, so readers share it without copying and a
+    // tile that's looked up stays valid even if it's replaced or removed meanwhile. Each tile has
+    // a FeatureIndex and a RoadGraph, which are built when it's added, on the thread that adds it.
+    //
+    class FeatureStore {
+    public:
+        // Replaces the tile if it's already loaded
+        void AddTile(const TileId &tile, std::shared_ptr<const FeatureCollection> features);
+        bool RemoveTile(const TileId &tile);
+        // Returns null if the tile isn't loaded
+        std::shared_ptr<const FeatureCollection> GetTile(const TileId &tile) const;
+        std::shared_ptr<const FeatureIndex> GetIndex(const TileId &tile) const;
+        std::shared_ptr<const RoadGraph> GetRoadGraph(const TileId &tile) const;
+
+        // Replace the contents of nearest with up to count features in one of the categories,
+        // from any tile, nearest first. A line or polygon which crosses into more than one tile is
+        // in each of them, so one with the same OSM id and category as a nearer one in another
+        // tile is left out.
+        void FindNearest(double latitude, double longitude, size_t count, uint32_t categories,
+                         std::vector<TileFeature> &nearest,
+                         double max_distance = std::numeric_limits<double>::infinity()) const;
+        // Replace the contents of features with those in one of the categories in the listener's
+        // field of view, from any tile, nearest first, see FeatureIndex::FindInFieldOfView.
+        // Duplicates are left out as for FindNearest.
+        void FindInFieldOfView(double latitude, double longitude, double heading, double width,
+                               double range, uint32_t categories,
+                               std::vector<TileFeature> &features) const;
+
+        // Replace the contents of roads with the roads leaving an intersection feature of the
+        // tile, in order of their bearings. Each one is followed to the next node, carrying on
+        // into the next tile where it crosses the edge of this one, so that a road that's only
+        // split by the tile edges is one road. Returns false if the tile isn't loaded or the
+        // feature isn't an intersection on any roads.
+        bool GetIntersectionRoads(const TileId &tile, uint32_t feature,
+                                  std::vector<IntersectionRoad> &roads) const;
+
+        std::vector<TileId> GetTileIds() const;
+        size_t GetTileCount() const;
+        void Clear();
+
+    private:
+        struct Tile {
+            TileId id;
+            std::shared_ptr<const FeatureIndex> index;
+            std::shared_ptr<const RoadGraph> graph;
+        };
+
+        // A copy of the tiles, so that they can be queried without holding the lock
+        std::vector<Tile> GetTiles() const;
+
+        mutable std::mutex m_Mutex;
+        std::unordered_map<uint64_t, Tile> m_Tiles;
+    };
+
+} // soundscape
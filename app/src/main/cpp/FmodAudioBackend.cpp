@@ -0,0 +1,310 @@
+#include <cstring>
+#include <ctime>
+
+#include "FmodAudioBackend.h"
+#include "RealtimeCheck.h"
+#include "Trace.h"
+
+using namespace soundscape;
+
+static FMOD_VECTOR ToFmodVector(const AudioVector &vector)
+{
+    return {vector.x, vector.y, vector.z};
+}
+
+namespace {
+
+    class FmodAudioChannel : public IAudioChannel {
+    public:
+        FmodAudioChannel(FMOD::Sound *sound, FMOD::Channel *channel)
+            : m_pSound(sound),
+              m_pChannel(channel)
+        {
+        }
+
+        ~FmodAudioChannel() override
+        {
+            // Releasing the sound stops the channel that's playing it
+            auto result = m_pSound->release();
+            ERROR_CHECK(result);
+        }
+
+        void SetPosition(const AudioVector &position) override
+        {
+            FMOD_VECTOR pos = ToFmodVector(position);
+            FMOD_VECTOR vel = {0.0f, 0.0f, 0.0f};
+
+            auto result = m_pChannel->set3DAttributes(&pos, &vel);
+            ERROR_CHECK(result);
+        }
+
+    private:
+        FMOD::Sound *m_pSound;
+        FMOD::Channel *m_pChannel;
+    };
+}
+
+// FMOD allocates from this fixed pool rather than the heap, so that the mixer thread never calls
+// malloc and FMOD's memory use can't grow without bound. It has plenty of room for the 32 channels
+// that the system is initialized with, and its high water mark is in the engine's memory stats.
+static const int FMOD_POOL_SIZE = 16 * 1024 * 1024;
+alignas(16) static char s_FmodPool[FMOD_POOL_SIZE];
+
+static bool InitializeFmodMemory()
+{
+    // This has to happen once, before the first FMOD system is created
+    static const FMOD_RESULT result = FMOD::Memory_Initialize(s_FmodPool, FMOD_POOL_SIZE,
+                                                              nullptr, nullptr, nullptr);
+    ERROR_CHECK(result);
+    return result == FMOD_OK;
+}
+
+#if 0
+    static FMOD_RESULT F_CALLBACK LoggingCallback(FMOD_DEBUG_FLAGS flags,
+                                                  const char *file,
+                                                  int line,
+                                                  const char *func,
+                                                  const char *message)
+    {
+        TRACE("%d of %s: %s", line, file, message);
+        return FMOD_OK;
+    }
+#endif
+
+FmodAudioBackend::FmodAudioBackend() noexcept
+{
+    FMOD_RESULT result;
+
+    InitializeFmodMemory();
+
+    // Create a System object and initialize
+    FMOD::System *system;
+    FMOD::System_Create(&system);
+    m_pSystem = system;
+
+    result = m_pSystem->setSoftwareFormat(22050, FMOD_SPEAKERMODE_SURROUND, 0);
+    ERROR_CHECK(result);
+
+    result = m_pSystem->init(32, FMOD_INIT_NORMAL, nullptr);
+    ERROR_CHECK(result);
+
+    // Positions are passed to FMOD in metres
+    result = m_pSystem->set3DSettings(1.0, 1.0f, 1.0f);
+    ERROR_CHECK(result);
+
+    // The mixer writes ahead into a ring of DSP buffers
+    unsigned int buffer_length;
+    int buffer_count;
+    int sample_rate;
+    if((m_pSystem->getDSPBufferSize(&buffer_length, &buffer_count) == FMOD_OK) &&
+       (m_pSystem->getSoftwareFormat(&sample_rate, nullptr, nullptr) == FMOD_OK) &&
+       (sample_rate > 0)) {
+        m_OutputLatency = static_cast<uint64_t>(buffer_length) * buffer_count * 1000000000ULL / sample_rate;
+    }
+#if 0
+    int numdrivers = 0;
+    result = m_pSystem->getNumDrivers(&numdrivers);
+    ERROR_CHECK(result);
+    for(int id = 0; id < numdrivers; ++id) {
+        char name[256];
+        FMOD_GUID guid;
+        int systemrate;
+        FMOD_SPEAKERMODE speakermode;
+        int speakermodechannels;
+
+        result = m_pSystem->getDriverInfo(id,
+                name,
+                sizeof(name),
+                &guid,
+                &systemrate,
+                &speakermode,
+                &speakermodechannels);
+        ERROR_CHECK(result);
+
+        TRACE("Audio driver: %s  %d %d %d", name, systemrate, speakermode, speakermodechannels);
+    }
+#endif
+}
+
+FmodAudioBackend::~FmodAudioBackend()
+{
+    TRACE("System release");
+    auto result = m_pSystem->release();
+    ERROR_CHECK(result);
+    m_pSystem = nullptr;
+}
+
+bool FmodAudioBackend::LoadPcm(const std::string &filename, std::vector<uint8_t> &pcm)
+{
+    FMOD::Sound* sound;
+
+    auto result = m_pSystem->createSound(filename.c_str(), FMOD_DEFAULT | FMOD_OPENONLY, nullptr, &sound);
+    ERROR_CHECK(result);
+    if(result != FMOD_OK)
+        return false;
+
+    unsigned int length;
+    result = sound->getLength(&length, FMOD_TIMEUNIT_RAWBYTES);
+    ERROR_CHECK(result);
+
+    pcm.resize(length);
+
+    unsigned int bytes_read;
+    result = sound->readData(pcm.data(), length, &bytes_read);
+    ERROR_CHECK(result);
+
+    result = sound->release();
+    ERROR_CHECK(result);
+
+    return true;
+}
+
+std::unique_ptr<IAudioChannel> FmodAudioBackend::PlayStream(AudioStream *stream,
+                                                            const AudioVector &position)
+{
+    auto format = stream->GetStreamFormat();
+
+    FMOD_CREATESOUNDEXINFO extra_info;
+    memset(&extra_info, 0, sizeof(FMOD_CREATESOUNDEXINFO));
+    extra_info.cbsize = sizeof(FMOD_CREATESOUNDEXINFO);  /* Required. */
+    extra_info.numchannels = 1;
+    extra_info.defaultfrequency = format.sample_rate;
+    extra_info.length = format.length;                              /* Length of PCM data in bytes of whole song (for Sound::getLength) */
+    extra_info.decodebuffersize = format.decode_buffer_size;        /* Chunk size of stream update in samples. This will be the amount of data passed to the user callback. */
+    extra_info.format = FMOD_SOUND_FORMAT_PCM16;                    /* Data format of sound. */
+    extra_info.pcmreadcallback = StaticPcmReadCallback;             /* User callback for reading. */
+    extra_info.userdata = stream;
+
+    FMOD::Sound *sound;
+    auto result = m_pSystem->createSound(nullptr,
+                                         FMOD_OPENUSER | (format.loop ? FMOD_LOOP_NORMAL : FMOD_LOOP_OFF) |
+                                         FMOD_3D | FMOD_CREATESTREAM,
+                                         &extra_info,
+                                         &sound);
+    ERROR_CHECK(result);
+    if(result != FMOD_OK)
+        return nullptr;
+
+    result = sound->set3DMinMaxDistance(format.min_distance, format.max_distance);
+    ERROR_CHECK(result);
+
+    // Start paused so that the position is set before any audio is heard
+    FMOD::Channel *channel;
+    result = m_pSystem->playSound(sound, nullptr, true, &channel);
+    ERROR_CHECK(result);
+
+    auto fmod_channel = std::make_unique<FmodAudioChannel>(sound, channel);
+    fmod_channel->SetPosition(position);
+
+    result = channel->setPaused(false);
+    ERROR_CHECK(result);
+
+    return fmod_channel;
+}
+
+void FmodAudioBackend::SetListener(const AudioVector &position, const AudioVector &velocity,
+                                   const AudioVector &forward, const AudioVector &up)
+{
+    FMOD_VECTOR pos = ToFmodVector(position);
+    FMOD_VECTOR vel = ToFmodVector(velocity);
+    FMOD_VECTOR fwd = ToFmodVector(forward);
+    FMOD_VECTOR u = ToFmodVector(up);
+
+    auto result = m_pSystem->set3DListenerAttributes(0, &pos, &vel, &fwd, &u);
+    ERROR_CHECK(result);
+}
+
+void FmodAudioBackend::Update()
+{
+    TRACE_SCOPE("FmodUpdate");
+    auto result = m_pSystem->update();
+    ERROR_CHECK(result);
+}
+
+bool FmodAudioBackend::GetCpuUsage(float &dsp, float &stream)
+{
+    // The stream callbacks run on FMOD's stream thread, so they're in the stream usage
+    FMOD_CPU_USAGE usage;
+    auto result = m_pSystem->getCPUUsage(&usage);
+    ERROR_CHECK(result);
+    if(result != FMOD_OK)
+        return false;
+
+    dsp = usage.dsp;
+    stream = usage.stream;
+    return true;
+}
+
+uint64_t FmodAudioBackend::GetTime()
+{
+    timespec now{};
+    clock_gettime(CLOCK_BOOTTIME, &now);
+    return static_cast<uint64_t>(now.tv_sec) * 1000000000ULL + static_cast<uint64_t>(now.tv_nsec);
+}
+
+uint64_t FmodAudioBackend::GetOutputTime(const AudioStreamFormat *format)
+{
+    // A stream is double buffered, so what's read now is played after the block before it
+    uint64_t stream_latency = 0;
+    if(format && (format->sample_rate > 0))
+        stream_latency = static_cast<uint64_t>(format->decode_buffer_size) * 1000000000ULL / format->sample_rate;
+    return GetTime() + m_OutputLatency + stream_latency;
+}
+
+void FmodAudioBackend::SetMixCallback(MixCallback callback, void *context)
+{
+    // The members are only read by the system callback, so they're set while it's not registered
+    auto result = m_pSystem->setCallback(nullptr, FMOD_SYSTEM_CALLBACK_PREMIX);
+    ERROR_CHECK(result);
+    m_MixCallback = callback;
+    m_pMixContext = context;
+    if(!callback)
+        return;
+
+    result = m_pSystem->setUserData(this);
+    ERROR_CHECK(result);
+    result = m_pSystem->setCallback(&FmodAudioBackend::StaticSystemCallback, FMOD_SYSTEM_CALLBACK_PREMIX);
+    ERROR_CHECK(result);
+}
+
+bool FmodAudioBackend::GetMemoryUsage(size_t &pool, size_t &used, size_t &high_water)
+{
+    if(!InitializeFmodMemory())
+        return false;
+
+    int current, max;
+    auto result = FMOD::Memory_GetStats(&current, &max, false);
+    ERROR_CHECK(result);
+    if(result != FMOD_OK)
+        return false;
+
+    pool = FMOD_POOL_SIZE;
+    used = static_cast<size_t>(current);
+    high_water = static_cast<size_t>(max);
+    return true;
+}
+
+FMOD_RESULT F_CALLBACK FmodAudioBackend::StaticPcmReadCallback(FMOD_SOUND* sound, void *data, unsigned int data_length) {
+    AudioStream *stream;
+    ((FMOD::Sound*)sound)->getUserData((void **)&stream);
+    REALTIME_SCOPE();
+    stream->PcmReadCallback(data, data_length);
+
+    return FMOD_OK;
+}
+
+FMOD_RESULT F_CALLBACK FmodAudioBackend::StaticSystemCallback(FMOD_SYSTEM *system MAYBE_UNUSED,
+                                                              FMOD_SYSTEM_CALLBACK_TYPE type,
+                                                              void *data1 MAYBE_UNUSED,
+                                                              void *data2 MAYBE_UNUSED,
+                                                              void *user_data)
+{
+    // The premix callback is made on the mixer thread before each block is mixed, with the
+    // listener attributes from the last System::update already applied
+    auto backend = static_cast<FmodAudioBackend *>(user_data);
+    if((type == FMOD_SYSTEM_CALLBACK_PREMIX) && backend && backend->m_MixCallback) {
+        REALTIME_SCOPE();
+        backend->m_MixCallback(backend->m_pMixContext);
+    }
+    return FMOD_OK;
+}
@@ -0,0 +1,40 @@
+#pragma once
+
+#include "fmod.hpp"
+#include "fmod.h"
+#include "AudioBackend.h"
+
+namespace soundscape {
+
+    class FmodAudioBackend : public IAudioBackend {
+    public:
+        FmodAudioBackend() noexcept;
+        ~FmodAudioBackend() override;
+
+        bool LoadPcm(const std::string &filename, std::vector<uint8_t> &pcm) override;
+        std::unique_ptr<IAudioChannel> PlayStream(AudioStream *stream,
+                                                  const AudioVector &position) override;
+        void SetListener(const AudioVector &position, const AudioVector &velocity,
+                         const AudioVector &forward, const AudioVector &up) override;
+        void Update() override;
+        bool GetCpuUsage(float &dsp, float &stream) override;
+        uint64_t GetTime() override;
+        uint64_t GetOutputTime(const AudioStreamFormat *format) override;
+        void SetMixCallback(MixCallback callback, void *context) override;
+        bool GetMemoryUsage(size_t &pool, size_t &used, size_t &high_water) override;
+
+    private:
+        static FMOD_RESULT F_CALLBACK
+        StaticPcmReadCallback(FMOD_SOUND *sound, void *data, unsigned int data_length);
+        static FMOD_RESULT F_CALLBACK
+        StaticSystemCallback(FMOD_SYSTEM *system, FMOD_SYSTEM_CALLBACK_TYPE type,
+                             void *data1, void *data2, void *user_data);
+
+        FMOD::System * m_pSystem = nullptr;
+        // Time from audio being mixed to it being heard
+        uint64_t m_OutputLatency = 0;
+        MixCallback m_MixCallback = nullptr;
+        void *m_pMixContext = nullptr;
+    };
+
+} // soundscape
@@ -0,0 +1,244 @@
+#include <algorithm>
+#include <cmath>
+
+#include "GeoBatch.h"
+#include "GeoUtils.h"
+
+using namespace soundscape;
+
+// The kernel helpers are forced inline so that they pick up the instruction set of the kernel
+// they're called from, and so that the loops they're in can be vectorized.
+#define ALWAYS_INLINE inline __attribute__((always_inline))
+
+namespace {
+
+    // sin and cos for |x| <= pi/2. These are the Taylor series truncated where the error over
+    // that range drops below float precision.
+    ALWAYS_INLINE float Sin(float x)
+    {
+        float x2 = x * x;
+        return x * (1.0f + x2 * (-1.0f / 6.0f + x2 * (1.0f / 120.0f + x2 * (-1.0f / 5040.0f +
+                    x2 * (1.0f / 362880.0f + x2 * (-1.0f / 39916800.0f))))));
+    }
+
+    ALWAYS_INLINE float Cos(float x)
+    {
+        float x2 = x * x;
+        return 1.0f + x2 * (-1.0f / 2.0f + x2 * (1.0f / 24.0f + x2 * (-1.0f / 720.0f +
+                     x2 * (1.0f / 40320.0f + x2 * (-1.0f / 3628800.0f + x2 * (1.0f / 479001600.0f))))));
+    }
+
+    // Branch free atan2. The ratio of the smaller to the larger argument is reduced to at most
+    // tan(pi/8) and the Cephes atanf polynomial used on that.
+    ALWAYS_INLINE float Atan2(float y, float x)
+    {
+        const auto PI = static_cast<float>(M_PI);
+        float abs_x = std::fabs(x);
+        float abs_y = std::fabs(y);
+        float larger = std::max(abs_x, abs_y);
+        float smaller = std::min(abs_x, abs_y);
+        float t = smaller / (larger > 0.0f ? larger : 1.0f);
+
+        bool reduced = t > 0.41421356f;
+        float u = reduced ? (t - 1.0f) / (t + 1.0f) : t;
+        float z = u * u;
+        float angle = (((8.05374449538e-2f * z - 1.38776856032e-1f) * z + 1.99777106478e-1f) * z
+                       - 3.33329491539e-1f) * z * u + u;
+        angle = reduced ? angle + (PI / 4.0f) : angle;
+
+        angle = (abs_y > abs_x) ? (PI / 2.0f) - angle : angle;
+        angle = (x < 0.0f) ? PI - angle : angle;
+        return (y < 0.0f) ? -angle : angle;
+    }
+
+    enum class Formula {
+        Equirectangular,
+        Haversine
+    };
+
+    //
+    // The trig is all done on half the latitude and longitude differences, which are always within
+    // +/-pi/2 so no further range reduction is needed. The bearing is calculated as
+    //
+    //   atan2(sin(dlon).cos(lat2), sin(dlat) + 2.sin(lat1).cos(lat2).sin^2(dlon/2))
+    //
+    // which is the usual spherical formula rearranged so that it doesn't suffer from cancellation
+    // when the source is close to the listener.
+    //
+    template<Formula formula>
+    ALWAYS_INLINE void Kernel(double listener_latitude, double listener_longitude,
+                              const double *latitudes, const double *longitudes, size_t count,
+                              float *bearings, float *distances)
+    {
+        const auto listener_latitude_radians = toRadians(listener_latitude);
+        const auto sin_lat1 = static_cast<float>(sin(listener_latitude_radians));
+        const auto cos_lat1 = static_cast<float>(cos(listener_latitude_radians));
+        const auto radius = static_cast<float>(EARTH_RADIUS_METERS);
+        const auto to_degrees = static_cast<float>(RADIANS_TO_DEGREES);
+        const double half_to_radians = DEGREES_TO_RADIANS / 2.0;
+
+#pragma omp simd
+        for(size_t i = 0; i < count; ++i) {
+            double dlon = longitudes[i] - listener_longitude;
+            dlon = (dlon > 180.0) ? dlon - 360.0 : dlon;
+            dlon = (dlon < -180.0) ? dlon + 360.0 : dlon;
+            auto half_dlat = static_cast<float>((latitudes[i] - listener_latitude) * half_to_radians);
+            auto half_dlon = static_cast<float>(dlon * half_to_radians);
+
+            float sin_half_dlat = Sin(half_dlat);
+            float cos_half_dlat = Cos(half_dlat);
+
+            if constexpr (formula == Formula::Equirectangular) {
+                // Flat earth using the latitude midway between the listener and the source. The
+                // direction of that line is corrected to the initial great circle bearing using
+                // the convergence of the meridians.
+                float cos_mid = cos_lat1 * cos_half_dlat - sin_lat1 * sin_half_dlat;
+                float sin_mid = sin_lat1 * cos_half_dlat + cos_lat1 * sin_half_dlat;
+                float x = 2.0f * half_dlon * cos_mid;
+                float y = 2.0f * half_dlat;
+
+                distances[i] = radius * std::sqrt(x * x + y * y);
+                bearings[i] = (Atan2(x, y) - half_dlon * sin_mid) * to_degrees;
+            } else {
+                float sin_half_dlon = Sin(half_dlon);
+                float cos_half_dlon = Cos(half_dlon);
+                float sin_dlat = 2.0f * sin_half_dlat * cos_half_dlat;
+                float cos_dlat = 1.0f - 2.0f * sin_half_dlat * sin_half_dlat;
+                float sin_dlon = 2.0f * sin_half_dlon * cos_half_dlon;
+                float cos_lat2 = cos_lat1 * cos_dlat - sin_lat1 * sin_dlat;
+                float haversine_dlon = sin_half_dlon * sin_half_dlon;
+
+                float a = sin_half_dlat * sin_half_dlat + cos_lat1 * cos_lat2 * haversine_dlon;
+                a = std::min(std::max(a, 0.0f), 1.0f);
+                distances[i] = 2.0f * radius * Atan2(std::sqrt(a), std::sqrt(1.0f - a));
+
+                float y = sin_dlon * cos_lat2;
+                float x = sin_dlat + 2.0f * sin_lat1 * cos_lat2 * haversine_dlon;
+                bearings[i] = Atan2(y, x) * to_degrees;
+            }
+        }
+    }
+
+    // Returns true if all of the sources are close enough for the equirectangular approximation
+    ALWAYS_INLINE bool AllSourcesNearby(double listener_latitude, double listener_longitude,
+                                        const double *latitudes, const double *longitudes,
+                                        size_t count)
+    {
+        // Compare in degrees of latitude, allowing for the narrowing of longitude with latitude.
+        // Using the cos of the listener latitude is close enough for this test.
+        const double max_degrees = EQUIRECTANGULAR_MAX_DISTANCE /
+                                   (EARTH_RADIUS_METERS * DEGREES_TO_RADIANS);
+        const double cos_lat1 = cos(toRadians(listener_latitude));
+
+        double furthest = 0.0;
+#pragma omp simd reduction(max:furthest)
+        for(size_t i = 0; i < count; ++i) {
+            double dlon = std::fabs(longitudes[i] - listener_longitude);
+            dlon = (dlon > 180.0) ? 360.0 - dlon : dlon;
+            double dlat = latitudes[i] - listener_latitude;
+            double dx = dlon * cos_lat1;
+            furthest = std::max(furthest, dlat * dlat + dx * dx);
+        }
+        return furthest <= (max_degrees * max_degrees);
+    }
+
+    ALWAYS_INLINE void Batch(double listener_latitude, double listener_longitude,
+                             const double *latitudes, const double *longitudes, size_t count,
+                             float *bearings, float *distances)
+    {
+        if(AllSourcesNearby(listener_latitude, listener_longitude, latitudes, longitudes, count))
+            Kernel<Formula::Equirectangular>(listener_latitude, listener_longitude,
+                                             latitudes, longitudes, count, bearings, distances);
+        else
+            Kernel<Formula::Haversine>(listener_latitude, listener_longitude,
+                                       latitudes, longitudes, count, bearings, distances);
+    }
+
+    void GenericBatch(double listener_latitude, double listener_longitude,
+                      const double *latitudes, const double *longitudes, size_t count,
+                      float *bearings, float *distances)
+    {
+        Batch(listener_latitude, listener_longitude, latitudes, longitudes, count,
+              bearings, distances);
+    }
+
+#if defined(__x86_64__) || defined(__i386__)
+    __attribute__((target("avx2,fma")))
+    void Avx2Batch(double listener_latitude, double listener_longitude,
+                   const double *latitudes, const double *longitudes, size_t count,
+                   float *bearings, float *distances)
+    {
+        Batch(listener_latitude, listener_longitude, latitudes, longitudes, count,
+              bearings, distances);
+    }
+#endif
+}
+
+GeoBatchKernel soundscape::GetBestGeoBatchKernel()
+{
+#if defined(__x86_64__) || defined(__i386__)
+    static const bool has_avx2 = __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma");
+    if(has_avx2)
+        return GeoBatchKernel::Avx2;
+#endif
+    return GeoBatchKernel::Generic;
+}
+
+const char *soundscape::GetGeoBatchKernelName(GeoBatchKernel kernel)
+{
+    switch(kernel) {
+        case GeoBatchKernel::Generic:   return "generic";
+        case GeoBatchKernel::Avx2:      return "avx2";
+    }
+    return "unknown";
+}
+
+void soundscape::BatchBearingAndDistance(double listener_latitude, double listener_longitude,
+                                         const double *latitudes, const double *longitudes,
+                                         size_t count,
+                                         float *bearings, float *distances)
+{
+    BatchBearingAndDistance(GetBestGeoBatchKernel(), listener_latitude, listener_longitude,
+                            latitudes, longitudes, count, bearings, distances);
+}
+
+void soundscape::BatchBearingAndDistance(GeoBatchKernel kernel,
+                                         double listener_latitude, double listener_longitude,
+                                         const double *latitudes, const double *longitudes,
+                                         size_t count,
+                                         float *bearings, float *distances)
+{
+#if defined(__x86_64__) || defined(__i386__)
+    if(kernel == GeoBatchKernel::Avx2) {
+        Avx2Batch(listener_latitude, listener_longitude, latitudes, longitudes, count,
+                  bearings, distances);
+        return;
+    }
+#endif
+    GenericBatch(listener_latitude, listener_longitude, latitudes, longitudes, count,
+                 bearings, distances);
+}
+
+size_t soundscape::BatchFindInBox(const double *latitudes, const double *longitudes, size_t count,
+                                  double south, double west, double north, double east)
+{
+    // Small enough that the short circuit helps on the short lines of most features
+    const size_t BLOCK_SIZE = 16;
+    for(size_t start = 0; start < count; start += BLOCK_SIZE) {
+        auto end = std::min(start + BLOCK_SIZE, count);
+        int inside = 0;
+#pragma omp simd reduction(|:inside)
+        for(size_t i = start; i < end; ++i) {
+            inside |= (latitudes[i] >= south) & (latitudes[i] <= north) &
+                      (longitudes[i] >= west) & (longitudes[i] <= east);
+        }
+        if(inside) {
+            for(size_t i = start; i < end; ++i) {
+                if((latitudes[i] >= south) && (latitudes[i] <= north) &&
+                   (longitudes[i] >= west) && (longitudes[i] <= east))
+                    return i;
+            }
+        }
+    }
+    return count;
+}
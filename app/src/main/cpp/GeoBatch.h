@@ -0,0 +1,54 @@
+#pragma once
+
+#include <cstddef>
+
+namespace soundscape {
+
+    //
+    // Bearing and distance from the listener to a batch of sources whose positions are held as
+    // separate latitude and longitude arrays. The sources are processed several at a time using
+    // SIMD, with polynomial approximations for the trig functions. On x86-64 an AVX2 kernel is
+    // selected at runtime if the CPU supports it, otherwise the generic kernel is used, which is
+    // vectorized with SSE2 on x86-64 and with NEON on arm64.
+    //
+    // Bearings are in degrees from the listener to the source in the range -180 to 180, and
+    // distances are in metres. Differences from the listener are taken in double precision and
+    // the rest of the calculation is in float. When every source is within
+    // EQUIRECTANGULAR_MAX_DISTANCE of the listener an equirectangular approximation is used,
+    // otherwise the haversine formula is used.
+    //
+    // Compared with the double precision haversine formulas in GeoUtils.h, the errors are checked
+    // by GeoBatchTest to be within:
+    //
+    //   distance: 1mm + 10 parts per million
+    //   bearing:  0.01 degrees, for sources more than 1m from the listener
+    //
+    const double EQUIRECTANGULAR_MAX_DISTANCE = 5000.0;
+
+    enum class GeoBatchKernel {
+        Generic,
+        Avx2,
+    };
+
+    GeoBatchKernel GetBestGeoBatchKernel();
+    const char *GetGeoBatchKernelName(GeoBatchKernel kernel);
+
+    void BatchBearingAndDistance(double listener_latitude, double listener_longitude,
+                                 const double *latitudes, const double *longitudes, size_t count,
+                                 float *bearings, float *distances);
+
+    // As above, but using a specific kernel. This is for tests and benchmarks, the kernel must be
+    // supported by the CPU.
+    void BatchBearingAndDistance(GeoBatchKernel kernel,
+                                 double listener_latitude, double listener_longitude,
+                                 const double *latitudes, const double *longitudes, size_t count,
+                                 float *bearings, float *distances);
+
+    // The index of the first of a batch of points which is inside the box, edges included, or
+    // count if none of them are. The points are compared a block at a time with vector compares,
+    // stopping at the first block that has a point inside, so finding one near the start of a
+    // long line is cheap.
+    size_t BatchFindInBox(const double *latitudes, const double *longitudes, size_t count,
+                          double south, double west, double north, double east);
+
+} // soundscape
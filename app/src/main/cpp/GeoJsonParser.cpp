@@ -0,0 +1,791 @@
+#include <cstdlib>
+#include <cstring>
+#include <locale.h>
+
+#include "GeoJsonParser.h"
+#include "Trace.h"
+
+using namespace soundscape;
+
+// Objects and arrays in skipped values and properties can't be nested deeper than this
+static const int MAX_DEPTH = 64;
+// A MultiPolygon's coordinates are the most deeply nested
+static const uint32_t MAX_COORDINATE_DEPTH = 4;
+
+std::string_view FeatureCollection::GetProperty(const Feature &feature, std::string_view key) const
+{
+    for(uint32_t index = 0; index < feature.property_count; ++index) {
+        const auto &property = properties[feature.first_property + index];
+        if(GetString(property.key) == key)
+            return GetString(property.value);
+    }
+    return {};
+}
+
+void FeatureCollection::Clear()
+{
+    features.clear();
+    parts.clear();
+    longitudes.clear();
+    latitudes.clear();
+    properties.clear();
+    osm_ids.clear();
+    strings.clear();
+}
+
+static bool IsDigit(char c)
+{
+    return (c >= '0') && (c <= '9');
+}
+
+static int HexValue(char c)
+{
+    if(IsDigit(c))
+        return c - '0';
+    if((c >= 'a') && (c <= 'f'))
+        return c - 'a' + 10;
+    if((c >= 'A') && (c <= 'F'))
+        return c - 'A' + 10;
+    return -1;
+}
+
+static void AppendUtf8(std::string &text, uint32_t code_point)
+{
+    if(code_point < 0x80) {
+        text += static_cast<char>(code_point);
+    } else if(code_point < 0x800) {
+        text += static_cast<char>(0xc0 | (code_point >> 6));
+        text += static_cast<char>(0x80 | (code_point & 0x3f));
+    } else if(code_point < 0x10000) {
+        text += static_cast<char>(0xe0 | (code_point >> 12));
+        text += static_cast<char>(0x80 | ((code_point >> 6) & 0x3f));
+        text += static_cast<char>(0x80 | (code_point & 0x3f));
+    } else {
+        text += static_cast<char>(0xf0 | (code_point >> 18));
+        text += static_cast<char>(0x80 | ((code_point >> 12) & 0x3f));
+        text += static_cast<char>(0x80 | ((code_point >> 6) & 0x3f));
+        text += static_cast<char>(0x80 | (code_point & 0x3f));
+    }
+}
+
+static StringRef AppendString(std::string &strings, const char *text, size_t length)
+{
+    StringRef string{static_cast<uint32_t>(strings.size()), static_cast<uint32_t>(length)};
+    strings.append(text, length);
+    return string;
+}
+
+bool GeoJsonParser::Fail(const char *message)
+{
+    if(m_Error.empty()) {
+        m_Error = message;
+        m_Error += " at offset ";
+        m_Error += std::to_string(m_pPos - m_pStart);
+    }
+    return false;
+}
+
+void GeoJsonParser::SkipWhitespace()
+{
+    while((m_pPos < m_pEnd) &&
+          ((*m_pPos == ' ') || (*m_pPos == '\n') || (*m_pPos == '\r') || (*m_pPos == '\t')))
+        ++m_pPos;
+}
+
+bool GeoJsonParser::SkipComma()
+{
+    SkipWhitespace();
+    if((m_pPos < m_pEnd) && (*m_pPos == ',')) {
+        ++m_pPos;
+        return true;
+    }
+    return false;
+}
+
+bool GeoJsonParser::Expect(char c)
+{
+    SkipWhitespace();
+    if((m_pPos == m_pEnd) || (*m_pPos != c)) {
+        static const char *messages[] = {"Expected '{'", "Expected '}'", "Expected '['", "Expected ']'",
+                                         "Expected ':'", "Expected ','", "Expected '\"'"};
+        static const char expected[] = "{}[]:,\"";
+        return Fail(messages[strchr(expected, c) - expected]);
+    }
+    ++m_pPos;
+    return true;
+}
+
+bool GeoJsonParser::ParseString(StringRef &string)
+{
+    if(!Expect('"'))
+        return false;
+
+    auto &strings = m_pFeatures->strings;
+    string.offset = static_cast<uint32_t>(strings.size());
+    while(true) {
+        // Copy the run of characters up to the next quote or escape in one go
+        auto run = m_pPos;
+        while((m_pPos < m_pEnd) && (*m_pPos != '"') && (*m_pPos != '\\')) {
+            if(static_cast<unsigned char>(*m_pPos) < 0x20)
+                return Fail("Control character in string");
+            ++m_pPos;
+        }
+        strings.append(run, m_pPos - run);
+        if(m_pPos == m_pEnd)
+            return Fail("Unterminated string");
+        if(*m_pPos++ == '"')
+            break;
+
+        if(m_pPos == m_pEnd)
+            return Fail("Unterminated string");
+        switch(*m_pPos++) {
+            case '"': strings += '"'; break;
+            case '\\': strings += '\\'; break;
+            case '/': strings += '/'; break;
+            case 'b': strings += '\b'; break;
+            case 'f': strings += '\f'; break;
+            case 'n': strings += '\n'; break;
+            case 'r': strings += '\r'; break;
+            case 't': strings += '\t'; break;
+            case 'u': {
+                auto parse_hex = [this](uint32_t &value) {
+                    if(m_pEnd - m_pPos < 4)
+                        return false;
+                    value = 0;
+                    for(int digit = 0; digit < 4; ++digit) {
+                        auto hex = HexValue(*m_pPos++);
+                        if(hex < 0)
+                            return false;
+                        value = (value << 4) | static_cast<uint32_t>(hex);
+                    }
+                    return true;
+                };
+                uint32_t code_point;
+                if(!parse_hex(code_point))
+                    return Fail("Invalid unicode escape");
+                // A character outside the basic multilingual plane is escaped as a surrogate pair
+                if((code_point >= 0xd800) && (code_point < 0xdc00) &&
+                   (m_pEnd - m_pPos >= 2) && (m_pPos[0] == '\\') && (m_pPos[1] == 'u')) {
+                    m_pPos += 2;
+                    uint32_t low;
+                    if(!parse_hex(low) || (low < 0xdc00) || (low >= 0xe000))
+                        return Fail("Invalid surrogate pair");
+                    code_point = 0x10000 + ((code_point - 0xd800) << 10) + (low - 0xdc00);
+                }
+                AppendUtf8(strings, code_point);
+                break;
+            }
+            default:
+                return Fail("Invalid escape");
+        }
+    }
+    string.length = static_cast<uint32_t>(strings.size() - string.offset);
+    return true;
+}
+
+bool GeoJsonParser::ParseKey(std::string_view &key)
+{
+    if(!Expect('"'))
+        return false;
+
+    // Keys rarely have escapes, so they're compared in place when they don't
+    auto start = m_pPos;
+    while((m_pPos < m_pEnd) && (*m_pPos != '"') && (*m_pPos != '\\'))
+        ++m_pPos;
+    if((m_pPos < m_pEnd) && (*m_pPos == '"')) {
+        key = std::string_view(start, m_pPos - start);
+        ++m_pPos;
+    } else {
+        // Unescape it at the end of the strings, and then take it off again
+        m_pPos = start - 1;
+        StringRef string;
+        if(!ParseString(string))
+            return false;
+        m_Key.assign(m_pFeatures->strings, string.offset, string.length);
+        m_pFeatures->strings.resize(string.offset);
+        key = m_Key;
+    }
+    return Expect(':');
+}
+
+bool GeoJsonParser::ParseNumber(double &value)
+{
+    // Exact powers of ten which are all that's needed for the fast path
+    static const double POWERS_OF_TEN[] = {
+        1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+        1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+    };
+
+    SkipWhitespace();
+    auto start = m_pPos;
+    bool negative = (m_pPos < m_pEnd) && (*m_pPos == '-');
+    if(negative)
+        ++m_pPos;
+
+    // Read up to 19 significant digits into an integer
+    uint64_t mantissa = 0;
+    int digits = 0;
+    int exponent = 0;
+    if((m_pPos == m_pEnd) || !IsDigit(*m_pPos))
+        return Fail("Expected a number");
+    if(*m_pPos == '0') {
+        ++m_pPos;
+    } else {
+        while((m_pPos < m_pEnd) && IsDigit(*m_pPos)) {
+            if(digits < 19) {
+                mantissa = (mantissa * 10) + static_cast<uint64_t>(*m_pPos - '0');
+                ++digits;
+            } else {
+                ++exponent;
+            }
+            ++m_pPos;
+        }
+    }
+    if((m_pPos < m_pEnd) && (*m_pPos == '.')) {
+        ++m_pPos;
+        if((m_pPos == m_pEnd) || !IsDigit(*m_pPos))
+            return Fail("Expected a digit");
+        while((m_pPos < m_pEnd) && IsDigit(*m_pPos)) {
+            // Leading zeros after the point aren't significant
+            if((digits < 19) && ((mantissa != 0) || (*m_pPos != '0'))) {
+                mantissa = (mantissa * 10) + static_cast<uint64_t>(*m_pPos - '0');
+                ++digits;
+                --exponent;
+            } else if(mantissa == 0) {
+                --exponent;
+            }
+            ++m_pPos;
+        }
+    }
+    if((m_pPos < m_pEnd) && ((*m_pPos == 'e') || (*m_pPos == 'E'))) {
+        ++m_pPos;
+        bool negative_exponent = false;
+        if((m_pPos < m_pEnd) && ((*m_pPos == '+') || (*m_pPos == '-')))
+            negative_exponent = (*m_pPos++ == '-');
+        if((m_pPos == m_pEnd) || !IsDigit(*m_pPos))
+            return Fail("Expected a digit");
+        int explicit_exponent = 0;
+        while((m_pPos < m_pEnd) && IsDigit(*m_pPos)) {
+            if(explicit_exponent < 100000)
+                explicit_exponent = (explicit_exponent * 10) + (*m_pPos - '0');
+            ++m_pPos;
+        }
+        exponent += negative_exponent ? -explicit_exponent : explicit_exponent;
+    }
+
+    // Both the mantissa and the power of ten are exact, so one multiply or divide rounds
+    // correctly. Anything else, which coordinates never are, goes through strtod. JSON numbers
+    // always use '.', so it's parsed in the C locale whatever the process locale is.
+    if((mantissa < (uint64_t(1) << 53)) && (exponent >= -22) && (exponent <= 22)) {
+        auto magnitude = static_cast<double>(mantissa);
+        if(exponent < 0)
+            magnitude /= POWERS_OF_TEN[-exponent];
+        else
+            magnitude *= POWERS_OF_TEN[exponent];
+        value = negative ? -magnitude : magnitude;
+        return true;
+    }
+    std::string text(start, m_pPos - start);
+    static locale_t c_locale = newlocale(LC_ALL_MASK, "C", nullptr);
+    value = strtod_l(text.c_str(), nullptr, c_locale);
+    return true;
+}
+
+bool GeoJsonParser::ParseInteger(int64_t &value)
+{
+    // Read directly rather than as a double, as ids for features which aren't in OSM itself are
+    // beyond the integers that a double can hold exactly
+    SkipWhitespace();
+    bool negative = (m_pPos < m_pEnd) && (*m_pPos == '-');
+    if(negative)
+        ++m_pPos;
+    if((m_pPos == m_pEnd) || !IsDigit(*m_pPos))
+        return Fail("Expected an integer");
+
+    uint64_t magnitude = 0;
+    const uint64_t limit = negative ? (uint64_t(INT64_MAX) + 1) : uint64_t(INT64_MAX);
+    while((m_pPos < m_pEnd) && IsDigit(*m_pPos)) {
+        auto digit = static_cast<uint64_t>(*m_pPos - '0');
+        if(magnitude > (limit - digit) / 10)
+            return Fail("Integer out of range");
+        magnitude = (magnitude * 10) + digit;
+        ++m_pPos;
+    }
+    if((m_pPos < m_pEnd) && ((*m_pPos == '.') || (*m_pPos == 'e') || (*m_pPos == 'E')))
+        return Fail("Expected an integer");
+
+    value = negative ? static_cast<int64_t>(0 - magnitude) : static_cast<int64_t>(magnitude);
+    return true;
+}
+
+bool GeoJsonParser::SkipValue(int depth)
+{
+    if(depth > MAX_DEPTH)
+        return Fail("Nested too deeply");
+
+    SkipWhitespace();
+    if(m_pPos == m_pEnd)
+        return Fail("Expected a value");
+
+    switch(*m_pPos) {
+        case '"': {
+            ++m_pPos;
+            while((m_pPos < m_pEnd) && (*m_pPos != '"')) {
+                if(*m_pPos == '\\')
+                    ++m_pPos;
+                ++m_pPos;
+            }
+            if(m_pPos >= m_pEnd)
+                return Fail("Unterminated string");
+            ++m_pPos;
+            return true;
+        }
+        case '{': {
+            ++m_pPos;
+            SkipWhitespace();
+            if((m_pPos < m_pEnd) && (*m_pPos == '}')) {
+                ++m_pPos;
+                return true;
+            }
+            do {
+                std::string_view key;
+                if(!ParseKey(key) || !SkipValue(depth + 1))
+                    return false;
+            } while(SkipComma());
+            return Expect('}');
+        }
+        case '[': {
+            ++m_pPos;
+            SkipWhitespace();
+            if((m_pPos < m_pEnd) && (*m_pPos == ']')) {
+                ++m_pPos;
+                return true;
+            }
+            do {
+                if(!SkipValue(depth + 1))
+                    return false;
+            } while(SkipComma());
+            return Expect(']');
+        }
+        case 't':
+        case 'f':
+        case 'n': {
+            for(auto literal: {"true", "false", "null"}) {
+                auto length = strlen(literal);
+                if((static_cast<size_t>(m_pEnd - m_pPos) >= length) && (memcmp(m_pPos, literal, length) == 0)) {
+                    m_pPos += length;
+                    return true;
+                }
+            }
+            return Fail("Invalid literal");
+        }
+        default: {
+            double number;
+            return ParseNumber(number);
+        }
+    }
+}
+
+bool GeoJsonParser::Parse(const char *json, size_t length, FeatureCollection &features)
+{
+    m_pStart = json;
+    m_pPos = json;
+    m_pEnd = json + length;
+    m_pFeatures = &features;
+    m_Error.clear();
+
+    // Roughly what a tile needs, so that the arrays don't have to grow as they're filled
+    auto reserve = [](auto &array, size_t size) {
+        if(array.capacity() < array.size() + size)
+            array.reserve(array.size() + size);
+    };
+    reserve(features.longitudes, length / 24);
+    reserve(features.latitudes, length / 24);
+    reserve(features.strings, length / 4);
+
+    auto feature_count = features.features.size();
+    auto part_count = features.parts.size();
+    auto coordinate_count = features.longitudes.size();
+    auto property_count = features.properties.size();
+    auto osm_id_count = features.osm_ids.size();
+    auto strings_length = features.strings.size();
+
+    bool ok = ParseFeatureCollection();
+    if(ok) {
+        SkipWhitespace();
+        if(m_pPos != m_pEnd)
+            ok = Fail("Unexpected text after the FeatureCollection");
+    }
+    if(!ok) {
+        TRACE_ERROR("GeoJSON rejected: %s", m_Error.c_str());
+        features.features.resize(feature_count);
+        features.parts.resize(part_count);
+        features.longitudes.resize(coordinate_count);
+        features.latitudes.resize(coordinate_count);
+        features.properties.resize(property_count);
+        features.osm_ids.resize(osm_id_count);
+        features.strings.resize(strings_length);
+    }
+    m_pFeatures = nullptr;
+    return ok;
+}
+
+bool GeoJsonParser::ParseFeatureCollection()
+{
+    if(!Expect('{'))
+        return false;
+
+    bool have_type = false;
+    SkipWhitespace();
+    if((m_pPos < m_pEnd) && (*m_pPos == '}')) {
+        ++m_pPos;
+        return Fail("Expected a FeatureCollection");
+    }
+    do {
+        std::string_view key;
+        if(!ParseKey(key))
+            return false;
+
+        if(key == "type") {
+            StringRef type;
+            if(!ParseString(type))
+                return false;
+            if(m_pFeatures->GetString(type) != "FeatureCollection")
+                return Fail("Expected a FeatureCollection");
+            m_pFeatures->strings.resize(type.offset);
+            have_type = true;
+        } else if(key == "features") {
+            if(!Expect('['))
+                return false;
+            SkipWhitespace();
+            if((m_pPos < m_pEnd) && (*m_pPos == ']')) {
+                ++m_pPos;
+            } else {
+                do {
+                    if(!ParseFeature())
+                        return false;
+                } while(SkipComma());
+                if(!Expect(']'))
+                    return false;
+            }
+        } else if(!SkipValue()) {
+            return false;
+        }
+    } while(SkipComma());
+
+    if(!Expect('}'))
+        return false;
+    if(!have_type)
+        return Fail("FeatureCollection has no type");
+    return true;
+}
+
+bool GeoJsonParser::ParseFeature()
+{
+    if(!Expect('{'))
+        return false;
+
+    auto &features = *m_pFeatures;
+    Feature feature;
+    feature.first_part = static_cast<uint32_t>(features.parts.size());
+    feature.first_property = static_cast<uint32_t>(features.properties.size());
+    feature.first_osm_id = static_cast<uint32_t>(features.osm_ids.size());
+
+    // Each of these members sets the range of the feature's entries, so a second one would
+    // leave the range covering the wrong entries
+    bool have_type = false;
+    bool have_geometry = false;
+    bool have_properties = false;
+    bool have_osm_ids = false;
+    SkipWhitespace();
+    if((m_pPos < m_pEnd) && (*m_pPos != '}')) {
+        do {
+            std::string_view key;
+            if(!ParseKey(key))
+                return false;
+
+            bool ok;
+            if(((key == "geometry") && have_geometry) ||
+               ((key == "properties") && have_properties) ||
+               ((key == "osm_ids") && have_osm_ids))
+                return Fail("Feature has a member more than once");
+            if(key == "type") {
+                StringRef type;
+                if(!ParseString(type))
+                    return false;
+                if(features.GetString(type) != "Feature")
+                    return Fail("Expected a Feature");
+                features.strings.resize(type.offset);
+                have_type = true;
+                ok = true;
+            } else if(key == "geometry") {
+                ok = ParseGeometry(feature);
+                have_geometry = true;
+            } else if(key == "properties") {
+                ok = ParseProperties(feature);
+                have_properties = true;
+            } else if(key == "feature_type") {
+                ok = ParseString(feature.feature_type);
+            } else if(key == "feature_value") {
+                ok = ParseString(feature.feature_value);
+            } else if(key == "osm_ids") {
+                ok = ParseOsmIds(feature);
+                have_osm_ids = true;
+            } else {
+                ok = SkipValue();
+            }
+            if(!ok)
+                return false;
+        } while(SkipComma());
+    }
+    if(!Expect('}'))
+        return false;
+    if(!have_type)
+        return Fail("Feature has no type");
+
+    feature.category = GetFeatureCategory(features.GetString(feature.feature_type),
+                                          features.GetString(feature.feature_value));
+    features.features.push_back(feature);
+    return true;
+}
+
+bool GeoJsonParser::ParseGeometry(Feature &feature)
+{
+    SkipWhitespace();
+    if((m_pEnd - m_pPos >= 4) && (memcmp(m_pPos, "null", 4) == 0)) {
+        m_pPos += 4;
+        return true;
+    }
+    if(!Expect('{'))
+        return false;
+
+    static const std::pair<std::string_view, GeometryType> TYPES[] = {
+        {"Point", GeometryType::Point},
+        {"MultiPoint", GeometryType::MultiPoint},
+        {"LineString", GeometryType::LineString},
+        {"MultiLineString", GeometryType::MultiLineString},
+        {"Polygon", GeometryType::Polygon},
+        {"MultiPolygon", GeometryType::MultiPolygon},
+        {"GeometryCollection", GeometryType::None}
+    };
+    // The depth of the coordinates arrays for each type, where a position is 1
+    static const uint32_t DEPTHS[] = {0, 1, 2, 2, 3, 3, 4};
+
+    bool have_type = false;
+    bool have_coordinates = false;
+    uint32_t depth = 0;
+    GeometryType type = GeometryType::None;
+    auto &features = *m_pFeatures;
+    auto part_count = features.parts.size();
+    auto coordinate_count = features.longitudes.size();
+    do {
+        std::string_view key;
+        if(!ParseKey(key))
+            return false;
+
+        if(key == "type") {
+            StringRef type_string;
+            if(!ParseString(type_string))
+                return false;
+            auto name = m_pFeatures->GetString(type_string);
+            have_type = false;
+            for(const auto &known: TYPES) {
+                if(name == known.first) {
+                    type = known.second;
+                    have_type = true;
+                }
+            }
+            if(!have_type)
+                return Fail("Unknown geometry type");
+            m_pFeatures->strings.resize(type_string.offset);
+        } else if(key == "coordinates") {
+            if(have_coordinates)
+                return Fail("Geometry has more than one coordinates member");
+            if(!ParseCoordinates(feature, depth))
+                return false;
+            have_coordinates = true;
+        } else if(!SkipValue()) {
+            // Including the geometries of a GeometryCollection
+            return false;
+        }
+    } while(SkipComma());
+
+    if(!Expect('}'))
+        return false;
+    if(!have_type)
+        return Fail("Geometry has no type");
+    if(type == GeometryType::None) {
+        // The type can come after the coordinates, so any that a GeometryCollection has are
+        // only dropped now
+        features.parts.resize(part_count);
+        features.longitudes.resize(coordinate_count);
+        features.latitudes.resize(coordinate_count);
+        feature.first_part = static_cast<uint32_t>(part_count);
+        feature.part_count = 0;
+        return true;
+    }
+    if(!have_coordinates)
+        return Fail("Geometry has no coordinates");
+    // An empty array could be any depth
+    if((depth != 0) && (depth != DEPTHS[static_cast<size_t>(type)]))
+        return Fail("Coordinates don't match the geometry type");
+
+    feature.geometry = type;
+    return true;
+}
+
+bool GeoJsonParser::ParseCoordinates(Feature &feature, uint32_t &depth)
+{
+    // The coordinates are read without knowing the geometry type, as it can come after them.
+    // Each array of positions becomes a part, and the depth is checked against the type later.
+    struct Level {
+        uint32_t depth;
+        uint32_t first_coordinate;
+        uint32_t children;
+    };
+    Level levels[MAX_COORDINATE_DEPTH];
+    int level = -1;
+    bool need_array = true;
+    auto &features = *m_pFeatures;
+    feature.first_part = static_cast<uint32_t>(features.parts.size());
+    feature.part_count = 0;
+
+    while(true) {
+        if(need_array) {
+            if(!Expect('['))
+                return false;
+            if(++level == static_cast<int>(MAX_COORDINATE_DEPTH))
+                return Fail("Coordinates nested too deeply");
+            levels[level] = {0, static_cast<uint32_t>(features.longitudes.size()), 0};
+            SkipWhitespace();
+            if((m_pPos < m_pEnd) && ((*m_pPos == '-') || IsDigit(*m_pPos))) {
+                // A position, of which only the longitude and latitude are kept
+                double longitude, latitude;
+                if(!ParseNumber(longitude) || !Expect(',') || !ParseNumber(latitude))
+                    return false;
+                while(SkipComma()) {
+                    double altitude;
+                    if(!ParseNumber(altitude))
+                        return false;
+                }
+                if(!Expect(']'))
+                    return false;
+                features.longitudes.push_back(longitude);
+                features.latitudes.push_back(latitude);
+                levels[level].depth = 1;
+            } else if((m_pPos < m_pEnd) && (*m_pPos == ']')) {
+                ++m_pPos;
+            } else {
+                continue;
+            }
+        } else if(!Expect(']')) {
+            return false;
+        }
+
+        // An array has ended
+        auto &child = levels[level];
+        if(child.depth == 2) {
+            // An array of positions, which in a MultiPolygon is a ring of the polygon that its
+            // grandparent is reading
+            auto polygon = (level >= 2) ? levels[level - 2].children : 0;
+            features.parts.push_back({child.first_coordinate,
+                                      static_cast<uint32_t>(features.longitudes.size()) - child.first_coordinate,
+                                      polygon});
+            ++feature.part_count;
+        }
+        if(level == 0) {
+            // A Point is a part of its own
+            if(child.depth == 1) {
+                features.parts.push_back({child.first_coordinate, 1, 0});
+                ++feature.part_count;
+            }
+            depth = child.depth;
+            return true;
+        }
+
+        auto &parent = levels[level - 1];
+        if(child.depth != 0) {
+            if((parent.depth != 0) && (parent.depth != child.depth + 1))
+                return Fail("Coordinates nested inconsistently");
+            parent.depth = child.depth + 1;
+        }
+        ++parent.children;
+        --level;
+
+        need_array = SkipComma();
+    }
+}
+
+bool GeoJsonParser::ParseProperties(Feature &feature)
+{
+    SkipWhitespace();
+    if((m_pEnd - m_pPos >= 4) && (memcmp(m_pPos, "null", 4) == 0)) {
+        m_pPos += 4;
+        return true;
+    }
+    if(!Expect('{'))
+        return false;
+
+    auto &features = *m_pFeatures;
+    feature.first_property = static_cast<uint32_t>(features.properties.size());
+    SkipWhitespace();
+    if((m_pPos < m_pEnd) && (*m_pPos == '}')) {
+        ++m_pPos;
+        return true;
+    }
+    do {
+        Property property{};
+        if(!ParseString(property.key) || !Expect(':'))
+            return false;
+
+        SkipWhitespace();
+        if(m_pPos == m_pEnd)
+            return Fail("Expected a value");
+        if(*m_pPos == '"') {
+            if(!ParseString(property.value))
+                return false;
+            property.type = PropertyType::String;
+        } else {
+            // Keep the JSON text of anything else
+            auto start = m_pPos;
+            if(!SkipValue(1))
+                return false;
+            switch(*start) {
+                case 't':
+                case 'f': property.type = PropertyType::Boolean; break;
+                case 'n': property.type = PropertyType::Null; break;
+                case '{':
+                case '[': property.type = PropertyType::Json; break;
+                default: property.type = PropertyType::Number; break;
+            }
+            property.value = AppendString(features.strings, start, m_pPos - start);
+        }
+        features.properties.push_back(property);
+        ++feature.property_count;
+    } while(SkipComma());
+
+    return Expect('}');
+}
+
+bool GeoJsonParser::ParseOsmIds(Feature &feature)
+{
+    if(!Expect('['))
+        return false;
+
+    auto &features = *m_pFeatures;
+    feature.first_osm_id = static_cast<uint32_t>(features.osm_ids.size());
+    SkipWhitespace();
+    if((m_pPos < m_pEnd) && (*m_pPos == ']')) {
+        ++m_pPos;
+        return true;
+    }
+    do {
+        int64_t id;
+        if(!ParseInteger(id))
+            return false;
+        features.osm_ids.push_back(id);
+        ++feature.osm_id_count;
+    } while(SkipComma());
+
+    return Expect(']');
+}
@@ -0,0 +1,144 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "FeatureCategory.h"
+
+namespace soundscape {
+
+    enum class GeometryType : uint8_t {
+        // A feature whose geometry is null, or a GeometryCollection which isn't read
+        None = 0,
+        Point,
+        MultiPoint,
+        LineString,
+        MultiLineString,
+        Polygon,
+        MultiPolygon
+    };
+
+    // A string in FeatureCollection::strings
+    struct StringRef {
+        uint32_t offset = 0;
+        uint32_t length = 0;
+    };
+
+    enum class PropertyType : uint8_t {
+        String = 0,
+        // Anything else is kept as its JSON text, which for an object or array is the whole thing
+        Number,
+        Boolean,
+        Null,
+        Json
+    };
+
+    struct Property {
+        StringRef key;
+        StringRef value;
+        PropertyType type;
+    };
+
+    //
+    // A run of coordinates within a feature's geometry. A Point or MultiPoint has one part
+    // holding all of its points, a LineString one part, a MultiLineString a part for each line and
+    // a Polygon a part for each ring, with the exterior ring first. A MultiPolygon has a part for
+    // each ring of each polygon, and polygon says which polygon the ring belongs to.
+    //
+    struct GeometryPart {
+        uint32_t first_coordinate;
+        uint32_t coordinate_count;
+        uint32_t polygon;
+    };
+
+    struct Feature {
+        GeometryType geometry = GeometryType::None;
+        // The Soundscape tile members, which are empty for other GeoJSON
+        StringRef feature_type;
+        StringRef feature_value;
+        FeatureCategory category = FeatureCategory::Poi;
+        uint32_t first_part = 0;
+        uint32_t part_count = 0;
+        uint32_t first_property = 0;
+        uint32_t property_count = 0;
+        uint32_t first_osm_id = 0;
+        uint32_t osm_id_count = 0;
+    };
+
+    //
+    // The features of a GeoJSON FeatureCollection in flat arrays. Each feature refers to ranges of
+    // the parts, properties and OSM ids, and the parts to ranges of the coordinates, which are
+    // stored as separate arrays of longitudes and latitudes so that they can be processed in
+    // batches like the beacons in AudioEngine::UpdateGeometry. Clearing the collection keeps the
+    // capacity of the arrays, so reusing one for each tile doesn't allocate once it's grown.
+    //
+    struct FeatureCollection {
+        std::vector<Feature> features;
+        std::vector<GeometryPart> parts;
+        std::vector<double> longitudes;
+        std::vector<double> latitudes;
+        std::vector<Property> properties;
+        std::vector<int64_t> osm_ids;
+        // The text of every string, one after the other, unescaped
+        std::string strings;
+
+        std::string_view GetString(StringRef string) const
+        {
+            return {strings.data() + string.offset, string.length};
+        }
+        // The value of a property of the feature, or an empty view if it doesn't have one
+        std::string_view GetProperty(const Feature &feature, std::string_view key) const;
+
+        void Clear();
+    };
+
+    //
+    // Streaming GeoJSON parser. The input is scanned once, and values are written into the
+    // FeatureCollection as they're read rather than into a document tree. The members of an
+    // object can be in any order, and members that aren't needed, such as foreign members and
+    // bounding boxes, are skipped over without being stored. Altitudes are ignored.
+    //
+    class GeoJsonParser {
+    public:
+        // Parse a FeatureCollection, adding its features to those already in features. Returns
+        // false if it's not valid, in which case the features that were added are removed again.
+        bool Parse(const char *json, size_t length, FeatureCollection &features);
+        bool Parse(const std::string &json, FeatureCollection &features)
+        {
+            return Parse(json.data(), json.size(), features);
+        }
+
+        // What was wrong with the input that was last rejected, and where
+        const std::string &GetError() const { return m_Error; }
+
+    private:
+        bool Fail(const char *message);
+        void SkipWhitespace();
+        bool Expect(char c);
+        // Skip the comma between members or elements, returning false if there isn't one
+        bool SkipComma();
+        bool ParseString(StringRef &string);
+        bool ParseKey(std::string_view &key);
+        bool ParseNumber(double &value);
+        bool ParseInteger(int64_t &value);
+        bool SkipValue(int depth = 0);
+        bool ParseFeatureCollection();
+        bool ParseFeature();
+        bool ParseGeometry(Feature &feature);
+        bool ParseCoordinates(Feature &feature, uint32_t &depth);
+        bool ParseProperties(Feature &feature);
+        bool ParseOsmIds(Feature &feature);
+
+        const char *m_pStart = nullptr;
+        const char *m_pPos = nullptr;
+        const char *m_pEnd = nullptr;
+        FeatureCollection *m_pFeatures = nullptr;
+        std::string m_Error;
+        // Where a key with escapes is unescaped
+        std::string m_Key;
+    };
+
+} // soundscape
@@ -1,41 +1,222 @@
 #pragma once
 
+#include <algorithm>
 #include <cmath>
+#include <limits>
 
 //
 // C++ versions of GeoUtils functions
 //
-const double DEGREES_TO_RADIANS = 2.0 * M_PI / 360.0;
-const double RADIANS_TO_DEGREES = 1.0 / DEGREES_TO_RADIANS;
-const double EARTH_RADIUS_METERS = 6378137.0;   //  Original Soundscape uses 6378137.0 not 6371000.0
+constexpr double DEGREES_TO_RADIANS = 2.0 * M_PI / 360.0;
+constexpr double RADIANS_TO_DEGREES = 1.0 / DEGREES_TO_RADIANS;
+constexpr double EARTH_RADIUS_METERS = 6378137.0;   //  Original Soundscape uses 6378137.0 not 6371000.0
 
-// We use this for FMOD coordinates so that we can just pass in straight GPS values as if they
-// were X/Y coordinates. We can only do this because we're always close enough to our beacons to
-// consider the earth as flat. FMOD_DISTANCE_FACTOR is set to the number of metres per degree of
-// longitude/latitude.
-const float FMOD_DISTANCE_FACTOR = static_cast<float>((2.0 * M_PI * EARTH_RADIUS_METERS) / 360.0);
+namespace geo {
+
+    //
+    // Formula policies for the distance and initial bearing between two points. In order of
+    // increasing cost and accuracy:
+    //
+    //   Equirectangular  Flat earth at the mid latitude. Only suitable for short distances.
+    //   Haversine        Great circle on a sphere of radius EARTH_RADIUS_METERS.
+    //   Ellipsoidal      Vincenty's inverse formula on the WGS84 ellipsoid.
+    //
+    // The scalar type is a template parameter so that a call site can trade precision for speed
+    // too, e.g. geo::distance<geo::Equirectangular>(lat1, lon1, lat2, lon2) with float arguments.
+    // Note that a float latitude or longitude is only accurate to around a metre, so float is
+    // only suitable where errors of that size don't matter. Bearings are in degrees in the range
+    // -180 to 180, and distances in metres. The accuracy of every combination is measured by
+    // GeoUtilsBenchmark. The angle conversions are constexpr, but the formulas can't be as the
+    // standard maths functions aren't constexpr in C++17.
+    //
+    constexpr double WGS84_SEMI_MAJOR_AXIS = 6378137.0;
+    constexpr double WGS84_FLATTENING = 1.0 / 298.257223563;
+
+    template<typename T>
+    constexpr T toRadians(T degrees)
+    {
+        return degrees * static_cast<T>(DEGREES_TO_RADIANS);
+    }
+
+    template<typename T>
+    constexpr T fromRadians(T radians)
+    {
+        return radians * static_cast<T>(RADIANS_TO_DEGREES);
+    }
+
+    // Wrap an angle in degrees into the range -180 to 180
+    template<typename T>
+    constexpr T wrapDegrees(T degrees)
+    {
+        while(degrees > T(180))
+            degrees -= T(360);
+        while(degrees < T(-180))
+            degrees += T(360);
+        return degrees;
+    }
+
+    struct Equirectangular {
+        template<typename T>
+        static T distance(T lat1, T lon1, T lat2, T lon2)
+        {
+            T x, y;
+            project(lat1, lon1, lat2, lon2, x, y);
+            return static_cast<T>(EARTH_RADIUS_METERS) * std::sqrt(x * x + y * y);
+        }
+
+        template<typename T>
+        static T bearing(T lat1, T lon1, T lat2, T lon2)
+        {
+            T x, y;
+            project(lat1, lon1, lat2, lon2, x, y);
+            return fromRadians(std::atan2(x, y));
+        }
+
+    private:
+        template<typename T>
+        static void project(T lat1, T lon1, T lat2, T lon2, T &x, T &y)
+        {
+            x = toRadians(wrapDegrees(lon2 - lon1)) * std::cos(toRadians((lat1 + lat2) / T(2)));
+            y = toRadians(lat2 - lat1);
+        }
+    };
+
+    struct Haversine {
+        template<typename T>
+        static T distance(T lat1, T lon1, T lat2, T lon2)
+        {
+            auto sin_half_dlat = std::sin(toRadians(lat2 - lat1) / T(2));
+            auto sin_half_dlon = std::sin(toRadians(wrapDegrees(lon2 - lon1)) / T(2));
+            auto a = sin_half_dlat * sin_half_dlat +
+                     std::cos(toRadians(lat1)) * std::cos(toRadians(lat2)) * sin_half_dlon * sin_half_dlon;
+            auto c = T(2) * std::asin(std::sqrt(std::min(a, T(1))));
+            return static_cast<T>(EARTH_RADIUS_METERS) * c;
+        }
+
+        template<typename T>
+        static T bearing(T lat1, T lon1, T lat2, T lon2)
+        {
+            auto latitude1 = toRadians(lat1);
+            auto latitude2 = toRadians(lat2);
+            auto longDiff = toRadians(wrapDegrees(lon2 - lon1));
+            auto y = std::sin(longDiff) * std::cos(latitude2);
+            auto x = std::cos(latitude1) * std::sin(latitude2) -
+                     std::sin(latitude1) * std::cos(latitude2) * std::cos(longDiff);
+            return fromRadians(std::atan2(y, x));
+        }
+    };
+
+    struct Ellipsoidal {
+        template<typename T>
+        static T distance(T lat1, T lon1, T lat2, T lon2)
+        {
+            T distance, bearing;
+            solve(lat1, lon1, lat2, lon2, distance, bearing);
+            return distance;
+        }
+
+        template<typename T>
+        static T bearing(T lat1, T lon1, T lat2, T lon2)
+        {
+            T distance, bearing;
+            solve(lat1, lon1, lat2, lon2, distance, bearing);
+            return bearing;
+        }
+
+    private:
+        // Vincenty's inverse formula. For nearly antipodal points the iteration may not converge,
+        // in which case the result from the last iteration is returned.
+        template<typename T>
+        static void solve(T lat1, T lon1, T lat2, T lon2, T &distance, T &bearing)
+        {
+            const auto a = static_cast<T>(WGS84_SEMI_MAJOR_AXIS);
+            const auto f = static_cast<T>(WGS84_FLATTENING);
+            const auto b = a * (T(1) - f);
+            const auto tolerance = std::max(static_cast<T>(1e-12),
+                                            T(4) * std::numeric_limits<T>::epsilon());
+            const int MAX_ITERATIONS = 100;
+
+            auto L = toRadians(wrapDegrees(lon2 - lon1));
+            auto U1 = std::atan((T(1) - f) * std::tan(toRadians(lat1)));
+            auto U2 = std::atan((T(1) - f) * std::tan(toRadians(lat2)));
+            auto sinU1 = std::sin(U1), cosU1 = std::cos(U1);
+            auto sinU2 = std::sin(U2), cosU2 = std::cos(U2);
+
+            T lambda = L;
+            T sinLambda, cosLambda, sinSigma, cosSigma, sigma, cosSqAlpha, cos2SigmaM;
+            for(int iteration = 0; iteration < MAX_ITERATIONS; ++iteration) {
+                sinLambda = std::sin(lambda);
+                cosLambda = std::cos(lambda);
+                auto t1 = cosU2 * sinLambda;
+                auto t2 = cosU1 * sinU2 - sinU1 * cosU2 * cosLambda;
+                sinSigma = std::sqrt(t1 * t1 + t2 * t2);
+                if(sinSigma == T(0)) {
+                    // Coincident points
+                    distance = T(0);
+                    bearing = T(0);
+                    return;
+                }
+                cosSigma = sinU1 * sinU2 + cosU1 * cosU2 * cosLambda;
+                sigma = std::atan2(sinSigma, cosSigma);
+                auto sinAlpha = cosU1 * cosU2 * sinLambda / sinSigma;
+                cosSqAlpha = T(1) - sinAlpha * sinAlpha;
+                // cosSqAlpha is zero for points on the equator
+                cos2SigmaM = (cosSqAlpha != T(0)) ? cosSigma - T(2) * sinU1 * sinU2 / cosSqAlpha : T(0);
+                auto C = f / T(16) * cosSqAlpha * (T(4) + f * (T(4) - T(3) * cosSqAlpha));
+                auto previous_lambda = lambda;
+                lambda = L + (T(1) - C) * f * sinAlpha *
+                             (sigma + C * sinSigma * (cos2SigmaM + C * cosSigma *
+                                                                   (T(-1) + T(2) * cos2SigmaM * cos2SigmaM)));
+                if(std::fabs(lambda - previous_lambda) <= tolerance)
+                    break;
+            }
+
+            auto uSq = cosSqAlpha * (a * a - b * b) / (b * b);
+            auto A = T(1) + uSq / T(16384) * (T(4096) + uSq * (T(-768) + uSq * (T(320) - T(175) * uSq)));
+            auto B = uSq / T(1024) * (T(256) + uSq * (T(-128) + uSq * (T(74) - T(47) * uSq)));
+            auto deltaSigma = B * sinSigma *
+                              (cos2SigmaM + B / T(4) *
+                                            (cosSigma * (T(-1) + T(2) * cos2SigmaM * cos2SigmaM) -
+                                             B / T(6) * cos2SigmaM * (T(-3) + T(4) * sinSigma * sinSigma) *
+                                             (T(-3) + T(4) * cos2SigmaM * cos2SigmaM)));
+
+            distance = b * A * (sigma - deltaSigma);
+            bearing = fromRadians(std::atan2(cosU2 * sinLambda,
+                                             cosU1 * sinU2 - sinU1 * cosU2 * cosLambda));
+        }
+    };
+
+    template<typename Formula, typename T>
+    inline T distance(T lat1, T lon1, T lat2, T lon2)
+    {
+        return Formula::distance(lat1, lon1, lat2, lon2);
+    }
+
+    // Initial bearing from the first point to the second
+    template<typename Formula, typename T>
+    inline T bearing(T lat1, T lon1, T lat2, T lon2)
+    {
+        return Formula::bearing(lat1, lon1, lat2, lon2);
+    }
+}
 
 inline double toRadians(double degrees)
 {
-    return degrees * DEGREES_TO_RADIANS;
+    return geo::toRadians(degrees);
 }
 
 inline double fromRadians(double degrees)
 {
-    return degrees * RADIANS_TO_DEGREES;
+    return geo::fromRadians(degrees);
 }
 
+// Bearing from the first point to the second in the range 0 to 360 degrees, as in GeoUtils.kt
 inline double bearingFromTwoPoints(
         double lat1, double lon1,
         double lat2, double lon2)
 {
-    auto latitude1 = toRadians(lat1);
-    auto latitude2 = toRadians(lat2);
-    auto longDiff = toRadians(lon2 - lon1);
-    auto y = sin(longDiff) * cos(latitude2);
-    auto x = cos(latitude1) * sin(latitude2) - sin(latitude1) * cos(latitude2) * cos(longDiff);
-
-    return ((int)(fromRadians(atan2(y, x)) + 360) % 360) - 180;
+    auto bearing = geo::bearing<geo::Haversine>(lat1, lon1, lat2, lon2);
+    return (bearing < 0.0) ? bearing + 360.0 : bearing;
 }
 
 inline void getDestinationCoordinate(double lat, double lon, double bearing, double distance, double &new_lat, double &new_lon)
@@ -57,17 +238,110 @@ inline void getDestinationCoordinate(double lat, double lon, double bearing, dou
 
 inline double distance(double lat1, double long1, double lat2, double long2)
 {
-    auto deltaLat = toRadians(lat2 - lat1);
-    auto deltaLon = toRadians(long2 - long1);
+    return geo::distance<geo::Haversine>(lat1, long1, lat2, long2);
+}
+
+// The edges of a rectangle in degrees, as BoundingBox in GeoUtils.kt
+struct BoundingBox {
+    double westLongitude = 0.0;
+    double southLatitude = 0.0;
+    double eastLongitude = 0.0;
+    double northLatitude = 0.0;
+
+    // Edges are inside
+    bool contains(double latitude, double longitude) const
+    {
+        return (latitude >= southLatitude) && (latitude <= northLatitude) &&
+               (longitude >= westLongitude) && (longitude <= eastLongitude);
+    }
+};
 
-    auto a =
-            sin(deltaLat / 2) * sin(deltaLat / 2) + cos(toRadians(lat1)) * cos(toRadians(lat2)) * sin(
-                    deltaLon / 2
-            ) * sin(
-                    deltaLon / 2
-            );
+// The slippy map tile containing a location, clamped to the map as getXYTile in TileUtils.kt
+inline void getXYTile(double lat, double lon, int zoom, int &x, int &y)
+{
+    const int tiles = 1 << zoom;
+    auto latRad = toRadians(lat);
+    x = static_cast<int>(std::floor((lon + 180.0) / 360.0 * tiles));
+    y = static_cast<int>(std::floor((1.0 - std::asinh(std::tan(latRad)) / M_PI) / 2.0 * tiles));
+    x = std::clamp(x, 0, tiles - 1);
+    y = std::clamp(y, 0, tiles - 1);
+}
 
-    auto c = 2 * asin(sqrt(a));
+// Latitude of the north edge of a row of slippy map tiles
+inline double tileToLat(int y, int zoom)
+{
+    auto n = M_PI - (2.0 * M_PI * y) / static_cast<double>(1 << zoom);
+    return fromRadians(std::atan(std::sinh(n)));
+}
 
-    return (EARTH_RADIUS_METERS * c);
+// Longitude of the west edge of a column of slippy map tiles
+inline double tileToLon(int x, int zoom)
+{
+    return x / static_cast<double>(1 << zoom) * 360.0 - 180.0;
 }
+
+inline BoundingBox tileToBoundingBox(int x, int y, int zoom)
+{
+    BoundingBox box;
+    box.northLatitude = tileToLat(y, zoom);
+    box.southLatitude = tileToLat(y + 1, zoom);
+    box.westLongitude = tileToLon(x, zoom);
+    box.eastLongitude = tileToLon(x + 1, zoom);
+    return box;
+}
+
+//
+// Local East-North-Up frame which is tangent to the earth at an origin near to the listener. The
+// conversion is done in double precision and the results are in metres, so they can be passed to
+// FMOD as floats without losing precision as long as the origin is kept close to the listener.
+// Beacons are projected onto the tangent plane i.e. the up component is dropped.
+//
+class LocalFrame {
+public:
+    void SetOrigin(double latitude, double longitude)
+    {
+        auto lat = toRadians(latitude);
+        auto lon = toRadians(longitude);
+        m_SinLatitude = sin(lat);
+        m_CosLatitude = cos(lat);
+        m_SinLongitude = sin(lon);
+        m_CosLongitude = cos(lon);
+        ToEcef(latitude, longitude, m_OriginX, m_OriginY, m_OriginZ);
+        m_Valid = true;
+    }
+
+    bool IsValid() const { return m_Valid; }
+
+    void ToLocal(double latitude, double longitude, double &east, double &north) const
+    {
+        double x, y, z;
+        ToEcef(latitude, longitude, x, y, z);
+        auto dx = x - m_OriginX;
+        auto dy = y - m_OriginY;
+        auto dz = z - m_OriginZ;
+
+        east = -m_SinLongitude * dx + m_CosLongitude * dy;
+        north = -m_SinLatitude * m_CosLongitude * dx
+                - m_SinLatitude * m_SinLongitude * dy
+                + m_CosLatitude * dz;
+    }
+
+private:
+    static void ToEcef(double latitude, double longitude, double &x, double &y, double &z)
+    {
+        auto lat = toRadians(latitude);
+        auto lon = toRadians(longitude);
+        x = EARTH_RADIUS_METERS * cos(lat) * cos(lon);
+        y = EARTH_RADIUS_METERS * cos(lat) * sin(lon);
+        z = EARTH_RADIUS_METERS * sin(lat);
+    }
+
+    bool m_Valid = false;
+    double m_SinLatitude = 0.0;
+    double m_CosLatitude = 1.0;
+    double m_SinLongitude = 0.0;
+    double m_CosLongitude = 1.0;
+    double m_OriginX = EARTH_RADIUS_METERS;
+    double m_OriginY = 0.0;
+    double m_OriginZ = 0.0;
+};
@@ -0,0 +1,265 @@
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <fstream>
+#include <iterator>
+
+#include "GpxFile.h"
+#include "GeoUtils.h"
+#include "Trace.h"
+
+using namespace soundscape;
+
+static bool IsSpace(char c)
+{
+    return (c == ' ') || (c == '\t') || (c == '\r') || (c == '\n');
+}
+
+static std::string Trim(const std::string &value)
+{
+    size_t start = 0;
+    size_t end = value.size();
+    while((start < end) && IsSpace(value[start]))
+        ++start;
+    while((end > start) && IsSpace(value[end - 1]))
+        --end;
+    return value.substr(start, end - start);
+}
+
+static std::string Unescape(const std::string &value)
+{
+    static const std::pair<const char *, char> ENTITIES[] = {
+        {"&amp;", '&'}, {"&lt;", '<'}, {"&gt;", '>'}, {"&quot;", '"'}, {"&apos;", '\''}
+    };
+
+    std::string result;
+    size_t pos = 0;
+    while(pos < value.size()) {
+        bool replaced = false;
+        if(value[pos] == '&') {
+            for(const auto &entity: ENTITIES) {
+                auto length = strlen(entity.first);
+                if(value.compare(pos, length, entity.first) == 0) {
+                    result += entity.second;
+                    pos += length;
+                    replaced = true;
+                    break;
+                }
+            }
+        }
+        if(!replaced)
+            result += value[pos++];
+    }
+    return result;
+}
+
+// Parse a numeric attribute from the text between an element's name and the end of its start tag
+static bool ParseAttribute(const std::string &attributes, const std::string &name, double &value)
+{
+    size_t pos = 0;
+    while((pos = attributes.find(name + "=", pos)) != std::string::npos) {
+        if((pos > 0) && IsSpace(attributes[pos - 1])) {
+            auto quote = pos + name.size() + 1;
+            if((quote < attributes.size()) && ((attributes[quote] == '"') || (attributes[quote] == '\''))) {
+                auto end = attributes.find(attributes[quote], quote + 1);
+                if(end == std::string::npos)
+                    return false;
+                auto text = Trim(attributes.substr(quote + 1, end - quote - 1));
+                char *parsed_end;
+                value = strtod(text.c_str(), &parsed_end);
+                return !text.empty() && (*parsed_end == '\0');
+            }
+        }
+        pos += name.size();
+    }
+    return false;
+}
+
+// Get the text of the first child element with this name
+static bool GetChildText(const std::string &content, const std::string &name, std::string &text)
+{
+    auto start = content.find("<" + name + ">");
+    if(start == std::string::npos)
+        return false;
+    start += name.size() + 2;
+    auto end = content.find("</" + name + ">", start);
+    if(end == std::string::npos)
+        return false;
+    text = Unescape(Trim(content.substr(start, end - start)));
+    return true;
+}
+
+// Parse an ISO 8601 time as used by GPX e.g. 2024-05-15T16:03:07.574171Z
+static bool ParseTime(const std::string &text, double &time)
+{
+    int year, month, day, hour, minute;
+    double second;
+    int consumed = 0;
+    if(sscanf(text.c_str(), "%d-%d-%dT%d:%d:%lf%n",
+              &year, &month, &day, &hour, &minute, &second, &consumed) != 6)
+        return false;
+
+    struct tm fields{};
+    fields.tm_year = year - 1900;
+    fields.tm_mon = month - 1;
+    fields.tm_mday = day;
+    fields.tm_hour = hour;
+    fields.tm_min = minute;
+    time = static_cast<double>(timegm(&fields)) + second;
+
+    // Times are UTC unless they have an offset
+    auto zone = text.c_str() + consumed;
+    if((*zone == '+') || (*zone == '-')) {
+        int offset_hours, offset_minutes = 0;
+        if(sscanf(zone + 1, "%d:%d", &offset_hours, &offset_minutes) < 1)
+            return false;
+        auto offset = offset_hours * 3600.0 + offset_minutes * 60.0;
+        time += (*zone == '+') ? -offset : offset;
+    }
+    return true;
+}
+
+bool soundscape::ParseGpx(const std::string &text, GpxData &gpx)
+{
+    gpx = GpxData();
+
+    size_t pos = 0;
+    while((pos = text.find('<', pos)) != std::string::npos) {
+        if(text.compare(pos, 4, "<!--") == 0) {
+            pos = text.find("-->", pos);
+            if(pos == std::string::npos)
+                break;
+            continue;
+        }
+
+        auto name_end = text.find_first_of(" \t\r\n/>", pos + 1);
+        auto tag_end = text.find('>', pos);
+        if((name_end == std::string::npos) || (tag_end == std::string::npos)) {
+            TRACE_ERROR("GPX has an unterminated tag");
+            return false;
+        }
+        auto element = text.substr(pos + 1, name_end - pos - 1);
+        pos = tag_end + 1;
+
+        std::vector<GpxPoint> *points = nullptr;
+        if(element == "wpt")
+            points = &gpx.waypoints;
+        else if(element == "rtept")
+            points = &gpx.route;
+        else if(element == "trkpt")
+            points = &gpx.track;
+
+        std::string content;
+        bool self_closing = (text[tag_end - 1] == '/');
+        if((points || (element == "metadata")) && !self_closing) {
+            auto end = text.find("</" + element + ">", pos);
+            if(end == std::string::npos) {
+                TRACE_ERROR("GPX %s isn't closed", element.c_str());
+                return false;
+            }
+            content = text.substr(pos, end - pos);
+            pos = end;
+        }
+
+        if(element == "metadata") {
+            GetChildText(content, "name", gpx.name);
+        } else if(points) {
+            GpxPoint point;
+            auto attributes = text.substr(name_end, tag_end - name_end);
+            if(!ParseAttribute(attributes, "lat", point.latitude) ||
+               !ParseAttribute(attributes, "lon", point.longitude)) {
+                TRACE_ERROR("GPX %s has no location", element.c_str());
+                return false;
+            }
+
+            GetChildText(content, "name", point.name);
+            std::string time;
+            if(GetChildText(content, "time", time)) {
+                point.has_time = ParseTime(time, point.time);
+                if(!point.has_time)
+                    TRACE_WARNING("GPX time %s not understood", time.c_str());
+            }
+            points->push_back(point);
+        }
+    }
+    return true;
+}
+
+bool soundscape::ReadGpxFile(const std::string &path, GpxData &gpx)
+{
+    std::ifstream file(path, std::ios::binary);
+    if(!file) {
+        TRACE_ERROR("Failed to open %s", path.c_str());
+        return false;
+    }
+    std::string text((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+
+    if(!ParseGpx(text, gpx)) {
+        TRACE_ERROR("Failed to parse %s", path.c_str());
+        return false;
+    }
+    return true;
+}
+
+GpxTimeline::GpxTimeline(const std::vector<GpxPoint> &points, double speed)
+    : m_Points(points)
+{
+    m_HasTimes = !points.empty() &&
+                 std::all_of(points.begin(), points.end(),
+                             [](const GpxPoint &point) { return point.has_time; });
+
+    for(size_t i = 0; i < points.size(); ++i) {
+        if(i == 0) {
+            m_Times.push_back(0.0);
+        } else if(m_HasTimes) {
+            // Times which go backwards are treated as no time passing
+            m_Times.push_back(std::max(m_Times.back(), points[i].time - points[0].time));
+        } else {
+            auto leg_length = distance(points[i - 1].latitude, points[i - 1].longitude,
+                                       points[i].latitude, points[i].longitude);
+            m_Times.push_back(m_Times.back() + leg_length / speed);
+        }
+    }
+}
+
+size_t GpxTimeline::GetLeg(double seconds) const
+{
+    if(m_Points.size() < 2)
+        return 0;
+
+    auto next = std::upper_bound(m_Times.begin(), m_Times.end(), seconds);
+    auto leg = static_cast<size_t>(std::max<ptrdiff_t>(next - m_Times.begin() - 1, 0));
+    return std::min(leg, m_Points.size() - 2);
+}
+
+void GpxTimeline::GetPosition(double seconds, double &latitude, double &longitude,
+                              double &course) const
+{
+    latitude = longitude = course = 0.0;
+    if(m_Points.empty())
+        return;
+    if(m_Points.size() == 1) {
+        latitude = m_Points[0].latitude;
+        longitude = m_Points[0].longitude;
+        return;
+    }
+
+    auto leg = GetLeg(seconds);
+    const auto &start = m_Points[leg];
+    const auto &end = m_Points[leg + 1];
+    auto leg_duration = m_Times[leg + 1] - m_Times[leg];
+    double fraction = 1.0;
+    if(leg_duration > 0.0)
+        fraction = std::clamp((seconds - m_Times[leg]) / leg_duration, 0.0, 1.0);
+
+    latitude = start.latitude + (end.latitude - start.latitude) * fraction;
+    longitude = start.longitude + (end.longitude - start.longitude) * fraction;
+
+    // At the end of the leg there's no direction left to walk in, so keep the direction of the leg
+    if(fraction < 1.0)
+        course = bearingFromTwoPoints(latitude, longitude, end.latitude, end.longitude);
+    else
+        course = bearingFromTwoPoints(start.latitude, start.longitude, end.latitude, end.longitude);
+}
@@ -0,0 +1,61 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+namespace soundscape {
+
+    struct GpxPoint {
+        double latitude = 0.0;
+        double longitude = 0.0;
+        // Seconds since the epoch, only valid if has_time is set
+        double time = 0.0;
+        bool has_time = false;
+        std::string name;
+    };
+
+    // The points from a GPX file. Multiple routes or track segments are joined together.
+    struct GpxData {
+        std::string name;
+        std::vector<GpxPoint> waypoints;
+        std::vector<GpxPoint> route;
+        std::vector<GpxPoint> track;
+    };
+
+    //
+    // Only the parts of GPX 1.1 that are needed to replay a walk are read: the location, time and
+    // name of each wpt, rtept and trkpt. It's a simple scan for those elements rather than a full
+    // XML parser, which is all that the files written by Soundscape and the authoring tool need.
+    //
+    bool ParseGpx(const std::string &text, GpxData &gpx);
+    bool ReadGpxFile(const std::string &path, GpxData &gpx);
+
+    //
+    // The position along a path of GPX points over time. Points without times, such as route
+    // points, are spaced out along the path at a constant speed. Positions between the points are
+    // linearly interpolated, which is close enough for points that are nearby.
+    //
+    class GpxTimeline {
+    public:
+        // Speed is in metres per second and is only used if the points don't all have times
+        GpxTimeline(const std::vector<GpxPoint> &points, double speed);
+
+        bool HasTimes() const { return m_HasTimes; }
+        // The number of seconds from the first point to the last
+        double GetDuration() const { return m_Times.empty() ? 0.0 : m_Times.back(); }
+
+        // The index of the point that the leg being walked at this time starts from
+        size_t GetLeg(double seconds) const;
+
+        // The position at this many seconds from the start, and the course in degrees from there
+        // to the end of the leg
+        void GetPosition(double seconds, double &latitude, double &longitude, double &course) const;
+
+    private:
+        std::vector<GpxPoint> m_Points;
+        // Seconds from the first point to each point
+        std::vector<double> m_Times;
+        bool m_HasTimes;
+    };
+
+} // soundscape
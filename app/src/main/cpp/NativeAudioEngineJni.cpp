@@ -0,0 +1,449 @@
+//
+// JNI binding for NativeAudioEngine.kt. This is a thin layer over the C API in soundscape_engine.h.
+// The native methods are registered in JNI_OnLoad rather than being looked up by their mangled
+// names, and the class and method IDs that we need later are cached there too.
+//
+#include <algorithm>
+#include <cmath>
+#include <vector>
+#include <jni.h>
+
+#include "soundscape_engine.h"
+#include "Trace.h"
+
+static JavaVM *g_pJavaVM = nullptr;
+static jclass g_NativeAudioEngineClass = nullptr;
+static jmethodID g_OnAudioEventsPending = nullptr;
+
+static soundscape_engine *ToEngine(jlong engine_handle)
+{
+    return reinterpret_cast<soundscape_engine *>(engine_handle);
+}
+
+// The engine control thread is attached to the JVM the first time that it calls back into Kotlin
+// and is detached again when the thread exits.
+class JniThreadAttachment {
+public:
+    ~JniThreadAttachment() {
+        if(m_pEnv)
+            g_pJavaVM->DetachCurrentThread();
+    }
+
+    JNIEnv *GetEnv() {
+        if((m_pEnv == nullptr) && (g_pJavaVM->AttachCurrentThread(&m_pEnv, nullptr) != JNI_OK)) {
+            TRACE_ERROR("Failed to attach thread to JVM");
+            m_pEnv = nullptr;
+        }
+        return m_pEnv;
+    }
+
+private:
+    JNIEnv *m_pEnv = nullptr;
+};
+static thread_local JniThreadAttachment t_JniThread;
+
+static void NotifyEventsPending(void *context) {
+    auto env = t_JniThread.GetEnv();
+    if(env) {
+        env->CallVoidMethod(static_cast<jobject>(context), g_OnAudioEventsPending);
+        if(env->ExceptionCheck()) {
+            TRACE_ERROR("Exception from onAudioEventsPending");
+            env->ExceptionClear();
+        }
+    }
+}
+
+static jlong Create(JNIEnv *env, jobject thiz) {
+    auto engine = soundscape_engine_create();
+    if(engine)
+        soundscape_engine_set_event_callback(engine, NotifyEventsPending, env->NewGlobalRef(thiz));
+
+    return reinterpret_cast<jlong>(engine);
+}
+
+static void Destroy(JNIEnv *env, jobject thiz MAYBE_UNUSED, jlong engine_handle) {
+    auto engine = ToEngine(engine_handle);
+    if(engine) {
+        // Destroying the engine stops the control thread, so there are no more event callbacks
+        auto listener = static_cast<jobject>(soundscape_engine_get_event_callback_context(engine));
+        soundscape_engine_destroy(engine);
+        if(listener)
+            env->DeleteGlobalRef(listener);
+    }
+}
+
+static void UpdateGeometry(JNIEnv *env MAYBE_UNUSED, jobject thiz MAYBE_UNUSED,
+                           jlong engine_handle,
+                           jdouble latitude, jdouble longitude, jdouble heading) {
+    soundscape_engine_update_geometry(ToEngine(engine_handle), latitude, longitude, heading);
+}
+
+static void SetBeaconType(JNIEnv *env MAYBE_UNUSED, jobject thiz MAYBE_UNUSED,
+                          jlong engine_handle, jint beacon_type) {
+    soundscape_engine_set_beacon_type(ToEngine(engine_handle), beacon_type);
+}
+
+static jlong CreateNativeBeacon(JNIEnv *env MAYBE_UNUSED, jobject thiz MAYBE_UNUSED,
+                                jlong engine_handle, jdouble latitude, jdouble longitude) {
+    return soundscape_engine_create_beacon(ToEngine(engine_handle), latitude, longitude);
+}
+
+static void DestroyNativeBeacon(JNIEnv *env MAYBE_UNUSED, jobject thiz MAYBE_UNUSED,
+                                jlong engine_handle, jlong beacon_handle) {
+    soundscape_engine_destroy_audio(ToEngine(engine_handle), beacon_handle);
+}
+
+static jlong CreateNativeTextToSpeech(JNIEnv *env MAYBE_UNUSED, jobject thiz MAYBE_UNUSED,
+                                      jlong engine_handle,
+                                      jdouble latitude, jdouble longitude, jint tts_socket) {
+    return soundscape_engine_create_text_to_speech(ToEngine(engine_handle),
+                                                   latitude, longitude, tts_socket);
+}
+
+static jint SubmitCommands(JNIEnv *env, jobject thiz MAYBE_UNUSED,
+                           jlong engine_handle, jobject commands, jint length) {
+    auto data = static_cast<uint8_t *>(env->GetDirectBufferAddress(commands));
+    auto capacity = env->GetDirectBufferCapacity(commands);
+    if((data == nullptr) || (length < 0) || (length > capacity)) {
+        TRACE_ERROR("SubmitCommands failed - invalid command buffer");
+        return -1;
+    }
+    return soundscape_engine_submit_commands(ToEngine(engine_handle), data, length);
+}
+
+static void RegisterPoseMailbox(JNIEnv *env, jobject thiz MAYBE_UNUSED,
+                                jlong engine_handle, jobject mailbox) {
+    auto memory = env->GetDirectBufferAddress(mailbox);
+    auto capacity = env->GetDirectBufferCapacity(mailbox);
+    soundscape_engine_register_pose_mailbox(ToEngine(engine_handle), memory,
+                                            capacity > 0 ? static_cast<size_t>(capacity) : 0);
+}
+
+static jint DrainEvents(JNIEnv *env, jobject thiz MAYBE_UNUSED,
+                        jlong engine_handle, jlongArray events) {
+    // Each event is returned as three longs: type, handle and value
+    auto max_events = static_cast<size_t>(env->GetArrayLength(events) / 3);
+    std::vector<soundscape_event> drained(max_events);
+    auto count = soundscape_engine_drain_events(ToEngine(engine_handle), drained.data(), max_events);
+
+    std::vector<jlong> packed(count * 3);
+    for(size_t i = 0; i < count; ++i) {
+        packed[i * 3] = drained[i].type;
+        packed[i * 3 + 1] = drained[i].handle;
+        packed[i * 3 + 2] = drained[i].value;
+    }
+    env->SetLongArrayRegion(events, 0, static_cast<jsize>(packed.size()), packed.data());
+    return static_cast<jint>(count);
+}
+
+static jboolean GetStats(JNIEnv *env, jobject thiz MAYBE_UNUSED,
+                         jlong engine_handle, jdoubleArray stats, jboolean reset) {
+    // Each source type is returned as seven values: callbacks, padded callbacks and the 50th,
+    // 90th, 99th and 99.9th percentile and maximum callback durations in nanoseconds. They're
+    // followed by five values for each motion path: the count and the 50th, 95th and 99th
+    // percentile and maximum latencies in nanoseconds. Last are the DSP, stream, peak DSP and
+    // peak stream CPU percentages.
+    const jsize STATS_LENGTH = (SOUNDSCAPE_SOURCE_TYPES * 7) + (SOUNDSCAPE_MOTION_PATHS * 5) + 4;
+    if(env->GetArrayLength(stats) < STATS_LENGTH) {
+        TRACE_ERROR("GetStats failed - stats array too short");
+        return JNI_FALSE;
+    }
+
+    soundscape_stats engine_stats;
+    if(soundscape_engine_get_stats(ToEngine(engine_handle), &engine_stats, reset) != 0)
+        return JNI_FALSE;
+
+    std::vector<jdouble> packed;
+    for(const auto &callbacks: engine_stats.callbacks) {
+        packed.push_back(static_cast<jdouble>(callbacks.callbacks));
+        packed.push_back(static_cast<jdouble>(callbacks.padded_callbacks));
+        packed.push_back(static_cast<jdouble>(callbacks.p50_ns));
+        packed.push_back(static_cast<jdouble>(callbacks.p90_ns));
+        packed.push_back(static_cast<jdouble>(callbacks.p99_ns));
+        packed.push_back(static_cast<jdouble>(callbacks.p999_ns));
+        packed.push_back(static_cast<jdouble>(callbacks.max_ns));
+    }
+    for(const auto &motion: engine_stats.motion) {
+        packed.push_back(static_cast<jdouble>(motion.count));
+        packed.push_back(static_cast<jdouble>(motion.p50_ns));
+        packed.push_back(static_cast<jdouble>(motion.p95_ns));
+        packed.push_back(static_cast<jdouble>(motion.p99_ns));
+        packed.push_back(static_cast<jdouble>(motion.max_ns));
+    }
+    packed.push_back(engine_stats.dsp_cpu);
+    packed.push_back(engine_stats.stream_cpu);
+    packed.push_back(engine_stats.peak_dsp_cpu);
+    packed.push_back(engine_stats.peak_stream_cpu);
+    env->SetDoubleArrayRegion(stats, 0, STATS_LENGTH, packed.data());
+    return JNI_TRUE;
+}
+
+static jboolean GetMemoryStats(JNIEnv *env, jobject thiz MAYBE_UNUSED,
+                               jlong engine_handle, jlongArray stats) {
+    // The fields of soundscape_memory_stats in order
+    const jsize STATS_LENGTH = sizeof(soundscape_memory_stats) / sizeof(uint64_t);
+    if(env->GetArrayLength(stats) < STATS_LENGTH) {
+        TRACE_ERROR("GetMemoryStats failed - stats array too short");
+        return JNI_FALSE;
+    }
+
+    soundscape_memory_stats memory_stats;
+    if(soundscape_engine_get_memory_stats(ToEngine(engine_handle), &memory_stats) != 0)
+        return JNI_FALSE;
+
+    env->SetLongArrayRegion(stats, 0, STATS_LENGTH, reinterpret_cast<const jlong *>(&memory_stats));
+    return JNI_TRUE;
+}
+
+static jint LoadTiles(JNIEnv *env, jobject thiz MAYBE_UNUSED,
+                      jlong engine_handle, jintArray tile_ids, jobjectArray tiles) {
+    // The tile ids are three ints for each tile: x, y and zoom
+    auto count = env->GetArrayLength(tiles);
+    if(env->GetArrayLength(tile_ids) < count * 3) {
+        TRACE_ERROR("LoadTiles failed - tile ids array too short");
+        return -1;
+    }
+    std::vector<jint> ids(static_cast<size_t>(count) * 3);
+    env->GetIntArrayRegion(tile_ids, 0, count * 3, ids.data());
+
+    // The JSON is passed as UTF-8 bytes rather than as strings, as JNI only gives out strings as
+    // UTF-16 or as modified UTF-8, which encodes U+0000 and the characters outside the BMP
+    // differently. They're all held until the tiles have been loaded.
+    std::vector<jbyteArray> arrays(count);
+    std::vector<jbyte *> bytes(count);
+    std::vector<soundscape_tile> engine_tiles(count);
+    for(jsize index = 0; index < count; ++index) {
+        arrays[index] = static_cast<jbyteArray>(env->GetObjectArrayElement(tiles, index));
+        bytes[index] = arrays[index] ? env->GetByteArrayElements(arrays[index], nullptr) : nullptr;
+        auto &tile = engine_tiles[index];
+        tile.x = ids[index * 3];
+        tile.y = ids[index * 3 + 1];
+        tile.zoom = ids[index * 3 + 2];
+        tile.json = bytes[index] ? reinterpret_cast<const char *>(bytes[index]) : "";
+        tile.length = bytes[index] ? static_cast<size_t>(env->GetArrayLength(arrays[index])) : 0;
+    }
+
+    auto loaded = soundscape_engine_load_tiles(ToEngine(engine_handle), engine_tiles.data(),
+                                               engine_tiles.size());
+
+    for(jsize index = 0; index < count; ++index) {
+        if(arrays[index]) {
+            // The bytes are only read, so there's nothing to copy back
+            if(bytes[index])
+                env->ReleaseByteArrayElements(arrays[index], bytes[index], JNI_ABORT);
+            env->DeleteLocalRef(arrays[index]);
+        }
+    }
+    return loaded;
+}
+
+static jlong GetTileFeatureCount(JNIEnv *env MAYBE_UNUSED, jobject thiz MAYBE_UNUSED,
+                                 jlong engine_handle, jint x, jint y, jint zoom) {
+    return soundscape_engine_get_tile_feature_count(ToEngine(engine_handle), x, y, zoom);
+}
+
+static jboolean SaveTileFile(JNIEnv *env, jobject thiz MAYBE_UNUSED,
+                             jlong engine_handle, jint x, jint y, jint zoom, jstring path) {
+    auto path_chars = env->GetStringUTFChars(path, nullptr);
+    auto result = soundscape_engine_save_tile_file(ToEngine(engine_handle), x, y, zoom, path_chars);
+    env->ReleaseStringUTFChars(path, path_chars);
+    return result == 0;
+}
+
+static jboolean LoadTileFile(JNIEnv *env, jobject thiz MAYBE_UNUSED,
+                             jlong engine_handle, jstring path) {
+    auto path_chars = env->GetStringUTFChars(path, nullptr);
+    auto result = soundscape_engine_load_tile_file(ToEngine(engine_handle), path_chars);
+    env->ReleaseStringUTFChars(path, path_chars);
+    return result == 0;
+}
+
+static jboolean OpenTileCache(JNIEnv *env, jobject thiz MAYBE_UNUSED,
+                              jlong engine_handle, jstring directory, jlong budget) {
+    auto directory_chars = env->GetStringUTFChars(directory, nullptr);
+    auto result = soundscape_engine_open_tile_cache(ToEngine(engine_handle), directory_chars,
+                                                    static_cast<uint64_t>(budget));
+    env->ReleaseStringUTFChars(directory, directory_chars);
+    return result == 0;
+}
+
+static jboolean LoadCachedTile(JNIEnv *env MAYBE_UNUSED, jobject thiz MAYBE_UNUSED,
+                               jlong engine_handle, jint x, jint y, jint zoom) {
+    return soundscape_engine_load_cached_tile(ToEngine(engine_handle), x, y, zoom) == 0;
+}
+
+static jboolean StartTileWorkingSet(JNIEnv *env MAYBE_UNUSED, jobject thiz MAYBE_UNUSED,
+                                    jlong engine_handle, jdouble radius) {
+    return soundscape_engine_start_tile_working_set(ToEngine(engine_handle), radius) == 0;
+}
+
+static jint GetMissingTiles(JNIEnv *env, jobject thiz MAYBE_UNUSED,
+                            jlong engine_handle, jintArray tile_ids) {
+    // Three ints for each tile: x, y and zoom
+    auto count = static_cast<size_t>(env->GetArrayLength(tile_ids) / 3);
+    std::vector<soundscape_tile_id> tiles(count);
+    auto found = soundscape_engine_get_missing_tiles(ToEngine(engine_handle), tiles.data(), count);
+    if(found <= 0)
+        return 0;
+
+    std::vector<jint> ids(static_cast<size_t>(found) * 3);
+    for(size_t i = 0; i < static_cast<size_t>(found); ++i) {
+        ids[i * 3] = tiles[i].x;
+        ids[i * 3 + 1] = tiles[i].y;
+        ids[i * 3 + 2] = tiles[i].zoom;
+    }
+    env->SetIntArrayRegion(tile_ids, 0, static_cast<jsize>(ids.size()), ids.data());
+    return static_cast<jint>(found);
+}
+
+static jboolean GetTileWorkingSetStats(JNIEnv *env, jobject thiz MAYBE_UNUSED,
+                                       jlong engine_handle, jlongArray stats) {
+    // The fields of soundscape_tile_working_set_stats in order
+    const jsize STATS_LENGTH = sizeof(soundscape_tile_working_set_stats) / sizeof(uint64_t);
+    if(env->GetArrayLength(stats) < STATS_LENGTH) {
+        TRACE_ERROR("GetTileWorkingSetStats failed - stats array too short");
+        return JNI_FALSE;
+    }
+
+    soundscape_tile_working_set_stats working_set_stats;
+    if(soundscape_engine_get_tile_working_set_stats(ToEngine(engine_handle), &working_set_stats) != 0)
+        return JNI_FALSE;
+
+    env->SetLongArrayRegion(stats, 0, STATS_LENGTH, reinterpret_cast<const jlong *>(&working_set_stats));
+    return JNI_TRUE;
+}
+
+// Copy the OSM ids and distances of the features found into the arrays
+static jint CopyFeatures(JNIEnv *env, const std::vector<soundscape_nearest_feature> &features,
+                         int64_t found, jlongArray osm_ids, jdoubleArray distances) {
+    if(found <= 0)
+        return 0;
+
+    std::vector<jlong> ids(static_cast<size_t>(found));
+    std::vector<jdouble> metres(static_cast<size_t>(found));
+    for(size_t i = 0; i < ids.size(); ++i) {
+        ids[i] = features[i].osm_id;
+        metres[i] = features[i].distance;
+    }
+    env->SetLongArrayRegion(osm_ids, 0, static_cast<jsize>(found), ids.data());
+    env->SetDoubleArrayRegion(distances, 0, static_cast<jsize>(found), metres.data());
+    return static_cast<jint>(found);
+}
+
+static jint FindNearest(JNIEnv *env, jobject thiz MAYBE_UNUSED,
+                        jlong engine_handle, jdouble latitude, jdouble longitude,
+                        jint categories, jdouble max_distance,
+                        jlongArray osm_ids, jdoubleArray distances) {
+    // Up to as many features as there is room for in both arrays, nearest first
+    auto count = static_cast<size_t>(std::min(env->GetArrayLength(osm_ids), env->GetArrayLength(distances)));
+    std::vector<soundscape_nearest_feature> nearest(count);
+    auto found = soundscape_engine_find_nearest(ToEngine(engine_handle), latitude, longitude,
+                                                static_cast<uint32_t>(categories), max_distance,
+                                                nearest.data(), count);
+    return CopyFeatures(env, nearest, found, osm_ids, distances);
+}
+
+static jint FindInFieldOfView(JNIEnv *env, jobject thiz MAYBE_UNUSED,
+                              jlong engine_handle, jdouble latitude, jdouble longitude,
+                              jdouble heading, jdouble width, jdouble range, jint categories,
+                              jlongArray osm_ids, jdoubleArray distances) {
+    auto count = static_cast<size_t>(std::min(env->GetArrayLength(osm_ids), env->GetArrayLength(distances)));
+    std::vector<soundscape_nearest_feature> features(count);
+    auto found = soundscape_engine_find_in_field_of_view(ToEngine(engine_handle), latitude, longitude,
+                                                         heading, width, range,
+                                                         static_cast<uint32_t>(categories),
+                                                         features.data(), count);
+    return CopyFeatures(env, features, found, osm_ids, distances);
+}
+
+// The values of each road in the array passed to GetNearestIntersection
+static const jsize INTERSECTION_ROAD_VALUES = 5;
+
+static jint GetNearestIntersection(JNIEnv *env, jobject thiz MAYBE_UNUSED,
+                                   jlong engine_handle, jdouble latitude, jdouble longitude,
+                                   jdouble max_distance, jlongArray osm_ids, jdoubleArray values) {
+    // The intersection's OSM id goes first, followed by those of the roads, and each road has its
+    // bearing, length, the location of the node at its other end and its type in values. Returns
+    // the number of roads, or -1 if there's no intersection.
+    auto count = static_cast<size_t>(std::max(std::min(env->GetArrayLength(osm_ids) - 1,
+                                                       env->GetArrayLength(values) / INTERSECTION_ROAD_VALUES), 0));
+    soundscape_nearest_feature intersection;
+    std::vector<soundscape_intersection_road> roads(count);
+    auto found = soundscape_engine_get_nearest_intersection(ToEngine(engine_handle), latitude, longitude,
+                                                            max_distance, &intersection, roads.data(), count);
+    if((found < 0) || std::isinf(intersection.distance))
+        return -1;
+
+    std::vector<jlong> ids(static_cast<size_t>(found) + 1);
+    std::vector<jdouble> road_values(static_cast<size_t>(found) * INTERSECTION_ROAD_VALUES);
+    ids[0] = intersection.osm_id;
+    for(size_t i = 0; i < static_cast<size_t>(found); ++i) {
+        const auto &road = roads[i];
+        ids[i + 1] = road.osm_id;
+        auto *value = &road_values[i * INTERSECTION_ROAD_VALUES];
+        value[0] = road.bearing;
+        value[1] = road.length;
+        value[2] = road.end_latitude;
+        value[3] = road.end_longitude;
+        value[4] = road.end_type;
+    }
+    env->SetLongArrayRegion(osm_ids, 0, static_cast<jsize>(ids.size()), ids.data());
+    env->SetDoubleArrayRegion(values, 0, static_cast<jsize>(road_values.size()), road_values.data());
+    return static_cast<jint>(found);
+}
+
+static const JNINativeMethod g_NativeAudioEngineMethods[] = {
+        {"create",                   "()J",                          reinterpret_cast<void *>(Create)},
+        {"destroy",                  "(J)V",                         reinterpret_cast<void *>(Destroy)},
+        {"updateGeometry",           "(JDDD)V",                      reinterpret_cast<void *>(UpdateGeometry)},
+        {"setBeaconType",            "(JI)V",                        reinterpret_cast<void *>(SetBeaconType)},
+        {"createNativeBeacon",       "(JDD)J",                       reinterpret_cast<void *>(CreateNativeBeacon)},
+        {"destroyNativeBeacon",      "(JJ)V",                        reinterpret_cast<void *>(DestroyNativeBeacon)},
+        {"createNativeTextToSpeech", "(JDDI)J",                      reinterpret_cast<void *>(CreateNativeTextToSpeech)},
+        {"submitCommands",           "(JLjava/nio/ByteBuffer;I)I",   reinterpret_cast<void *>(SubmitCommands)},
+        {"registerPoseMailbox",      "(JLjava/nio/ByteBuffer;)V",    reinterpret_cast<void *>(RegisterPoseMailbox)},
+        {"drainEvents",              "(J[J)I",                       reinterpret_cast<void *>(DrainEvents)},
+        {"getStats",                 "(J[DZ)Z",                      reinterpret_cast<void *>(GetStats)},
+        {"getMemoryStats",           "(J[J)Z",                       reinterpret_cast<void *>(GetMemoryStats)},
+        {"loadTiles",                "(J[I[[B)I",                   reinterpret_cast<void *>(LoadTiles)},
+        {"getTileFeatureCount",      "(JIII)J",                      reinterpret_cast<void *>(GetTileFeatureCount)},
+        {"saveTileFile",             "(JIIILjava/lang/String;)Z",    reinterpret_cast<void *>(SaveTileFile)},
+        {"loadTileFile",             "(JLjava/lang/String;)Z",       reinterpret_cast<void *>(LoadTileFile)},
+        {"openTileCache",            "(JLjava/lang/String;J)Z",      reinterpret_cast<void *>(OpenTileCache)},
+        {"loadCachedTile",           "(JIII)Z",                      reinterpret_cast<void *>(LoadCachedTile)},
+        {"startTileWorkingSet",      "(JD)Z",                        reinterpret_cast<void *>(StartTileWorkingSet)},
+        {"getMissingTiles",          "(J[I)I",                       reinterpret_cast<void *>(GetMissingTiles)},
+        {"getTileWorkingSetStats",   "(J[J)Z",                       reinterpret_cast<void *>(GetTileWorkingSetStats)},
+        {"findNearest",              "(JDDID[J[D)I",                 reinterpret_cast<void *>(FindNearest)},
+        {"findInFieldOfView",        "(JDDDDDI[J[D)I",               reinterpret_cast<void *>(FindInFieldOfView)},
+        {"getNearestIntersection",   "(JDDD[J[D)I",                  reinterpret_cast<void *>(GetNearestIntersection)},
+};
+
+extern "C"
+JNIEXPORT jint JNICALL
+JNI_OnLoad(JavaVM *vm, void *reserved MAYBE_UNUSED) {
+    JNIEnv *env;
+    if(vm->GetEnv(reinterpret_cast<void **>(&env), JNI_VERSION_1_6) != JNI_OK)
+        return JNI_ERR;
+
+    auto engine_class = env->FindClass("com/scottishtecharmy/soundscape/audio/NativeAudioEngine");
+    if(engine_class == nullptr)
+        return JNI_ERR;
+
+    // Holding a global reference to the class keeps the cached method ID valid
+    g_NativeAudioEngineClass = static_cast<jclass>(env->NewGlobalRef(engine_class));
+    env->DeleteLocalRef(engine_class);
+
+    g_OnAudioEventsPending = env->GetMethodID(g_NativeAudioEngineClass, "onAudioEventsPending", "()V");
+    if(g_OnAudioEventsPending == nullptr)
+        return JNI_ERR;
+
+    auto method_count = static_cast<jint>(sizeof(g_NativeAudioEngineMethods) / sizeof(JNINativeMethod));
+    if(env->RegisterNatives(g_NativeAudioEngineClass, g_NativeAudioEngineMethods, method_count) != JNI_OK) {
+        TRACE_ERROR("Failed to register NativeAudioEngine methods");
+        return JNI_ERR;
+    }
+
+    g_pJavaVM = vm;
+    return JNI_VERSION_1_6;
+}
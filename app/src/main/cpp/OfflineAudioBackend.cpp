@@ -0,0 +1,288 @@
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+
+#include "OfflineAudioBackend.h"
+#include "RealtimeCheck.h"
+#include "WavFile.h"
+#include "Trace.h"
+
+using namespace soundscape;
+
+// The host build points this at app/src/main/assets
+#ifndef SOUNDSCAPE_ASSET_DIRECTORY
+#define SOUNDSCAPE_ASSET_DIRECTORY "assets"
+#endif
+
+namespace soundscape {
+
+    class OfflineAudioChannel : public IAudioChannel {
+    public:
+        OfflineAudioChannel(OfflineAudioBackend *backend, AudioStream *stream,
+                            const AudioVector &position)
+            : m_pBackend(backend),
+              m_pStream(stream),
+              m_Format(stream->GetStreamFormat()),
+              m_Position(position)
+        {
+            m_Buffer.resize(std::max(m_Format.decode_buffer_size, 1U));
+            m_ReadPosition = m_Buffer.size();
+        }
+
+        ~OfflineAudioChannel() override
+        {
+            m_pBackend->RemoveChannel(this);
+        }
+
+        void SetPosition(const AudioVector &position) override
+        {
+            m_pBackend->SetChannelPosition(this, position);
+        }
+
+        // Called with the backend mutex held
+        void Mix(float *mix, size_t frames, int output_rate,
+                 const AudioVector &listener, const AudioVector &right)
+        {
+            const auto PI = static_cast<float>(M_PI);
+
+            float dx = m_Position.x - listener.x;
+            float dy = m_Position.y - listener.y;
+            float dz = m_Position.z - listener.z;
+            float distance = std::sqrt(dx * dx + dy * dy + dz * dz);
+
+            float gain = m_Format.min_distance /
+                         std::clamp(distance, m_Format.min_distance, m_Format.max_distance);
+            float pan = 0.0f;
+            if(distance > 0.0f)
+                pan = std::clamp((dx * right.x + dy * right.y + dz * right.z) / distance, -1.0f, 1.0f);
+
+            // Constant power panning
+            float angle = (pan + 1.0f) * PI / 4.0f;
+            float left_gain = gain * std::cos(angle) / 32768.0f;
+            float right_gain = gain * std::sin(angle) / 32768.0f;
+
+            double step = static_cast<double>(m_Format.sample_rate) / output_rate;
+            for(size_t frame = 0; frame < frames; ++frame) {
+                while(m_Phase >= 1.0) {
+                    m_Previous = m_Current;
+                    m_Current = NextSample(frame);
+                    m_Phase -= 1.0;
+                }
+                auto sample = static_cast<float>(m_Previous + (m_Current - m_Previous) * m_Phase);
+                mix[frame * 2] += sample * left_gain;
+                mix[frame * 2 + 1] += sample * right_gain;
+                m_Phase += step;
+            }
+        }
+
+    private:
+        friend class OfflineAudioBackend;
+
+        float NextSample(size_t frame)
+        {
+            // Like FMOD, the stream is read a decode buffer at a time. Unlike FMOD it's read just
+            // as it's needed, so it's heard from the frame being mixed.
+            if(m_ReadPosition == m_Buffer.size()) {
+                m_pBackend->m_MixFrame = m_pBackend->m_RenderedFrames + frame;
+                auto start = std::chrono::steady_clock::now();
+                {
+                    REALTIME_SCOPE();
+                    m_pStream->PcmReadCallback(m_Buffer.data(),
+                                               static_cast<unsigned int>(m_Buffer.size() * sizeof(int16_t)));
+                }
+                m_pBackend->RecordStreamRead(
+                    std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count());
+                m_ReadPosition = 0;
+            }
+            return m_Buffer[m_ReadPosition++];
+        }
+
+        OfflineAudioBackend *m_pBackend;
+        AudioStream *m_pStream;
+        AudioStreamFormat m_Format;
+        AudioVector m_Position;
+
+        std::vector<int16_t> m_Buffer;
+        size_t m_ReadPosition;
+        double m_Phase = 1.0;
+        float m_Previous = 0.0f;
+        float m_Current = 0.0f;
+    };
+
+} // soundscape
+
+OfflineAudioBackend::OfflineAudioBackend()
+    : OfflineAudioBackend(SOUNDSCAPE_ASSET_DIRECTORY, 22050)
+{
+}
+
+OfflineAudioBackend::OfflineAudioBackend(const std::string &asset_directory, int sample_rate)
+    : m_AssetDirectory(asset_directory),
+      m_SampleRate(sample_rate),
+      m_UpdateCount(0),
+      m_RenderedFrames(0),
+      m_MixFrame(0)
+{
+}
+
+OfflineAudioBackend::~OfflineAudioBackend()
+{
+    if(!m_Channels.empty())
+        TRACE_WARNING("OfflineAudioBackend destroyed with %zu channels playing", m_Channels.size());
+}
+
+bool OfflineAudioBackend::LoadPcm(const std::string &filename, std::vector<uint8_t> &pcm)
+{
+    const std::string ASSET_PREFIX = "file:///android_asset/";
+
+    std::string path = filename;
+    if(path.compare(0, ASSET_PREFIX.size(), ASSET_PREFIX) == 0)
+        path = m_AssetDirectory + "/" + path.substr(ASSET_PREFIX.size());
+
+    WavData wav;
+    if(!ReadWavFile(path, wav))
+        return false;
+
+    if(wav.channels != 1) {
+        TRACE_ERROR("%s has %d channels, only mono is supported", path.c_str(), wav.channels);
+        return false;
+    }
+
+    pcm.resize(wav.samples.size() * sizeof(int16_t));
+    memcpy(pcm.data(), wav.samples.data(), pcm.size());
+    return true;
+}
+
+std::unique_ptr<IAudioChannel> OfflineAudioBackend::PlayStream(AudioStream *stream,
+                                                               const AudioVector &position)
+{
+    auto channel = std::make_unique<OfflineAudioChannel>(this, stream, position);
+
+    std::lock_guard<std::mutex> guard(m_Mutex);
+    m_Channels.push_back(channel.get());
+    return channel;
+}
+
+void OfflineAudioBackend::SetListener(const AudioVector &position,
+                                      const AudioVector &velocity,
+                                      const AudioVector &forward, const AudioVector &up MAYBE_UNUSED)
+{
+    std::lock_guard<std::mutex> guard(m_Mutex);
+    m_ListenerPosition = position;
+    m_ListenerVelocity = velocity;
+    m_ListenerForward = forward;
+}
+
+AudioVector OfflineAudioBackend::GetListenerVelocity()
+{
+    std::lock_guard<std::mutex> guard(m_Mutex);
+    return m_ListenerVelocity;
+}
+
+void OfflineAudioBackend::Update()
+{
+    ++m_UpdateCount;
+}
+
+bool OfflineAudioBackend::GetCpuUsage(float &dsp, float &stream)
+{
+    // As FMOD reports it, the stream reads are counted separately from the mixing
+    std::lock_guard<std::mutex> guard(m_Mutex);
+    if(m_CpuFrames == 0)
+        return false;
+
+    auto seconds = static_cast<double>(m_CpuFrames) / m_SampleRate;
+    dsp = static_cast<float>(100.0 * (m_CpuRenderSeconds - m_CpuStreamSeconds) / seconds);
+    stream = static_cast<float>(100.0 * m_CpuStreamSeconds / seconds);
+    m_CpuRenderSeconds = 0.0;
+    m_CpuStreamSeconds = 0.0;
+    m_CpuFrames = 0;
+    return true;
+}
+
+void OfflineAudioBackend::Render(int16_t *output, size_t frames)
+{
+    TRACE_SCOPE("OfflineRender");
+    std::lock_guard<std::mutex> guard(m_Mutex);
+    auto start = std::chrono::steady_clock::now();
+    if(m_MixCallback)
+        m_MixCallback(m_pMixContext);
+
+    // The listener is always upright, so to the right is the forward vector turned 90 degrees
+    // clockwise when looking down on it.
+    AudioVector right = {m_ListenerForward.z, 0.0f, -m_ListenerForward.x};
+
+    m_MixBuffer.assign(frames * CHANNELS, 0.0f);
+    for(auto channel: m_Channels)
+        channel->Mix(m_MixBuffer.data(), frames, m_SampleRate, m_ListenerPosition, right);
+
+    for(size_t i = 0; i < m_MixBuffer.size(); ++i) {
+        auto sample = std::clamp(m_MixBuffer[i] * 32768.0f, -32768.0f, 32767.0f);
+        output[i] = static_cast<int16_t>(std::lrint(sample));
+    }
+
+    m_CpuRenderSeconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    m_CpuFrames += frames;
+    m_RenderedFrames += frames;
+}
+
+uint64_t OfflineAudioBackend::GetTime()
+{
+    return m_RenderedFrames * 1000000000ULL / static_cast<uint64_t>(m_SampleRate);
+}
+
+uint64_t OfflineAudioBackend::GetOutputTime(const AudioStreamFormat *format)
+{
+    // Stream reads are only made while rendering, and the listener is picked up at the start of
+    // the next render
+    auto frame = format ? m_MixFrame.load() : m_RenderedFrames.load();
+    return frame * 1000000000ULL / static_cast<uint64_t>(m_SampleRate);
+}
+
+void OfflineAudioBackend::SetMixCallback(MixCallback callback, void *context)
+{
+    std::lock_guard<std::mutex> guard(m_Mutex);
+    m_MixCallback = callback;
+    m_pMixContext = context;
+}
+
+bool OfflineAudioBackend::GetMemoryUsage(size_t &pool MAYBE_UNUSED, size_t &used MAYBE_UNUSED,
+                                         size_t &high_water MAYBE_UNUSED)
+{
+    // The mix and stream buffers are allocated from the heap when the streams are created
+    return false;
+}
+
+size_t OfflineAudioBackend::GetPlayingCount()
+{
+    std::lock_guard<std::mutex> guard(m_Mutex);
+    return m_Channels.size();
+}
+
+OfflineStreamReadStats OfflineAudioBackend::GetStreamReadStats()
+{
+    std::lock_guard<std::mutex> guard(m_Mutex);
+    return m_StreamReadStats;
+}
+
+void OfflineAudioBackend::RecordStreamRead(double seconds)
+{
+    ++m_StreamReadStats.reads;
+    m_StreamReadStats.total_seconds += seconds;
+    m_StreamReadStats.max_seconds = std::max(m_StreamReadStats.max_seconds, seconds);
+    m_CpuStreamSeconds += seconds;
+}
+
+void OfflineAudioBackend::RemoveChannel(OfflineAudioChannel *channel)
+{
+    std::lock_guard<std::mutex> guard(m_Mutex);
+    m_Channels.erase(std::remove(m_Channels.begin(), m_Channels.end(), channel), m_Channels.end());
+}
+
+void OfflineAudioBackend::SetChannelPosition(OfflineAudioChannel *channel,
+                                             const AudioVector &position)
+{
+    std::lock_guard<std::mutex> guard(m_Mutex);
+    channel->m_Position = position;
+}
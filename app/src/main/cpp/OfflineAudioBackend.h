@@ -0,0 +1,94 @@
+#pragma once
+
+#include <atomic>
+#include <mutex>
+#include <vector>
+
+#include "AudioBackend.h"
+
+namespace soundscape {
+
+    class OfflineAudioChannel;
+
+    // Timings of the stream PCM callbacks made while rendering
+    struct OfflineStreamReadStats {
+        uint64_t reads = 0;
+        double total_seconds = 0.0;
+        double max_seconds = 0.0;
+    };
+
+    //
+    // Backend for host builds which mixes the audio itself instead of playing it. Nothing is
+    // rendered until Render is called, so a test or benchmark can run the engine and render the
+    // resulting audio as fast as it likes, and write it out as a WAV file.
+    //
+    // The mixing is a simple approximation of what FMOD does. Each stream is resampled to the
+    // output rate with linear interpolation, attenuated with inverse distance rolloff between
+    // its minimum and maximum distances, and panned to stereo by its direction relative to the
+    // listener.
+    //
+    class OfflineAudioBackend : public IAudioBackend {
+    public:
+        static const int CHANNELS = 2;
+
+        // Android asset URLs are loaded from the app's assets directory in the source tree
+        OfflineAudioBackend();
+        OfflineAudioBackend(const std::string &asset_directory, int sample_rate);
+        ~OfflineAudioBackend() override;
+
+        bool LoadPcm(const std::string &filename, std::vector<uint8_t> &pcm) override;
+        std::unique_ptr<IAudioChannel> PlayStream(AudioStream *stream,
+                                                  const AudioVector &position) override;
+        void SetListener(const AudioVector &position, const AudioVector &velocity,
+                         const AudioVector &forward, const AudioVector &up) override;
+        void Update() override;
+        bool GetCpuUsage(float &dsp, float &stream) override;
+        uint64_t GetTime() override;
+        uint64_t GetOutputTime(const AudioStreamFormat *format) override;
+        void SetMixCallback(MixCallback callback, void *context) override;
+        bool GetMemoryUsage(size_t &pool, size_t &used, size_t &high_water) override;
+
+        // Mix the next frames of interleaved stereo audio
+        void Render(int16_t *output, size_t frames);
+
+        int GetSampleRate() const { return m_SampleRate; }
+        // The number of streams which are playing
+        size_t GetPlayingCount();
+        uint64_t GetUpdateCount() const { return m_UpdateCount; }
+        // The listener velocity, which isn't used in the mix as there's no Doppler
+        AudioVector GetListenerVelocity();
+        OfflineStreamReadStats GetStreamReadStats();
+
+    private:
+        friend class OfflineAudioChannel;
+        void RemoveChannel(OfflineAudioChannel *channel);
+        void SetChannelPosition(OfflineAudioChannel *channel, const AudioVector &position);
+        // Called with the mutex held
+        void RecordStreamRead(double seconds);
+
+        std::string m_AssetDirectory;
+        int m_SampleRate;
+
+        std::mutex m_Mutex;
+        std::vector<OfflineAudioChannel *> m_Channels;
+        AudioVector m_ListenerPosition = {0.0f, 0.0f, 0.0f};
+        AudioVector m_ListenerForward = {0.0f, 0.0f, 1.0f};
+        AudioVector m_ListenerVelocity = {0.0f, 0.0f, 0.0f};
+        std::vector<float> m_MixBuffer;
+        OfflineStreamReadStats m_StreamReadStats;
+        MixCallback m_MixCallback = nullptr;
+        void *m_pMixContext = nullptr;
+
+        // Time spent rendering and in the stream reads since the CPU usage was last read, and
+        // the number of frames rendered in that time
+        double m_CpuRenderSeconds = 0.0;
+        double m_CpuStreamSeconds = 0.0;
+        size_t m_CpuFrames = 0;
+        std::atomic<uint64_t> m_UpdateCount;
+
+        // The frames rendered so far, and the frame being mixed when a stream was last read
+        std::atomic<uint64_t> m_RenderedFrames;
+        std::atomic<uint64_t> m_MixFrame;
+    };
+
+} // soundscape
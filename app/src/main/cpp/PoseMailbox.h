@@ -0,0 +1,107 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+
+namespace soundscape {
+
+    struct Pose {
+        double latitude;
+        double longitude;
+        double heading;
+        int64_t timestamp;
+    };
+
+    //
+    // The pose mailbox is a small block of memory shared with Kotlin (a direct ByteBuffer) into
+    // which the latest listener pose is written. It's protected by a sequence lock: the writer
+    // makes the sequence odd, writes the pose and then makes it even again. The reader copies the
+    // pose and only accepts it if the sequence was even and unchanged across the copy. Only the
+    // latest pose is kept, so a burst of sensor updates between reads coalesces into one.
+    //
+    // The layout is duplicated in PoseMailbox.kt.
+    //
+    struct PoseMailboxLayout {
+        uint32_t sequence;
+        uint32_t reserved;
+        double latitude;
+        double longitude;
+        double heading;
+        int64_t timestamp;
+    };
+    static_assert(sizeof(PoseMailboxLayout) == 40);
+
+    class PoseMailbox {
+    public:
+        explicit PoseMailbox(void *memory)
+        : m_pLayout(static_cast<PoseMailboxLayout *>(memory))
+        {
+        }
+
+        // Returns true and fills in pose if a new pose has been written since the last call
+        bool Read(Pose &pose)
+        {
+            for(int attempt = 0; attempt < MAX_READ_ATTEMPTS; ++attempt) {
+                auto before = __atomic_load_n(&m_pLayout->sequence, __ATOMIC_ACQUIRE);
+                if(before & 1)
+                    continue;   // Write in progress
+                if(before == m_LastSequence)
+                    return false;
+
+                Pose copy;
+                copy.latitude = LoadDouble(&m_pLayout->latitude);
+                copy.longitude = LoadDouble(&m_pLayout->longitude);
+                copy.heading = LoadDouble(&m_pLayout->heading);
+                copy.timestamp = __atomic_load_n(&m_pLayout->timestamp, __ATOMIC_RELAXED);
+
+                std::atomic_thread_fence(std::memory_order_acquire);
+                auto after = __atomic_load_n(&m_pLayout->sequence, __ATOMIC_RELAXED);
+                if(before == after) {
+                    m_LastSequence = before;
+                    pose = copy;
+                    return true;
+                }
+            }
+            // The writer kept getting in the way, try again next time around
+            return false;
+        }
+
+        // Writer used from C++ e.g. host test harnesses. There must only be a single writer.
+        void Write(const Pose &pose)
+        {
+            auto sequence = __atomic_load_n(&m_pLayout->sequence, __ATOMIC_RELAXED);
+            __atomic_store_n(&m_pLayout->sequence, sequence + 1, __ATOMIC_RELAXED);
+            std::atomic_thread_fence(std::memory_order_release);
+
+            StoreDouble(&m_pLayout->latitude, pose.latitude);
+            StoreDouble(&m_pLayout->longitude, pose.longitude);
+            StoreDouble(&m_pLayout->heading, pose.heading);
+            __atomic_store_n(&m_pLayout->timestamp, pose.timestamp, __ATOMIC_RELAXED);
+
+            __atomic_store_n(&m_pLayout->sequence, sequence + 2, __ATOMIC_RELEASE);
+        }
+
+    private:
+        static double LoadDouble(double *source)
+        {
+            uint64_t bits = __atomic_load_n(reinterpret_cast<uint64_t *>(source), __ATOMIC_RELAXED);
+            double value;
+            memcpy(&value, &bits, sizeof(value));
+            return value;
+        }
+
+        static void StoreDouble(double *destination, double value)
+        {
+            uint64_t bits;
+            memcpy(&bits, &value, sizeof(bits));
+            __atomic_store_n(reinterpret_cast<uint64_t *>(destination), bits, __ATOMIC_RELAXED);
+        }
+
+        const static int MAX_READ_ATTEMPTS = 4;
+
+        PoseMailboxLayout *m_pLayout;
+        uint32_t m_LastSequence = 0;
+    };
+
+} // soundscape
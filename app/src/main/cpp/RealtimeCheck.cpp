@@ -0,0 +1,109 @@
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <execinfo.h>
+#include <unistd.h>
+
+#include "RealtimeCheck.h"
+
+using namespace soundscape;
+
+thread_local int soundscape::t_RealtimeDepth = 0;
+
+// Set while reporting, so that what the report itself does isn't reported
+static thread_local bool t_Reporting = false;
+
+static std::atomic<uint64_t> g_Violations[static_cast<size_t>(RealtimeViolation::Count)];
+static std::atomic<bool> g_Abort(getenv("SOUNDSCAPE_REALTIME_ABORT") != nullptr);
+
+// Hashes of the call sites which have been reported, so that each is only printed once
+static const size_t MAX_REPORTED_SITES = 256;
+static std::atomic<uint64_t> g_ReportedSites[MAX_REPORTED_SITES];
+
+static const char *g_ViolationNames[] = {"allocation", "lock", "system call"};
+
+namespace {
+    class RealtimeCheckInit {
+    public:
+        RealtimeCheckInit()
+        {
+            // The first backtrace loads the unwinder, which allocates, so get that done now
+            void *frames[2];
+            backtrace(frames, 2);
+        }
+
+        ~RealtimeCheckInit()
+        {
+            auto allocations = GetRealtimeViolations(RealtimeViolation::Allocation);
+            auto locks = GetRealtimeViolations(RealtimeViolation::Lock);
+            auto syscalls = GetRealtimeViolations(RealtimeViolation::Syscall);
+            if(allocations || locks || syscalls) {
+                fprintf(stderr, "Real-time violations: %llu allocations, %llu locks, %llu system calls\n",
+                        static_cast<unsigned long long>(allocations),
+                        static_cast<unsigned long long>(locks),
+                        static_cast<unsigned long long>(syscalls));
+            }
+        }
+    };
+    RealtimeCheckInit g_RealtimeCheckInit;
+}
+
+// Returns true if the site hasn't been reported before
+static bool AddReportedSite(uint64_t site)
+{
+    // Zero marks an empty slot
+    if(site == 0)
+        site = 1;
+    for(size_t probe = 0; probe < MAX_REPORTED_SITES; ++probe) {
+        auto &slot = g_ReportedSites[(site + probe) % MAX_REPORTED_SITES];
+        uint64_t empty = 0;
+        if(slot.compare_exchange_strong(empty, site))
+            return true;
+        if(empty == site)
+            return false;
+    }
+    // The table is full, so stop printing
+    return false;
+}
+
+void soundscape::ReportRealtimeViolation(RealtimeViolation violation, const char *function)
+{
+    if(t_Reporting)
+        return;
+    t_Reporting = true;
+
+    ++g_Violations[static_cast<size_t>(violation)];
+
+    void *frames[32];
+    int count = backtrace(frames, 32);
+    uint64_t site = static_cast<uint64_t>(violation);
+    for(int frame = 0; frame < count; ++frame)
+        site = (site * 1099511628211ULL) ^ reinterpret_cast<uintptr_t>(frames[frame]);
+
+    if(AddReportedSite(site) || g_Abort) {
+        fprintf(stderr, "Real-time violation: %s from %s in a stream callback\n",
+                g_ViolationNames[static_cast<size_t>(violation)], function);
+        // This writes the symbols straight to the file descriptor without allocating
+        backtrace_symbols_fd(frames, count, STDERR_FILENO);
+    }
+    if(g_Abort)
+        abort();
+
+    t_Reporting = false;
+}
+
+uint64_t soundscape::GetRealtimeViolations(RealtimeViolation violation)
+{
+    return g_Violations[static_cast<size_t>(violation)];
+}
+
+void soundscape::ResetRealtimeViolations()
+{
+    for(auto &violations: g_Violations)
+        violations = 0;
+}
+
+void soundscape::SetRealtimeAbort(bool abort)
+{
+    g_Abort = abort;
+}
@@ -0,0 +1,52 @@
+#pragma once
+
+//
+// Checking that the audio stream callbacks are real-time safe. The backends wrap each call into a
+// PcmReadCallback in REALTIME_SCOPE. In builds with SOUNDSCAPE_REALTIME_CHECK, linking in
+// RealtimeInterpose.cpp replaces malloc and free, mutex locking and the blocking system calls with
+// versions which report any call made from inside a scope, with a stack trace. The interposer
+// relies on glibc, so it's only used by the host tests, and it can't be combined with the
+// sanitizers, which replace malloc themselves.
+//
+// Without SOUNDSCAPE_REALTIME_CHECK the scopes compile to nothing.
+//
+#include <cstdint>
+
+namespace soundscape {
+
+    enum class RealtimeViolation {
+        Allocation = 0,
+        Lock = 1,
+        Syscall = 2,
+        Count
+    };
+
+#ifdef SOUNDSCAPE_REALTIME_CHECK
+    extern thread_local int t_RealtimeDepth;
+
+    class RealtimeScope {
+    public:
+        RealtimeScope() { ++t_RealtimeDepth; }
+        ~RealtimeScope() { --t_RealtimeDepth; }
+    };
+
+    inline bool InRealtimeScope() { return t_RealtimeDepth > 0; }
+
+    // Count a violation from the interposer, and the first time that it's made from a call site
+    // print it and the stack to stderr. If SOUNDSCAPE_REALTIME_ABORT is set in the environment or
+    // SetRealtimeAbort has been called, abort after printing it.
+    void ReportRealtimeViolation(RealtimeViolation violation, const char *function);
+
+    // Violations since the counts were last reset
+    uint64_t GetRealtimeViolations(RealtimeViolation violation);
+    void ResetRealtimeViolations();
+    void SetRealtimeAbort(bool abort);
+#endif
+
+} // soundscape
+
+#ifdef SOUNDSCAPE_REALTIME_CHECK
+#define REALTIME_SCOPE() soundscape::RealtimeScope realtime_scope
+#else
+#define REALTIME_SCOPE()
+#endif
@@ -0,0 +1,205 @@
+//
+// Replacements for the functions which aren't real-time safe, which report calls made from inside
+// a REALTIME_SCOPE and then do what the real function would. Linking this into a program puts its
+// definitions ahead of the C library's, see RealtimeCheck.h. Allocation goes straight to glibc's
+// own entry points, as looking those up with dlsym would itself allocate.
+//
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+#include <cerrno>
+#include <cstdarg>
+#include <cstddef>
+#include <dlfcn.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <pthread.h>
+#include <semaphore.h>
+#include <sys/select.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "RealtimeCheck.h"
+
+using namespace soundscape;
+
+extern "C" {
+    void *__libc_malloc(size_t size);
+    void *__libc_calloc(size_t count, size_t size);
+    void *__libc_realloc(void *block, size_t size);
+    void *__libc_memalign(size_t alignment, size_t size);
+    void __libc_free(void *block);
+}
+
+static inline void Check(RealtimeViolation violation, const char *function)
+{
+    if(InRealtimeScope())
+        ReportRealtimeViolation(violation, function);
+}
+
+// Look up the next definition of a function, which is the C library's
+template<typename Function>
+static Function GetNext(const char *name)
+{
+    return reinterpret_cast<Function>(dlsym(RTLD_NEXT, name));
+}
+
+#define REAL_FUNCTION(name) \
+    static auto real = GetNext<decltype(&::name)>(#name)
+
+extern "C" {
+
+void *malloc(size_t size)
+{
+    Check(RealtimeViolation::Allocation, "malloc");
+    return __libc_malloc(size);
+}
+
+void *calloc(size_t count, size_t size)
+{
+    Check(RealtimeViolation::Allocation, "calloc");
+    return __libc_calloc(count, size);
+}
+
+void *realloc(void *block, size_t size)
+{
+    Check(RealtimeViolation::Allocation, "realloc");
+    return __libc_realloc(block, size);
+}
+
+void *memalign(size_t alignment, size_t size)
+{
+    Check(RealtimeViolation::Allocation, "memalign");
+    return __libc_memalign(alignment, size);
+}
+
+void *aligned_alloc(size_t alignment, size_t size)
+{
+    Check(RealtimeViolation::Allocation, "aligned_alloc");
+    return __libc_memalign(alignment, size);
+}
+
+int posix_memalign(void **block, size_t alignment, size_t size)
+{
+    Check(RealtimeViolation::Allocation, "posix_memalign");
+    if((alignment < sizeof(void *)) || (alignment & (alignment - 1)))
+        return EINVAL;
+    *block = __libc_memalign(alignment, size);
+    return *block ? 0 : ENOMEM;
+}
+
+void free(void *block)
+{
+    // Freeing nothing doesn't touch the allocator
+    if(block)
+        Check(RealtimeViolation::Allocation, "free");
+    __libc_free(block);
+}
+
+int pthread_mutex_lock(pthread_mutex_t *mutex)
+{
+    Check(RealtimeViolation::Lock, "pthread_mutex_lock");
+    REAL_FUNCTION(pthread_mutex_lock);
+    return real(mutex);
+}
+
+int pthread_rwlock_rdlock(pthread_rwlock_t *lock)
+{
+    Check(RealtimeViolation::Lock, "pthread_rwlock_rdlock");
+    REAL_FUNCTION(pthread_rwlock_rdlock);
+    return real(lock);
+}
+
+int pthread_rwlock_wrlock(pthread_rwlock_t *lock)
+{
+    Check(RealtimeViolation::Lock, "pthread_rwlock_wrlock");
+    REAL_FUNCTION(pthread_rwlock_wrlock);
+    return real(lock);
+}
+
+int sem_wait(sem_t *semaphore)
+{
+    Check(RealtimeViolation::Lock, "sem_wait");
+    REAL_FUNCTION(sem_wait);
+    return real(semaphore);
+}
+
+ssize_t read(int fd, void *data, size_t length)
+{
+    Check(RealtimeViolation::Syscall, "read");
+    REAL_FUNCTION(read);
+    return real(fd, data, length);
+}
+
+ssize_t write(int fd, const void *data, size_t length)
+{
+    Check(RealtimeViolation::Syscall, "write");
+    REAL_FUNCTION(write);
+    return real(fd, data, length);
+}
+
+ssize_t recv(int fd, void *data, size_t length, int flags)
+{
+    Check(RealtimeViolation::Syscall, "recv");
+    REAL_FUNCTION(recv);
+    return real(fd, data, length, flags);
+}
+
+ssize_t send(int fd, const void *data, size_t length, int flags)
+{
+    Check(RealtimeViolation::Syscall, "send");
+    REAL_FUNCTION(send);
+    return real(fd, data, length, flags);
+}
+
+int open(const char *path, int flags, ...)
+{
+    Check(RealtimeViolation::Syscall, "open");
+    mode_t mode = 0;
+    if(flags & (O_CREAT | O_TMPFILE)) {
+        va_list args;
+        va_start(args, flags);
+        mode = va_arg(args, mode_t);
+        va_end(args);
+    }
+    REAL_FUNCTION(open);
+    return real(path, flags, mode);
+}
+
+int close(int fd)
+{
+    Check(RealtimeViolation::Syscall, "close");
+    REAL_FUNCTION(close);
+    return real(fd);
+}
+
+int poll(struct pollfd *fds, nfds_t count, int timeout)
+{
+    Check(RealtimeViolation::Syscall, "poll");
+    REAL_FUNCTION(poll);
+    return real(fds, count, timeout);
+}
+
+int select(int count, fd_set *read_fds, fd_set *write_fds, fd_set *except_fds, struct timeval *timeout)
+{
+    Check(RealtimeViolation::Syscall, "select");
+    REAL_FUNCTION(select);
+    return real(count, read_fds, write_fds, except_fds, timeout);
+}
+
+int nanosleep(const struct timespec *duration, struct timespec *remaining)
+{
+    Check(RealtimeViolation::Syscall, "nanosleep");
+    REAL_FUNCTION(nanosleep);
+    return real(duration, remaining);
+}
+
+int usleep(useconds_t microseconds)
+{
+    Check(RealtimeViolation::Syscall, "usleep");
+    REAL_FUNCTION(usleep);
+    return real(microseconds);
+}
+
+}
@@ -0,0 +1,273 @@
+#include <algorithm>
+#include <cstring>
+#include <functional>
+
+#include "RoadGraph.h"
+
+using namespace soundscape;
+
+// Clip the segment from (latitude0, longitude0) to (latitude1, longitude1) to the box, returning
+// the part of it inside as the range t0 to t1 along it, or false if none of it is
+static bool ClipSegment(const BoundingBox &box, double latitude0, double longitude0,
+                        double latitude1, double longitude1, double &t0, double &t1)
+{
+    auto d_latitude = latitude1 - latitude0;
+    auto d_longitude = longitude1 - longitude0;
+    const double p[4] = {-d_longitude, d_longitude, -d_latitude, d_latitude};
+    const double q[4] = {longitude0 - box.westLongitude, box.eastLongitude - longitude0,
+                         latitude0 - box.southLatitude, box.northLatitude - latitude0};
+    t0 = 0.0;
+    t1 = 1.0;
+    for(int edge = 0; edge < 4; ++edge) {
+        if(p[edge] == 0.0) {
+            if(q[edge] < 0.0)
+                return false;
+            continue;
+        }
+        auto t = q[edge] / p[edge];
+        if(p[edge] < 0.0) {
+            if(t > t1)
+                return false;
+            t0 = std::max(t0, t);
+        } else {
+            if(t < t0)
+                return false;
+            t1 = std::min(t1, t);
+        }
+    }
+    return true;
+}
+
+size_t RoadGraph::CoordinateHash::operator()(const Coordinate &coordinate) const
+{
+    uint64_t latitude;
+    uint64_t longitude;
+    memcpy(&latitude, &coordinate.latitude, sizeof(latitude));
+    memcpy(&longitude, &coordinate.longitude, sizeof(longitude));
+    return std::hash<uint64_t>()(latitude * 0x9e3779b97f4a7c15ull ^ longitude);
+}
+
+RoadGraph::RoadGraph(const FeatureCollection &features, const BoundingBox &bounds)
+{
+    // The intersections first, so that the roads can be split at them
+    for(uint32_t index = 0; index < features.features.size(); ++index) {
+        const auto &feature = features.features[index];
+        if((feature.category != FeatureCategory::Intersection) ||
+           (feature.geometry != GeometryType::Point) || (feature.part_count == 0))
+            continue;
+        const auto &part = features.parts[feature.first_part];
+        if(part.coordinate_count == 0)
+            continue;
+        Coordinate coordinate = {features.latitudes[part.first_coordinate],
+                                 features.longitudes[part.first_coordinate]};
+        auto node = GetNode(coordinate, RoadNodeType::Intersection);
+        if(m_Nodes[node].type == RoadNodeType::Intersection) {
+            m_Nodes[node].feature = index;
+            m_IntersectionNodes.emplace(index, node);
+        }
+    }
+
+    for(uint32_t index = 0; index < features.features.size(); ++index) {
+        const auto &feature = features.features[index];
+        if((feature.category != FeatureCategory::Road) && (feature.category != FeatureCategory::Path))
+            continue;
+        if((feature.geometry != GeometryType::LineString) &&
+           (feature.geometry != GeometryType::MultiLineString))
+            continue;
+        auto osm_id = (feature.osm_id_count != 0) ? features.osm_ids[feature.first_osm_id] : 0;
+
+        for(uint32_t part_index = 0; part_index < feature.part_count; ++part_index) {
+            const auto &part = features.parts[feature.first_part + part_index];
+            const auto *latitudes = features.latitudes.data() + part.first_coordinate;
+            const auto *longitudes = features.longitudes.data() + part.first_coordinate;
+            auto last = part.coordinate_count - 1;
+
+            // Walk along the line, starting an edge where it starts or comes into the tile and
+            // ending it at each intersection, where it leaves the tile and where it ends
+            auto start = NO_ROAD_NODE;
+            uint32_t first_coordinate = 0;
+            for(uint32_t vertex = 0; vertex + 1 < part.coordinate_count; ++vertex) {
+                Coordinate a = {latitudes[vertex], longitudes[vertex]};
+                Coordinate b = {latitudes[vertex + 1], longitudes[vertex + 1]};
+                if(a == b)
+                    continue;
+                double t0;
+                double t1;
+                if(!ClipSegment(bounds, a.latitude, a.longitude, b.latitude, b.longitude, t0, t1))
+                    continue;
+                if(t1 <= t0) {
+                    // It only touches the edge of the tile at a, so if it's on its way out then
+                    // that's where the edge ends
+                    if(start != NO_ROAD_NODE) {
+                        EndEdge(index, osm_id, first_coordinate, start, RoadNodeType::Border);
+                        start = NO_ROAD_NODE;
+                    }
+                    continue;
+                }
+
+                if(start == NO_ROAD_NODE) {
+                    auto entry = a;
+                    if(t0 > 0.0) {
+                        entry.latitude += t0 * (b.latitude - a.latitude);
+                        entry.longitude += t0 * (b.longitude - a.longitude);
+                    }
+                    // After the first vertex, the line can only start again by coming back into
+                    // the tile
+                    auto type = ((t0 > 0.0) || (vertex > 0)) ? RoadNodeType::Border : RoadNodeType::End;
+                    start = GetNode(entry, type);
+                    first_coordinate = static_cast<uint32_t>(m_Latitudes.size());
+                    m_Latitudes.push_back(entry.latitude);
+                    m_Longitudes.push_back(entry.longitude);
+                }
+
+                if(t1 < 1.0) {
+                    Coordinate exit = {a.latitude + t1 * (b.latitude - a.latitude),
+                                       a.longitude + t1 * (b.longitude - a.longitude)};
+                    m_Latitudes.push_back(exit.latitude);
+                    m_Longitudes.push_back(exit.longitude);
+                    AddEdge(index, osm_id, first_coordinate, start, GetNode(exit, RoadNodeType::Border));
+                    start = NO_ROAD_NODE;
+                    continue;
+                }
+
+                m_Latitudes.push_back(b.latitude);
+                m_Longitudes.push_back(b.longitude);
+                if(vertex + 1 == last) {
+                    AddEdge(index, osm_id, first_coordinate, start, GetNode(b, RoadNodeType::End));
+                    start = NO_ROAD_NODE;
+                    continue;
+                }
+                auto it = m_NodesByCoordinate.find(b);
+                if((it != m_NodesByCoordinate.end()) &&
+                   (m_Nodes[it->second].type == RoadNodeType::Intersection)) {
+                    AddEdge(index, osm_id, first_coordinate, start, it->second);
+                    start = it->second;
+                    first_coordinate = static_cast<uint32_t>(m_Latitudes.size());
+                    m_Latitudes.push_back(b.latitude);
+                    m_Longitudes.push_back(b.longitude);
+                }
+            }
+            // A line whose last segments were all repeats of the same point
+            if(start != NO_ROAD_NODE)
+                EndEdge(index, osm_id, first_coordinate, start, RoadNodeType::End);
+        }
+    }
+
+    BuildLegs();
+    decltype(m_NodesByCoordinate)().swap(m_NodesByCoordinate);
+}
+
+uint32_t RoadGraph::GetNode(const Coordinate &coordinate, RoadNodeType type)
+{
+    auto inserted = m_NodesByCoordinate.emplace(coordinate, static_cast<uint32_t>(m_Nodes.size()));
+    if(inserted.second)
+        m_Nodes.push_back({coordinate.latitude, coordinate.longitude, type, 0, 0, 0});
+    return inserted.first->second;
+}
+
+void RoadGraph::AddEdge(uint32_t feature, int64_t osm_id, uint32_t first_coordinate,
+                        uint32_t start, uint32_t end)
+{
+    RoadEdge edge;
+    edge.feature = feature;
+    edge.osm_id = osm_id;
+    edge.nodes[0] = start;
+    edge.nodes[1] = end;
+    edge.first_coordinate = first_coordinate;
+    edge.coordinate_count = static_cast<uint32_t>(m_Latitudes.size()) - first_coordinate;
+    edge.length = 0.0;
+    for(auto coordinate = first_coordinate + 1; coordinate < m_Latitudes.size(); ++coordinate) {
+        edge.length += distance(m_Latitudes[coordinate - 1], m_Longitudes[coordinate - 1],
+                                m_Latitudes[coordinate], m_Longitudes[coordinate]);
+    }
+
+    for(auto node: edge.nodes) {
+        if((m_Nodes[node].type == RoadNodeType::Border) && (osm_id != 0))
+            m_BorderNodes.emplace(osm_id, node);
+        ++m_Nodes[node].leg_count;
+    }
+    m_Edges.push_back(edge);
+}
+
+// End the edge at its last coordinate so far, or drop it if that's the only one
+void RoadGraph::EndEdge(uint32_t feature, int64_t osm_id, uint32_t first_coordinate,
+                        uint32_t start, RoadNodeType type)
+{
+    if(m_Latitudes.size() - first_coordinate < 2) {
+        m_Latitudes.resize(first_coordinate);
+        m_Longitudes.resize(first_coordinate);
+        return;
+    }
+    Coordinate end = {m_Latitudes.back(), m_Longitudes.back()};
+    AddEdge(feature, osm_id, first_coordinate, start, GetNode(end, type));
+}
+
+// The bearing from one end of the edge towards the point ROAD_BEARING_DISTANCE along it, or its
+// other end if it's shorter than that, as getReferenceCoordinate in GeoUtils.kt
+double RoadGraph::GetBearing(const RoadEdge &edge, bool from_end) const
+{
+    auto count = static_cast<int>(edge.coordinate_count);
+    auto step = from_end ? -1 : 1;
+    auto first = static_cast<int>(edge.first_coordinate) + (from_end ? count - 1 : 0);
+    auto latitude = m_Latitudes[first];
+    auto longitude = m_Longitudes[first];
+
+    auto target_latitude = m_Latitudes[first + step * (count - 1)];
+    auto target_longitude = m_Longitudes[first + step * (count - 1)];
+    auto travelled = 0.0;
+    for(int i = 1; i < count; ++i) {
+        auto previous = first + step * (i - 1);
+        auto current = first + step * i;
+        auto length = distance(m_Latitudes[previous], m_Longitudes[previous],
+                               m_Latitudes[current], m_Longitudes[current]);
+        if(travelled + length >= ROAD_BEARING_DISTANCE) {
+            auto t = (length > 0.0) ? (ROAD_BEARING_DISTANCE - travelled) / length : 1.0;
+            target_latitude = m_Latitudes[previous] + t * (m_Latitudes[current] - m_Latitudes[previous]);
+            target_longitude = m_Longitudes[previous] + t * (m_Longitudes[current] - m_Longitudes[previous]);
+            break;
+        }
+        travelled += length;
+    }
+    return bearingFromTwoPoints(latitude, longitude, target_latitude, target_longitude);
+}
+
+void RoadGraph::BuildLegs()
+{
+    uint32_t first_leg = 0;
+    for(auto &node: m_Nodes) {
+        node.first_leg = first_leg;
+        first_leg += node.leg_count;
+        node.leg_count = 0;
+    }
+    m_Legs.resize(first_leg);
+    for(uint32_t index = 0; index < m_Edges.size(); ++index) {
+        const auto &edge = m_Edges[index];
+        for(int end = 0; end < 2; ++end) {
+            auto &node = m_Nodes[edge.nodes[end]];
+            m_Legs[node.first_leg + node.leg_count++] = {index, edge.nodes[1 - end],
+                                                         GetBearing(edge, end == 1)};
+        }
+    }
+    for(const auto &node: m_Nodes) {
+        std::sort(m_Legs.begin() + node.first_leg, m_Legs.begin() + node.first_leg + node.leg_count,
+                  [](const RoadLeg &a, const RoadLeg &b) { return a.bearing < b.bearing; });
+    }
+}
+
+uint32_t RoadGraph::GetIntersectionNode(uint32_t feature) const
+{
+    auto it = m_IntersectionNodes.find(feature);
+    return (it == m_IntersectionNodes.end()) ? NO_ROAD_NODE : it->second;
+}
+
+uint32_t RoadGraph::FindBorderNode(int64_t osm_id, double latitude, double longitude,
+                                   double tolerance) const
+{
+    auto range = m_BorderNodes.equal_range(osm_id);
+    for(auto it = range.first; it != range.second; ++it) {
+        const auto &node = m_Nodes[it->second];
+        if(distance(latitude, longitude, node.latitude, node.longitude) <= tolerance)
+            return it->second;
+    }
+    return NO_ROAD_NODE;
+}
@@ -0,0 +1,126 @@
+#pragma once
+
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+
+#include "GeoJsonParser.h"
+#include "GeoUtils.h"
+
+namespace soundscape {
+
+    enum class RoadNodeType : uint8_t {
+        // A gd_intersection feature of the tile
+        Intersection = 0,
+        // Where a road ends, or where it carries on as another road without an intersection
+        End,
+        // Where a road crosses the edge of the tile
+        Border
+    };
+
+    const uint32_t NO_ROAD_NODE = UINT32_MAX;
+
+    struct RoadNode {
+        double latitude;
+        double longitude;
+        RoadNodeType type;
+        // The intersection feature, for an intersection
+        uint32_t feature;
+        // The node's range of legs
+        uint32_t first_leg;
+        uint32_t leg_count;
+    };
+
+    // A piece of road between two nodes
+    struct RoadEdge {
+        // The road feature, and its first OSM id or 0 if it has none
+        uint32_t feature;
+        int64_t osm_id;
+        // The nodes at the start and end of the coordinates
+        uint32_t nodes[2];
+        uint32_t first_coordinate;
+        uint32_t coordinate_count;
+        // In metres
+        double length;
+    };
+
+    // An edge as seen from one of its nodes
+    struct RoadLeg {
+        uint32_t edge;
+        // The node at the other end
+        uint32_t node;
+        // The direction in degrees from 0 to 360 in which the road leaves the node, which is
+        // towards the point ROAD_BEARING_DISTANCE along it as in getRoadBearingToIntersection
+        double bearing;
+    };
+
+    const double ROAD_BEARING_DISTANCE = 3.0;
+
+    //
+    // The road network of a tile, built once when the tile is loaded so that intersection queries
+    // are lookups rather than the scans of the road and intersection collections done by
+    // getIntersectionRoadNames, splitRoadByIntersection and getRoadBearingToIntersection in
+    // TileUtils.kt.
+    //
+    // The roads and paths of the tile are split into edges at every intersection feature that's on
+    // one of their vertices, with the bearing of each road leaving each node worked out in advance
+    // and the legs of each node sorted by it. Roads which share an end without an intersection
+    // feature share an End node.
+    //
+    // Tiles keep the whole of each road with a vertex inside them, so a road that carries on into
+    // another tile is cut off where it crosses the edge of this one, at a Border node. The tile
+    // next door cuts the same road at the same point, so the two can be joined up by the road's
+    // OSM id and the location of the node, see FeatureStore::GetIntersectionRoads. The graph has
+    // its own copy of the coordinates of the edges, as the ends at the tile edges are new points.
+    //
+    class RoadGraph {
+    public:
+        RoadGraph(const FeatureCollection &features, const BoundingBox &bounds);
+
+        const std::vector<RoadNode> &GetNodes() const { return m_Nodes; }
+        const std::vector<RoadEdge> &GetEdges() const { return m_Edges; }
+        const std::vector<RoadLeg> &GetLegs() const { return m_Legs; }
+        const std::vector<double> &GetLatitudes() const { return m_Latitudes; }
+        const std::vector<double> &GetLongitudes() const { return m_Longitudes; }
+
+        // The node of an intersection feature, or NO_ROAD_NODE if it isn't one
+        uint32_t GetIntersectionNode(uint32_t feature) const;
+        // The Border node where the road with the OSM id crosses the edge of the tile within
+        // tolerance metres of the location, or NO_ROAD_NODE if there isn't one
+        uint32_t FindBorderNode(int64_t osm_id, double latitude, double longitude,
+                                double tolerance) const;
+
+    private:
+        struct Coordinate {
+            double latitude;
+            double longitude;
+            bool operator==(const Coordinate &other) const
+            {
+                return (latitude == other.latitude) && (longitude == other.longitude);
+            }
+        };
+        struct CoordinateHash {
+            size_t operator()(const Coordinate &coordinate) const;
+        };
+
+        uint32_t GetNode(const Coordinate &coordinate, RoadNodeType type);
+        void AddEdge(uint32_t feature, int64_t osm_id, uint32_t first_coordinate,
+                     uint32_t start, uint32_t end);
+        void EndEdge(uint32_t feature, int64_t osm_id, uint32_t first_coordinate,
+                     uint32_t start, RoadNodeType type);
+        double GetBearing(const RoadEdge &edge, bool from_end) const;
+        void BuildLegs();
+
+        std::vector<RoadNode> m_Nodes;
+        std::vector<RoadEdge> m_Edges;
+        std::vector<RoadLeg> m_Legs;
+        std::vector<double> m_Latitudes;
+        std::vector<double> m_Longitudes;
+
+        std::unordered_map<Coordinate, uint32_t, CoordinateHash> m_NodesByCoordinate;
+        std::unordered_map<uint32_t, uint32_t> m_IntersectionNodes;
+        // The Border nodes by the OSM id of their roads
+        std::unordered_multimap<int64_t, uint32_t> m_BorderNodes;
+    };
+
+} // soundscape
@@ -0,0 +1,671 @@
+#include <algorithm>
+#include <array>
+#include <cerrno>
+#include <chrono>
+#include <cmath>
+#include <cstddef>
+#include <cstring>
+#include <limits>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+#include "GeoUtils.h"
+#include "TileCache.h"
+#include "TileClipper.h"
+#include "TileFile.h"
+#include "Trace.h"
+
+using namespace soundscape;
+
+namespace {
+    // The log starts with this, and the records follow it one after the other, each padded to a
+    // multiple of 8 bytes so that the tile files in them are aligned for TileFile
+    struct TileCacheLogHeader {
+        char magic[4];
+        uint32_t version;
+        uint64_t reserved;
+    };
+
+    struct TileCacheRecord {
+        char magic[4];
+        // The size of the tile file which follows, or zero if the tile was removed
+        uint32_t length;
+        uint64_t quadkey;
+        // When the tile was written, in seconds since the epoch
+        int64_t time;
+        // CRC-32 of the tile file, and of the fields above
+        uint32_t checksum;
+        uint32_t header_checksum;
+    };
+}
+
+// The headers are written in native byte order, and the log is little endian like the tile files
+static_assert(__BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__, "The tile cache log is little endian");
+static_assert(sizeof(TileCacheLogHeader) == 16, "TileCacheLogHeader layout");
+static_assert(sizeof(TileCacheRecord) == 32, "TileCacheRecord layout");
+
+static const char LOG_MAGIC[4] = {'S', 'S', 'T', 'L'};
+static const char RECORD_MAGIC[4] = {'S', 'S', 'T', 'R'};
+static const uint32_t LOG_VERSION = 1;
+static const char *LOG_NAME = "tiles.log";
+static const char *COMPACT_SUFFIX = ".compact";
+
+// A tile's age is counted as this much more for each metre that it is from the listener
+static const double SECONDS_PER_METRE = 3.6;
+// Dead records are left until there's at least this much of them, however few tiles there are
+static const uint64_t MIN_COMPACTION_BYTES = 1024 * 1024;
+
+static uint32_t Crc32(const uint8_t *data, size_t length)
+{
+    static const auto TABLE = [] {
+        std::array<uint32_t, 256> table{};
+        for(uint32_t index = 0; index < 256; ++index) {
+            uint32_t crc = index;
+            for(int bit = 0; bit < 8; ++bit)
+                crc = (crc & 1) ? (0xedb88320 ^ (crc >> 1)) : (crc >> 1);
+            table[index] = crc;
+        }
+        return table;
+    }();
+
+    uint32_t crc = 0xffffffff;
+    for(size_t index = 0; index < length; ++index)
+        crc = TABLE[(crc ^ data[index]) & 0xff] ^ (crc >> 8);
+    return crc ^ 0xffffffff;
+}
+
+static uint32_t HeaderChecksum(const TileCacheRecord &record)
+{
+    return Crc32(reinterpret_cast<const uint8_t *>(&record), offsetof(TileCacheRecord, header_checksum));
+}
+
+static uint64_t RecordSize(uint32_t length)
+{
+    return sizeof(TileCacheRecord) + ((static_cast<uint64_t>(length) + 7) & ~uint64_t(7));
+}
+
+static bool WriteAll(int fd, const void *data, size_t length, uint64_t offset)
+{
+    auto bytes = static_cast<const uint8_t *>(data);
+    while(length > 0) {
+        auto result = pwrite(fd, bytes, length, static_cast<off_t>(offset));
+        if(result < 0) {
+            if(errno == EINTR)
+                continue;
+            return false;
+        }
+        bytes += result;
+        length -= static_cast<size_t>(result);
+        offset += static_cast<uint64_t>(result);
+    }
+    return true;
+}
+
+static bool ReadAll(int fd, void *data, size_t length, uint64_t offset)
+{
+    auto bytes = static_cast<uint8_t *>(data);
+    while(length > 0) {
+        auto result = pread(fd, bytes, length, static_cast<off_t>(offset));
+        if(result < 0) {
+            if(errno == EINTR)
+                continue;
+            return false;
+        }
+        if(result == 0)
+            return false;
+        bytes += result;
+        length -= static_cast<size_t>(result);
+        offset += static_cast<uint64_t>(result);
+    }
+    return true;
+}
+
+static bool WriteLogHeader(int fd)
+{
+    TileCacheLogHeader header{};
+    memcpy(header.magic, LOG_MAGIC, sizeof(header.magic));
+    header.version = LOG_VERSION;
+    return (ftruncate(fd, 0) == 0) && WriteAll(fd, &header, sizeof(header), 0);
+}
+
+static int64_t SystemClock()
+{
+    return std::chrono::duration_cast<std::chrono::seconds>(
+            std::chrono::system_clock::now().time_since_epoch()).count();
+}
+
+TileCache::TileCache(std::function<int64_t()> clock)
+         : m_Clock(clock ? std::move(clock) : SystemClock),
+           m_Latitude(NAN),
+           m_Longitude(NAN)
+{
+}
+
+TileCache::~TileCache()
+{
+    Close();
+}
+
+bool TileCache::Open(const std::string &directory, uint64_t budget)
+{
+    Close();
+
+    if((mkdir(directory.c_str(), 0755) != 0) && (errno != EEXIST)) {
+        TRACE_ERROR("Failed to create %s: %s", directory.c_str(), strerror(errno));
+        return false;
+    }
+    auto log_path = directory + "/" + LOG_NAME;
+    // Left behind if the app was killed while compacting, in which case the log is still whole
+    unlink((log_path + COMPACT_SUFFIX).c_str());
+
+    int fd = open(log_path.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+    if(fd < 0) {
+        TRACE_ERROR("Failed to open %s: %s", log_path.c_str(), strerror(errno));
+        return false;
+    }
+
+    std::lock_guard<std::mutex> compaction_guard(m_CompactionMutex);
+    std::lock_guard<std::mutex> guard(m_Mutex);
+    m_Directory = directory;
+    m_LogPath = log_path;
+    m_Fd = fd;
+    m_Budget = budget;
+    m_Stats = TileCacheStats();
+    if(!Scan()) {
+        close(m_Fd);
+        m_Fd = -1;
+        m_Entries.clear();
+        return false;
+    }
+    Evict(std::numeric_limits<uint64_t>::max());
+    TRACE("TileCache opened %s with %zu tiles", m_LogPath.c_str(), m_Entries.size());
+
+    m_CompactionThreadRunning = true;
+    m_CompactionThread = std::thread(&TileCache::CompactionThread, this);
+    return true;
+}
+
+void TileCache::Close()
+{
+    StopCompactionThread();
+
+    std::lock_guard<std::mutex> compaction_guard(m_CompactionMutex);
+    std::lock_guard<std::mutex> guard(m_Mutex);
+    if(m_Fd >= 0)
+        close(m_Fd);
+    m_Fd = -1;
+    m_LogSize = 0;
+    m_Entries.clear();
+}
+
+bool TileCache::IsOpen() const
+{
+    std::lock_guard<std::mutex> guard(m_Mutex);
+    return m_Fd >= 0;
+}
+
+bool TileCache::Scan()
+{
+    struct stat status{};
+    if(fstat(m_Fd, &status) != 0)
+        return false;
+    auto size = static_cast<uint64_t>(status.st_size);
+
+    TileCacheLogHeader header{};
+    if((size < sizeof(header)) || !ReadAll(m_Fd, &header, sizeof(header), 0) ||
+       (memcmp(header.magic, LOG_MAGIC, sizeof(header.magic)) != 0) ||
+       (header.version != LOG_VERSION)) {
+        // A new cache, or one from another version which is simply thrown away
+        if(size != 0)
+            TRACE_WARNING("Discarding tile cache %s", m_LogPath.c_str());
+        m_LogSize = sizeof(header);
+        return WriteLogHeader(m_Fd) && (fsync(m_Fd) == 0);
+    }
+
+    uint64_t offset = sizeof(header);
+    while(offset + sizeof(TileCacheRecord) <= size) {
+        TileCacheRecord record{};
+        if(!ReadAll(m_Fd, &record, sizeof(record), offset) ||
+           (memcmp(record.magic, RECORD_MAGIC, sizeof(record.magic)) != 0) ||
+           (record.header_checksum != HeaderChecksum(record)) ||
+           (offset + RecordSize(record.length) > size))
+            break;
+
+        auto it = m_Entries.find(record.quadkey);
+        if(it != m_Entries.end()) {
+            auto replaced = RecordSize(it->second.length);
+            m_Stats.live_bytes -= replaced;
+            m_Stats.dead_bytes += replaced;
+        }
+        if(record.length == 0) {
+            if(it != m_Entries.end())
+                m_Entries.erase(it);
+            m_Stats.dead_bytes += sizeof(record);
+        } else {
+            m_Entries[record.quadkey] = {offset, record.length, record.checksum, record.time};
+            m_Stats.live_bytes += RecordSize(record.length);
+        }
+        offset += RecordSize(record.length);
+    }
+
+    // Anything after the last whole record was being written when the app was killed
+    if(offset < size) {
+        TRACE_WARNING("Cutting %llu bytes from the end of %s",
+                      static_cast<unsigned long long>(size - offset), m_LogPath.c_str());
+        if(ftruncate(m_Fd, static_cast<off_t>(offset)) != 0)
+            return false;
+    }
+    m_LogSize = offset;
+    return true;
+}
+
+bool TileCache::Append(uint64_t key, const uint8_t *data, uint32_t length, int64_t time)
+{
+    TileCacheRecord record{};
+    memcpy(record.magic, RECORD_MAGIC, sizeof(record.magic));
+    record.length = length;
+    record.quadkey = key;
+    record.time = time;
+    record.checksum = Crc32(data, length);
+    record.header_checksum = HeaderChecksum(record);
+
+    static const uint8_t PADDING[8] = {};
+    struct iovec vectors[3] = {
+        {&record, sizeof(record)},
+        {const_cast<uint8_t *>(data), length},
+        {const_cast<uint8_t *>(PADDING), static_cast<size_t>(RecordSize(length) - sizeof(record) - length)}
+    };
+    auto size = RecordSize(length);
+    auto written = pwritev(m_Fd, vectors, 3, static_cast<off_t>(m_LogSize));
+    // The record has to be on disk before it's in the index, so that a tile which has been read
+    // from the cache is never lost
+    if((written != static_cast<ssize_t>(size)) || (fdatasync(m_Fd) != 0)) {
+        TRACE_ERROR("Failed to write to %s: %s", m_LogPath.c_str(), strerror(errno));
+        if(ftruncate(m_Fd, static_cast<off_t>(m_LogSize)) != 0)
+            TRACE_ERROR("Failed to truncate %s", m_LogPath.c_str());
+        return false;
+    }
+    m_LogSize += size;
+    return true;
+}
+
+void TileCache::RemoveEntry(uint64_t key)
+{
+    auto it = m_Entries.find(key);
+    if(it == m_Entries.end())
+        return;
+    auto size = RecordSize(it->second.length);
+    m_Stats.live_bytes -= size;
+    m_Stats.dead_bytes += size;
+    m_Entries.erase(it);
+}
+
+void TileCache::Evict(uint64_t keep)
+{
+    double latitude = m_Latitude.load(std::memory_order_relaxed);
+    double longitude = m_Longitude.load(std::memory_order_relaxed);
+    bool have_location = !std::isnan(latitude) && !std::isnan(longitude);
+    auto now = m_Clock();
+
+    while(m_Stats.live_bytes > m_Budget) {
+        auto victim = m_Entries.end();
+        double victim_score = -std::numeric_limits<double>::infinity();
+        for(auto it = m_Entries.begin(); it != m_Entries.end(); ++it) {
+            if(it->first == keep)
+                continue;
+            double score = static_cast<double>(now - it->second.last_used);
+            if(have_location) {
+                auto tile = TileId::FromQuadKey(it->first);
+                auto box = tileToBoundingBox(tile.x, tile.y, tile.zoom);
+                score += SECONDS_PER_METRE * distance(latitude, longitude,
+                                                      (box.southLatitude + box.northLatitude) / 2,
+                                                      (box.westLongitude + box.eastLongitude) / 2);
+            }
+            if(score > victim_score) {
+                victim = it;
+                victim_score = score;
+            }
+        }
+        if(victim == m_Entries.end())
+            break;
+
+        // If the removal can't be written the tile comes back when the cache is next opened,
+        // which is only a waste of space
+        auto key = victim->first;
+        if(Append(key, nullptr, 0, now))
+            m_Stats.dead_bytes += sizeof(TileCacheRecord);
+        RemoveEntry(key);
+        ++m_Stats.evictions;
+    }
+}
+
+void TileCache::SetBudget(uint64_t budget)
+{
+    {
+        std::lock_guard<std::mutex> guard(m_Mutex);
+        m_Budget = budget;
+        if(m_Fd >= 0)
+            Evict(std::numeric_limits<uint64_t>::max());
+    }
+    m_CompactionWakeup.notify_one();
+}
+
+void TileCache::SetLocation(double latitude, double longitude)
+{
+    m_Latitude.store(latitude, std::memory_order_relaxed);
+    m_Longitude.store(longitude, std::memory_order_relaxed);
+}
+
+bool TileCache::Get(const TileId &tile, FeatureCollection &features)
+{
+    features.Clear();
+
+    auto key = tile.GetQuadKey();
+    Entry entry{};
+    void *mapping;
+    size_t mapping_length;
+    uint64_t page_offset;
+    {
+        std::lock_guard<std::mutex> guard(m_Mutex);
+        auto it = m_Entries.find(key);
+        if((m_Fd < 0) || (it == m_Entries.end())) {
+            ++m_Stats.misses;
+            return false;
+        }
+        entry = it->second;
+        it->second.last_used = m_Clock();
+
+        // Mapped here as a compaction could close the file as soon as the lock is released. The
+        // mapping stays valid even if it does.
+        static const auto page_size = static_cast<uint64_t>(sysconf(_SC_PAGESIZE));
+        auto data_offset = entry.offset + sizeof(TileCacheRecord);
+        page_offset = data_offset - (data_offset % page_size);
+        mapping_length = static_cast<size_t>(data_offset - page_offset + entry.length);
+        mapping = mmap(nullptr, mapping_length, PROT_READ, MAP_PRIVATE, m_Fd,
+                       static_cast<off_t>(page_offset));
+    }
+    if(mapping == MAP_FAILED) {
+        TRACE_ERROR("Failed to map %s: %s", m_LogPath.c_str(), strerror(errno));
+        std::lock_guard<std::mutex> guard(m_Mutex);
+        ++m_Stats.misses;
+        return false;
+    }
+
+    auto data = static_cast<const uint8_t *>(mapping) +
+                (entry.offset + sizeof(TileCacheRecord) - page_offset);
+    TileFile file;
+    bool ok = (Crc32(data, entry.length) == entry.checksum) &&
+              file.Open(data, entry.length) &&
+              (file.GetTile() == tile) &&
+              file.Decode(features);
+    file.Close();
+    munmap(mapping, mapping_length);
+
+    std::lock_guard<std::mutex> guard(m_Mutex);
+    if(ok) {
+        ++m_Stats.hits;
+        return true;
+    }
+
+    TRACE_WARNING("Tile %d,%d in the cache is corrupt", tile.x, tile.y);
+    ++m_Stats.corrupt;
+    ++m_Stats.misses;
+    auto it = m_Entries.find(key);
+    if((m_Fd >= 0) && (it != m_Entries.end()) && (it->second.checksum == entry.checksum)) {
+        if(Append(key, nullptr, 0, m_Clock()))
+            m_Stats.dead_bytes += sizeof(TileCacheRecord);
+        RemoveEntry(key);
+    }
+    return false;
+}
+
+bool TileCache::Put(const TileId &tile, const FeatureCollection &features)
+{
+    std::vector<uint8_t> data;
+    if(!EncodeTileFile(tile, features, data))
+        return false;
+
+    auto key = tile.GetQuadKey();
+    {
+        std::lock_guard<std::mutex> guard(m_Mutex);
+        if(m_Fd < 0)
+            return false;
+        auto now = m_Clock();
+        auto offset = m_LogSize;
+        if(!Append(key, data.data(), static_cast<uint32_t>(data.size()), now))
+            return false;
+
+        RemoveEntry(key);
+        m_Entries[key] = {offset, static_cast<uint32_t>(data.size()), Crc32(data.data(), data.size()), now};
+        m_Stats.live_bytes += RecordSize(static_cast<uint32_t>(data.size()));
+        Evict(key);
+        if(!NeedsCompaction())
+            return true;
+    }
+    m_CompactionWakeup.notify_one();
+    return true;
+}
+
+bool TileCache::Remove(const TileId &tile)
+{
+    auto key = tile.GetQuadKey();
+    {
+        std::lock_guard<std::mutex> guard(m_Mutex);
+        if((m_Fd < 0) || (m_Entries.count(key) == 0))
+            return false;
+        if(!Append(key, nullptr, 0, m_Clock()))
+            return false;
+        m_Stats.dead_bytes += sizeof(TileCacheRecord);
+        RemoveEntry(key);
+    }
+    m_CompactionWakeup.notify_one();
+    return true;
+}
+
+bool TileCache::Contains(const TileId &tile) const
+{
+    std::lock_guard<std::mutex> guard(m_Mutex);
+    return m_Entries.count(tile.GetQuadKey()) != 0;
+}
+
+bool TileCache::GetOrFetch(const TileId &tile, ITileSource &source, FeatureCollection &features)
+{
+    if(Get(tile, features))
+        return true;
+
+    std::string json;
+    if(!source.FetchTile(tile, json))
+        return false;
+    GeoJsonParser parser;
+    FeatureCollection parsed;
+    if(!parser.Parse(json, parsed)) {
+        TRACE_WARNING("Tile %d,%d isn't valid GeoJSON: %s", tile.x, tile.y, parser.GetError().c_str());
+        return false;
+    }
+    ClipFeatures(parsed, tileToBoundingBox(tile.x, tile.y, tile.zoom), features);
+    // The tile is still good even if it couldn't be cached
+    Put(tile, features);
+    return true;
+}
+
+bool TileCache::NeedsCompaction() const
+{
+    return (m_Fd >= 0) &&
+           (m_Stats.dead_bytes >= MIN_COMPACTION_BYTES) &&
+           (m_Stats.dead_bytes >= m_Stats.live_bytes);
+}
+
+bool TileCache::Compact()
+{
+    std::lock_guard<std::mutex> compaction_guard(m_CompactionMutex);
+
+    // Copy the records which are live now into the new log in quadkey order, without holding
+    // the lock so that tiles can still be read and written
+    std::vector<std::pair<uint64_t, Entry>> live;
+    uint64_t snapshot_end;
+    int fd;
+    std::string path;
+    {
+        std::lock_guard<std::mutex> guard(m_Mutex);
+        if(m_Fd < 0)
+            return false;
+        live.assign(m_Entries.begin(), m_Entries.end());
+        snapshot_end = m_LogSize;
+        // Close can't happen while this mutex is held, so the file stays open
+        fd = m_Fd;
+        path = m_LogPath + COMPACT_SUFFIX;
+    }
+    std::sort(live.begin(), live.end(),
+              [](const auto &a, const auto &b) { return a.first < b.first; });
+
+    int compact_fd = open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if(compact_fd < 0) {
+        TRACE_ERROR("Failed to create %s: %s", path.c_str(), strerror(errno));
+        return false;
+    }
+    auto fail = [&path, compact_fd]() {
+        TRACE_ERROR("Failed to compact %s: %s", path.c_str(), strerror(errno));
+        close(compact_fd);
+        unlink(path.c_str());
+        return false;
+    };
+
+    std::vector<uint8_t> buffer;
+    auto copy = [&buffer, compact_fd](int from, uint64_t offset, uint32_t length, uint64_t to) {
+        buffer.resize(RecordSize(length));
+        return ReadAll(from, buffer.data(), buffer.size(), offset) &&
+               WriteAll(compact_fd, buffer.data(), buffer.size(), to);
+    };
+
+    if(!WriteLogHeader(compact_fd))
+        return fail();
+    uint64_t compact_size = sizeof(TileCacheLogHeader);
+    std::unordered_map<uint64_t, uint64_t> new_offsets;
+    for(const auto &[key, entry]: live) {
+        if(!copy(fd, entry.offset, entry.length, compact_size))
+            return fail();
+        new_offsets[entry.offset] = compact_size;
+        compact_size += RecordSize(entry.length);
+    }
+
+    // The records written since the snapshot are copied after the live ones just as they are,
+    // so that replacing and removing tiles is replayed in the same order when the cache is next
+    // opened. They're copied until there are none left to copy, and then any which are written
+    // while renaming the new log are copied under the lock.
+    const uint64_t tail_start = compact_size;
+    uint64_t copied_end = snapshot_end;
+    auto copy_tail = [&](uint64_t end) {
+        while(copied_end < end) {
+            auto length = static_cast<size_t>(std::min<uint64_t>(end - copied_end, 64 * 1024));
+            buffer.resize(length);
+            if(!ReadAll(fd, buffer.data(), length, copied_end) ||
+               !WriteAll(compact_fd, buffer.data(), length, compact_size))
+                return false;
+            copied_end += length;
+            compact_size += length;
+        }
+        return true;
+    };
+    while(true) {
+        uint64_t end;
+        {
+            std::lock_guard<std::mutex> guard(m_Mutex);
+            end = m_LogSize;
+        }
+        if(end == copied_end)
+            break;
+        if(!copy_tail(end))
+            return fail();
+    }
+    if((fsync(compact_fd) != 0) || (rename(path.c_str(), m_LogPath.c_str()) != 0))
+        return fail();
+
+    {
+        std::lock_guard<std::mutex> guard(m_Mutex);
+        // The old log can't be put back now that it's been renamed over, so if these can't be
+        // copied the tiles in them are dropped instead. If the app is killed before they're
+        // synced they're lost, which only means that a tile is fetched or evicted again.
+        auto renamed_end = copied_end;
+        auto renamed_size = compact_size;
+        if(!copy_tail(m_LogSize) ||
+           ((copied_end != renamed_end) && (fdatasync(compact_fd) != 0))) {
+            TRACE_ERROR("Failed to copy the end of %s: %s", m_LogPath.c_str(), strerror(errno));
+            if(ftruncate(compact_fd, static_cast<off_t>(renamed_size)) != 0)
+                TRACE_ERROR("Failed to truncate %s", m_LogPath.c_str());
+            compact_size = renamed_size;
+            for(auto it = m_Entries.begin(); it != m_Entries.end();) {
+                if(it->second.offset >= renamed_end)
+                    it = m_Entries.erase(it);
+                else
+                    ++it;
+            }
+        }
+
+        uint64_t live_bytes = 0;
+        for(auto &[key, entry]: m_Entries) {
+            if(entry.offset < snapshot_end)
+                entry.offset = new_offsets[entry.offset];
+            else
+                entry.offset = entry.offset - snapshot_end + tail_start;
+            live_bytes += RecordSize(entry.length);
+        }
+        close(m_Fd);
+        m_Fd = compact_fd;
+        TRACE("TileCache compacted %s from %llu to %llu bytes", m_LogPath.c_str(),
+              static_cast<unsigned long long>(m_LogSize), static_cast<unsigned long long>(compact_size));
+        m_LogSize = compact_size;
+        m_Stats.live_bytes = live_bytes;
+        m_Stats.dead_bytes = compact_size - sizeof(TileCacheLogHeader) - live_bytes;
+        ++m_Stats.compactions;
+    }
+
+    // The rename is only durable once the directory is synced
+    int directory_fd = open(m_Directory.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if((directory_fd < 0) || (fsync(directory_fd) != 0))
+        TRACE_WARNING("Failed to sync %s: %s", m_Directory.c_str(), strerror(errno));
+    if(directory_fd >= 0)
+        close(directory_fd);
+    return true;
+}
+
+void TileCache::CompactionThread()
+{
+    pthread_setname_np(pthread_self(), "TileCompaction");
+    std::unique_lock<std::mutex> lock(m_Mutex);
+    while(m_CompactionThreadRunning) {
+        if(!NeedsCompaction()) {
+            m_CompactionWakeup.wait(lock);
+            continue;
+        }
+        lock.unlock();
+        bool compacted = Compact();
+        lock.lock();
+        // Wait for something to change before trying again, rather than retrying in a loop
+        if(!compacted && m_CompactionThreadRunning)
+            m_CompactionWakeup.wait(lock);
+    }
+}
+
+void TileCache::StopCompactionThread()
+{
+    {
+        std::lock_guard<std::mutex> guard(m_Mutex);
+        m_CompactionThreadRunning = false;
+    }
+    m_CompactionWakeup.notify_one();
+    if(m_CompactionThread.joinable())
+        m_CompactionThread.join();
+}
+
+void TileCache::GetStats(TileCacheStats &stats) const
+{
+    std::lock_guard<std::mutex> guard(m_Mutex);
+    stats = m_Stats;
+    stats.tiles = m_Entries.size();
+    stats.budget = m_Budget;
+}
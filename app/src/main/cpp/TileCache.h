@@ -0,0 +1,127 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+
+#include "FeatureStore.h"
+#include "GeoJsonParser.h"
+#include "TileSource.h"
+
+namespace soundscape {
+
+    struct TileCacheStats {
+        uint64_t hits = 0;
+        uint64_t misses = 0;
+        uint64_t evictions = 0;
+        uint64_t compactions = 0;
+        // Tiles were dropped because their records were corrupt
+        uint64_t corrupt = 0;
+        uint64_t tiles = 0;
+        // The bytes of the tiles in the cache, which is what the budget limits, and the bytes of
+        // the log which are no longer needed and which compaction will reclaim
+        uint64_t live_bytes = 0;
+        uint64_t dead_bytes = 0;
+        uint64_t budget = 0;
+    };
+
+    //
+    // On-disk cache of clipped tiles in the binary tile format, see TileFile.h, which survives
+    // the app being restarted.
+    //
+    // The tiles are kept in a log file which is only ever appended to. Each record has a header
+    // with the tile's quadkey and a checksum, and removing a tile appends a record with no data.
+    // A record is synced to disk before the cache is updated, so if the app is killed while
+    // writing, the incomplete record at the end of the log is found and cut off when the cache
+    // is next opened. Records which are corrupt in any other way are found by their checksum
+    // when they're read, and dropped. Only the index of where each tile is in the log is kept in
+    // memory; it's rebuilt from the record headers when the cache is opened.
+    //
+    // Replaced and removed tiles leave dead records in the log. Once they take up as much space
+    // as the live ones, a background thread compacts the log by copying the live records into a
+    // new file in quadkey order, so that nearby tiles are near each other on disk, and renaming
+    // it over the old one. Tiles can still be read and written while it does so.
+    //
+    // When the live tiles go over the byte budget, the tiles which have gone longest without
+    // being used are removed first, but a tile's age is counted as an hour more for every
+    // kilometre that it is from the listener, so that tiles around where the listener is are
+    // kept even if they haven't been used for a while. Last use times are only kept in memory,
+    // and start at the time each tile was written when the cache is opened.
+    //
+    class TileCache {
+    public:
+        // The clock returns seconds since the epoch, and is the system clock unless one is given
+        explicit TileCache(std::function<int64_t()> clock = nullptr);
+        ~TileCache();
+
+        // Open or create the cache in the directory. Tiles are evicted if they're over the budget.
+        bool Open(const std::string &directory, uint64_t budget);
+        void Close();
+        bool IsOpen() const;
+
+        void SetBudget(uint64_t budget);
+        // Where the listener is, for weighting the eviction of tiles by distance. Called on every
+        // pose update, so it's lock free.
+        void SetLocation(double latitude, double longitude);
+
+        // Replace the contents of features with the tile's, returning false if it's not in the
+        // cache or it's corrupt, in which case it's removed
+        bool Get(const TileId &tile, FeatureCollection &features);
+        // Add or replace a tile, returning false if it couldn't be written
+        bool Put(const TileId &tile, const FeatureCollection &features);
+        bool Remove(const TileId &tile);
+        bool Contains(const TileId &tile) const;
+
+        // Get the tile from the cache, or fetch it from the source, parse and clip it and add it
+        // to the cache. Returns false if it's not in the cache and couldn't be fetched.
+        bool GetOrFetch(const TileId &tile, ITileSource &source, FeatureCollection &features);
+
+        // Compact the log now rather than waiting for the background thread
+        bool Compact();
+
+        void GetStats(TileCacheStats &stats) const;
+
+    private:
+        struct Entry {
+            // The offset of the record in the log, and the size of the tile file in it
+            uint64_t offset;
+            uint32_t length;
+            uint32_t checksum;
+            int64_t last_used;
+        };
+
+        bool Scan();
+        bool Append(uint64_t key, const uint8_t *data, uint32_t length, int64_t time);
+        void RemoveEntry(uint64_t key);
+        void Evict(uint64_t keep);
+        bool NeedsCompaction() const;
+        void CompactionThread();
+        void StopCompactionThread();
+
+        std::function<int64_t()> m_Clock;
+        std::string m_Directory;
+        std::string m_LogPath;
+
+        mutable std::mutex m_Mutex;
+        int m_Fd = -1;
+        uint64_t m_LogSize = 0;
+        uint64_t m_Budget = 0;
+        std::unordered_map<uint64_t, Entry> m_Entries;
+        TileCacheStats m_Stats;
+
+        // Compaction takes this before m_Mutex, so that only one runs at a time
+        std::mutex m_CompactionMutex;
+        std::thread m_CompactionThread;
+        std::condition_variable m_CompactionWakeup;
+        bool m_CompactionThreadRunning = false;
+
+        std::atomic<double> m_Latitude;
+        std::atomic<double> m_Longitude;
+    };
+
+} // soundscape
@@ -0,0 +1,120 @@
+#include <algorithm>
+#include <atomic>
+#include <thread>
+
+#include "GeoBatch.h"
+#include "TileClipper.h"
+#include "Trace.h"
+
+using namespace soundscape;
+
+static StringRef CopyString(const FeatureCollection &from, StringRef string, std::string &to)
+{
+    StringRef copy{static_cast<uint32_t>(to.size()), string.length};
+    to.append(from.strings, string.offset, string.length);
+    return copy;
+}
+
+static void AppendFeature(const FeatureCollection &from, const Feature &feature, FeatureCollection &to)
+{
+    Feature copy = feature;
+    copy.feature_type = CopyString(from, feature.feature_type, to.strings);
+    copy.feature_value = CopyString(from, feature.feature_value, to.strings);
+
+    copy.first_part = static_cast<uint32_t>(to.parts.size());
+    for(uint32_t index = 0; index < feature.part_count; ++index) {
+        auto part = from.parts[feature.first_part + index];
+        auto first = from.longitudes.begin() + part.first_coordinate;
+        auto first_latitude = from.latitudes.begin() + part.first_coordinate;
+        part.first_coordinate = static_cast<uint32_t>(to.longitudes.size());
+        to.longitudes.insert(to.longitudes.end(), first, first + part.coordinate_count);
+        to.latitudes.insert(to.latitudes.end(), first_latitude, first_latitude + part.coordinate_count);
+        to.parts.push_back(part);
+    }
+
+    copy.first_property = static_cast<uint32_t>(to.properties.size());
+    for(uint32_t index = 0; index < feature.property_count; ++index) {
+        auto property = from.properties[feature.first_property + index];
+        property.key = CopyString(from, property.key, to.strings);
+        property.value = CopyString(from, property.value, to.strings);
+        to.properties.push_back(property);
+    }
+
+    copy.first_osm_id = static_cast<uint32_t>(to.osm_ids.size());
+    auto first_id = from.osm_ids.begin() + feature.first_osm_id;
+    to.osm_ids.insert(to.osm_ids.end(), first_id, first_id + feature.osm_id_count);
+
+    to.features.push_back(copy);
+}
+
+void soundscape::ClipFeatures(const FeatureCollection &features, const BoundingBox &box,
+                              FeatureCollection &clipped)
+{
+    // At most everything is kept, so reserving that means the arrays are only allocated once
+    clipped.features.reserve(clipped.features.size() + features.features.size());
+    clipped.parts.reserve(clipped.parts.size() + features.parts.size());
+    clipped.longitudes.reserve(clipped.longitudes.size() + features.longitudes.size());
+    clipped.latitudes.reserve(clipped.latitudes.size() + features.latitudes.size());
+    clipped.properties.reserve(clipped.properties.size() + features.properties.size());
+    clipped.osm_ids.reserve(clipped.osm_ids.size() + features.osm_ids.size());
+    clipped.strings.reserve(clipped.strings.size() + features.strings.size());
+
+    for(const auto &feature: features.features) {
+        if(feature.part_count == 0)
+            continue;
+
+        // The parts of a feature are one after the other, so all of its vertices can be tested
+        // in one batch
+        auto first = features.parts[feature.first_part].first_coordinate;
+        const auto &last_part = features.parts[feature.first_part + feature.part_count - 1];
+        size_t count = last_part.first_coordinate + last_part.coordinate_count - first;
+        auto inside = BatchFindInBox(features.latitudes.data() + first,
+                                     features.longitudes.data() + first, count,
+                                     box.southLatitude, box.westLongitude,
+                                     box.northLatitude, box.eastLongitude);
+        if(inside < count)
+            AppendFeature(features, feature, clipped);
+    }
+}
+
+size_t soundscape::LoadTiles(const TileJson *tiles, size_t count, const TileAdder &add,
+                             unsigned max_threads)
+{
+    std::atomic<size_t> next_tile(0);
+    std::atomic<size_t> loaded(0);
+    auto worker = [&]() {
+        // Each thread parses into its own collection, which keeps its capacity between tiles
+        GeoJsonParser parser;
+        FeatureCollection parsed;
+        for(size_t index = next_tile++; index < count; index = next_tile++) {
+            const auto &tile = tiles[index];
+            parsed.Clear();
+            if(!parser.Parse(tile.json, tile.length, parsed)) {
+                TRACE_WARNING("Tile %d/%d/%d not loaded", tile.tile.zoom, tile.tile.x, tile.tile.y);
+                continue;
+            }
+            auto clipped = std::make_shared<FeatureCollection>();
+            ClipFeatures(parsed, tileToBoundingBox(tile.tile.x, tile.tile.y, tile.tile.zoom), *clipped);
+            add(tile.tile, std::move(clipped));
+            ++loaded;
+        }
+    };
+
+    size_t thread_count = max_threads ? max_threads : std::max(1U, std::thread::hardware_concurrency());
+    thread_count = std::min(thread_count, count);
+    std::vector<std::thread> threads;
+    for(size_t thread = 1; thread < thread_count; ++thread)
+        threads.emplace_back(worker);
+    worker();
+    for(auto &thread: threads)
+        thread.join();
+    return loaded;
+}
+
+size_t soundscape::LoadTiles(const TileJson *tiles, size_t count, FeatureStore &store,
+                             unsigned max_threads)
+{
+    return LoadTiles(tiles, count, [&store](const TileId &tile, std::shared_ptr<const FeatureCollection> features) {
+        store.AddTile(tile, std::move(features));
+    }, max_threads);
+}
@@ -0,0 +1,41 @@
+#pragma once
+
+#include <cstddef>
+#include <functional>
+#include <memory>
+
+#include "FeatureStore.h"
+#include "GeoJsonParser.h"
+#include "GeoUtils.h"
+
+namespace soundscape {
+
+    //
+    // The tile server returns features which have been wrapped around large areas in OSM along
+    // with the tile, for example whole university campuses and long distance walking routes. A
+    // feature is kept if any of its vertices is inside the tile, in which case the whole of it is
+    // kept, as cleanTileGeoJSON does in TileUtils.kt.
+    //
+
+    // Append the features which have a vertex inside the box to clipped
+    void ClipFeatures(const FeatureCollection &features, const BoundingBox &box,
+                      FeatureCollection &clipped);
+
+    struct TileJson {
+        TileId tile;
+        const char *json;
+        size_t length;
+    };
+
+    // Parse and clip each tile and pass it to add, which is called from all of the threads. The
+    // tiles are shared between up to max_threads threads, including the calling thread, or one
+    // per core if max_threads is zero. Returns the number of tiles added, which is fewer than
+    // count if any weren't valid GeoJSON.
+    typedef std::function<void(const TileId &tile, std::shared_ptr<const FeatureCollection> features)> TileAdder;
+    size_t LoadTiles(const TileJson *tiles, size_t count, const TileAdder &add,
+                     unsigned max_threads = 0);
+    // As above, adding the tiles to the store
+    size_t LoadTiles(const TileJson *tiles, size_t count, FeatureStore &store,
+                     unsigned max_threads = 0);
+
+} // soundscape
@@ -0,0 +1,528 @@
+#include <algorithm>
+#include <cerrno>
+#include <cmath>
+#include <cstring>
+#include <limits>
+#include <unordered_map>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "TileFile.h"
+#include "Trace.h"
+
+using namespace soundscape;
+
+// The records are read in place, so their layout mustn't depend on the compiler, and the fields
+// are written in native byte order, which is only the little endian of the format on little
+// endian CPUs. Every Android ABI is, so this is never expected to fire.
+static_assert(__BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__, "Tile files are little endian");
+static_assert(sizeof(TileFileHeader) == 112, "TileFileHeader layout");
+static_assert(sizeof(TileFileFeature) == 52, "TileFileFeature layout");
+static_assert(sizeof(TileFilePart) == 12, "TileFilePart layout");
+static_assert(sizeof(TileFileProperty) == 12, "TileFileProperty layout");
+static_assert(sizeof(TileFileString) == 8, "TileFileString layout");
+
+static const char TILE_FILE_MAGIC[4] = {'S', 'S', 'T', 'F'};
+static const double UNITS_PER_DEGREE = 1e7;
+// Anything bigger than this can't be a coordinate, and would overflow when converted to units
+static const double MAX_DEGREES = 1000.0;
+
+static int64_t ToUnits(double degrees)
+{
+    return std::llround(degrees * UNITS_PER_DEGREE);
+}
+
+static double ToDegrees(int64_t units)
+{
+    return static_cast<double>(units) / UNITS_PER_DEGREE;
+}
+
+static int32_t ClampToInt32(int64_t value)
+{
+    return static_cast<int32_t>(std::clamp<int64_t>(value,
+                                                    std::numeric_limits<int32_t>::min(),
+                                                    std::numeric_limits<int32_t>::max()));
+}
+
+static void WriteVarint(int64_t value, std::vector<uint8_t> &data)
+{
+    // Zigzag encoding so that small negative numbers are small too
+    auto bits = (static_cast<uint64_t>(value) << 1) ^ static_cast<uint64_t>(value >> 63);
+    while(bits >= 0x80) {
+        data.push_back(static_cast<uint8_t>(bits | 0x80));
+        bits >>= 7;
+    }
+    data.push_back(static_cast<uint8_t>(bits));
+}
+
+static bool ReadVarint(const uint8_t *&pos, const uint8_t *end, int64_t &value)
+{
+    uint64_t bits = 0;
+    for(unsigned shift = 0; shift < 64; shift += 7) {
+        if(pos == end)
+            return false;
+        uint8_t byte = *pos++;
+        bits |= static_cast<uint64_t>(byte & 0x7f) << shift;
+        if((byte & 0x80) == 0) {
+            value = static_cast<int64_t>((bits >> 1) ^ (~(bits & 1) + 1));
+            return true;
+        }
+    }
+    return false;
+}
+
+static size_t Align(size_t offset)
+{
+    return (offset + 7) & ~static_cast<size_t>(7);
+}
+
+namespace {
+    // Gives each distinct string an index in the string table
+    class StringTable {
+    public:
+        StringTable()
+        {
+            m_Strings.push_back({0, 0});
+            m_Indices.emplace(std::string_view(), 0);
+        }
+
+        uint32_t Add(std::string_view string)
+        {
+            auto result = m_Indices.emplace(string, static_cast<uint32_t>(m_Strings.size()));
+            if(result.second) {
+                m_Strings.push_back({static_cast<uint32_t>(m_Data.size()),
+                                     static_cast<uint32_t>(string.size())});
+                m_Data.append(string);
+            }
+            return result.first->second;
+        }
+
+        const std::vector<TileFileString> &GetStrings() const { return m_Strings; }
+        const std::string &GetData() const { return m_Data; }
+
+    private:
+        // The views are of the strings in the FeatureCollection, which outlives the table
+        std::unordered_map<std::string_view, uint32_t> m_Indices;
+        std::vector<TileFileString> m_Strings;
+        std::string m_Data;
+    };
+}
+
+template<typename T>
+static void CopySection(std::vector<uint8_t> &data, const TileFileSection &section, const T *records)
+{
+    if(section.size != 0)
+        memcpy(data.data() + section.offset, records, section.size);
+}
+
+bool soundscape::EncodeTileFile(const TileId &tile, const FeatureCollection &features,
+                                std::vector<uint8_t> &data)
+{
+    auto box = tileToBoundingBox(tile.x, tile.y, tile.zoom);
+    auto origin_longitude = ToUnits(box.westLongitude);
+    auto origin_latitude = ToUnits(box.southLatitude);
+
+    StringTable strings;
+    std::vector<TileFileFeature> file_features;
+    std::vector<TileFilePart> file_parts;
+    std::vector<TileFileProperty> file_properties;
+    std::vector<uint8_t> coordinates;
+    file_features.reserve(features.features.size());
+    file_parts.reserve(features.parts.size());
+    file_properties.reserve(features.properties.size());
+    // Most coordinates take about five bytes
+    coordinates.reserve(features.longitudes.size() * 5);
+
+    for(const auto &feature: features.features) {
+        TileFileFeature file_feature{};
+        file_feature.feature_type = strings.Add(features.GetString(feature.feature_type));
+        file_feature.feature_value = strings.Add(features.GetString(feature.feature_value));
+        file_feature.first_part = static_cast<uint32_t>(file_parts.size());
+        file_feature.part_count = feature.part_count;
+        file_feature.first_property = static_cast<uint32_t>(file_properties.size());
+        file_feature.property_count = feature.property_count;
+        file_feature.first_osm_id = feature.first_osm_id;
+        file_feature.osm_id_count = feature.osm_id_count;
+        file_feature.geometry = feature.geometry;
+        file_feature.category = feature.category;
+
+        int64_t min_longitude = std::numeric_limits<int64_t>::max();
+        int64_t min_latitude = std::numeric_limits<int64_t>::max();
+        int64_t max_longitude = std::numeric_limits<int64_t>::min();
+        int64_t max_latitude = std::numeric_limits<int64_t>::min();
+        for(uint32_t index = 0; index < feature.part_count; ++index) {
+            const auto &part = features.parts[feature.first_part + index];
+            file_parts.push_back({part.coordinate_count, part.polygon,
+                                  static_cast<uint32_t>(coordinates.size())});
+
+            int64_t last_longitude = 0;
+            int64_t last_latitude = 0;
+            for(uint32_t point = 0; point < part.coordinate_count; ++point) {
+                auto longitude = features.longitudes[part.first_coordinate + point];
+                auto latitude = features.latitudes[part.first_coordinate + point];
+                if(!(std::fabs(longitude) <= MAX_DEGREES) || !(std::fabs(latitude) <= MAX_DEGREES)) {
+                    TRACE_ERROR("Tile %d,%d has a coordinate out of range", tile.x, tile.y);
+                    return false;
+                }
+                auto x = ToUnits(longitude) - origin_longitude;
+                auto y = ToUnits(latitude) - origin_latitude;
+                WriteVarint(x - last_longitude, coordinates);
+                WriteVarint(y - last_latitude, coordinates);
+                last_longitude = x;
+                last_latitude = y;
+
+                min_longitude = std::min(min_longitude, x);
+                min_latitude = std::min(min_latitude, y);
+                max_longitude = std::max(max_longitude, x);
+                max_latitude = std::max(max_latitude, y);
+            }
+        }
+        if(min_longitude <= max_longitude) {
+            file_feature.min_longitude = ClampToInt32(min_longitude);
+            file_feature.min_latitude = ClampToInt32(min_latitude);
+            file_feature.max_longitude = ClampToInt32(max_longitude);
+            file_feature.max_latitude = ClampToInt32(max_latitude);
+        }
+
+        for(uint32_t index = 0; index < feature.property_count; ++index) {
+            const auto &property = features.properties[feature.first_property + index];
+            TileFileProperty file_property{};
+            file_property.key = strings.Add(features.GetString(property.key));
+            file_property.value = strings.Add(features.GetString(property.value));
+            file_property.type = property.type;
+            file_properties.push_back(file_property);
+        }
+        file_features.push_back(file_feature);
+    }
+
+    TileFileHeader header{};
+    memcpy(header.magic, TILE_FILE_MAGIC, sizeof(header.magic));
+    header.version = TILE_FILE_VERSION;
+    header.x = tile.x;
+    header.y = tile.y;
+    header.zoom = tile.zoom;
+    header.feature_count = static_cast<uint32_t>(file_features.size());
+    header.part_count = static_cast<uint32_t>(file_parts.size());
+    header.property_count = static_cast<uint32_t>(file_properties.size());
+    header.string_count = static_cast<uint32_t>(strings.GetStrings().size());
+    header.osm_id_count = static_cast<uint32_t>(features.osm_ids.size());
+    header.coordinate_count = static_cast<uint32_t>(features.longitudes.size());
+    header.origin_longitude = static_cast<int32_t>(origin_longitude);
+    header.origin_latitude = static_cast<int32_t>(origin_latitude);
+
+    // Lay out the sections, checking that the offsets fit in 32 bits
+    size_t offset = sizeof(TileFileHeader);
+    bool too_big = false;
+    auto place = [&offset, &too_big](TileFileSection &section, size_t size) {
+        offset = Align(offset);
+        section.offset = static_cast<uint32_t>(offset);
+        section.size = static_cast<uint32_t>(size);
+        offset += size;
+        too_big |= (offset > std::numeric_limits<uint32_t>::max());
+    };
+    place(header.features, file_features.size() * sizeof(TileFileFeature));
+    place(header.parts, file_parts.size() * sizeof(TileFilePart));
+    place(header.properties, file_properties.size() * sizeof(TileFileProperty));
+    place(header.strings, strings.GetStrings().size() * sizeof(TileFileString));
+    place(header.osm_ids, features.osm_ids.size() * sizeof(int64_t));
+    place(header.coordinates, coordinates.size());
+    place(header.string_data, strings.GetData().size());
+    if(too_big) {
+        TRACE_ERROR("Tile %d,%d is too big for a tile file", tile.x, tile.y);
+        return false;
+    }
+    header.file_size = static_cast<uint32_t>(offset);
+
+    // The padding between the sections is zeroed so that the files are reproducible
+    data.assign(offset, 0);
+    memcpy(data.data(), &header, sizeof(header));
+    CopySection(data, header.features, file_features.data());
+    CopySection(data, header.parts, file_parts.data());
+    CopySection(data, header.properties, file_properties.data());
+    CopySection(data, header.strings, strings.GetStrings().data());
+    CopySection(data, header.osm_ids, features.osm_ids.data());
+    CopySection(data, header.coordinates, coordinates.data());
+    CopySection(data, header.string_data, strings.GetData().data());
+    return true;
+}
+
+bool soundscape::WriteTileFile(const std::string &path, const TileId &tile,
+                               const FeatureCollection &features)
+{
+    std::vector<uint8_t> data;
+    if(!EncodeTileFile(tile, features, data))
+        return false;
+
+    auto temporary = path + ".tmp";
+    int fd = open(temporary.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if(fd < 0) {
+        TRACE_ERROR("Failed to create %s: %s", temporary.c_str(), strerror(errno));
+        return false;
+    }
+    size_t written = 0;
+    while(written < data.size()) {
+        auto result = write(fd, data.data() + written, data.size() - written);
+        if(result < 0) {
+            if(errno == EINTR)
+                continue;
+            break;
+        }
+        written += static_cast<size_t>(result);
+    }
+    // The data has to be on disk before the rename is, or a crash could leave an empty file
+    // under the real name
+    bool ok = (written == data.size()) && (fsync(fd) == 0);
+    if(!ok)
+        TRACE_ERROR("Failed to write %s: %s", temporary.c_str(), strerror(errno));
+    close(fd);
+
+    if(ok && (rename(temporary.c_str(), path.c_str()) != 0)) {
+        TRACE_ERROR("Failed to rename %s: %s", temporary.c_str(), strerror(errno));
+        ok = false;
+    }
+    if(!ok)
+        unlink(temporary.c_str());
+    return ok;
+}
+
+TileFile::~TileFile()
+{
+    Close();
+}
+
+bool TileFile::Open(const std::string &path)
+{
+    Close();
+
+    int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if(fd < 0)
+        return false;
+
+    struct stat status{};
+    if((fstat(fd, &status) != 0) || (status.st_size < static_cast<off_t>(sizeof(TileFileHeader)))) {
+        TRACE_WARNING("%s is too short to be a tile file", path.c_str());
+        close(fd);
+        return false;
+    }
+    auto length = static_cast<size_t>(status.st_size);
+    auto mapping = mmap(nullptr, length, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if(mapping == MAP_FAILED) {
+        TRACE_ERROR("Failed to map %s: %s", path.c_str(), strerror(errno));
+        return false;
+    }
+
+    if(!Map(static_cast<const uint8_t *>(mapping), length)) {
+        TRACE_WARNING("%s isn't a valid tile file", path.c_str());
+        munmap(mapping, length);
+        return false;
+    }
+    m_pMapping = mapping;
+    return true;
+}
+
+bool TileFile::Open(const uint8_t *data, size_t length)
+{
+    Close();
+    return Map(data, length);
+}
+
+bool TileFile::Map(const uint8_t *data, size_t length)
+{
+    m_pData = data;
+    m_Length = length;
+    if(!Validate()) {
+        m_pData = nullptr;
+        m_Length = 0;
+        return false;
+    }
+    return true;
+}
+
+void TileFile::Close()
+{
+    if(m_pMapping)
+        munmap(m_pMapping, m_Length);
+    m_pMapping = nullptr;
+    m_pData = nullptr;
+    m_Length = 0;
+    m_pHeader = nullptr;
+}
+
+static bool CheckSection(const TileFileSection &section, size_t length, uint64_t count, size_t size)
+{
+    return ((section.offset % 8) == 0) &&
+           (section.offset >= sizeof(TileFileHeader)) &&
+           (static_cast<uint64_t>(section.offset) + section.size <= length) &&
+           ((size == 0) || (section.size == count * size));
+}
+
+bool TileFile::Validate()
+{
+    if((m_Length < sizeof(TileFileHeader)) || ((reinterpret_cast<uintptr_t>(m_pData) % 8) != 0))
+        return false;
+    auto header = reinterpret_cast<const TileFileHeader *>(m_pData);
+    if((memcmp(header->magic, TILE_FILE_MAGIC, sizeof(header->magic)) != 0) ||
+       (header->version != TILE_FILE_VERSION) ||
+       (header->file_size != m_Length))
+        return false;
+
+    if(!CheckSection(header->features, m_Length, header->feature_count, sizeof(TileFileFeature)) ||
+       !CheckSection(header->parts, m_Length, header->part_count, sizeof(TileFilePart)) ||
+       !CheckSection(header->properties, m_Length, header->property_count, sizeof(TileFileProperty)) ||
+       !CheckSection(header->strings, m_Length, header->string_count, sizeof(TileFileString)) ||
+       !CheckSection(header->osm_ids, m_Length, header->osm_id_count, sizeof(int64_t)) ||
+       !CheckSection(header->coordinates, m_Length, 0, 0) ||
+       !CheckSection(header->string_data, m_Length, 0, 0))
+        return false;
+
+    m_pFeatures = reinterpret_cast<const TileFileFeature *>(m_pData + header->features.offset);
+    m_pParts = reinterpret_cast<const TileFilePart *>(m_pData + header->parts.offset);
+    m_pProperties = reinterpret_cast<const TileFileProperty *>(m_pData + header->properties.offset);
+    m_pStrings = reinterpret_cast<const TileFileString *>(m_pData + header->strings.offset);
+    m_pOsmIds = reinterpret_cast<const int64_t *>(m_pData + header->osm_ids.offset);
+    m_pCoordinates = m_pData + header->coordinates.offset;
+    m_pStringData = reinterpret_cast<const char *>(m_pData + header->string_data.offset);
+
+    auto in_range = [](uint32_t first, uint32_t count, uint32_t total) {
+        return static_cast<uint64_t>(first) + count <= total;
+    };
+    for(uint32_t index = 0; index < header->string_count; ++index) {
+        if(!in_range(m_pStrings[index].offset, m_pStrings[index].length, header->string_data.size))
+            return false;
+    }
+    uint64_t coordinate_count = 0;
+    for(uint32_t index = 0; index < header->part_count; ++index) {
+        const auto &part = m_pParts[index];
+        if(!in_range(part.data_offset, 0, header->coordinates.size))
+            return false;
+        coordinate_count += part.coordinate_count;
+    }
+    if(coordinate_count != header->coordinate_count)
+        return false;
+    for(uint32_t index = 0; index < header->property_count; ++index) {
+        const auto &property = m_pProperties[index];
+        if((property.key >= header->string_count) || (property.value >= header->string_count) ||
+           (property.type > PropertyType::Json))
+            return false;
+    }
+    for(uint32_t index = 0; index < header->feature_count; ++index) {
+        const auto &feature = m_pFeatures[index];
+        if((feature.feature_type >= header->string_count) ||
+           (feature.feature_value >= header->string_count) ||
+           !in_range(feature.first_part, feature.part_count, header->part_count) ||
+           !in_range(feature.first_property, feature.property_count, header->property_count) ||
+           !in_range(feature.first_osm_id, feature.osm_id_count, header->osm_id_count) ||
+           (feature.geometry > GeometryType::MultiPolygon) ||
+           (feature.category >= FeatureCategory::Count))
+            return false;
+    }
+
+    m_pHeader = header;
+    return true;
+}
+
+TileId TileFile::GetTile() const
+{
+    return {m_pHeader->x, m_pHeader->y, m_pHeader->zoom};
+}
+
+std::string_view TileFile::GetString(uint32_t index) const
+{
+    const auto &string = m_pStrings[index];
+    return {m_pStringData + string.offset, string.length};
+}
+
+BoundingBox TileFile::GetBounds(const TileFileFeature &feature) const
+{
+    BoundingBox box;
+    box.westLongitude = ToDegrees(m_pHeader->origin_longitude + int64_t(feature.min_longitude));
+    box.southLatitude = ToDegrees(m_pHeader->origin_latitude + int64_t(feature.min_latitude));
+    box.eastLongitude = ToDegrees(m_pHeader->origin_longitude + int64_t(feature.max_longitude));
+    box.northLatitude = ToDegrees(m_pHeader->origin_latitude + int64_t(feature.max_latitude));
+    return box;
+}
+
+bool TileFile::Decode(FeatureCollection &features) const
+{
+    const auto &header = *m_pHeader;
+    auto first_feature = features.features.size();
+    auto first_part = features.parts.size();
+    auto first_coordinate = features.longitudes.size();
+    auto first_property = features.properties.size();
+    auto first_osm_id = features.osm_ids.size();
+    auto first_string = features.strings.size();
+
+    features.features.reserve(first_feature + header.feature_count);
+    features.parts.reserve(first_part + header.part_count);
+    features.longitudes.reserve(first_coordinate + header.coordinate_count);
+    features.latitudes.reserve(first_coordinate + header.coordinate_count);
+    features.properties.reserve(first_property + header.property_count);
+
+    // The strings are shared between the features just as they are in the file
+    features.strings.append(m_pStringData, header.string_data.size);
+    auto to_string_ref = [this, first_string](uint32_t index) {
+        const auto &string = m_pStrings[index];
+        return StringRef{static_cast<uint32_t>(first_string + string.offset), string.length};
+    };
+    features.osm_ids.insert(features.osm_ids.end(), m_pOsmIds, m_pOsmIds + header.osm_id_count);
+
+    const auto *coordinates_end = m_pCoordinates + header.coordinates.size;
+    for(uint32_t index = 0; index < header.part_count; ++index) {
+        const auto &file_part = m_pParts[index];
+        GeometryPart part{static_cast<uint32_t>(features.longitudes.size()),
+                          file_part.coordinate_count, file_part.polygon};
+        const auto *pos = m_pCoordinates + file_part.data_offset;
+        // Wrapping rather than overflowing if the file is corrupt
+        uint64_t longitude = 0;
+        uint64_t latitude = 0;
+        for(uint32_t point = 0; point < file_part.coordinate_count; ++point) {
+            int64_t delta_longitude, delta_latitude;
+            if(!ReadVarint(pos, coordinates_end, delta_longitude) ||
+               !ReadVarint(pos, coordinates_end, delta_latitude)) {
+                features.features.resize(first_feature);
+                features.parts.resize(first_part);
+                features.longitudes.resize(first_coordinate);
+                features.latitudes.resize(first_coordinate);
+                features.properties.resize(first_property);
+                features.osm_ids.resize(first_osm_id);
+                features.strings.resize(first_string);
+                TRACE_WARNING("Tile file %d,%d has corrupt coordinates", header.x, header.y);
+                return false;
+            }
+            longitude += static_cast<uint64_t>(delta_longitude);
+            latitude += static_cast<uint64_t>(delta_latitude);
+            features.longitudes.push_back(
+                ToDegrees(header.origin_longitude + static_cast<int64_t>(longitude)));
+            features.latitudes.push_back(
+                ToDegrees(header.origin_latitude + static_cast<int64_t>(latitude)));
+        }
+        features.parts.push_back(part);
+    }
+
+    for(uint32_t index = 0; index < header.property_count; ++index) {
+        const auto &file_property = m_pProperties[index];
+        features.properties.push_back({to_string_ref(file_property.key),
+                                       to_string_ref(file_property.value), file_property.type});
+    }
+
+    for(uint32_t index = 0; index < header.feature_count; ++index) {
+        const auto &file_feature = m_pFeatures[index];
+        Feature feature;
+        feature.geometry = file_feature.geometry;
+        feature.feature_type = to_string_ref(file_feature.feature_type);
+        feature.feature_value = to_string_ref(file_feature.feature_value);
+        feature.category = file_feature.category;
+        feature.first_part = static_cast<uint32_t>(first_part + file_feature.first_part);
+        feature.part_count = file_feature.part_count;
+        feature.first_property = static_cast<uint32_t>(first_property + file_feature.first_property);
+        feature.property_count = file_feature.property_count;
+        feature.first_osm_id = static_cast<uint32_t>(first_osm_id + file_feature.first_osm_id);
+        feature.osm_id_count = file_feature.osm_id_count;
+        features.features.push_back(feature);
+    }
+    return true;
+}
@@ -0,0 +1,170 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "FeatureStore.h"
+#include "GeoJsonParser.h"
+#include "GeoUtils.h"
+
+namespace soundscape {
+
+    //
+    // Binary tile format which is written once after a tile has been parsed and is memory mapped
+    // to load it again, so that a cached tile doesn't have to be parsed. All of the fields are
+    // little endian, and every section starts on an 8 byte boundary so that the records can be
+    // read in place. The sections follow the header in this order:
+    //
+    //   features     TileFileFeature[feature_count]
+    //   parts        TileFilePart[part_count]
+    //   properties   TileFileProperty[property_count]
+    //   strings      TileFileString[string_count], string 0 is always the empty string
+    //   osm_ids      int64_t[osm_id_count]
+    //   coordinates  the coordinates of each part, see below
+    //   string_data  the text of the strings, one after the other
+    //
+    // Coordinates are in units of 1e-7 degrees relative to the tile's south west corner, which
+    // keeps them small. The first point of a part is stored as is and the others as the
+    // difference from the point before, each as a longitude and a latitude zigzag varint, so most
+    // take two or three bytes. Coordinates with up to 7 decimal places, which is as many as OSM
+    // has, are read back exactly. Strings are stored once however many times they're used.
+    //
+    // The version is bumped whenever the layout changes, and files of any other version are
+    // rejected rather than converted as they're only a cache.
+    //
+    constexpr uint32_t TILE_FILE_VERSION = 1;
+
+    struct TileFileSection {
+        uint32_t offset;
+        uint32_t size;
+    };
+
+    struct TileFileHeader {
+        char magic[4];
+        uint32_t version;
+        int32_t x;
+        int32_t y;
+        int32_t zoom;
+        uint32_t feature_count;
+        uint32_t part_count;
+        uint32_t property_count;
+        uint32_t string_count;
+        uint32_t osm_id_count;
+        uint32_t coordinate_count;
+        uint32_t file_size;
+        // The tile's south west corner in units of 1e-7 degrees
+        int32_t origin_longitude;
+        int32_t origin_latitude;
+        TileFileSection features;
+        TileFileSection parts;
+        TileFileSection properties;
+        TileFileSection strings;
+        TileFileSection osm_ids;
+        TileFileSection coordinates;
+        TileFileSection string_data;
+    };
+
+    struct TileFileFeature {
+        // The bounding box of the feature's coordinates in the same units as the coordinates,
+        // widened if need be to fit in 32 bits
+        int32_t min_longitude;
+        int32_t min_latitude;
+        int32_t max_longitude;
+        int32_t max_latitude;
+        // String indices
+        uint32_t feature_type;
+        uint32_t feature_value;
+        uint32_t first_part;
+        uint32_t part_count;
+        uint32_t first_property;
+        uint32_t property_count;
+        uint32_t first_osm_id;
+        uint32_t osm_id_count;
+        GeometryType geometry;
+        FeatureCategory category;
+        uint16_t reserved;
+    };
+
+    struct TileFilePart {
+        uint32_t coordinate_count;
+        uint32_t polygon;
+        // The offset of the part's first coordinate in the coordinates section
+        uint32_t data_offset;
+    };
+
+    struct TileFileProperty {
+        // String indices
+        uint32_t key;
+        uint32_t value;
+        PropertyType type;
+        uint8_t reserved[3];
+    };
+
+    struct TileFileString {
+        // The offset in the string_data section
+        uint32_t offset;
+        uint32_t length;
+    };
+
+    // Encode the features of a tile, which are normally those clipped to it, into data. Returns
+    // false if they're too big for the format.
+    bool EncodeTileFile(const TileId &tile, const FeatureCollection &features,
+                        std::vector<uint8_t> &data);
+
+    // The file is written under a temporary name and then renamed, so that a reader never sees a
+    // partly written file even if the app is killed.
+    bool WriteTileFile(const std::string &path, const TileId &tile, const FeatureCollection &features);
+
+    //
+    // A tile file which has been mapped into memory. Opening a file checks its header and that
+    // every index in it is in range, so that the records can then be used without any checks;
+    // the coordinates are checked as they're decoded.
+    //
+    class TileFile {
+    public:
+        TileFile() = default;
+        ~TileFile();
+        TileFile(const TileFile &) = delete;
+        TileFile &operator=(const TileFile &) = delete;
+
+        bool Open(const std::string &path);
+        // The data isn't copied, and must stay valid until the file is closed
+        bool Open(const uint8_t *data, size_t length);
+        void Close();
+        bool IsOpen() const { return m_pHeader != nullptr; }
+
+        TileId GetTile() const;
+        size_t GetSize() const { return m_Length; }
+        uint32_t GetFeatureCount() const { return m_pHeader->feature_count; }
+        const TileFileFeature &GetFeature(uint32_t index) const { return m_pFeatures[index]; }
+        std::string_view GetString(uint32_t index) const;
+        // The feature's bounding box in degrees
+        BoundingBox GetBounds(const TileFileFeature &feature) const;
+
+        // Append the features to features as if they'd been parsed from the tile's GeoJSON.
+        // Returns false if the coordinates are corrupt, in which case nothing is added.
+        bool Decode(FeatureCollection &features) const;
+
+    private:
+        bool Map(const uint8_t *data, size_t length);
+        bool Validate();
+
+        const uint8_t *m_pData = nullptr;
+        size_t m_Length = 0;
+        // Set if the data was mapped by Open and so has to be unmapped
+        void *m_pMapping = nullptr;
+
+        const TileFileHeader *m_pHeader = nullptr;
+        const TileFileFeature *m_pFeatures = nullptr;
+        const TileFilePart *m_pParts = nullptr;
+        const TileFileProperty *m_pProperties = nullptr;
+        const TileFileString *m_pStrings = nullptr;
+        const int64_t *m_pOsmIds = nullptr;
+        const uint8_t *m_pCoordinates = nullptr;
+        const char *m_pStringData = nullptr;
+    };
+
+} // soundscape
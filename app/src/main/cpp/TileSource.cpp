@@ -0,0 +1,40 @@
+#include <fstream>
+#include <iterator>
+
+#include "TileSource.h"
+#include "Trace.h"
+
+using namespace soundscape;
+
+FileTileSource::FileTileSource(const std::string &directory)
+              : m_Directory(directory),
+                m_FetchCount(0)
+{
+}
+
+void FileTileSource::AddTile(const TileId &tile, const std::string &name)
+{
+    std::lock_guard<std::mutex> guard(m_Mutex);
+    m_Names[tile.GetKey()] = name;
+}
+
+bool FileTileSource::FetchTile(const TileId &tile, std::string &json)
+{
+    std::string path;
+    {
+        std::lock_guard<std::mutex> guard(m_Mutex);
+        auto it = m_Names.find(tile.GetKey());
+        if(it == m_Names.end())
+            return false;
+        path = m_Directory + "/" + it->second;
+    }
+    ++m_FetchCount;
+
+    std::ifstream file(path, std::ios::binary);
+    if(!file) {
+        TRACE_ERROR("Failed to open %s", path.c_str());
+        return false;
+    }
+    json.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+    return true;
+}
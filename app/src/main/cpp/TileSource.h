@@ -0,0 +1,41 @@
+#pragma once
+
+#include <atomic>
+#include <map>
+#include <mutex>
+#include <string>
+
+#include "FeatureStore.h"
+
+namespace soundscape {
+
+    // Where tiles of GeoJSON come from when they aren't in the tile cache
+    class ITileSource {
+    public:
+        virtual ~ITileSource() = default;
+        // Returns false if the tile couldn't be fetched
+        virtual bool FetchTile(const TileId &tile, std::string &json) = 0;
+    };
+
+    //
+    // Stand-in for the tile server for tests and benchmarks, which reads each tile from a file
+    // instead. It counts the fetches so that a test can tell whether a tile came from the cache.
+    //
+    class FileTileSource : public ITileSource {
+    public:
+        explicit FileTileSource(const std::string &directory);
+
+        // The name of the tile's file in the directory
+        void AddTile(const TileId &tile, const std::string &name);
+
+        bool FetchTile(const TileId &tile, std::string &json) override;
+        unsigned GetFetchCount() const { return m_FetchCount; }
+
+    private:
+        std::string m_Directory;
+        std::mutex m_Mutex;
+        std::map<uint64_t, std::string> m_Names;
+        std::atomic<unsigned> m_FetchCount;
+    };
+
+} // soundscape
@@ -0,0 +1,439 @@
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+
+#include <pthread.h>
+
+#include "GeoUtils.h"
+#include "TileWorkingSet.h"
+#include "Trace.h"
+
+using namespace soundscape;
+
+static const int WORKING_SET_ZOOM = 16;
+// How far the listener moves before the tiles are looked at again, which is small compared to
+// a zoom 16 tile so that a tile edge is noticed soon after it's crossed
+static const double PLAN_DISTANCE = 10.0;
+// How far the listener moves before their course is measured again. GPS noise makes the course
+// over shorter distances than this wander.
+static const double COURSE_DISTANCE = 20.0;
+// How far outside the circles a tile has to be before it's unloaded, as a proportion of the
+// radius and at least the minimum
+static const double EVICTION_MARGIN = 0.5;
+static const double MIN_EVICTION_MARGIN = 100.0;
+
+// A location in fixed point with steps of 1e-7 degrees, which is about a centimetre, as OSM
+// stores them, so that a latitude and longitude fit in one lock free atomic
+static uint64_t PackLocation(double latitude, double longitude)
+{
+    auto packed_latitude = static_cast<uint32_t>(static_cast<int32_t>(std::lround(latitude * 1e7)));
+    auto packed_longitude = static_cast<uint32_t>(static_cast<int32_t>(std::lround(longitude * 1e7)));
+    return (static_cast<uint64_t>(packed_latitude) << 32) | packed_longitude;
+}
+
+static void UnpackLocation(uint64_t location, double &latitude, double &longitude)
+{
+    latitude = static_cast<int32_t>(static_cast<uint32_t>(location >> 32)) * 1e-7;
+    longitude = static_cast<int32_t>(static_cast<uint32_t>(location)) * 1e-7;
+}
+
+// The distance in metres from the location to the nearest point of the tile
+static double DistanceToTile(double latitude, double longitude, const TileId &tile)
+{
+    auto box = tileToBoundingBox(tile.x, tile.y, tile.zoom);
+    // The tile can be across the antimeridian from the location, so the location's longitude is
+    // taken as the one within 180 degrees of the tile
+    auto centre = (box.westLongitude + box.eastLongitude) / 2.0;
+    longitude = centre + std::remainder(longitude - centre, 360.0);
+    return distance(latitude, longitude,
+                    std::clamp(latitude, box.southLatitude, box.northLatitude),
+                    std::clamp(longitude, box.westLongitude, box.eastLongitude));
+}
+
+TileWorkingSet::TileWorkingSet(FeatureStore &store, TileCache &cache)
+              : m_Store(store),
+                m_Cache(cache),
+                m_Radius(0.0),
+                m_Location(0),
+                m_HaveLocation(false),
+                m_Woken(false),
+                m_WokenLocation(0),
+                m_LocationSequence(0),
+                m_PlannedSequence(0),
+                m_Stopping(false)
+{
+}
+
+TileWorkingSet::~TileWorkingSet()
+{
+    Stop();
+}
+
+void TileWorkingSet::Start(double radius, std::shared_ptr<ITileSource> source)
+{
+    if(radius <= 0.0) {
+        Stop();
+        return;
+    }
+    std::lock_guard<std::mutex> start_stop_guard(m_StartStopMutex);
+    {
+        std::lock_guard<std::mutex> guard(m_Mutex);
+        m_pSource = std::move(source);
+        m_Radius = radius;
+        if(!m_Running) {
+            m_Running = true;
+            m_Stopping = false;
+            m_WorkerThread = std::thread(&TileWorkingSet::WorkerThread, this);
+        }
+        // Plan for where the listener is now with the new radius
+        if(m_HaveLocation) {
+            m_Woken = true;
+            m_WokenLocation = m_Location.load();
+            ++m_LocationSequence;
+        }
+    }
+    m_Wakeup.notify_one();
+}
+
+void TileWorkingSet::Stop()
+{
+    std::lock_guard<std::mutex> start_stop_guard(m_StartStopMutex);
+    {
+        std::lock_guard<std::mutex> guard(m_Mutex);
+        if(!m_Running)
+            return;
+        m_Stopping = true;
+        m_Radius = 0.0;
+    }
+    m_Wakeup.notify_one();
+    m_WorkerThread.join();
+
+    std::lock_guard<std::mutex> guard(m_Mutex);
+    m_Running = false;
+    m_Woken = false;
+    m_Current.clear();
+    m_Ahead.clear();
+    m_Failed.clear();
+    // Starting again somewhere else isn't a crossing, and the old course doesn't lead there
+    m_HaveTile = false;
+    m_HaveCourse = false;
+    m_Idle.notify_all();
+}
+
+bool TileWorkingSet::IsRunning() const
+{
+    std::lock_guard<std::mutex> guard(m_Mutex);
+    return m_Running;
+}
+
+void TileWorkingSet::SetLocation(double latitude, double longitude)
+{
+    auto location = PackLocation(latitude, longitude);
+    m_Location = location;
+    m_HaveLocation = true;
+    if(m_Radius.load() <= 0.0)
+        return;
+    if(m_Woken) {
+        double woken_latitude;
+        double woken_longitude;
+        UnpackLocation(m_WokenLocation.load(), woken_latitude, woken_longitude);
+        if(distance(woken_latitude, woken_longitude, latitude, longitude) < PLAN_DISTANCE)
+            return;
+    }
+
+    {
+        std::lock_guard<std::mutex> guard(m_Mutex);
+        m_Woken = true;
+        m_WokenLocation = location;
+        ++m_LocationSequence;
+    }
+    m_Wakeup.notify_one();
+}
+
+void TileWorkingSet::SetMissingCallback(std::function<void(size_t missing)> callback)
+{
+    std::lock_guard<std::mutex> guard(m_Mutex);
+    m_MissingCallback = std::move(callback);
+}
+
+void TileWorkingSet::GetMissingTiles(std::vector<TileId> &tiles) const
+{
+    tiles.clear();
+    std::lock_guard<std::mutex> guard(m_Mutex);
+    for(const auto *wanted: {&m_Current, &m_Ahead}) {
+        for(const auto &tile: *wanted) {
+            if(m_Failed.count(tile.GetKey()) && !m_Store.GetIndex(tile))
+                tiles.push_back(tile);
+        }
+    }
+}
+
+bool TileWorkingSet::AddTile(const TileId &tile, std::shared_ptr<const FeatureCollection> features)
+{
+    if(tile.zoom != WORKING_SET_ZOOM)
+        return false;
+    {
+        std::lock_guard<std::mutex> guard(m_Mutex);
+        if(!m_Running)
+            return false;
+        // It's no longer missing whether it's wanted or not
+        m_Failed.erase(tile.GetKey());
+        if((std::find(m_Current.begin(), m_Current.end(), tile) == m_Current.end()) &&
+           (std::find(m_Ahead.begin(), m_Ahead.end(), tile) == m_Ahead.end()))
+            return true;
+    }
+    m_Store.AddTile(tile, std::move(features));
+    return true;
+}
+
+bool TileWorkingSet::WaitUntilIdle(int64_t timeout_ms)
+{
+    std::unique_lock<std::mutex> lock(m_Mutex);
+    return m_Idle.wait_for(lock, std::chrono::milliseconds(timeout_ms), [this]() {
+        return !m_Running || (!m_Busy && !LocationChanged());
+    });
+}
+
+void TileWorkingSet::GetStats(TileWorkingSetStats &stats) const
+{
+    std::lock_guard<std::mutex> guard(m_Mutex);
+    stats = m_Stats;
+    stats.tiles = m_Current.size() + m_Ahead.size();
+    stats.missing = 0;
+    for(const auto *wanted: {&m_Current, &m_Ahead}) {
+        for(const auto &tile: *wanted) {
+            if(!m_Store.GetIndex(tile))
+                ++stats.missing;
+        }
+    }
+}
+
+void TileWorkingSet::GetTilesInCircle(double latitude, double longitude, double radius,
+                                      std::vector<TileId> &tiles)
+{
+    tiles.clear();
+    double north;
+    double south;
+    double east;
+    double west;
+    double unused;
+    getDestinationCoordinate(latitude, longitude, 0.0, radius, north, unused);
+    getDestinationCoordinate(latitude, longitude, 180.0, radius, south, unused);
+    getDestinationCoordinate(latitude, longitude, 90.0, radius, unused, east);
+    getDestinationCoordinate(latitude, longitude, 270.0, radius, unused, west);
+    int min_x;
+    int min_y;
+    int max_x;
+    int max_y;
+    getXYTile(north, longitude, WORKING_SET_ZOOM, min_x, min_y);
+    getXYTile(south, longitude, WORKING_SET_ZOOM, max_x, max_y);
+
+    // Near the antimeridian the square around the circle goes past the last column of tiles and
+    // on into the first, so the columns are worked out from longitudes either side of the centre
+    // which go beyond 180 degrees, and then wrapped
+    const int columns = 1 << WORKING_SET_ZOOM;
+    east = longitude + std::fabs(std::remainder(east - longitude, 360.0));
+    west = longitude - std::fabs(std::remainder(longitude - west, 360.0));
+    min_x = static_cast<int>(std::floor((west + 180.0) / 360.0 * columns));
+    max_x = static_cast<int>(std::floor((east + 180.0) / 360.0 * columns));
+
+    // Only the tiles of the square around the circle which the circle overlaps
+    std::vector<std::pair<double, TileId>> overlapping;
+    for(int y = min_y; y <= max_y; ++y) {
+        for(int x = min_x; x <= max_x; ++x) {
+            TileId tile{((x % columns) + columns) % columns, y, WORKING_SET_ZOOM};
+            auto tile_distance = DistanceToTile(latitude, longitude, tile);
+            if(tile_distance <= radius)
+                overlapping.emplace_back(tile_distance, tile);
+        }
+    }
+    std::stable_sort(overlapping.begin(), overlapping.end(),
+                     [](const std::pair<double, TileId> &a, const std::pair<double, TileId> &b) {
+                         return a.first < b.first;
+                     });
+    for(const auto &tile: overlapping)
+        tiles.push_back(tile.second);
+}
+
+bool TileWorkingSet::LocationChanged() const
+{
+    return m_LocationSequence.load() != m_PlannedSequence.load();
+}
+
+void TileWorkingSet::WorkerThread()
+{
+    pthread_setname_np(pthread_self(), "TileWorkingSet");
+    std::unique_lock<std::mutex> lock(m_Mutex);
+    while(!m_Stopping) {
+        if(!LocationChanged()) {
+            m_Busy = false;
+            m_Idle.notify_all();
+            m_Wakeup.wait(lock);
+            continue;
+        }
+        m_Busy = true;
+        auto sequence = m_LocationSequence.load();
+        double latitude;
+        double longitude;
+        UnpackLocation(m_Location.load(), latitude, longitude);
+        auto radius = m_Radius.load();
+        auto source = m_pSource;
+        auto failures = m_Stats.failures;
+        lock.unlock();
+
+        Plan(latitude, longitude, radius);
+        m_PlannedSequence = sequence;
+        std::vector<TileId> current;
+        std::vector<TileId> ahead;
+        {
+            std::lock_guard<std::mutex> guard(m_Mutex);
+            current = m_Current;
+            ahead = m_Ahead;
+        }
+
+        // The tiles around the listener nearest first, and then those ahead of them, giving up
+        // to start again from the nearest as soon as they've moved on
+        auto complete = true;
+        for(const auto &tile: current) {
+            if(m_Stopping || LocationChanged()) {
+                complete = false;
+                break;
+            }
+            LoadTile(tile, false, source.get());
+        }
+        for(const auto &tile: ahead) {
+            if(!complete || m_Stopping || LocationChanged()) {
+                complete = false;
+                break;
+            }
+            LoadTile(tile, true, source.get());
+        }
+        // Only unload tiles once the new ones are in
+        if(complete)
+            Evict(latitude, longitude, radius);
+
+        lock.lock();
+        if((m_Stats.failures != failures) && m_MissingCallback) {
+            size_t missing = 0;
+            for(const auto *wanted: {&m_Current, &m_Ahead}) {
+                for(const auto &tile: *wanted)
+                    missing += m_Failed.count(tile.GetKey());
+            }
+            // The callback might want to look at the missing tiles
+            auto callback = m_MissingCallback;
+            lock.unlock();
+            callback(missing);
+            lock.lock();
+        }
+    }
+    m_Busy = false;
+}
+
+void TileWorkingSet::Plan(double latitude, double longitude, double radius)
+{
+    TileId tile;
+    tile.zoom = WORKING_SET_ZOOM;
+    getXYTile(latitude, longitude, WORKING_SET_ZOOM, tile.x, tile.y);
+    auto crossed = m_HaveTile && !(tile == m_Tile);
+    auto stalled = crossed && !m_Store.GetIndex(tile);
+    if(!m_HaveTile) {
+        m_CourseLatitude = latitude;
+        m_CourseLongitude = longitude;
+    }
+    m_HaveTile = true;
+    m_Tile = tile;
+
+    if(distance(m_CourseLatitude, m_CourseLongitude, latitude, longitude) >= COURSE_DISTANCE) {
+        m_Course = bearingFromTwoPoints(m_CourseLatitude, m_CourseLongitude, latitude, longitude);
+        m_HaveCourse = true;
+        m_CourseLatitude = latitude;
+        m_CourseLongitude = longitude;
+    }
+
+    std::vector<TileId> current;
+    std::vector<TileId> ahead;
+    GetTilesInCircle(latitude, longitude, radius, current);
+    if(m_HaveCourse) {
+        // The same circle, moved a radius ahead
+        getDestinationCoordinate(latitude, longitude, m_Course, radius, m_AheadLatitude, m_AheadLongitude);
+        GetTilesInCircle(m_AheadLatitude, m_AheadLongitude, radius, ahead);
+        ahead.erase(std::remove_if(ahead.begin(), ahead.end(), [&current](const TileId &candidate) {
+            return std::find(current.begin(), current.end(), candidate) != current.end();
+        }), ahead.end());
+    }
+
+    std::lock_guard<std::mutex> guard(m_Mutex);
+    if(crossed) {
+        ++m_Stats.crossings;
+        if(stalled) {
+            ++m_Stats.stalls;
+            TRACE_WARNING("Tile %d,%d wasn't loaded when the listener got to it", tile.x, tile.y);
+        }
+        // Give the tiles that couldn't be loaded another go
+        m_Failed.clear();
+    }
+    m_Current = std::move(current);
+    m_Ahead = std::move(ahead);
+}
+
+bool TileWorkingSet::LoadTile(const TileId &tile, bool prefetch, ITileSource *source)
+{
+    if(m_Store.GetIndex(tile))
+        return true;
+    {
+        std::lock_guard<std::mutex> guard(m_Mutex);
+        if(m_Failed.count(tile.GetKey()))
+            return false;
+    }
+
+    auto cached = m_Cache.Contains(tile);
+    auto features = std::make_shared<FeatureCollection>();
+    auto loaded = source ? m_Cache.GetOrFetch(tile, *source, *features) : m_Cache.Get(tile, *features);
+    if(loaded)
+        m_Store.AddTile(tile, std::move(features));
+
+    std::lock_guard<std::mutex> guard(m_Mutex);
+    if(cached)
+        ++m_Stats.hits;
+    else {
+        ++m_Stats.misses;
+        if(loaded)
+            ++m_Stats.fetches;
+    }
+    if(!loaded) {
+        ++m_Stats.failures;
+        m_Failed.insert(tile.GetKey());
+        return false;
+    }
+    if(prefetch)
+        ++m_Stats.prefetches;
+    return true;
+}
+
+void TileWorkingSet::Evict(double latitude, double longitude, double radius)
+{
+    std::vector<TileId> current;
+    std::vector<TileId> ahead;
+    {
+        std::lock_guard<std::mutex> guard(m_Mutex);
+        current = m_Current;
+        ahead = m_Ahead;
+    }
+    auto keep_distance = radius + std::max(radius * EVICTION_MARGIN, MIN_EVICTION_MARGIN);
+    uint64_t evicted = 0;
+    for(const auto &tile: m_Store.GetTileIds()) {
+        if((tile.zoom != WORKING_SET_ZOOM) ||
+           (std::find(current.begin(), current.end(), tile) != current.end()) ||
+           (std::find(ahead.begin(), ahead.end(), tile) != ahead.end()))
+            continue;
+        // Tiles near either circle are kept, so that a course which wavers doesn't unload and
+        // load the same tiles at the edge of the one ahead
+        if((DistanceToTile(latitude, longitude, tile) > keep_distance) &&
+           (!m_HaveCourse || (DistanceToTile(m_AheadLatitude, m_AheadLongitude, tile) > keep_distance))) {
+            m_Store.RemoveTile(tile);
+            ++evicted;
+        }
+    }
+    std::lock_guard<std::mutex> guard(m_Mutex);
+    m_Stats.evictions += evicted;
+}
@@ -0,0 +1,157 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <unordered_set>
+#include <vector>
+
+#include "FeatureStore.h"
+#include "TileCache.h"
+#include "TileSource.h"
+
+namespace soundscape {
+
+    struct TileWorkingSetStats {
+        // Tiles that were loaded from the tile cache, and those that weren't in it
+        uint64_t hits = 0;
+        uint64_t misses = 0;
+        // Misses that were fetched from the tile source, and those that couldn't be and so are
+        // left to the client to load
+        uint64_t fetches = 0;
+        uint64_t failures = 0;
+        // Tiles loaded because they're ahead of the listener rather than around them
+        uint64_t prefetches = 0;
+        uint64_t evictions = 0;
+        // The number of times the listener moved into another tile, and how many of those times
+        // the tile wasn't loaded yet
+        uint64_t crossings = 0;
+        uint64_t stalls = 0;
+        // The tiles wanted now, and how many of them aren't loaded
+        uint64_t tiles = 0;
+        uint64_t missing = 0;
+    };
+
+    //
+    // Keeps the zoom 16 tiles around the listener loaded in the FeatureStore as they move, so
+    // that the client doesn't have to work out and fetch the whole square of tiles that
+    // getTilesForRegion in TileUtils.kt returns on every update.
+    //
+    // The working set is the tiles which overlap a circle around the listener. The listener's
+    // course is worked out from how they've moved, and the tiles overlapping the same circle
+    // moved ahead of them along it are prefetched once the ones around them are loaded. Tiles
+    // are only unloaded once they're a margin outside both circles, so walking back and forth
+    // across a tile edge doesn't load and unload the same tiles over and over.
+    //
+    // Pose updates only store the location, and a worker thread does the loading when the
+    // listener has moved far enough to need it. It loads tiles from the tile cache, or fetches
+    // them from the tile source if there is one, nearest first, and starts again from the
+    // nearest if the listener moves on meanwhile. Tiles are added to the store without holding
+    // up queries of it, and the old tiles stay until the new ones are loaded, so the callouts
+    // never wait for tiles when the listener crosses a tile edge. Tiles that couldn't be loaded
+    // are left for the client to fetch, see GetMissingTiles.
+    //
+    // While it's running, the working set owns all of the zoom 16 tiles in the store, so zoom 16
+    // tiles which the client loads have to be passed to AddTile rather than added to the store.
+    //
+    class TileWorkingSet {
+    public:
+        TileWorkingSet(FeatureStore &store, TileCache &cache);
+        ~TileWorkingSet();
+
+        // Start managing the tiles within radius metres of the listener, fetching any that aren't
+        // in the cache from the source if there is one. Starting again changes the radius.
+        void Start(double radius, std::shared_ptr<ITileSource> source = nullptr);
+        void Stop();
+        bool IsRunning() const;
+
+        // Called on every pose update, so it's lock free unless the listener has moved far
+        // enough for the tiles to be looked at again
+        void SetLocation(double latitude, double longitude);
+
+        // Called from the worker thread when there are tiles that couldn't be loaded. It must be
+        // set before the working set is started.
+        void SetMissingCallback(std::function<void(size_t missing)> callback);
+        // Replace the contents of tiles with the tiles which are wanted but aren't loaded,
+        // nearest first
+        void GetMissingTiles(std::vector<TileId> &tiles) const;
+        // Add a tile which the client has loaded to the store if it's wanted, and otherwise drop
+        // it, as it can be loaded from the cache once it is. Returns false if the working set
+        // isn't running or it isn't a zoom 16 tile, in which case the client owns the tile and
+        // adds it to the store itself.
+        bool AddTile(const TileId &tile, std::shared_ptr<const FeatureCollection> features);
+
+        // Wait until the worker has caught up with the latest location, returning false if it
+        // hadn't within the timeout. It's for tests and benchmarks.
+        bool WaitUntilIdle(int64_t timeout_ms);
+
+        void GetStats(TileWorkingSetStats &stats) const;
+
+        // The zoom 16 tiles that the circle overlaps, nearest to its centre first
+        static void GetTilesInCircle(double latitude, double longitude, double radius,
+                                     std::vector<TileId> &tiles);
+
+    private:
+        void WorkerThread();
+        // Work out the tiles wanted at the location, and whether the listener's moved into
+        // another tile
+        void Plan(double latitude, double longitude, double radius);
+        // Returns false if the tile isn't loaded
+        bool LoadTile(const TileId &tile, bool prefetch, ITileSource *source);
+        void Evict(double latitude, double longitude, double radius);
+        bool LocationChanged() const;
+
+        FeatureStore &m_Store;
+        TileCache &m_Cache;
+        std::shared_ptr<ITileSource> m_pSource;
+        std::function<void(size_t)> m_MissingCallback;
+
+        // The radius is 0 when the working set isn't running
+        std::atomic<double> m_Radius;
+        // The latitude and longitude are packed together, see PackLocation, so that they're
+        // always read as a pair
+        std::atomic<uint64_t> m_Location;
+        std::atomic<bool> m_HaveLocation;
+        // Where the listener was when the worker was last woken, so that pose updates can tell
+        // whether it needs waking again
+        std::atomic<bool> m_Woken;
+        std::atomic<uint64_t> m_WokenLocation;
+        // Bumped each time the worker is woken, and set to the same when it's planned for it
+        std::atomic<uint64_t> m_LocationSequence;
+        std::atomic<uint64_t> m_PlannedSequence;
+        std::atomic<bool> m_Stopping;
+
+        // Held for the whole of Start and Stop, so that a Stop waiting for the worker to finish
+        // doesn't race another Stop joining it too, or a Start which would find it still running
+        std::mutex m_StartStopMutex;
+        mutable std::mutex m_Mutex;
+        std::condition_variable m_Wakeup;
+        std::condition_variable m_Idle;
+        std::thread m_WorkerThread;
+        bool m_Running = false;
+        bool m_Busy = false;
+        // The tiles around the listener and those ahead of them, each nearest first
+        std::vector<TileId> m_Current;
+        std::vector<TileId> m_Ahead;
+        // Tiles that couldn't be loaded, which aren't tried again until the listener moves into
+        // another tile
+        std::unordered_set<uint64_t> m_Failed;
+        TileWorkingSetStats m_Stats;
+
+        // Only used by the worker thread
+        bool m_HaveTile = false;
+        TileId m_Tile;
+        bool m_HaveCourse = false;
+        double m_Course = 0.0;
+        double m_CourseLatitude = 0.0;
+        double m_CourseLongitude = 0.0;
+        // The centre of the circle ahead, if there's a course
+        double m_AheadLatitude = 0.0;
+        double m_AheadLongitude = 0.0;
+    };
+
+} // soundscape
@@ -0,0 +1,515 @@
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include <pthread.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#ifdef __ANDROID__
+#include <android/log.h>
+#endif
+
+#include "Trace.h"
+#include "TraceRing.h"
+
+using namespace soundscape;
+
+namespace {
+
+    // Enough for a burst of a few hundred records from a thread between drains
+    const size_t RING_CAPACITY = 1 << 16;
+    const auto DRAIN_INTERVAL = std::chrono::milliseconds(20);
+    // Threads take rings from a pool which the drain keeps topped up, so that a thread's first
+    // trace doesn't have to allocate one. Threads beyond the most rings don't get one, and their
+    // records are dropped.
+    const size_t SPARE_RINGS = 4;
+    const size_t MAX_RINGS = 64;
+
+    // Scoped trace events are records with this format, a name and a duration in nanoseconds
+    const TraceFormat g_TraceEventFormat = {TRACE_LEVEL_NONE, "%s %llu"};
+    std::atomic<bool> g_TraceEventsEnabled(false);
+
+    struct ThreadRing {
+        ThreadRing() : ring(RING_CAPACITY), thread(0), in_use(false) {}
+
+        TraceRing ring;
+        std::atomic<int> thread;
+        std::atomic<bool> in_use;
+        uint64_t reported_dropped = 0;
+
+        // The name of the thread which last used the ring, saved when it exits
+        char name[16] = {};
+        std::atomic<bool> name_saved{false};
+        // Whether the name of the thread using the ring has been written to the trace event file
+        std::atomic<bool> event_thread_named{false};
+    };
+
+    class TraceDrain {
+    public:
+        TraceDrain()
+            : m_Start(std::chrono::steady_clock::now()),
+              m_Running(true)
+        {
+#ifndef __ANDROID__
+            m_pFile = stderr;
+            auto path = getenv("SOUNDSCAPE_TRACE_FILE");
+            if(path) {
+                m_pOwnedFile = fopen(path, "w");
+                if(m_pOwnedFile)
+                    m_pFile = m_pOwnedFile;
+            }
+#endif
+            AddSpareRings();
+            pthread_key_create(&m_RingKey, &TraceDrain::ThreadExit);
+            m_Thread = std::thread(&TraceDrain::DrainThread, this);
+            atexit(&TraceDrain::Exit);
+
+#ifndef __ANDROID__
+            auto events_path = getenv("SOUNDSCAPE_TRACE_EVENTS");
+            if(events_path)
+                StartEvents(events_path);
+#endif
+        }
+
+        // Rings are kept for the life of the process, and are reused once the thread that was
+        // using them has exited. Taking one from the pool doesn't lock or allocate, so that even
+        // the mixer thread's first trace doesn't block. Returns nullptr if there are none spare.
+        ThreadRing *AcquireRing()
+        {
+            auto count = m_RingCount.load(std::memory_order_acquire);
+            for(size_t index = 0; index < count; ++index) {
+                auto ring = m_Rings[index].get();
+                bool expected = false;
+                if(ring->in_use.compare_exchange_strong(expected, true)) {
+                    ring->thread = static_cast<int>(syscall(SYS_gettid));
+                    ring->name_saved = false;
+                    ring->event_thread_named = false;
+                    // The key's destructor releases the ring when the thread exits. A
+                    // thread_local with a destructor would allocate on the first trace.
+                    pthread_setspecific(m_RingKey, ring);
+                    return ring;
+                }
+            }
+            return nullptr;
+        }
+
+        // Called as the thread exits, which isn't time critical, so its name is saved for the
+        // records that it leaves in the ring. Those are drained before the ring goes back to the
+        // pool, otherwise the next thread to take it would have them reported under its own id.
+        void ReleaseRing(ThreadRing *ring)
+        {
+            {
+                std::lock_guard<std::mutex> guard(m_RingsMutex);
+                pthread_getname_np(pthread_self(), ring->name, sizeof(ring->name));
+                ring->name_saved = true;
+            }
+            {
+                std::lock_guard<std::mutex> drain_guard(m_DrainMutex);
+                DrainRing(*ring);
+            }
+            ring->in_use = false;
+        }
+
+        // A record from a thread which couldn't get a ring
+        void CountUnringed() { m_Unringed.fetch_add(1, std::memory_order_relaxed); }
+
+        void Drain()
+        {
+            std::lock_guard<std::mutex> drain_guard(m_DrainMutex);
+            auto count = m_RingCount.load(std::memory_order_acquire);
+
+            for(size_t index = 0; index < count; ++index)
+                DrainRing(*m_Rings[index]);
+            auto unringed = m_Unringed.load(std::memory_order_relaxed);
+            if(unringed != m_ReportedUnringed) {
+                Output(TRACE_LEVEL_WARNING, GetSeconds(), 0,
+                       std::to_string(unringed - m_ReportedUnringed) +
+                       " trace records dropped from threads with no ring");
+                m_ReportedUnringed = unringed;
+            }
+#ifndef __ANDROID__
+            fflush(m_pFile);
+            if(m_pEventsFile)
+                fflush(m_pEventsFile);
+#endif
+        }
+
+        // Called with m_DrainMutex held
+        void DrainRing(ThreadRing &ring)
+        {
+            uint8_t record[TRACE_MAX_RECORD];
+            size_t size;
+            while((size = ring.ring.Read(record, sizeof(record))) > 0)
+                Write(ring, record, size);
+
+            auto dropped = ring.ring.GetDroppedCount();
+            if(dropped != ring.reported_dropped) {
+                Output(TRACE_LEVEL_WARNING, GetSeconds(), ring.thread,
+                       std::to_string(dropped - ring.reported_dropped) + " trace records dropped");
+                ring.reported_dropped = dropped;
+            }
+        }
+
+        bool StartEvents(const char *path)
+        {
+            StopEvents();
+
+            std::lock_guard<std::mutex> drain_guard(m_DrainMutex);
+            m_pEventsFile = fopen(path, "w");
+            if(!m_pEventsFile)
+                return false;
+
+            fprintf(m_pEventsFile, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[");
+            m_EventCount = 0;
+            auto count = m_RingCount.load(std::memory_order_acquire);
+            for(size_t index = 0; index < count; ++index)
+                m_Rings[index]->event_thread_named = false;
+            g_TraceEventsEnabled = true;
+            return true;
+        }
+
+        void StopEvents()
+        {
+            if(!g_TraceEventsEnabled.exchange(false))
+                return;
+
+            // Write out the events that are already in the rings before closing the file
+            Drain();
+            std::lock_guard<std::mutex> drain_guard(m_DrainMutex);
+            if(m_pEventsFile) {
+                fprintf(m_pEventsFile, "\n]}\n");
+                fclose(m_pEventsFile);
+                m_pEventsFile = nullptr;
+            }
+        }
+
+        void SetFile(FILE *file)
+        {
+            std::lock_guard<std::mutex> drain_guard(m_DrainMutex);
+            m_pFile = file ? file : stderr;
+        }
+
+        uint64_t GetDroppedCount()
+        {
+            uint64_t dropped = m_Unringed.load(std::memory_order_relaxed);
+            auto count = m_RingCount.load(std::memory_order_acquire);
+            for(size_t index = 0; index < count; ++index)
+                dropped += m_Rings[index]->ring.GetDroppedCount();
+            return dropped;
+        }
+
+        // Timestamps are in nanoseconds since the drain was created
+        uint64_t GetTimestamp() const
+        {
+            return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+                std::chrono::steady_clock::now() - m_Start).count());
+        }
+        double GetSeconds() const { return static_cast<double>(GetTimestamp()) * 1e-9; }
+
+    private:
+        static void Exit();
+        static void ThreadExit(void *ring);
+
+        void DrainThread()
+        {
+            while(m_Running) {
+                Drain();
+                AddSpareRings();
+                std::this_thread::sleep_for(DRAIN_INTERVAL);
+            }
+        }
+
+        // Allocate rings until there are SPARE_RINGS not in use. Only the drain adds rings, and
+        // once one is published by bumping the count it's never moved or freed.
+        void AddSpareRings()
+        {
+            std::lock_guard<std::mutex> guard(m_RingsMutex);
+            auto count = m_RingCount.load(std::memory_order_relaxed);
+            size_t spare = 0;
+            for(size_t index = 0; index < count; ++index) {
+                if(!m_Rings[index]->in_use)
+                    ++spare;
+            }
+            while((spare < SPARE_RINGS) && (count < MAX_RINGS)) {
+                m_Rings[count++] = std::make_unique<ThreadRing>();
+                m_RingCount.store(count, std::memory_order_release);
+                ++spare;
+            }
+        }
+
+        // Threads don't look up their names when they take a ring, so it's read from /proc
+        // while the thread is running, or it was saved when it exited
+        std::string GetThreadName(ThreadRing &ring)
+        {
+            std::lock_guard<std::mutex> guard(m_RingsMutex);
+            if(ring.name_saved)
+                return ring.name;
+
+            char name[32] = {};
+            auto path = "/proc/self/task/" + std::to_string(ring.thread.load()) + "/comm";
+            auto file = fopen(path.c_str(), "r");
+            if(file) {
+                if(fgets(name, sizeof(name), file))
+                    name[strcspn(name, "\n")] = '\0';
+                fclose(file);
+            }
+            return name;
+        }
+
+        void Write(ThreadRing &ring, const uint8_t *record, size_t size)
+        {
+            uint64_t timestamp;
+            const TraceFormat *format;
+            if(size < sizeof(timestamp) + sizeof(format))
+                return;
+            memcpy(&timestamp, record, sizeof(timestamp));
+            memcpy(&format, record + sizeof(timestamp), sizeof(format));
+
+            auto offset = sizeof(timestamp) + sizeof(format);
+            if(format == &g_TraceEventFormat) {
+                WriteEvent(ring, timestamp, record + offset, size - offset);
+                return;
+            }
+            Output(format->level, static_cast<double>(timestamp) * 1e-9, ring.thread,
+                   FormatRecord(format->format, record + offset, size - offset));
+        }
+
+        // The event record was committed when the event ended, and is written out as a Chrome
+        // trace complete event with its times in microseconds
+        void WriteEvent(ThreadRing &ring, uint64_t timestamp, const uint8_t *arguments, size_t size)
+        {
+            if(!m_pEventsFile)
+                return;
+            if((size < 2) || (arguments[0] != static_cast<uint8_t>(TraceArgumentType::String)))
+                return;
+            size_t length = arguments[1];
+            auto offset = 2 + length;
+            if((size < offset + 1 + sizeof(uint64_t)) ||
+               (arguments[offset] != static_cast<uint8_t>(TraceArgumentType::Unsigned)))
+                return;
+            std::string name(reinterpret_cast<const char *>(arguments + 2), length);
+            uint64_t duration;
+            memcpy(&duration, arguments + offset + 1, sizeof(duration));
+
+            auto pid = static_cast<int>(getpid());
+            int thread = ring.thread;
+            if(!ring.event_thread_named) {
+                fprintf(m_pEventsFile,
+                        "%s\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":%d,\"tid\":%d,\"args\":{\"name\":\"%s\"}}",
+                        m_EventCount++ ? "," : "", pid, thread, JsonEscape(GetThreadName(ring)).c_str());
+                ring.event_thread_named = true;
+            }
+
+            auto start = timestamp - std::min(duration, timestamp);
+            fprintf(m_pEventsFile,
+                    "%s\n{\"name\":\"%s\",\"cat\":\"soundscape\",\"ph\":\"X\",\"ts\":%.3f,\"dur\":%.3f,\"pid\":%d,\"tid\":%d}",
+                    m_EventCount++ ? "," : "", JsonEscape(name).c_str(),
+                    static_cast<double>(start) * 1e-3, static_cast<double>(duration) * 1e-3, pid, thread);
+        }
+
+        static std::string JsonEscape(const std::string &text)
+        {
+            std::string escaped;
+            for(auto c: text) {
+                if((c == '"') || (c == '\\'))
+                    escaped += '\\';
+                if(static_cast<unsigned char>(c) >= ' ')
+                    escaped += c;
+            }
+            return escaped;
+        }
+
+        // Logcat has its own timestamps and thread IDs
+        void Output(int level MAYBE_UNUSED, double seconds MAYBE_UNUSED, int thread MAYBE_UNUSED,
+                    const std::string &message)
+        {
+#ifdef __ANDROID__
+            android_LogPriority priority = ANDROID_LOG_DEBUG;
+            if(level == TRACE_LEVEL_ERROR)
+                priority = ANDROID_LOG_ERROR;
+            else if(level == TRACE_LEVEL_WARNING)
+                priority = ANDROID_LOG_WARN;
+            else if(level == TRACE_LEVEL_INFO)
+                priority = ANDROID_LOG_INFO;
+            __android_log_write(priority, "AudioEngine", message.c_str());
+#else
+            fprintf(m_pFile, "AudioEngine %11.6f %6d: %s\n", seconds, thread, message.c_str());
+#endif
+        }
+
+        // Format the arguments one conversion at a time, using the type that they were recorded
+        // with rather than trusting the length modifiers in the format.
+        static std::string FormatRecord(const char *format, const uint8_t *arguments, size_t size)
+        {
+            std::string message;
+            size_t offset = 0;
+            char output[TRACE_MAX_RECORD];
+
+            const char *p = format;
+            while(*p) {
+                if(*p != '%') {
+                    message += *p++;
+                    continue;
+                }
+                if(p[1] == '%') {
+                    message += '%';
+                    p += 2;
+                    continue;
+                }
+
+                // Flags, width and precision are kept and the length modifiers dropped
+                std::string spec = "%";
+                ++p;
+                while(*p && strchr("-+ #0123456789.", *p))
+                    spec += *p++;
+                while(*p && strchr("hljztL", *p))
+                    ++p;
+                char conversion = *p ? *p++ : 's';
+
+                if(offset >= size) {
+                    message += "<missing>";
+                    continue;
+                }
+                auto type = static_cast<TraceArgumentType>(arguments[offset++]);
+                if(type == TraceArgumentType::String) {
+                    size_t length = arguments[offset++];
+                    std::string value(reinterpret_cast<const char *>(arguments + offset), length);
+                    offset += length;
+                    snprintf(output, sizeof(output), (spec + "s").c_str(), value.c_str());
+                    message += output;
+                    continue;
+                }
+
+                uint64_t bits;
+                memcpy(&bits, arguments + offset, sizeof(bits));
+                offset += sizeof(bits);
+                double real;
+                memcpy(&real, &bits, sizeof(real));
+                auto integer = static_cast<long long>(bits);
+                if(type == TraceArgumentType::Double)
+                    integer = static_cast<long long>(real);
+                else if(type == TraceArgumentType::Signed)
+                    real = static_cast<double>(integer);
+                else
+                    real = static_cast<double>(bits);
+
+                if(strchr("fFeEgGaA", conversion))
+                    snprintf(output, sizeof(output), (spec + conversion).c_str(), real);
+                else if(conversion == 'p')
+                    snprintf(output, sizeof(output), (spec + "p").c_str(), reinterpret_cast<void *>(bits));
+                else if(conversion == 'c')
+                    snprintf(output, sizeof(output), (spec + "c").c_str(), static_cast<int>(integer));
+                else if(strchr("diouxX", conversion))
+                    snprintf(output, sizeof(output), (spec + "ll" + conversion).c_str(), integer);
+                else
+                    snprintf(output, sizeof(output), "<%%%c?>", conversion);
+                message += output;
+            }
+            return message;
+        }
+
+        std::chrono::steady_clock::time_point m_Start;
+
+        std::mutex m_RingsMutex;
+        std::unique_ptr<ThreadRing> m_Rings[MAX_RINGS];
+        std::atomic<size_t> m_RingCount{0};
+        std::atomic<uint64_t> m_Unringed{0};
+        pthread_key_t m_RingKey{};
+        uint64_t m_ReportedUnringed = 0;
+
+        std::mutex m_DrainMutex;
+        FILE *m_pFile = nullptr;
+        FILE *m_pOwnedFile = nullptr;
+        FILE *m_pEventsFile = nullptr;
+        size_t m_EventCount = 0;
+
+        std::atomic<bool> m_Running;
+        std::thread m_Thread;
+    };
+
+    // The drain is never destroyed, so that threads which trace while the process exits don't
+    // use it after it's gone. Instead it's stopped and flushed at exit.
+    TraceDrain &GetDrain()
+    {
+        static auto drain = new TraceDrain();
+        return *drain;
+    }
+
+    void TraceDrain::Exit()
+    {
+        auto &drain = GetDrain();
+        drain.StopEvents();
+        drain.m_Running = false;
+        if(drain.m_Thread.joinable())
+            drain.m_Thread.join();
+        drain.Drain();
+    }
+
+    thread_local ThreadRing *t_pRing = nullptr;
+
+    // Releases the thread's ring for reuse when the thread exits
+    void TraceDrain::ThreadExit(void *ring)
+    {
+        t_pRing = nullptr;
+        GetDrain().ReleaseRing(static_cast<ThreadRing *>(ring));
+    }
+}
+
+void soundscape::TraceCommit(TraceRecord &record)
+{
+    auto &drain = GetDrain();
+    if(!t_pRing) {
+        t_pRing = drain.AcquireRing();
+        if(!t_pRing) {
+            drain.CountUnringed();
+            return;
+        }
+    }
+
+    auto timestamp = drain.GetTimestamp();
+    memcpy(record.GetData(), &timestamp, sizeof(timestamp));
+    t_pRing->ring.Write(record.GetData(), record.GetSize());
+}
+
+void soundscape::TraceFlush()
+{
+    GetDrain().Drain();
+}
+
+void soundscape::SetTraceFile(FILE *file)
+{
+    GetDrain().SetFile(file);
+}
+
+uint64_t soundscape::GetTraceDroppedCount()
+{
+    return GetDrain().GetDroppedCount();
+}
+
+bool soundscape::StartTraceEvents(const char *path)
+{
+    return GetDrain().StartEvents(path);
+}
+
+void soundscape::StopTraceEvents()
+{
+    GetDrain().StopEvents();
+}
+
+bool soundscape::TraceEventsEnabled()
+{
+    return g_TraceEventsEnabled.load(std::memory_order_relaxed);
+}
+
+void soundscape::TraceEventCommit(const char *name, uint64_t duration_ns)
+{
+    TraceRecord record(&g_TraceEventFormat);
+    record.Add(name);
+    record.Add(duration_ns);
+    TraceCommit(record);
+}
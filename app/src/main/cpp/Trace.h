@@ -1,9 +1,243 @@
 #pragma once
 
-#include <android/log.h>
+//
+// Tracing which is cheap enough to leave in the audio paths. A trace statement doesn't format
+// anything or make any system calls. It writes a binary record of a pointer to its static format
+// and its arguments into a lock-free ring belonging to the calling thread, and a background drain
+// thread formats the records and writes them to logcat on Android or to stderr or a file on the
+// host. If a ring is full the record is dropped and counted, so a trace never blocks.
+//
+// Trace statements below SOUNDSCAPE_TRACE_LEVEL are compiled out, though their formats are still
+// checked against their arguments.
+//
+// TRACE_SCOPE marks a span of code as an event on a timeline. On Android the events are ATrace
+// sections which show up in Perfetto and systrace. On the host they go through the same rings and
+// the drain writes them out as Chrome trace event JSON, which can be opened in Perfetto or
+// chrome://tracing, while StartTraceEvents is recording.
+//
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <type_traits>
+
+#ifdef __ANDROID__
+#include <android/trace.h>
+#endif
 
 #define MAYBE_UNUSED __attribute__((unused))
 
-#define TRACE(args...) \
-__android_log_print(android_LogPriority::ANDROID_LOG_DEBUG, "AudioEngine", args)
-#define ERROR_CHECK(a) if(a) TRACE("line %d, result %d", __LINE__, a)
+#define TRACE_LEVEL_NONE 0
+#define TRACE_LEVEL_ERROR 1
+#define TRACE_LEVEL_WARNING 2
+#define TRACE_LEVEL_INFO 3
+#define TRACE_LEVEL_DEBUG 4
+
+#ifndef SOUNDSCAPE_TRACE_LEVEL
+#define SOUNDSCAPE_TRACE_LEVEL TRACE_LEVEL_DEBUG
+#endif
+
+namespace soundscape {
+
+    // The format of a trace statement. It's static, so its address identifies it in the records.
+    struct TraceFormat {
+        int level;
+        const char *format;
+    };
+
+    enum class TraceArgumentType : uint8_t {
+        Signed,
+        Unsigned,
+        Double,
+        Pointer,
+        String
+    };
+
+    // The largest record, including its header, and the longest string argument. Longer strings
+    // are truncated and arguments which don't fit are left out.
+    const size_t TRACE_MAX_RECORD = 256;
+    const size_t TRACE_MAX_STRING = 96;
+
+    //
+    // A record is built on the stack and then copied into the ring. It starts with a timestamp,
+    // which is filled in when it's committed, and the format pointer. Each argument follows as a
+    // type byte and then either 8 bytes of value, or for a string a length byte and the characters.
+    //
+    class TraceRecord {
+    public:
+        explicit TraceRecord(const TraceFormat *format)
+        {
+            m_Size = sizeof(uint64_t);
+            Append(&format, sizeof(format));
+        }
+
+        template<typename T>
+        void Add(T value)
+        {
+            if constexpr(std::is_enum_v<T>)
+                Add(static_cast<std::underlying_type_t<T>>(value));
+            else if constexpr(std::is_same_v<T, const char *> || std::is_same_v<T, char *>)
+                AddString(value);
+            else if constexpr(std::is_pointer_v<T>)
+                AddValue(TraceArgumentType::Pointer, reinterpret_cast<uintptr_t>(value));
+            else if constexpr(std::is_floating_point_v<T>)
+                AddValue(TraceArgumentType::Double, static_cast<double>(value));
+            else if constexpr(std::is_signed_v<T>)
+                AddValue(TraceArgumentType::Signed, static_cast<int64_t>(value));
+            else
+                AddValue(TraceArgumentType::Unsigned, static_cast<uint64_t>(value));
+        }
+
+        uint8_t *GetData() { return m_Data; }
+        uint16_t GetSize() const { return static_cast<uint16_t>(m_Size); }
+
+    private:
+        template<typename T>
+        void AddValue(TraceArgumentType type, T value)
+        {
+            static_assert(sizeof(T) == 8);
+            if(m_Size + 1 + sizeof(T) > TRACE_MAX_RECORD)
+                return;
+            m_Data[m_Size++] = static_cast<uint8_t>(type);
+            Append(&value, sizeof(value));
+        }
+
+        void AddString(const char *value)
+        {
+            size_t length = 0;
+            if(value)
+                length = strnlen(value, TRACE_MAX_STRING);
+            if(m_Size + 2 + length > TRACE_MAX_RECORD)
+                return;
+            m_Data[m_Size++] = static_cast<uint8_t>(TraceArgumentType::String);
+            m_Data[m_Size++] = static_cast<uint8_t>(length);
+            Append(value, length);
+        }
+
+        void Append(const void *data, size_t size)
+        {
+            memcpy(m_Data + m_Size, data, size);
+            m_Size += size;
+        }
+
+        uint8_t m_Data[TRACE_MAX_RECORD];
+        size_t m_Size;
+    };
+
+    // Timestamp the record and write it to the calling thread's ring
+    void TraceCommit(TraceRecord &record);
+
+    template<typename... Args>
+    inline void TraceLog(const TraceFormat *format, Args... args)
+    {
+        TraceRecord record(format);
+        (record.Add(args), ...);
+        TraceCommit(record);
+    }
+
+    // Never called, it's only there so that the compiler checks the format against the arguments
+    inline void TraceCheckFormat(const char *format MAYBE_UNUSED, ...) __attribute__((format(printf, 1, 2)));
+    inline void TraceCheckFormat(const char *format MAYBE_UNUSED, ...) {}
+
+    // Format and write out everything that's been traced so far
+    void TraceFlush();
+
+    // Host builds trace to stderr unless SOUNDSCAPE_TRACE_FILE is set in the environment, or
+    // another file is set here. The file isn't closed by the trace.
+    void SetTraceFile(FILE *file);
+
+    // The number of records dropped because a ring was full
+    uint64_t GetTraceDroppedCount();
+
+    // Record the scoped trace events on the host to a Chrome trace event JSON file, until
+    // StopTraceEvents is called or the process exits. Setting SOUNDSCAPE_TRACE_EVENTS in the
+    // environment to a path starts recording to it. Returns false if the file can't be opened.
+    bool StartTraceEvents(const char *path);
+    void StopTraceEvents();
+    bool TraceEventsEnabled();
+
+    // Write an event which ended now to the calling thread's ring
+    void TraceEventCommit(const char *name, uint64_t duration_ns);
+
+    class TraceScope {
+    public:
+        explicit TraceScope(const char *name)
+        {
+#ifdef __ANDROID__
+            ATrace_beginSection(name);
+#else
+            if(TraceEventsEnabled()) {
+                m_Name = name;
+                m_Start = std::chrono::steady_clock::now();
+            }
+#endif
+        }
+
+        ~TraceScope()
+        {
+#ifdef __ANDROID__
+            ATrace_endSection();
+#else
+            if(m_Name) {
+                auto duration = std::chrono::steady_clock::now() - m_Start;
+                TraceEventCommit(m_Name,
+                                 static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(duration).count()));
+            }
+#endif
+        }
+
+        TraceScope(const TraceScope &) = delete;
+        TraceScope &operator=(const TraceScope &) = delete;
+
+    private:
+#ifndef __ANDROID__
+        const char *m_Name = nullptr;
+        std::chrono::steady_clock::time_point m_Start;
+#endif
+    };
+}
+
+#define TRACE_SCOPE_CONCAT_(a, b) a##b
+#define TRACE_SCOPE_NAME_(line) TRACE_SCOPE_CONCAT_(trace_scope_, line)
+#define TRACE_SCOPE(name) soundscape::TraceScope TRACE_SCOPE_NAME_(__LINE__)(name)
+
+#define SOUNDSCAPE_TRACE(level, format, args...) \
+    do { \
+        if(false) \
+            soundscape::TraceCheckFormat(format, ##args); \
+        static const soundscape::TraceFormat trace_format_ = {level, format}; \
+        soundscape::TraceLog(&trace_format_, ##args); \
+    } while(0)
+
+#define SOUNDSCAPE_NO_TRACE(format, args...) \
+    do { \
+        if(false) \
+            soundscape::TraceCheckFormat(format, ##args); \
+    } while(0)
+
+#if SOUNDSCAPE_TRACE_LEVEL >= TRACE_LEVEL_ERROR
+#define TRACE_ERROR(format, args...) SOUNDSCAPE_TRACE(TRACE_LEVEL_ERROR, format, ##args)
+#else
+#define TRACE_ERROR(format, args...) SOUNDSCAPE_NO_TRACE(format, ##args)
+#endif
+
+#if SOUNDSCAPE_TRACE_LEVEL >= TRACE_LEVEL_WARNING
+#define TRACE_WARNING(format, args...) SOUNDSCAPE_TRACE(TRACE_LEVEL_WARNING, format, ##args)
+#else
+#define TRACE_WARNING(format, args...) SOUNDSCAPE_NO_TRACE(format, ##args)
+#endif
+
+#if SOUNDSCAPE_TRACE_LEVEL >= TRACE_LEVEL_INFO
+#define TRACE_INFO(format, args...) SOUNDSCAPE_TRACE(TRACE_LEVEL_INFO, format, ##args)
+#else
+#define TRACE_INFO(format, args...) SOUNDSCAPE_NO_TRACE(format, ##args)
+#endif
+
+// TRACE is for debug tracing
+#if SOUNDSCAPE_TRACE_LEVEL >= TRACE_LEVEL_DEBUG
+#define TRACE(format, args...) SOUNDSCAPE_TRACE(TRACE_LEVEL_DEBUG, format, ##args)
+#else
+#define TRACE(format, args...) SOUNDSCAPE_NO_TRACE(format, ##args)
+#endif
+
+#define ERROR_CHECK(a) if(a) TRACE_ERROR("line %d, result %d", __LINE__, a)
@@ -0,0 +1,89 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+namespace soundscape {
+
+    //
+    // Single producer, single consumer ring of variable length binary records. Each thread that
+    // traces writes into its own ring and the drain thread reads from all of them, so neither
+    // side ever waits for the other. A record which doesn't fit is dropped and counted rather
+    // than blocking the writer, which may be the mixer thread.
+    //
+    class TraceRing {
+    public:
+        // The capacity must be a power of two
+        explicit TraceRing(size_t capacity)
+            : m_Buffer(capacity),
+              m_Mask(capacity - 1),
+              m_WritePosition(0),
+              m_ReadPosition(0),
+              m_Dropped(0)
+        {
+        }
+
+        // Producer only
+        bool Write(const uint8_t *data, uint16_t size)
+        {
+            auto write = m_WritePosition.load(std::memory_order_relaxed);
+            auto read = m_ReadPosition.load(std::memory_order_acquire);
+            if(m_Buffer.size() - (write - read) < sizeof(size) + size) {
+                m_Dropped.fetch_add(1, std::memory_order_relaxed);
+                return false;
+            }
+            Copy(write, reinterpret_cast<const uint8_t *>(&size), sizeof(size));
+            Copy(write + sizeof(size), data, size);
+            m_WritePosition.store(write + sizeof(size) + size, std::memory_order_release);
+            return true;
+        }
+
+        // Consumer only. Reads the next record into data and returns its size, or returns zero if
+        // there are no records waiting. Records longer than max_size are truncated.
+        size_t Read(uint8_t *data, size_t max_size)
+        {
+            auto read = m_ReadPosition.load(std::memory_order_relaxed);
+            auto write = m_WritePosition.load(std::memory_order_acquire);
+            if(read == write)
+                return 0;
+
+            uint16_t size;
+            Copy(reinterpret_cast<uint8_t *>(&size), read, sizeof(size));
+            auto copy_size = std::min<size_t>(size, max_size);
+            Copy(data, read + sizeof(size), copy_size);
+            m_ReadPosition.store(read + sizeof(size) + size, std::memory_order_release);
+            return copy_size;
+        }
+
+        uint64_t GetDroppedCount() const { return m_Dropped.load(std::memory_order_relaxed); }
+
+    private:
+        void Copy(uint64_t position, const uint8_t *data, size_t size)
+        {
+            auto offset = position & m_Mask;
+            auto first = std::min(size, m_Buffer.size() - offset);
+            memcpy(m_Buffer.data() + offset, data, first);
+            memcpy(m_Buffer.data(), data + first, size - first);
+        }
+
+        void Copy(uint8_t *data, uint64_t position, size_t size) const
+        {
+            auto offset = position & m_Mask;
+            auto first = std::min(size, m_Buffer.size() - offset);
+            memcpy(data, m_Buffer.data() + offset, first);
+            memcpy(data + first, m_Buffer.data(), size - first);
+        }
+
+        std::vector<uint8_t> m_Buffer;
+        uint64_t m_Mask;
+
+        // Positions increase forever and are masked to index the buffer
+        alignas(64) std::atomic<uint64_t> m_WritePosition;
+        alignas(64) std::atomic<uint64_t> m_ReadPosition;
+        std::atomic<uint64_t> m_Dropped;
+    };
+
+} // soundscape
@@ -0,0 +1,106 @@
+#include <cstring>
+#include <fstream>
+#include <iterator>
+
+#include "WavFile.h"
+#include "Trace.h"
+
+using namespace soundscape;
+
+// WAV files are little endian, as are all of the platforms that we build for, so the header
+// fields are copied directly.
+template<typename T>
+static T ReadField(const std::vector<uint8_t> &data, size_t offset)
+{
+    T value;
+    memcpy(&value, data.data() + offset, sizeof(T));
+    return value;
+}
+
+template<typename T>
+static void WriteField(std::ofstream &file, T value)
+{
+    file.write(reinterpret_cast<const char *>(&value), sizeof(T));
+}
+
+bool soundscape::ReadWavFile(const std::string &path, WavData &wav)
+{
+    std::ifstream file(path, std::ios::binary);
+    if(!file) {
+        TRACE_ERROR("Failed to open %s", path.c_str());
+        return false;
+    }
+    std::vector<uint8_t> data((std::istreambuf_iterator<char>(file)),
+                              std::istreambuf_iterator<char>());
+
+    if((data.size() < 12) ||
+       (memcmp(data.data(), "RIFF", 4) != 0) ||
+       (memcmp(data.data() + 8, "WAVE", 4) != 0)) {
+        TRACE_ERROR("%s is not a WAV file", path.c_str());
+        return false;
+    }
+
+    bool have_format = false;
+    size_t offset = 12;
+    while(offset + 8 <= data.size()) {
+        auto chunk_size = ReadField<uint32_t>(data, offset + 4);
+        auto chunk_data = offset + 8;
+        if(chunk_size > data.size() - chunk_data)
+            break;
+
+        if(memcmp(data.data() + offset, "fmt ", 4) == 0) {
+            if(chunk_size < 16)
+                break;
+            auto format = ReadField<uint16_t>(data, chunk_data);
+            auto bits_per_sample = ReadField<uint16_t>(data, chunk_data + 14);
+            if((format != 1) || (bits_per_sample != 16)) {
+                TRACE_ERROR("%s is not PCM16", path.c_str());
+                return false;
+            }
+            wav.channels = ReadField<uint16_t>(data, chunk_data + 2);
+            wav.sample_rate = static_cast<int>(ReadField<uint32_t>(data, chunk_data + 4));
+            have_format = true;
+        } else if((memcmp(data.data() + offset, "data", 4) == 0) && have_format) {
+            wav.samples.resize(chunk_size / sizeof(int16_t));
+            memcpy(wav.samples.data(), data.data() + chunk_data,
+                   wav.samples.size() * sizeof(int16_t));
+            return true;
+        }
+        // Chunks are padded to an even length
+        offset = chunk_data + chunk_size + (chunk_size & 1);
+    }
+
+    TRACE_ERROR("%s has no audio data", path.c_str());
+    return false;
+}
+
+bool soundscape::WriteWavFile(const std::string &path, const WavData &wav)
+{
+    std::ofstream file(path, std::ios::binary);
+    if(!file) {
+        TRACE_ERROR("Failed to create %s", path.c_str());
+        return false;
+    }
+
+    auto data_size = static_cast<uint32_t>(wav.samples.size() * sizeof(int16_t));
+    auto block_align = static_cast<uint16_t>(wav.channels * sizeof(int16_t));
+
+    file.write("RIFF", 4);
+    WriteField<uint32_t>(file, 36 + data_size);
+    file.write("WAVE", 4);
+
+    file.write("fmt ", 4);
+    WriteField<uint32_t>(file, 16);
+    WriteField<uint16_t>(file, 1);
+    WriteField<uint16_t>(file, static_cast<uint16_t>(wav.channels));
+    WriteField<uint32_t>(file, static_cast<uint32_t>(wav.sample_rate));
+    WriteField<uint32_t>(file, static_cast<uint32_t>(wav.sample_rate) * block_align);
+    WriteField<uint16_t>(file, block_align);
+    WriteField<uint16_t>(file, 16);
+
+    file.write("data", 4);
+    WriteField<uint32_t>(file, data_size);
+    file.write(reinterpret_cast<const char *>(wav.samples.data()), data_size);
+
+    return static_cast<bool>(file);
+}
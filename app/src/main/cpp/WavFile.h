@@ -0,0 +1,20 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace soundscape {
+
+    // PCM16 audio, with the samples for each channel interleaved
+    struct WavData {
+        int sample_rate = 0;
+        int channels = 0;
+        std::vector<int16_t> samples;
+    };
+
+    // Only uncompressed PCM16 WAV files are supported
+    bool ReadWavFile(const std::string &path, WavData &wav);
+    bool WriteWavFile(const std::string &path, const WavData &wav);
+
+} // soundscape
@@ -0,0 +1,533 @@
+#include <algorithm>
+#include <limits>
+#include <memory>
+#include <vector>
+
+#include "soundscape_engine.h"
+#include "AudioEngine.h"
+#include "AudioBeacon.h"
+#include "TileClipper.h"
+#include "TileFile.h"
+#include "Trace.h"
+#ifdef __ANDROID__
+#include "FmodAudioBackend.h"
+#else
+#include "OfflineAudioBackend.h"
+#endif
+
+using namespace soundscape;
+
+static_assert(sizeof(soundscape_event) == sizeof(Event));
+static_assert(offsetof(soundscape_event, handle) == offsetof(Event, handle));
+static_assert(offsetof(soundscape_event, value) == offsetof(Event, value));
+
+static_assert(SOUNDSCAPE_SOURCE_BEACON == static_cast<int>(AudioSourceType::Beacon));
+static_assert(SOUNDSCAPE_SOURCE_TEXT_TO_SPEECH == static_cast<int>(AudioSourceType::TextToSpeech));
+static_assert(SOUNDSCAPE_SOURCE_TYPES == static_cast<int>(AudioSourceType::Count));
+static_assert(SOUNDSCAPE_MOTION_LAYER_SWITCH == static_cast<int>(MotionPath::LayerSwitch));
+static_assert(SOUNDSCAPE_MOTION_LISTENER == static_cast<int>(MotionPath::Listener));
+static_assert(SOUNDSCAPE_MOTION_PATHS == static_cast<int>(MotionPath::Count));
+static_assert(SOUNDSCAPE_CATEGORY_POI == static_cast<int>(FeatureCategory::Poi));
+static_assert(SOUNDSCAPE_CATEGORY_ROAD == static_cast<int>(FeatureCategory::Road));
+static_assert(SOUNDSCAPE_CATEGORY_PATH == static_cast<int>(FeatureCategory::Path));
+static_assert(SOUNDSCAPE_CATEGORY_INTERSECTION == static_cast<int>(FeatureCategory::Intersection));
+static_assert(SOUNDSCAPE_CATEGORY_ENTRANCE == static_cast<int>(FeatureCategory::Entrance));
+static_assert(SOUNDSCAPE_CATEGORY_BUS_STOP == static_cast<int>(FeatureCategory::BusStop));
+static_assert(SOUNDSCAPE_CATEGORY_CROSSING == static_cast<int>(FeatureCategory::Crossing));
+static_assert(SOUNDSCAPE_CATEGORIES == static_cast<int>(FeatureCategory::Count));
+static_assert(SOUNDSCAPE_ROAD_NODE_INTERSECTION == static_cast<int>(RoadNodeType::Intersection));
+static_assert(SOUNDSCAPE_ROAD_NODE_END == static_cast<int>(RoadNodeType::End));
+static_assert(SOUNDSCAPE_ROAD_NODE_BORDER == static_cast<int>(RoadNodeType::Border));
+
+static AudioEngine *ToEngine(soundscape_engine *engine)
+{
+    return reinterpret_cast<AudioEngine *>(engine);
+}
+
+soundscape_engine *soundscape_engine_create(void)
+{
+#ifdef __ANDROID__
+    auto ae = std::make_unique<AudioEngine>(std::make_unique<FmodAudioBackend>());
+#else
+    // Host builds have no audio device, so audio is only mixed when the backend is asked to
+    // render it. Use AudioEngine directly to get at the backend.
+    auto ae = std::make_unique<AudioEngine>(std::make_unique<OfflineAudioBackend>());
+#endif
+
+    if (not ae) {
+        TRACE_ERROR("Failed to create audio engine");
+        ae.reset(nullptr);
+    }
+
+    return reinterpret_cast<soundscape_engine *>(ae.release());
+}
+
+void soundscape_engine_destroy(soundscape_engine *engine)
+{
+    delete ToEngine(engine);
+}
+
+void soundscape_engine_update_geometry(soundscape_engine *engine,
+                                       double latitude, double longitude, double heading)
+{
+    auto ae = ToEngine(engine);
+    if (ae) {
+        ae->UpdateGeometry(latitude, longitude, heading);
+    } else {
+        TRACE_ERROR("UpdateGeometry failed - no AudioEngine");
+    }
+}
+
+void soundscape_engine_set_beacon_type(soundscape_engine *engine, int beacon_type)
+{
+    auto ae = ToEngine(engine);
+    if (ae) {
+        ae->SetBeaconType(beacon_type);
+    } else {
+        TRACE_ERROR("SetBeaconType failed - no AudioEngine");
+    }
+}
+
+soundscape_handle soundscape_engine_create_beacon(soundscape_engine *engine,
+                                                  double latitude, double longitude)
+{
+    auto ae = ToEngine(engine);
+    if(ae) {
+        std::unique_ptr<Beacon> beacon(new(ae->GetMemory()) Beacon(ae, latitude, longitude));
+        if (not beacon) {
+            TRACE_ERROR("Failed to create audio beacon");
+            beacon.reset(nullptr);
+        }
+        return beacon ? beacon.release()->GetHandle() : 0;
+    }
+    return 0;
+}
+
+soundscape_handle soundscape_engine_create_text_to_speech(soundscape_engine *engine,
+                                                          double latitude, double longitude,
+                                                          int tts_socket)
+{
+    auto ae = ToEngine(engine);
+    if(ae) {
+        std::unique_ptr<TextToSpeech> tts(new(ae->GetMemory()) TextToSpeech(ae, latitude, longitude, tts_socket));
+        if (not tts) {
+            TRACE_ERROR("Failed to create text to speech");
+            tts.reset(nullptr);
+        }
+        return tts ? tts.release()->GetHandle() : 0;
+    }
+    return 0;
+}
+
+int soundscape_engine_destroy_audio(soundscape_engine *engine, soundscape_handle handle)
+{
+    auto ae = ToEngine(engine);
+    if(ae && ae->DestroyAudio(handle))
+        return 0;
+
+    TRACE_ERROR("DestroyAudio failed - invalid handle");
+    return -1;
+}
+
+int soundscape_engine_submit_commands(soundscape_engine *engine, uint8_t *commands, size_t length)
+{
+    auto ae = ToEngine(engine);
+    if(ae && (commands || (length == 0)))
+        return ae->SubmitCommands(commands, length);
+
+    TRACE_ERROR("SubmitCommands failed - no AudioEngine or commands");
+    return -1;
+}
+
+int soundscape_engine_register_pose_mailbox(soundscape_engine *engine, void *memory, size_t length)
+{
+    auto ae = ToEngine(engine);
+    if(ae) {
+        if((memory == nullptr) ||
+           (length < sizeof(PoseMailboxLayout)) ||
+           (reinterpret_cast<uintptr_t>(memory) % alignof(PoseMailboxLayout))) {
+            TRACE_ERROR("RegisterPoseMailbox failed - invalid mailbox memory");
+            return -1;
+        }
+        ae->RegisterPoseMailbox(memory);
+        return 0;
+    }
+    TRACE_ERROR("RegisterPoseMailbox failed - no AudioEngine");
+    return -1;
+}
+
+void soundscape_engine_set_event_callback(soundscape_engine *engine,
+                                          soundscape_event_callback callback, void *context)
+{
+    auto ae = ToEngine(engine);
+    if(ae)
+        ae->SetEventCallback(callback, context);
+}
+
+void *soundscape_engine_get_event_callback_context(soundscape_engine *engine)
+{
+    auto ae = ToEngine(engine);
+    if(ae)
+        return ae->GetEventCallbackContext();
+    return nullptr;
+}
+
+size_t soundscape_engine_drain_events(soundscape_engine *engine,
+                                      soundscape_event *events, size_t max_events)
+{
+    auto ae = ToEngine(engine);
+    if(ae)
+        return ae->DrainEvents(reinterpret_cast<Event *>(events), max_events);
+
+    TRACE_ERROR("DrainEvents failed - no AudioEngine");
+    return 0;
+}
+
+int soundscape_engine_get_stats(soundscape_engine *engine, soundscape_stats *stats, int reset)
+{
+    auto ae = ToEngine(engine);
+    if((ae == nullptr) || (stats == nullptr)) {
+        TRACE_ERROR("GetStats failed - no AudioEngine or stats");
+        return -1;
+    }
+
+    AudioStatsSnapshot snapshot;
+    ae->GetStats()->GetSnapshot(snapshot, reset != 0);
+
+    for(int type = 0; type < SOUNDSCAPE_SOURCE_TYPES; ++type) {
+        auto &durations = snapshot.callbacks[type].durations;
+        auto &callbacks = stats->callbacks[type];
+        callbacks.callbacks = durations.count;
+        callbacks.padded_callbacks = snapshot.callbacks[type].padded;
+        callbacks.p50_ns = durations.GetPercentile(50.0);
+        callbacks.p90_ns = durations.GetPercentile(90.0);
+        callbacks.p99_ns = durations.GetPercentile(99.0);
+        callbacks.p999_ns = durations.GetPercentile(99.9);
+        callbacks.max_ns = durations.max;
+    }
+    for(int path = 0; path < SOUNDSCAPE_MOTION_PATHS; ++path) {
+        auto &latencies = snapshot.motion[path];
+        auto &motion = stats->motion[path];
+        motion.count = latencies.count;
+        motion.p50_ns = latencies.GetPercentile(50.0);
+        motion.p95_ns = latencies.GetPercentile(95.0);
+        motion.p99_ns = latencies.GetPercentile(99.0);
+        motion.max_ns = latencies.max;
+    }
+    stats->dsp_cpu = snapshot.dsp_cpu;
+    stats->stream_cpu = snapshot.stream_cpu;
+    stats->peak_dsp_cpu = snapshot.peak_dsp_cpu;
+    stats->peak_stream_cpu = snapshot.peak_stream_cpu;
+    return 0;
+}
+
+int soundscape_engine_set_memory_budget(soundscape_engine *engine, size_t budget)
+{
+    auto ae = ToEngine(engine);
+    if(ae == nullptr) {
+        TRACE_ERROR("SetMemoryBudget failed - no AudioEngine");
+        return -1;
+    }
+
+    ae->GetMemory()->SetBudget(budget);
+    return 0;
+}
+
+int soundscape_engine_get_memory_stats(soundscape_engine *engine, soundscape_memory_stats *stats)
+{
+    auto ae = ToEngine(engine);
+    if((ae == nullptr) || (stats == nullptr)) {
+        TRACE_ERROR("GetMemoryStats failed - no AudioEngine or stats");
+        return -1;
+    }
+
+    MemoryStats memory;
+    ae->GetMemoryStats(memory);
+    stats->budget = memory.budget;
+    stats->used = memory.used;
+    stats->high_water = memory.high_water;
+    stats->refused = memory.refused;
+    stats->arena_size = memory.arena_size;
+    stats->arena_used = memory.arena_used;
+    stats->arena_high_water = memory.arena_high_water;
+    stats->overflows = memory.overflows;
+    stats->backend_pool = memory.backend_pool;
+    stats->backend_used = memory.backend_used;
+    stats->backend_high_water = memory.backend_high_water;
+    return 0;
+}
+
+// Zoom 16 tiles belong to the working set while it's running
+static void AddTile(AudioEngine *ae, const TileId &tile, std::shared_ptr<const FeatureCollection> features)
+{
+    if(!ae->GetTileWorkingSet()->AddTile(tile, features))
+        ae->GetFeatureStore()->AddTile(tile, std::move(features));
+}
+
+int soundscape_engine_load_tiles(soundscape_engine *engine, const soundscape_tile *tiles, size_t count)
+{
+    auto ae = ToEngine(engine);
+    if((ae == nullptr) || ((tiles == nullptr) && (count != 0))) {
+        TRACE_ERROR("LoadTiles failed - no AudioEngine or tiles");
+        return -1;
+    }
+
+    std::vector<TileJson> tile_json(count);
+    for(size_t index = 0; index < count; ++index)
+        tile_json[index] = {{tiles[index].x, tiles[index].y, tiles[index].zoom},
+                            tiles[index].json, tiles[index].length};
+    auto cache = ae->GetTileCache();
+    auto loaded = LoadTiles(tile_json.data(), count,
+                            [ae, cache](const TileId &tile, std::shared_ptr<const FeatureCollection> features) {
+        // Cached first, so that a tile the working set doesn't want yet is there when it does
+        if(cache->IsOpen())
+            cache->Put(tile, *features);
+        AddTile(ae, tile, std::move(features));
+    });
+    return static_cast<int>(loaded);
+}
+
+int64_t soundscape_engine_get_tile_feature_count(soundscape_engine *engine,
+                                                 int32_t x, int32_t y, int32_t zoom)
+{
+    auto ae = ToEngine(engine);
+    if(ae == nullptr) {
+        TRACE_ERROR("GetTileFeatureCount failed - no AudioEngine");
+        return -1;
+    }
+
+    auto tile = ae->GetFeatureStore()->GetTile({x, y, zoom});
+    return tile ? static_cast<int64_t>(tile->features.size()) : -1;
+}
+
+int soundscape_engine_save_tile_file(soundscape_engine *engine,
+                                     int32_t x, int32_t y, int32_t zoom, const char *path)
+{
+    auto ae = ToEngine(engine);
+    if((ae == nullptr) || (path == nullptr)) {
+        TRACE_ERROR("SaveTileFile failed - no AudioEngine or path");
+        return -1;
+    }
+
+    TileId id{x, y, zoom};
+    auto tile = ae->GetFeatureStore()->GetTile(id);
+    if(!tile)
+        return -1;
+    return WriteTileFile(path, id, *tile) ? 0 : -1;
+}
+
+int soundscape_engine_load_tile_file(soundscape_engine *engine, const char *path)
+{
+    auto ae = ToEngine(engine);
+    if((ae == nullptr) || (path == nullptr)) {
+        TRACE_ERROR("LoadTileFile failed - no AudioEngine or path");
+        return -1;
+    }
+
+    TileFile file;
+    if(!file.Open(path))
+        return -1;
+    auto features = std::make_shared<FeatureCollection>();
+    if(!file.Decode(*features))
+        return -1;
+    AddTile(ae, file.GetTile(), std::move(features));
+    return 0;
+}
+
+int soundscape_engine_open_tile_cache(soundscape_engine *engine, const char *directory, uint64_t budget)
+{
+    auto ae = ToEngine(engine);
+    if((ae == nullptr) || (directory == nullptr)) {
+        TRACE_ERROR("OpenTileCache failed - no AudioEngine or directory");
+        return -1;
+    }
+    return ae->GetTileCache()->Open(directory, budget) ? 0 : -1;
+}
+
+int soundscape_engine_load_cached_tile(soundscape_engine *engine, int32_t x, int32_t y, int32_t zoom)
+{
+    auto ae = ToEngine(engine);
+    if(ae == nullptr) {
+        TRACE_ERROR("LoadCachedTile failed - no AudioEngine");
+        return -1;
+    }
+
+    TileId id{x, y, zoom};
+    auto features = std::make_shared<FeatureCollection>();
+    if(!ae->GetTileCache()->Get(id, *features))
+        return -1;
+    AddTile(ae, id, std::move(features));
+    return 0;
+}
+
+int soundscape_engine_get_tile_cache_stats(soundscape_engine *engine, soundscape_tile_cache_stats *stats)
+{
+    auto ae = ToEngine(engine);
+    if((ae == nullptr) || (stats == nullptr)) {
+        TRACE_ERROR("GetTileCacheStats failed - no AudioEngine or stats");
+        return -1;
+    }
+
+    TileCacheStats cache_stats;
+    ae->GetTileCache()->GetStats(cache_stats);
+    stats->hits = cache_stats.hits;
+    stats->misses = cache_stats.misses;
+    stats->evictions = cache_stats.evictions;
+    stats->compactions = cache_stats.compactions;
+    stats->corrupt = cache_stats.corrupt;
+    stats->tiles = cache_stats.tiles;
+    stats->live_bytes = cache_stats.live_bytes;
+    stats->dead_bytes = cache_stats.dead_bytes;
+    stats->budget = cache_stats.budget;
+    return 0;
+}
+
+int soundscape_engine_start_tile_working_set(soundscape_engine *engine, double radius)
+{
+    auto ae = ToEngine(engine);
+    if((ae == nullptr) || !(radius >= 0.0)) {
+        TRACE_ERROR("StartTileWorkingSet failed - no AudioEngine or bad radius");
+        return -1;
+    }
+    ae->GetTileWorkingSet()->Start(radius);
+    return 0;
+}
+
+int64_t soundscape_engine_get_missing_tiles(soundscape_engine *engine, soundscape_tile_id *tiles, size_t count)
+{
+    auto ae = ToEngine(engine);
+    if((ae == nullptr) || ((tiles == nullptr) && (count != 0))) {
+        TRACE_ERROR("GetMissingTiles failed - no AudioEngine or tiles");
+        return -1;
+    }
+
+    std::vector<TileId> missing;
+    ae->GetTileWorkingSet()->GetMissingTiles(missing);
+    auto copied = std::min(missing.size(), count);
+    for(size_t index = 0; index < copied; ++index)
+        tiles[index] = {missing[index].x, missing[index].y, missing[index].zoom};
+    return static_cast<int64_t>(copied);
+}
+
+int soundscape_engine_get_tile_working_set_stats(soundscape_engine *engine,
+                                                 soundscape_tile_working_set_stats *stats)
+{
+    auto ae = ToEngine(engine);
+    if((ae == nullptr) || (stats == nullptr)) {
+        TRACE_ERROR("GetTileWorkingSetStats failed - no AudioEngine or stats");
+        return -1;
+    }
+
+    TileWorkingSetStats working_set_stats;
+    ae->GetTileWorkingSet()->GetStats(working_set_stats);
+    stats->hits = working_set_stats.hits;
+    stats->misses = working_set_stats.misses;
+    stats->fetches = working_set_stats.fetches;
+    stats->failures = working_set_stats.failures;
+    stats->prefetches = working_set_stats.prefetches;
+    stats->evictions = working_set_stats.evictions;
+    stats->crossings = working_set_stats.crossings;
+    stats->stalls = working_set_stats.stalls;
+    stats->tiles = working_set_stats.tiles;
+    stats->missing = working_set_stats.missing;
+    return 0;
+}
+
+// Copy up to count of the features found into the results
+static int64_t CopyTileFeatures(const std::vector<TileFeature> &found,
+                                soundscape_nearest_feature *nearest, size_t count)
+{
+    auto copied = std::min(found.size(), count);
+    for(size_t index = 0; index < copied; ++index) {
+        const auto &feature = found[index];
+        const auto &collection = feature.index->GetFeatures();
+        const auto &details = collection.features[feature.feature];
+        nearest[index] = {feature.tile.x, feature.tile.y, feature.tile.zoom, feature.feature,
+                          details.osm_id_count ? collection.osm_ids[details.first_osm_id] : 0,
+                          feature.distance};
+    }
+    return static_cast<int64_t>(copied);
+}
+
+int64_t soundscape_engine_find_nearest(soundscape_engine *engine,
+                                       double latitude, double longitude,
+                                       uint32_t categories, double max_distance,
+                                       soundscape_nearest_feature *nearest, size_t count)
+{
+    auto ae = ToEngine(engine);
+    if((ae == nullptr) || ((nearest == nullptr) && (count != 0))) {
+        TRACE_ERROR("FindNearest failed - no AudioEngine or results");
+        return -1;
+    }
+
+    std::vector<TileFeature> found;
+    ae->GetFeatureStore()->FindNearest(latitude, longitude, count, categories, found, max_distance);
+    return CopyTileFeatures(found, nearest, count);
+}
+
+int64_t soundscape_engine_find_in_field_of_view(soundscape_engine *engine,
+                                                double latitude, double longitude,
+                                                double heading, double width, double range,
+                                                uint32_t categories,
+                                                soundscape_nearest_feature *features, size_t count)
+{
+    auto ae = ToEngine(engine);
+    if((ae == nullptr) || ((features == nullptr) && (count != 0))) {
+        TRACE_ERROR("FindInFieldOfView failed - no AudioEngine or results");
+        return -1;
+    }
+
+    std::vector<TileFeature> found;
+    ae->GetFeatureStore()->FindInFieldOfView(latitude, longitude, heading, width, range,
+                                             categories, found);
+    return CopyTileFeatures(found, features, count);
+}
+
+// How many of the nearest intersections soundscape_engine_get_nearest_intersection asks for at a
+// time, looking for one which is in the road graph
+static const size_t INTERSECTION_CANDIDATES = 4;
+
+int64_t soundscape_engine_get_nearest_intersection(soundscape_engine *engine,
+                                                   double latitude, double longitude,
+                                                   double max_distance,
+                                                   soundscape_nearest_feature *intersection,
+                                                   soundscape_intersection_road *roads, size_t count)
+{
+    auto ae = ToEngine(engine);
+    if((ae == nullptr) || (intersection == nullptr) || ((roads == nullptr) && (count != 0))) {
+        TRACE_ERROR("GetNearestIntersection failed - no AudioEngine or results");
+        return -1;
+    }
+
+    // The nearest intersection that the road graph has a node for, passing over any which it
+    // doesn't, such as those which aren't points. Nearly all of them have one, so only a few are
+    // asked for at first, and more only if none of those do.
+    auto store = ae->GetFeatureStore();
+    std::vector<TileFeature> found;
+    std::vector<IntersectionRoad> found_roads;
+    size_t checked = 0;
+    for(auto wanted = INTERSECTION_CANDIDATES; ; wanted *= 2) {
+        store->FindNearest(latitude, longitude, wanted,
+                           FeatureCategoryMask(FeatureCategory::Intersection), found, max_distance);
+        for(auto index = checked; index < found.size(); ++index) {
+            if(!store->GetIntersectionRoads(found[index].tile, found[index].feature, found_roads))
+                continue;
+            CopyTileFeatures({found[index]}, intersection, 1);
+            auto copied = std::min(found_roads.size(), count);
+            for(size_t road = 0; road < copied; ++road) {
+                const auto &from = found_roads[road];
+                roads[road] = {from.osm_id, from.bearing, from.length, from.end_latitude,
+                               from.end_longitude, static_cast<int32_t>(from.end_type),
+                               from.end_tile.x, from.end_tile.y, from.end_tile.zoom, from.end_feature};
+            }
+            return static_cast<int64_t>(copied);
+        }
+        if(found.size() < wanted)
+            break;
+        checked = found.size();
+    }
+
+    *intersection = {};
+    intersection->distance = std::numeric_limits<double>::infinity();
+    return 0;
+}
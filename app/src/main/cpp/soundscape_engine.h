@@ -0,0 +1,322 @@
+#pragma once
+
+//
+// Plain C API for the Soundscape audio engine. This is the only interface that the JNI layer uses,
+// and it can be driven just as well from a host program such as a test or benchmark with no JVM.
+//
+// Audio handles are returned by the create functions and from the create commands in a command
+// list (see AudioCommands.h). A handle is only valid until it's destroyed, or until a
+// SOUNDSCAPE_EVENT_SOURCE_FINISHED event has been delivered for it. Handles are never reused, so
+// one that's no longer valid is just rejected, and events for it can't be mistaken for another's.
+//
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct soundscape_engine soundscape_engine;
+typedef int64_t soundscape_handle;
+
+// The event types match soundscape::EventType
+enum {
+    SOUNDSCAPE_EVENT_SOURCE_FINISHED = 1,
+    SOUNDSCAPE_EVENT_QUEUE_ADVANCED = 2,
+    SOUNDSCAPE_EVENT_UNDERRUN = 3,
+    SOUNDSCAPE_EVENT_ASSET_LOADED = 4,
+    SOUNDSCAPE_EVENT_TILES_MISSING = 5,
+};
+
+typedef struct soundscape_event {
+    int64_t type;
+    soundscape_handle handle;
+    int64_t value;
+} soundscape_event;
+
+// The source types match soundscape::AudioSourceType
+enum {
+    SOUNDSCAPE_SOURCE_BEACON = 0,
+    SOUNDSCAPE_SOURCE_TEXT_TO_SPEECH = 1,
+    SOUNDSCAPE_SOURCE_TYPES = 2,
+};
+
+// The motion paths match soundscape::MotionPath
+enum {
+    SOUNDSCAPE_MOTION_LAYER_SWITCH = 0,
+    SOUNDSCAPE_MOTION_LISTENER = 1,
+    SOUNDSCAPE_MOTION_PATHS = 2,
+};
+
+// Stream callback durations are in nanoseconds, and the percentiles are accurate to about 6%
+typedef struct soundscape_callback_stats {
+    uint64_t callbacks;
+    // Callbacks which filled some of their buffer with silence because the audio wasn't ready
+    uint64_t padded_callbacks;
+    uint64_t p50_ns;
+    uint64_t p90_ns;
+    uint64_t p99_ns;
+    uint64_t p999_ns;
+    uint64_t max_ns;
+} soundscape_callback_stats;
+
+// Time in nanoseconds from a pose being captured to the audio which reflects it being heard
+typedef struct soundscape_latency_stats {
+    uint64_t count;
+    uint64_t p50_ns;
+    uint64_t p95_ns;
+    uint64_t p99_ns;
+    uint64_t max_ns;
+} soundscape_latency_stats;
+
+typedef struct soundscape_stats {
+    soundscape_callback_stats callbacks[SOUNDSCAPE_SOURCE_TYPES];
+    soundscape_latency_stats motion[SOUNDSCAPE_MOTION_PATHS];
+    // Percentages of real time spent mixing and in the stream callbacks, as last sampled and the
+    // peak since the stats were last reset
+    float dsp_cpu;
+    float stream_cpu;
+    float peak_dsp_cpu;
+    float peak_stream_cpu;
+} soundscape_stats;
+
+// Sizes are in bytes, see soundscape::MemoryStats
+typedef struct soundscape_memory_stats {
+    // The engine's budget, the bytes charged to it now and at most, and the allocations refused
+    // because they would have gone over it. Beacon assets which are refused play as silence.
+    uint64_t budget;
+    uint64_t used;
+    uint64_t high_water;
+    uint64_t refused;
+    // The arena which the audio sources are allocated from, and the allocations which didn't
+    // fit in it and went to the heap
+    uint64_t arena_size;
+    uint64_t arena_used;
+    uint64_t arena_high_water;
+    uint64_t overflows;
+    // The audio backend's fixed pool, which is zero if it allocates from the heap
+    uint64_t backend_pool;
+    uint64_t backend_used;
+    uint64_t backend_high_water;
+} soundscape_memory_stats;
+
+// A map tile of GeoJSON as returned by the tile server
+typedef struct soundscape_tile {
+    int32_t x;
+    int32_t y;
+    int32_t zoom;
+    const char *json;
+    size_t length;
+} soundscape_tile;
+
+// Sizes are in bytes, see soundscape::TileCacheStats
+typedef struct soundscape_tile_cache_stats {
+    uint64_t hits;
+    uint64_t misses;
+    uint64_t evictions;
+    uint64_t compactions;
+    uint64_t corrupt;
+    uint64_t tiles;
+    uint64_t live_bytes;
+    uint64_t dead_bytes;
+    uint64_t budget;
+} soundscape_tile_cache_stats;
+
+typedef struct soundscape_tile_id {
+    int32_t x;
+    int32_t y;
+    int32_t zoom;
+} soundscape_tile_id;
+
+// See soundscape::TileWorkingSetStats
+typedef struct soundscape_tile_working_set_stats {
+    uint64_t hits;
+    uint64_t misses;
+    uint64_t fetches;
+    uint64_t failures;
+    uint64_t prefetches;
+    uint64_t evictions;
+    uint64_t crossings;
+    uint64_t stalls;
+    uint64_t tiles;
+    uint64_t missing;
+} soundscape_tile_working_set_stats;
+
+// The feature categories match soundscape::FeatureCategory. A set of categories has the bit
+// 1 << category set for each of them.
+enum {
+    SOUNDSCAPE_CATEGORY_POI = 0,
+    SOUNDSCAPE_CATEGORY_ROAD = 1,
+    SOUNDSCAPE_CATEGORY_PATH = 2,
+    SOUNDSCAPE_CATEGORY_INTERSECTION = 3,
+    SOUNDSCAPE_CATEGORY_ENTRANCE = 4,
+    SOUNDSCAPE_CATEGORY_BUS_STOP = 5,
+    SOUNDSCAPE_CATEGORY_CROSSING = 6,
+    SOUNDSCAPE_CATEGORIES = 7,
+};
+
+// A feature of a loaded tile, found by soundscape_engine_find_nearest or
+// soundscape_engine_find_in_field_of_view. The feature is its index in the tile, and osm_id is
+// its first OSM id, or 0 if it doesn't have one.
+typedef struct soundscape_nearest_feature {
+    int32_t x;
+    int32_t y;
+    int32_t zoom;
+    uint32_t feature;
+    int64_t osm_id;
+    double distance;
+} soundscape_nearest_feature;
+
+// The kinds of node at the end of a road, which match soundscape::RoadNodeType. A border node is
+// where the road runs off the edge of the loaded tiles.
+enum {
+    SOUNDSCAPE_ROAD_NODE_INTERSECTION = 0,
+    SOUNDSCAPE_ROAD_NODE_END = 1,
+    SOUNDSCAPE_ROAD_NODE_BORDER = 2,
+};
+
+// A road leaving an intersection, found by soundscape_engine_get_nearest_intersection. The
+// bearing is in degrees clockwise from north, and the length is in metres along the road to the
+// node at its other end. That's in tile end_x, end_y, end_zoom, and end_feature is its
+// intersection feature if it's an intersection.
+typedef struct soundscape_intersection_road {
+    int64_t osm_id;
+    double bearing;
+    double length;
+    double end_latitude;
+    double end_longitude;
+    int32_t end_type;
+    int32_t end_x;
+    int32_t end_y;
+    int32_t end_zoom;
+    uint32_t end_feature;
+} soundscape_intersection_road;
+
+// Called from the engine control thread when there are new events to drain
+typedef void (*soundscape_event_callback)(void *context);
+
+soundscape_engine *soundscape_engine_create(void);
+void soundscape_engine_destroy(soundscape_engine *engine);
+
+void soundscape_engine_update_geometry(soundscape_engine *engine,
+                                       double latitude, double longitude, double heading);
+void soundscape_engine_set_beacon_type(soundscape_engine *engine, int beacon_type);
+
+// The create functions return 0 on failure
+soundscape_handle soundscape_engine_create_beacon(soundscape_engine *engine,
+                                                  double latitude, double longitude);
+soundscape_handle soundscape_engine_create_text_to_speech(soundscape_engine *engine,
+                                                          double latitude, double longitude,
+                                                          int tts_socket);
+// Returns 0 on success, or -1 if the handle isn't a live audio handle
+int soundscape_engine_destroy_audio(soundscape_engine *engine, soundscape_handle handle);
+
+// Returns the number of commands applied, or -1 if the list was rejected and nothing was applied
+int soundscape_engine_submit_commands(soundscape_engine *engine, uint8_t *commands, size_t length);
+
+// The memory must stay valid until the engine is destroyed. Returns 0 on success.
+int soundscape_engine_register_pose_mailbox(soundscape_engine *engine, void *memory, size_t length);
+
+// The callback must be set before the pose mailbox is registered
+void soundscape_engine_set_event_callback(soundscape_engine *engine,
+                                          soundscape_event_callback callback, void *context);
+void *soundscape_engine_get_event_callback_context(soundscape_engine *engine);
+
+// Returns the number of events written into events
+size_t soundscape_engine_drain_events(soundscape_engine *engine,
+                                      soundscape_event *events, size_t max_events);
+
+// Fill in the stats, which cover the time since they were last reset. If reset is non-zero they
+// are reset afterwards. Returns 0 on success.
+int soundscape_engine_get_stats(soundscape_engine *engine, soundscape_stats *stats, int reset);
+
+// Set the most memory in bytes that the engine may allocate for its audio sources and their
+// assets. Returns 0 on success.
+int soundscape_engine_set_memory_budget(soundscape_engine *engine, size_t budget);
+
+// Fill in the engine's current memory use. Returns 0 on success.
+int soundscape_engine_get_memory_stats(soundscape_engine *engine, soundscape_memory_stats *stats);
+
+// Parse the tiles, clip their features to the tile bounds and add them to the engine's feature
+// store, replacing any which are already loaded. The tiles are processed in parallel. While the
+// tile working set is running, zoom 16 tiles are only added to the store if it wants them, and
+// otherwise are left in the tile cache until it does. Returns the number of tiles loaded, which
+// is fewer than count if any weren't valid, or -1 on failure.
+int soundscape_engine_load_tiles(soundscape_engine *engine, const soundscape_tile *tiles, size_t count);
+
+// Returns the number of features in a loaded tile, or -1 if it isn't loaded
+int64_t soundscape_engine_get_tile_feature_count(soundscape_engine *engine,
+                                                 int32_t x, int32_t y, int32_t zoom);
+
+// Write a loaded tile to a binary tile file, see TileFile.h. Returns 0 on success, or -1 if the
+// tile isn't loaded or the file couldn't be written.
+int soundscape_engine_save_tile_file(soundscape_engine *engine,
+                                     int32_t x, int32_t y, int32_t zoom, const char *path);
+
+// Map a binary tile file written by soundscape_engine_save_tile_file and add its features to the
+// feature store, replacing the tile if it's already loaded, unless the tile working set doesn't
+// want it, as for soundscape_engine_load_tiles. Returns 0 on success, or -1 if the
+// file doesn't exist or isn't a valid tile file.
+int soundscape_engine_load_tile_file(soundscape_engine *engine, const char *path);
+
+// Open the on-disk tile cache in the directory, creating it if need be. Once it's open, tiles
+// loaded by soundscape_engine_load_tiles are written to it, and the tiles which are furthest from
+// the listener and least recently used are evicted to keep it within the budget in bytes. Returns
+// 0 on success.
+int soundscape_engine_open_tile_cache(soundscape_engine *engine, const char *directory, uint64_t budget);
+
+// Load a tile from the tile cache into the feature store, unless the tile working set doesn't
+// want it, as for soundscape_engine_load_tiles. Returns 0 on success, or -1 if the tile isn't in
+// the cache.
+int soundscape_engine_load_cached_tile(soundscape_engine *engine, int32_t x, int32_t y, int32_t zoom);
+
+// Fill in the tile cache stats. Returns 0 on success.
+int soundscape_engine_get_tile_cache_stats(soundscape_engine *engine, soundscape_tile_cache_stats *stats);
+
+// Keep the zoom 16 tiles within radius metres of the listener loaded from the tile cache as they
+// move, and those ahead of them, unloading the tiles they've left behind. A radius of 0 stops it.
+// Tiles that aren't in the cache are posted as a SOUNDSCAPE_EVENT_TILES_MISSING event for the
+// client to fetch and load with soundscape_engine_load_tiles. Returns 0 on success.
+int soundscape_engine_start_tile_working_set(soundscape_engine *engine, double radius);
+
+// Find up to count of the tiles wanted around the listener which couldn't be loaded from the
+// tile cache, nearest first. Returns the number found, or -1 on failure.
+int64_t soundscape_engine_get_missing_tiles(soundscape_engine *engine, soundscape_tile_id *tiles, size_t count);
+
+// Fill in the tile working set stats. Returns 0 on success.
+int soundscape_engine_get_tile_working_set_stats(soundscape_engine *engine,
+                                                 soundscape_tile_working_set_stats *stats);
+
+// Find up to count features in the set of categories within max_distance metres of the location,
+// in all of the loaded tiles, nearest first. Returns the number found, or -1 on failure.
+int64_t soundscape_engine_find_nearest(soundscape_engine *engine,
+                                       double latitude, double longitude,
+                                       uint32_t categories, double max_distance,
+                                       soundscape_nearest_feature *nearest, size_t count);
+
+// Find up to count features in the set of categories in the listener's field of view, in all of
+// the loaded tiles, nearest first. The field of view is a wedge width degrees wide centred on the
+// heading, which is in degrees clockwise from north, out to range metres. The distance of each
+// feature is to the nearest part of it which is in view. Returns the number found, or -1 on
+// failure.
+int64_t soundscape_engine_find_in_field_of_view(soundscape_engine *engine,
+                                                double latitude, double longitude,
+                                                double heading, double width, double range,
+                                                uint32_t categories,
+                                                soundscape_nearest_feature *features, size_t count);
+
+// Find the nearest intersection within max_distance metres of the location, and up to count of
+// the roads leaving it in order of their bearings, from the road graphs built when the tiles were
+// loaded. Returns the number of roads, or -1 on failure. If there's no intersection in range it
+// returns 0 and sets the intersection's distance to infinity, which tells it apart from one with
+// no roads, or from count being 0.
+int64_t soundscape_engine_get_nearest_intersection(soundscape_engine *engine,
+                                                   double latitude, double longitude,
+                                                   double max_distance,
+                                                   soundscape_nearest_feature *intersection,
+                                                   soundscape_intersection_road *roads, size_t count);
+
+#ifdef __cplusplus
+}
+#endif
@@ -26,7 +26,6 @@ import com.google.android.gms.common.GoogleApiAvailability
 import com.scottishtecharmy.soundscape.geojsonparser.geojson.LngLatAlt
 import com.scottishtecharmy.soundscape.gpx.GpxActivity
 import com.scottishtecharmy.soundscape.services.LocationService
-import kotlinx.coroutines.delay
 import kotlinx.coroutines.flow.collectLatest
 import kotlinx.coroutines.launch
 
@@ -270,20 +269,6 @@ class MainActivity : ComponentActivity() {
             }
         }
 
-        lifecycleScope.launch {
-            delay(10000)
-            val test = locationService?.getTileString()
-
-            println(test)
-        }
-
-        lifecycleScope.launch {
-            delay(10000)
-            val test = locationService?.getTileStringCaching(application)
-
-            println(test)
-        }
-
         if(intentLocation.latitude != 0.0 && intentLocation.longitude != 0.0) {
             locationService?.createBeacon(intentLocation.latitude, intentLocation.longitude)
         }
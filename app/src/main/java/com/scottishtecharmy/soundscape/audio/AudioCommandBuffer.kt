@@ -0,0 +1,101 @@
+package com.scottishtecharmy.soundscape.audio
+
+import java.nio.ByteBuffer
+import java.nio.ByteOrder
+
+/**
+ * Builds up a binary list of audio commands so that they can be submitted to the native
+ * AudioEngine in a single JNI call and applied atomically. The record layouts must match the
+ * command structures in AudioCommands.h.
+ *
+ * The buffer grows as commands are added, so a batch of any length can be built up. The handle
+ * indices returned by the create functions are offsets into it, and so stay valid when it grows.
+ */
+class AudioCommandBuffer(capacity: Int = DEFAULT_CAPACITY) {
+    var buffer: ByteBuffer = ByteBuffer.allocateDirect(capacity).order(ByteOrder.nativeOrder())
+        private set
+    val length: Int
+        get() = buffer.position()
+
+    /**
+     * Returns an index which can be passed to getHandle once the commands have been submitted to
+     * get the handle of the new beacon.
+     */
+    fun createBeacon(latitude: Double, longitude: Double) : Int {
+        putHeader(OPCODE_CREATE_BEACON, CREATE_BEACON_SIZE)
+        buffer.putDouble(latitude)
+        buffer.putDouble(longitude)
+        val handleIndex = buffer.position()
+        buffer.putLong(0)
+        return handleIndex
+    }
+
+    fun createTextToSpeech(latitude: Double, longitude: Double, ttsSocket: Int) : Int {
+        putHeader(OPCODE_CREATE_TEXT_TO_SPEECH, CREATE_TEXT_TO_SPEECH_SIZE)
+        buffer.putDouble(latitude)
+        buffer.putDouble(longitude)
+        buffer.putInt(ttsSocket)
+        buffer.putInt(0)
+        val handleIndex = buffer.position()
+        buffer.putLong(0)
+        return handleIndex
+    }
+
+    fun destroy(handle: Long) {
+        putHeader(OPCODE_DESTROY, DESTROY_SIZE)
+        buffer.putLong(handle)
+    }
+
+    fun move(handle: Long, latitude: Double, longitude: Double) {
+        putHeader(OPCODE_MOVE, MOVE_SIZE)
+        buffer.putLong(handle)
+        buffer.putDouble(latitude)
+        buffer.putDouble(longitude)
+    }
+
+    fun pose(latitude: Double, longitude: Double, heading: Double) {
+        putHeader(OPCODE_POSE, POSE_SIZE)
+        buffer.putDouble(latitude)
+        buffer.putDouble(longitude)
+        buffer.putDouble(heading)
+    }
+
+    fun getHandle(index: Int) : Long {
+        return buffer.getLong(index)
+    }
+
+    fun clear() {
+        buffer.clear()
+    }
+
+    private fun putHeader(opcode: Int, size: Int) {
+        if(buffer.remaining() < size) {
+            // Copy what's been added so far into a buffer with room for at least this command
+            var capacity = maxOf(buffer.capacity(), size) * 2
+            while(capacity - buffer.position() < size)
+                capacity *= 2
+            val grown = ByteBuffer.allocateDirect(capacity).order(ByteOrder.nativeOrder())
+            buffer.flip()
+            grown.put(buffer)
+            buffer = grown
+        }
+        buffer.putInt(opcode)
+        buffer.putInt(size)
+    }
+
+    companion object {
+        private const val DEFAULT_CAPACITY = 4096
+
+        private const val OPCODE_CREATE_BEACON = 1
+        private const val OPCODE_CREATE_TEXT_TO_SPEECH = 2
+        private const val OPCODE_DESTROY = 3
+        private const val OPCODE_MOVE = 4
+        private const val OPCODE_POSE = 5
+
+        private const val CREATE_BEACON_SIZE = 32
+        private const val CREATE_TEXT_TO_SPEECH_SIZE = 40
+        private const val DESTROY_SIZE = 16
+        private const val MOVE_SIZE = 32
+        private const val POSE_SIZE = 32
+    }
+}
@@ -0,0 +1,154 @@
+package com.scottishtecharmy.soundscape.audio
+
+/**
+ * Timings of the native stream callbacks for one type of audio source. The durations are in
+ * nanoseconds and are accurate to about 6%.
+ */
+data class AudioCallbackStats(
+    val callbacks: Long,
+    // Callbacks which had to fill some of their buffer with silence because the audio wasn't ready
+    val paddedCallbacks: Long,
+    val p50Nanoseconds: Long,
+    val p90Nanoseconds: Long,
+    val p99Nanoseconds: Long,
+    val p999Nanoseconds: Long,
+    val maxNanoseconds: Long
+)
+
+/**
+ * Time in nanoseconds from the listener's pose being captured to the audio which reflects it
+ * being heard.
+ */
+data class MotionLatencyStats(
+    val count: Long,
+    val p50Nanoseconds: Long,
+    val p95Nanoseconds: Long,
+    val p99Nanoseconds: Long,
+    val maxNanoseconds: Long
+)
+
+/**
+ * How well the native audio engine is keeping the mixer fed, see soundscape_stats in
+ * soundscape_engine.h. The motion latencies are for a beacon switching to the layer for a new
+ * heading, and for the listener position and orientation. The CPU usage is a percentage of real
+ * time.
+ */
+data class AudioEngineStats(
+    val beacon: AudioCallbackStats,
+    val textToSpeech: AudioCallbackStats,
+    val layerSwitchLatency: MotionLatencyStats,
+    val listenerLatency: MotionLatencyStats,
+    val dspCpu: Float,
+    val streamCpu: Float,
+    val peakDspCpu: Float,
+    val peakStreamCpu: Float
+) {
+    companion object {
+        // The layout of the array filled in by NativeAudioEngine.getStats
+        private const val CALLBACK_STATS_LENGTH = 7
+        private const val MOTION_STATS_LENGTH = 5
+        const val LENGTH = (CALLBACK_STATS_LENGTH * 2) + (MOTION_STATS_LENGTH * 2) + 4
+
+        private fun callbackStats(values: DoubleArray, offset: Int) = AudioCallbackStats(
+            values[offset].toLong(),
+            values[offset + 1].toLong(),
+            values[offset + 2].toLong(),
+            values[offset + 3].toLong(),
+            values[offset + 4].toLong(),
+            values[offset + 5].toLong(),
+            values[offset + 6].toLong())
+
+        private fun motionStats(values: DoubleArray, offset: Int) = MotionLatencyStats(
+            values[offset].toLong(),
+            values[offset + 1].toLong(),
+            values[offset + 2].toLong(),
+            values[offset + 3].toLong(),
+            values[offset + 4].toLong())
+
+        fun fromArray(values: DoubleArray): AudioEngineStats {
+            val motion = CALLBACK_STATS_LENGTH * 2
+            val cpu = motion + (MOTION_STATS_LENGTH * 2)
+            return AudioEngineStats(
+                callbackStats(values, 0),
+                callbackStats(values, CALLBACK_STATS_LENGTH),
+                motionStats(values, motion),
+                motionStats(values, motion + MOTION_STATS_LENGTH),
+                values[cpu].toFloat(),
+                values[cpu + 1].toFloat(),
+                values[cpu + 2].toFloat(),
+                values[cpu + 3].toFloat())
+        }
+    }
+}
+
+/**
+ * The native audio engine's memory use in bytes, see soundscape_memory_stats in
+ * soundscape_engine.h. Beacon assets which would go over the budget play as silence. The backend
+ * pool is FMOD's, which it allocates from rather than the heap.
+ */
+data class AudioMemoryStats(
+    val budget: Long,
+    val used: Long,
+    val highWater: Long,
+    val refused: Long,
+    val arenaSize: Long,
+    val arenaUsed: Long,
+    val arenaHighWater: Long,
+    val overflows: Long,
+    val backendPool: Long,
+    val backendUsed: Long,
+    val backendHighWater: Long
+) {
+    companion object {
+        // The length of the array filled in by NativeAudioEngine.getMemoryStats
+        const val LENGTH = 11
+
+        fun fromArray(values: LongArray) = AudioMemoryStats(
+            values[0],
+            values[1],
+            values[2],
+            values[3],
+            values[4],
+            values[5],
+            values[6],
+            values[7],
+            values[8],
+            values[9],
+            values[10])
+    }
+}
+
+/**
+ * How well the native tile working set is keeping up with the listener, see
+ * soundscape_tile_working_set_stats in soundscape_engine.h. A stall is when the listener moved
+ * into a tile before it was loaded.
+ */
+data class TileWorkingSetStats(
+    val hits: Long,
+    val misses: Long,
+    val fetches: Long,
+    val failures: Long,
+    val prefetches: Long,
+    val evictions: Long,
+    val crossings: Long,
+    val stalls: Long,
+    val tiles: Long,
+    val missing: Long
+) {
+    companion object {
+        // The length of the array filled in by NativeAudioEngine.getTileWorkingSetStats
+        const val LENGTH = 10
+
+        fun fromArray(values: LongArray) = TileWorkingSetStats(
+            values[0],
+            values[1],
+            values[2],
+            values[3],
+            values[4],
+            values[5],
+            values[6],
+            values[7],
+            values[8],
+            values[9])
+    }
+}
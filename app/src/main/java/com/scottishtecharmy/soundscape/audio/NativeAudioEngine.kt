@@ -7,14 +7,22 @@ import android.os.ParcelFileDescriptor
 import android.speech.tts.TextToSpeech
 import android.speech.tts.UtteranceProgressListener
 import android.util.Log
+import java.io.File
+import java.nio.ByteBuffer
 import java.util.Locale
+import java.util.concurrent.Executors
 
 
 class NativeAudioEngine : AudioEngine, TextToSpeech.OnInitListener {
     private var engineHandle : Long = 0
     private val engineMutex = Object()
     private var ttsSockets = HashMap<String, Array<ParcelFileDescriptor>>()
+    // Native handles are never reused, so a late SOURCE_FINISHED event can't match new speech
+    private var ttsHandles = HashMap<Long, String>()
     private var currentUtteranceId: String? = null
+    private val poseMailbox = PoseMailbox()
+    private val eventExecutor = Executors.newSingleThreadExecutor()
+    private val eventBuffer = LongArray(MAX_EVENTS_PER_DRAIN * 3)
 
     private lateinit var textToSpeech : TextToSpeech
     private lateinit var ttsSocket : ParcelFileDescriptor
@@ -22,10 +30,34 @@ class NativeAudioEngine : AudioEngine, TextToSpeech.OnInitListener {
     private external fun create() : Long
     private external fun destroy(engineHandle: Long)
     private external fun createNativeBeacon(engineHandle: Long, latitude: Double, longitude: Double) :  Long
-    private external fun destroyNativeBeacon(beaconHandle: Long)
+    private external fun destroyNativeBeacon(engineHandle: Long, beaconHandle: Long)
     private external fun createNativeTextToSpeech(engineHandle: Long, latitude: Double, longitude: Double, ttsSocket: Int) :  Long
     private external fun updateGeometry(engineHandle: Long, latitude: Double, longitude: Double, heading: Double)
     private external fun setBeaconType(engineHandle: Long, beaconType: Int)
+    private external fun submitCommands(engineHandle: Long, commands: ByteBuffer, length: Int) : Int
+    private external fun registerPoseMailbox(engineHandle: Long, mailbox: ByteBuffer)
+    private external fun drainEvents(engineHandle: Long, events: LongArray) : Int
+    private external fun getStats(engineHandle: Long, stats: DoubleArray, reset: Boolean) : Boolean
+    private external fun getMemoryStats(engineHandle: Long, stats: LongArray) : Boolean
+    private external fun loadTiles(engineHandle: Long, tileIds: IntArray, tiles: Array<ByteArray>) : Int
+    private external fun getTileFeatureCount(engineHandle: Long, x: Int, y: Int, zoom: Int) : Long
+    private external fun saveTileFile(engineHandle: Long, x: Int, y: Int, zoom: Int, path: String) : Boolean
+    private external fun loadTileFile(engineHandle: Long, path: String) : Boolean
+    private external fun openTileCache(engineHandle: Long, directory: String, budget: Long) : Boolean
+    private external fun loadCachedTile(engineHandle: Long, x: Int, y: Int, zoom: Int) : Boolean
+    private external fun startTileWorkingSet(engineHandle: Long, radius: Double) : Boolean
+    private external fun getMissingTiles(engineHandle: Long, tileIds: IntArray) : Int
+    private external fun getTileWorkingSetStats(engineHandle: Long, stats: LongArray) : Boolean
+    private external fun findNearest(engineHandle: Long, latitude: Double, longitude: Double,
+                                     categories: Int, maxDistance: Double,
+                                     osmIds: LongArray, distances: DoubleArray) : Int
+    private external fun findInFieldOfView(engineHandle: Long, latitude: Double, longitude: Double,
+                                           heading: Double, width: Double, range: Double,
+                                           categories: Int,
+                                           osmIds: LongArray, distances: DoubleArray) : Int
+    private external fun getNearestIntersection(engineHandle: Long, latitude: Double, longitude: Double,
+                                                maxDistance: Double,
+                                                osmIds: LongArray, values: DoubleArray) : Int
 
     fun destroy()
     {
@@ -42,6 +74,8 @@ class NativeAudioEngine : AudioEngine, TextToSpeech.OnInitListener {
                 ttsSocketPair.value[0].close()
                 ttsSocketPair.value[1].close()
             }
+            ttsSockets.clear()
+            ttsHandles.clear()
 
             textToSpeech.shutdown()
         }
@@ -53,6 +87,11 @@ class NativeAudioEngine : AudioEngine, TextToSpeech.OnInitListener {
                 return
             }
             engineHandle = this.create()
+            registerPoseMailbox(engineHandle, poseMailbox.buffer)
+            // Tiles loaded from the tile server are cached on disk from here on
+            if(!openTileCache(engineHandle, File(context.cacheDir, "tiles").path, TILE_CACHE_BUDGET)) {
+                Log.e(TAG, "Failed to open the tile cache")
+            }
             textToSpeech = TextToSpeech(context, this)
         }
     }
@@ -88,10 +127,14 @@ class NativeAudioEngine : AudioEngine, TextToSpeech.OnInitListener {
                 override fun onStart(utteranceId: String) {
                     Log.e("TTS", "OnStart $utteranceId")
                     if(currentUtteranceId != null){
-                        Log.e("TTS", "Closing socket pair $currentUtteranceId")
-                        ttsSockets[currentUtteranceId]!![0].closeWithError("Finished")
-                        ttsSockets[currentUtteranceId]!![1].close()
-                        ttsSockets.remove(currentUtteranceId)
+                        // The sockets may already have been released if the native audio finished
+                        synchronized(engineMutex) {
+                            ttsSockets.remove(currentUtteranceId)?.let { ttsSocketPair ->
+                                Log.e("TTS", "Closing socket pair $currentUtteranceId")
+                                ttsSocketPair[0].closeWithError("Finished")
+                                ttsSocketPair[1].close()
+                            }
+                        }
                     }
                     currentUtteranceId = utteranceId
                 }
@@ -119,9 +162,9 @@ class NativeAudioEngine : AudioEngine, TextToSpeech.OnInitListener {
     override fun destroyBeacon(beaconHandle: Long)
     {
         synchronized(engineMutex) {
-            if(beaconHandle != 0L) {
+            if((engineHandle != 0L) && (beaconHandle != 0L)) {
                 Log.d(TAG, "Call destroyNativeBeacon")
-                destroyNativeBeacon(beaconHandle)
+                destroyNativeBeacon(engineHandle, beaconHandle)
             }
         }
     }
@@ -142,25 +185,383 @@ class NativeAudioEngine : AudioEngine, TextToSpeech.OnInitListener {
                 ttsSockets[ttsSocket.toString()] = ttsSocketPair
 
                 Log.d(TAG, "Call createNativeTextToSpeech")
-                return createNativeTextToSpeech(engineHandle, latitude, longitude, ttsSocketPair[1].fd)
+                val handle = createNativeTextToSpeech(engineHandle, latitude, longitude, ttsSocketPair[1].fd)
+                if(handle != 0L) {
+                    ttsHandles[handle] = ttsSocket.toString()
+                }
+                return handle
             }
 
             return 0
         }
     }
     override fun updateGeometry(listenerLatitude: Double, listenerLongitude: Double, listenerHeading: Double)
+    {
+        // The native control thread picks up the latest pose from the mailbox, so there's no
+        // need to call into the engine or take the engine lock here.
+        poseMailbox.write(listenerLatitude, listenerLongitude, listenerHeading)
+    }
+    override fun setBeaconType(beaconType: Int)
+    {
+    }
+
+    override fun submitCommands(commands: AudioCommandBuffer) : Boolean
     {
         synchronized(engineMutex) {
-            if(engineHandle != 0L)
-                updateGeometry(engineHandle, listenerLatitude, listenerLongitude, listenerHeading)
+            if(engineHandle != 0L) {
+                return submitCommands(engineHandle, commands.buffer, commands.length) >= 0
+            }
+
+            return false
         }
     }
-    override fun setBeaconType(beaconType: Int)
+
+    /**
+     * Returns the native audio callback timings and CPU usage since the stats were last reset, or
+     * null if there's no engine. Resetting them each time gives the stats for each interval.
+     */
+    fun getStats(reset: Boolean) : AudioEngineStats?
+    {
+        synchronized(engineMutex) {
+            if(engineHandle == 0L) {
+                return null
+            }
+            val stats = DoubleArray(AudioEngineStats.LENGTH)
+            if(!getStats(engineHandle, stats, reset)) {
+                return null
+            }
+            return AudioEngineStats.fromArray(stats)
+        }
+    }
+
+    /**
+     * Returns the native engine's memory use, or null if there's no engine
+     */
+    fun getMemoryStats() : AudioMemoryStats?
+    {
+        synchronized(engineMutex) {
+            if(engineHandle == 0L) {
+                return null
+            }
+            val stats = LongArray(AudioMemoryStats.LENGTH)
+            if(!getMemoryStats(engineHandle, stats)) {
+                return null
+            }
+            return AudioMemoryStats.fromArray(stats)
+        }
+    }
+
+    /**
+     * Parses zoom 16 tiles of GeoJSON from the tile server straight into the native feature store,
+     * keeping the features which are inside each tile as cleanTileGeoJSON does. The tiles are
+     * parsed in parallel. Returns the number of tiles loaded.
+     */
+    fun loadTiles(tiles: List<Pair<Pair<Int, Int>, String>>) : Int
+    {
+        val tileIds = IntArray(tiles.size * 3)
+        tiles.forEachIndexed { index, tile ->
+            tileIds[index * 3] = tile.first.first
+            tileIds[index * 3 + 1] = tile.first.second
+            tileIds[index * 3 + 2] = 16
+        }
+        val json = Array(tiles.size) { index -> tiles[index].second.toByteArray(Charsets.UTF_8) }
+        synchronized(engineMutex) {
+            if(engineHandle == 0L) {
+                return 0
+            }
+            return maxOf(loadTiles(engineHandle, tileIds, json), 0)
+        }
+    }
+
+    /**
+     * Returns the number of features in a loaded zoom 16 tile, or -1 if it isn't loaded
+     */
+    fun getTileFeatureCount(x: Int, y: Int) : Long
+    {
+        synchronized(engineMutex) {
+            if(engineHandle == 0L) {
+                return -1
+            }
+            return getTileFeatureCount(engineHandle, x, y, 16)
+        }
+    }
+
+    /**
+     * Loads a zoom 16 tile from the native tile cache into the feature store without fetching or
+     * parsing it. Returns false if it isn't in the cache.
+     */
+    fun loadCachedTile(x: Int, y: Int) : Boolean
     {
+        synchronized(engineMutex) {
+            if(engineHandle == 0L) {
+                return false
+            }
+            return loadCachedTile(engineHandle, x, y, 16)
+        }
+    }
+
+    /**
+     * Called with the x and y of the zoom 16 tiles around the listener that the native tile
+     * working set couldn't load from the tile cache, for the client to fetch and pass to
+     * loadTiles. It's called on the event thread.
+     */
+    var onTilesMissing: ((List<Pair<Int, Int>>) -> Unit)? = null
+
+    /**
+     * Starts the native tile working set, which keeps the zoom 16 tiles within radius metres of
+     * the listener loaded from the tile cache as they move, and prefetches those ahead of them,
+     * so that the tiles don't have to be worked out with getTilesForRegion and loaded on every
+     * update. A radius of 0 stops it. Tiles which aren't in the cache are passed to
+     * onTilesMissing.
+     */
+    fun startTileWorkingSet(radius: Double) : Boolean
+    {
+        synchronized(engineMutex) {
+            if(engineHandle == 0L) {
+                return false
+            }
+            return startTileWorkingSet(engineHandle, radius)
+        }
+    }
+
+    /**
+     * Returns the x and y of the zoom 16 tiles around the listener that the tile working set
+     * couldn't load from the tile cache, nearest first
+     */
+    fun getMissingTiles() : List<Pair<Int, Int>>
+    {
+        val tileIds = IntArray(MAX_MISSING_TILES * 3)
+        val found: Int
+        synchronized(engineMutex) {
+            if(engineHandle == 0L) {
+                return emptyList()
+            }
+            found = getMissingTiles(engineHandle, tileIds)
+        }
+        return List(found) { index -> Pair(tileIds[index * 3], tileIds[index * 3 + 1]) }
+    }
+
+    /**
+     * Returns the tile working set's hits, misses and stalls, or null if there's no engine
+     */
+    fun getTileWorkingSetStats() : TileWorkingSetStats?
+    {
+        synchronized(engineMutex) {
+            if(engineHandle == 0L) {
+                return null
+            }
+            val stats = LongArray(TileWorkingSetStats.LENGTH)
+            if(!getTileWorkingSetStats(engineHandle, stats)) {
+                return null
+            }
+            return TileWorkingSetStats.fromArray(stats)
+        }
+    }
+
+    /**
+     * Finds up to count features of the loaded tiles in the categories, a set of the CATEGORY_
+     * bits, within maxDistance metres of the location using the native spatial index. Returns
+     * the OSM ids and distances of the features, nearest first. This replaces the linear scans of
+     * getNearestRoad, getNearestIntersection and getNearestPoi in TileUtils.kt.
+     */
+    fun findNearest(latitude: Double, longitude: Double, categories: Int, maxDistance: Double,
+                    count: Int = 1) : List<Pair<Long, Double>>
+    {
+        val osmIds = LongArray(count)
+        val distances = DoubleArray(count)
+        val found: Int
+        synchronized(engineMutex) {
+            if(engineHandle == 0L) {
+                return emptyList()
+            }
+            found = findNearest(engineHandle, latitude, longitude, categories, maxDistance, osmIds, distances)
+        }
+        return List(found) { index -> Pair(osmIds[index], distances[index]) }
+    }
+
+    /**
+     * Finds up to count features of the loaded tiles in the categories which are in the
+     * listener's field of view, a wedge width degrees wide centred on the heading and range
+     * metres long. Returns the OSM ids and distances of the features, nearest first. This
+     * replaces the FOV triangle tests of getFovIntersectionFeatureCollection,
+     * getFovRoadsFeatureCollection and getFovPoiFeatureCollection in TileUtils.kt, which look
+     * at every feature, with a query of the native spatial index that's cheap enough to run on
+     * every heading update.
+     */
+    fun findInFieldOfView(latitude: Double, longitude: Double, heading: Double, width: Double,
+                          range: Double, categories: Int, count: Int) : List<Pair<Long, Double>>
+    {
+        val osmIds = LongArray(count)
+        val distances = DoubleArray(count)
+        val found: Int
+        synchronized(engineMutex) {
+            if(engineHandle == 0L) {
+                return emptyList()
+            }
+            found = findInFieldOfView(engineHandle, latitude, longitude, heading, width, range,
+                                      categories, osmIds, distances)
+        }
+        return List(found) { index -> Pair(osmIds[index], distances[index]) }
+    }
+
+    /**
+     * A road leaving an intersection. The bearing is in degrees clockwise from north, and the
+     * road is followed across tile edges for length metres to the node at its other end, which
+     * is one of the ROAD_NODE_ types.
+     */
+    data class IntersectionRoad(val osmId: Long, val bearing: Double, val length: Double,
+                                val endLatitude: Double, val endLongitude: Double, val endType: Int)
+
+    /**
+     * Finds the nearest intersection within maxDistance metres of the location, and returns its
+     * OSM id and the roads leaving it in order of their bearings, or null if there isn't one.
+     * The roads come from the road graph built for each tile as it's loaded, which replaces
+     * getIntersectionRoadNames, splitRoadByIntersection and getRoadBearingToIntersection in
+     * TileUtils.kt.
+     */
+    fun getNearestIntersection(latitude: Double, longitude: Double, maxDistance: Double,
+                               maxRoads: Int = 8) : Pair<Long, List<IntersectionRoad>>?
+    {
+        val osmIds = LongArray(maxRoads + 1)
+        val values = DoubleArray(maxRoads * INTERSECTION_ROAD_VALUES)
+        val found: Int
+        synchronized(engineMutex) {
+            if(engineHandle == 0L) {
+                return null
+            }
+            found = getNearestIntersection(engineHandle, latitude, longitude, maxDistance, osmIds, values)
+        }
+        if(found < 0) {
+            return null
+        }
+        val roads = List(found) { index ->
+            val offset = index * INTERSECTION_ROAD_VALUES
+            IntersectionRoad(osmIds[index + 1], values[offset], values[offset + 1],
+                             values[offset + 2], values[offset + 3], values[offset + 4].toInt())
+        }
+        return Pair(osmIds[0], roads)
+    }
+
+    /**
+     * Writes a loaded zoom 16 tile to a binary tile file, which can be memory mapped by
+     * loadTileFile much more quickly than the tile's GeoJSON can be parsed. Returns false if the
+     * tile isn't loaded or the file couldn't be written.
+     */
+    fun saveTileFile(x: Int, y: Int, path: String) : Boolean
+    {
+        synchronized(engineMutex) {
+            if(engineHandle == 0L) {
+                return false
+            }
+            return saveTileFile(engineHandle, x, y, 16, path)
+        }
+    }
+
+    /**
+     * Loads a tile written by saveTileFile into the native feature store. Returns false if the
+     * file doesn't exist or isn't valid, in which case the tile should be fetched again.
+     */
+    fun loadTileFile(path: String) : Boolean
+    {
+        synchronized(engineMutex) {
+            if(engineHandle == 0L) {
+                return false
+            }
+            return loadTileFile(engineHandle, path)
+        }
+    }
+
+    /**
+     * Called by the native engine control thread when there are audio events waiting to be
+     * drained. The control thread mustn't block on engineMutex, so the events are drained in one
+     * batch on our own executor.
+     */
+    @Suppress("unused")
+    private fun onAudioEventsPending()
+    {
+        eventExecutor.execute { drainAudioEvents() }
+    }
+
+    private fun drainAudioEvents()
+    {
+        synchronized(engineMutex) {
+            if(engineHandle == 0L) {
+                return
+            }
+            do {
+                val count = drainEvents(engineHandle, eventBuffer)
+                for(event in 0 until count) {
+                    handleAudioEvent(eventBuffer[event * 3],
+                        eventBuffer[(event * 3) + 1],
+                        eventBuffer[(event * 3) + 2])
+                }
+            } while(count == MAX_EVENTS_PER_DRAIN)
+        }
+    }
+
+    private fun handleAudioEvent(type: Long, handle: Long, value: Long)
+    {
+        when(type) {
+            EVENT_SOURCE_FINISHED -> {
+                // The native audio has been destroyed, so release any text to speech sockets
+                val utteranceId = ttsHandles.remove(handle) ?: return
+                Log.d(TAG, "Text to speech finished $utteranceId")
+                ttsSockets.remove(utteranceId)?.let { ttsSocketPair ->
+                    ttsSocketPair[0].close()
+                    ttsSocketPair[1].close()
+                }
+            }
+            EVENT_QUEUE_ADVANCED -> Log.d(TAG, "Queue advanced to $handle")
+            EVENT_UNDERRUN -> Log.d(TAG, "Underrun on $handle")
+            EVENT_ASSET_LOADED -> Log.d(TAG, "Asset loaded for $handle, $value bytes")
+            EVENT_TILES_MISSING -> {
+                Log.d(TAG, "$value tiles missing")
+                onTilesMissing?.let { callback ->
+                    val missing = getMissingTiles()
+                    if(missing.isNotEmpty()) {
+                        callback(missing)
+                    }
+                }
+            }
+        }
     }
 
     companion object {
         private const val TAG = "NativeAudioEngine"
+
+        private const val MAX_EVENTS_PER_DRAIN = 64
+
+        // A tile is about 100KB in the cache, so this is several hundred tiles
+        private const val TILE_CACHE_BUDGET = 64L * 1024 * 1024
+
+        // More than the tiles in a circle and the circle ahead of it at any sensible radius
+        private const val MAX_MISSING_TILES = 64
+
+        // The bits of a set of categories for findNearest, which must match FeatureCategory in
+        // FeatureCategory.h
+        const val CATEGORY_POI = 1 shl 0
+        const val CATEGORY_ROAD = 1 shl 1
+        const val CATEGORY_PATH = 1 shl 2
+        const val CATEGORY_INTERSECTION = 1 shl 3
+        const val CATEGORY_ENTRANCE = 1 shl 4
+        const val CATEGORY_BUS_STOP = 1 shl 5
+        const val CATEGORY_CROSSING = 1 shl 6
+
+        // The kinds of node at the end of an IntersectionRoad, which must match RoadNodeType in
+        // RoadGraph.h
+        const val ROAD_NODE_INTERSECTION = 0
+        const val ROAD_NODE_END = 1
+        const val ROAD_NODE_BORDER = 2
+        // The values of each road passed back by getNearestIntersection
+        private const val INTERSECTION_ROAD_VALUES = 5
+
+        // These must match EventType in EventQueue.h
+        private const val EVENT_SOURCE_FINISHED = 1L
+        private const val EVENT_QUEUE_ADVANCED = 2L
+        private const val EVENT_UNDERRUN = 3L
+        private const val EVENT_ASSET_LOADED = 4L
+        private const val EVENT_TILES_MISSING = 5L
+
         init {
             System.loadLibrary("soundscape-audio")
         }
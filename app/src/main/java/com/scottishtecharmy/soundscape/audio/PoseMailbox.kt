@@ -0,0 +1,53 @@
+package com.scottishtecharmy.soundscape.audio
+
+import android.os.SystemClock
+import java.nio.ByteBuffer
+import java.nio.ByteOrder
+
+/**
+ * Memory shared with the native AudioEngine into which the latest listener pose is written. The
+ * native control thread polls it, so writing a pose doesn't need a JNI call. It's protected by a
+ * sequence lock which must match PoseMailbox.h: the sequence is made odd while the pose is being
+ * written and even again once it's complete.
+ */
+class PoseMailbox {
+    val buffer: ByteBuffer = ByteBuffer.allocateDirect(SIZE).order(ByteOrder.nativeOrder())
+
+    private var sequence = 0
+    @Volatile private var barrier = 0
+
+    @Synchronized
+    fun write(latitude: Double, longitude: Double, heading: Double) {
+        sequence += 1
+        buffer.putInt(SEQUENCE_OFFSET, sequence)
+        storeStoreBarrier()
+
+        buffer.putDouble(LATITUDE_OFFSET, latitude)
+        buffer.putDouble(LONGITUDE_OFFSET, longitude)
+        buffer.putDouble(HEADING_OFFSET, heading)
+        buffer.putLong(TIMESTAMP_OFFSET, SystemClock.elapsedRealtimeNanos())
+        storeStoreBarrier()
+
+        sequence += 1
+        buffer.putInt(SEQUENCE_OFFSET, sequence)
+    }
+
+    /**
+     * A volatile write followed by a volatile read stops the plain buffer writes before it being
+     * reordered with those after it, which is what the sequence lock relies on.
+     */
+    private fun storeStoreBarrier() {
+        barrier = sequence
+        @Suppress("UNUSED_VARIABLE")
+        val unused = barrier
+    }
+
+    companion object {
+        private const val SIZE = 40
+        private const val SEQUENCE_OFFSET = 0
+        private const val LATITUDE_OFFSET = 8
+        private const val LONGITUDE_OFFSET = 16
+        private const val HEADING_OFFSET = 24
+        private const val TIMESTAMP_OFFSET = 32
+    }
+}
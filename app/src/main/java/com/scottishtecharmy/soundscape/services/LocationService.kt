@@ -3,7 +3,6 @@ package com.scottishtecharmy.soundscape.services
 
 import android.Manifest.permission
 import android.annotation.SuppressLint
-import android.app.Application
 import android.app.Notification
 import android.app.NotificationChannel
 import android.app.NotificationManager
@@ -34,20 +33,18 @@ import com.google.android.gms.location.LocationServices
 import com.google.android.gms.location.Priority
 import com.scottishtecharmy.soundscape.MainActivity
 import com.scottishtecharmy.soundscape.R
+import com.scottishtecharmy.soundscape.audio.AudioCommandBuffer
 import com.scottishtecharmy.soundscape.audio.NativeAudioEngine
 import com.scottishtecharmy.soundscape.geojsonparser.geojson.LngLatAlt
 import com.scottishtecharmy.soundscape.network.ITileDAO
 import com.scottishtecharmy.soundscape.network.OkhttpClientInstance
-import com.scottishtecharmy.soundscape.network.RetrofitClientInstance
-import com.scottishtecharmy.soundscape.utils.*
 import kotlinx.coroutines.CoroutineScope
 import kotlinx.coroutines.Dispatchers
 import kotlinx.coroutines.Job
-import kotlinx.coroutines.async
 import kotlinx.coroutines.cancelChildren
 import kotlinx.coroutines.flow.MutableStateFlow
 import kotlinx.coroutines.flow.StateFlow
-import kotlinx.coroutines.withContext
+import kotlinx.coroutines.launch
 import retrofit2.awaitResponse
 import java.util.concurrent.Executors
 import kotlin.time.Duration.Companion.seconds
@@ -71,6 +68,13 @@ class LocationService : Service() {
     private val audioEngine = NativeAudioEngine()
     private var audioBeacon: Long = 0
 
+    // The tiles the audio engine's working set is missing are fetched through the HTTP cache
+    private val tileService by lazy {
+        OkhttpClientInstance(application).retrofitInstance?.create(ITileDAO::class.java)
+    }
+    // Tiles being fetched, so that they aren't fetched twice if they're reported missing again
+    private val fetchingTiles = HashSet<Pair<Int, Int>>()
+
     // secondary service
     private var timerJob: Job? = null
 
@@ -125,12 +129,18 @@ class LocationService : Service() {
 
         // Start audio engine
         audioEngine.initialize(applicationContext)
+
+        // The audio engine keeps the tiles around the listener loaded from its tile cache as the
+        // location updates come in, and asks for the ones that aren't cached yet
+        audioEngine.onTilesMissing = { tiles -> fetchTiles(tiles) }
+        audioEngine.startTileWorkingSet(TILE_WORKING_SET_RADIUS)
     }
 
     override fun onDestroy() {
         super.onDestroy()
         Log.d(TAG, "onDestroy")
 
+        audioEngine.onTilesMissing = null
         audioEngine.destroyBeacon(audioBeacon)
         audioEngine.destroy()
 
@@ -289,51 +299,45 @@ class LocationService : Service() {
         notificationManager.createNotificationChannel(channel)
     }
 
-    // testing out basic network connection with Retrofit and cleaning the tile
-    suspend fun getTileString(): String? {
-
-        val tileXY = _locationFlow.value?.let { getXYTile(it.latitude, _locationFlow.value!!.longitude) }
-
-        return withContext(Dispatchers.IO) {
-            val service = RetrofitClientInstance.retrofitInstance?.create(ITileDAO::class.java)
-
-            val tile = async { tileXY?.let { service?.getTile(it.first, tileXY.second) } }
-            val result = tile.await()?.awaitResponse()?.body()
-            return@withContext result?.let<String, String> {
-                tileXY?.let { it1 ->
-                    cleanTileGeoJSON(
-                        it1.first, tileXY.second, 16.0, it)
-                }.toString()
-            }
+    // Called on the audio engine's event thread, which mustn't wait for the network. The tiles
+    // go straight into the engine's native feature store and tile cache, which drop the features
+    // that aren't really in the tile, so there's no need to clean the JSON first.
+    private fun fetchTiles(tiles: List<Pair<Int, Int>>) {
+        val wanted = synchronized(fetchingTiles) {
+            tiles.filter { tile -> fetchingTiles.add(tile) }
         }
-    }
-
-    suspend fun getTileStringCaching(application: Application): String? {
-        val tileXY = _locationFlow.value?.let { getXYTile(it.latitude, _locationFlow.value!!.longitude) }
-
-        val okhttpClientInstance = OkhttpClientInstance(application)
-        return withContext(Dispatchers.IO) {
-
-            val service = okhttpClientInstance.retrofitInstance?.create(ITileDAO::class.java)
-            val tile = async { tileXY?.let { service?.getTileWithCache(it.first, tileXY.second) } }
-            val result = tile.await()?.awaitResponse()?.body()
-            return@withContext result?.let<String, String> {
-                tileXY?.let { it1 ->
-                    cleanTileGeoJSON(
-                        it1.first, tileXY.second, 16.0, it)
-                }.toString()
+        if(wanted.isEmpty()) {
+            return
+        }
+        coroutineScope.launch(Dispatchers.IO) {
+            val fetched = ArrayList<Pair<Pair<Int, Int>, String>>()
+            for(tile in wanted) {
+                try {
+                    val json = tileService?.getTileWithCache(tile.first, tile.second)?.awaitResponse()?.body()
+                    if(json != null) {
+                        fetched.add(Pair(tile, json))
+                    }
+                } catch(e: Exception) {
+                    Log.e(TAG, "Failed to fetch tile ${tile.first},${tile.second}: $e")
+                }
+            }
+            val loaded = audioEngine.loadTiles(fetched)
+            Log.d(TAG, "Fetched ${fetched.size} of ${wanted.size} missing tiles, $loaded loaded")
+            synchronized(fetchingTiles) {
+                fetchingTiles.removeAll(wanted.toSet())
             }
-
         }
-
     }
 
     fun createBeacon(latitude: Double, longitude: Double) {
+        // Replace any existing beacon with the new one in a single call to the audio engine
+        val commands = AudioCommandBuffer()
         if(audioBeacon != 0L)
         {
-            audioEngine.destroyBeacon(audioBeacon)
+            commands.destroy(audioBeacon)
         }
-        audioBeacon = audioEngine.createBeacon(latitude, longitude)
+        val beaconIndex = commands.createBeacon(latitude, longitude)
+        audioBeacon = if(audioEngine.submitCommands(commands)) commands.getHandle(beaconIndex) else 0
         // Report any change in beacon back to application
         _beaconFlow.value = LngLatAlt(longitude, latitude)
     }
@@ -346,5 +350,8 @@ class LocationService : Service() {
         private const val CHANNEL_ID = "LocationService_channel_01"
         private const val NOTIFICATION_CHANNEL_NAME = "Soundscape_LocationService"
         private const val NOTIFICATION_ID = 1000000
+
+        // The tiles within this many metres of the listener are kept loaded in the audio engine
+        private const val TILE_WORKING_SET_RADIUS = 500.0
     }
 }
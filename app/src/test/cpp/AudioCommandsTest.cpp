@@ -0,0 +1,235 @@
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "TestHarness.h"
+#include "AudioCommands.h"
+#include "AudioEngine.h"
+#include "OfflineAudioBackend.h"
+
+using namespace soundscape;
+
+TEST(parseCommandListTest)
+{
+    CommandListBuilder builder;
+    auto beacon_index = builder.CreateBeacon(55.9, -4.3);
+    builder.Move(0x1234, 55.91, -4.31);
+    auto tts_index = builder.CreateTextToSpeech(55.8, -4.2, 7);
+    builder.Destroy(0x1234);
+    builder.Pose(55.9, -4.3, 90.0);
+
+    CommandList commands;
+    CHECK(commands.Parse(builder.GetData(), builder.GetLength()));
+    CHECK_EQUAL(5u, commands.GetCount());
+    CHECK(commands.GetOpcode(0) == CommandOpcode::CreateBeacon);
+    CHECK(commands.GetOpcode(1) == CommandOpcode::Move);
+    CHECK(commands.GetOpcode(2) == CommandOpcode::CreateTextToSpeech);
+    CHECK(commands.GetOpcode(3) == CommandOpcode::Destroy);
+    CHECK(commands.GetOpcode(4) == CommandOpcode::Pose);
+
+    auto move = commands.Get<MoveCommand>(1);
+    CHECK_EQUAL(0x1234, move.handle);
+    CHECK_NEAR(55.91, move.latitude, 0.0);
+    CHECK_NEAR(-4.31, move.longitude, 0.0);
+
+    auto tts = commands.Get<CreateTextToSpeechCommand>(2);
+    CHECK_EQUAL(7, tts.tts_socket);
+
+    auto pose = commands.Get<PoseCommand>(4);
+    CHECK_NEAR(90.0, pose.heading, 0.0);
+
+    // Handles written back by the engine should be visible to the builder
+    commands.SetHandle(0, 0xbeac0);
+    commands.SetHandle(2, 0x77500);
+    CHECK_EQUAL(0xbeac0, builder.GetHandle(beacon_index));
+    CHECK_EQUAL(0x77500, builder.GetHandle(tts_index));
+}
+
+TEST(emptyCommandListTest)
+{
+    CommandList commands;
+    CHECK(commands.Parse(nullptr, 0));
+    CHECK_EQUAL(0u, commands.GetCount());
+}
+
+TEST(rejectTruncatedCommandListTest)
+{
+    CommandListBuilder builder;
+    builder.CreateBeacon(55.9, -4.3);
+    builder.Pose(55.9, -4.3, 90.0);
+
+    CommandList commands;
+    CHECK(!commands.Parse(builder.GetData(), builder.GetLength() - 1));
+    CHECK(!commands.Parse(builder.GetData(), sizeof(CreateBeaconCommand) + 4));
+}
+
+TEST(rejectMalformedHeaderTest)
+{
+    CommandListBuilder builder;
+    builder.Destroy(0x1234);
+
+    CommandList commands;
+    CommandHeader header;
+
+    // Unknown opcode
+    memcpy(&header, builder.GetData(), sizeof(header));
+    header.opcode = 99;
+    memcpy(builder.GetData(), &header, sizeof(header));
+    CHECK(!commands.Parse(builder.GetData(), builder.GetLength()));
+
+    // Size which doesn't match the opcode
+    header.opcode = static_cast<uint32_t>(CommandOpcode::Destroy);
+    header.size = sizeof(DestroyCommand) + 8;
+    memcpy(builder.GetData(), &header, sizeof(header));
+    CHECK(!commands.Parse(builder.GetData(), builder.GetLength()));
+}
+
+TEST(rejectInvalidArgumentsTest)
+{
+    CommandList commands;
+    {
+        CommandListBuilder builder;
+        builder.CreateBeacon(91.0, -4.3);
+        CHECK(!commands.Parse(builder.GetData(), builder.GetLength()));
+    }
+    {
+        CommandListBuilder builder;
+        builder.Pose(55.9, -4.3, NAN);
+        CHECK(!commands.Parse(builder.GetData(), builder.GetLength()));
+    }
+    {
+        CommandListBuilder builder;
+        builder.CreateTextToSpeech(55.9, -4.3, -1);
+        CHECK(!commands.Parse(builder.GetData(), builder.GetLength()));
+    }
+    {
+        CommandListBuilder builder;
+        builder.Destroy(0);
+        CHECK(!commands.Parse(builder.GetData(), builder.GetLength()));
+    }
+    {
+        // One bad command anywhere in the list rejects all of it
+        CommandListBuilder builder;
+        builder.CreateBeacon(55.9, -4.3);
+        builder.Move(0x1234, 55.9, 181.0);
+        CHECK(!commands.Parse(builder.GetData(), builder.GetLength()));
+    }
+}
+
+TEST(submitCommandsTest)
+{
+    AudioEngine engine(std::make_unique<OfflineAudioBackend>());
+    MemoryStats empty_stats;
+    engine.GetMemoryStats(empty_stats);
+
+    int sockets[2];
+    CHECK_EQUAL(0, socketpair(AF_UNIX, SOCK_STREAM, 0, sockets));
+
+    // The engine writes the handles of the new audio back into the command list
+    CommandListBuilder builder;
+    auto beacon_index = builder.CreateBeacon(55.9, -4.3);
+    auto tts_index = builder.CreateTextToSpeech(55.9, -4.31, sockets[0]);
+    builder.Pose(55.9, -4.3, 90.0);
+    CHECK_EQUAL(3, engine.SubmitCommands(builder.GetData(), builder.GetLength()));
+    auto beacon = builder.GetHandle(beacon_index);
+    auto tts = builder.GetHandle(tts_index);
+    CHECK(beacon != 0);
+    CHECK(tts != 0);
+    CHECK(beacon != tts);
+
+    MemoryStats stats;
+    engine.GetMemoryStats(stats);
+    CHECK(stats.arena_used > empty_stats.arena_used);
+
+    // A list with a handle the engine doesn't know is rejected, and the beacon that it would
+    // have created before getting to it isn't
+    builder.Clear();
+    auto rejected_index = builder.CreateBeacon(55.8, -4.2);
+    builder.Move(beacon, 55.91, -4.31);
+    builder.Destroy(tts);
+    builder.Move(0x1234, 55.91, -4.31);
+    CHECK_EQUAL(-1, engine.SubmitCommands(builder.GetData(), builder.GetLength()));
+    CHECK_EQUAL(0, builder.GetHandle(rejected_index));
+    MemoryStats rejected_stats;
+    engine.GetMemoryStats(rejected_stats);
+    CHECK_EQUAL(stats.arena_used, rejected_stats.arena_used);
+
+    // As is destroying the same audio twice, which leaves it alone
+    builder.Clear();
+    builder.Destroy(tts);
+    builder.Destroy(tts);
+    CHECK_EQUAL(-1, engine.SubmitCommands(builder.GetData(), builder.GetLength()));
+
+    // Both are still there to be destroyed
+    builder.Clear();
+    builder.Destroy(beacon);
+    builder.Destroy(tts);
+    CHECK_EQUAL(2, engine.SubmitCommands(builder.GetData(), builder.GetLength()));
+    engine.GetMemoryStats(stats);
+    CHECK_EQUAL(empty_stats.arena_used, stats.arena_used);
+    builder.Clear();
+    builder.Destroy(beacon);
+    CHECK_EQUAL(-1, engine.SubmitCommands(builder.GetData(), builder.GetLength()));
+    close(sockets[0]);
+    close(sockets[1]);
+}
+
+TEST(destroyQueuedTextToSpeechTest)
+{
+    AudioEngine engine(std::make_unique<OfflineAudioBackend>());
+
+    const int COUNT = 3;
+    int sockets[COUNT][2];
+    CommandListBuilder builder;
+    size_t indices[COUNT];
+    for(int i = 0; i < COUNT; ++i) {
+        CHECK_EQUAL(0, socketpair(AF_UNIX, SOCK_STREAM, 0, sockets[i]));
+        indices[i] = builder.CreateTextToSpeech(55.9, -4.31, sockets[i][0]);
+    }
+    CHECK_EQUAL(COUNT, engine.SubmitCommands(builder.GetData(), builder.GetLength()));
+    int64_t handles[COUNT];
+    for(int i = 0; i < COUNT; ++i)
+        handles[i] = builder.GetHandle(indices[i]);
+
+    // Only the first of the queue plays
+    Event events[8];
+    CHECK_EQUAL(1u, engine.DrainEvents(events, 8));
+    CHECK(events[0].type == EventType::QueueAdvanced);
+    CHECK_EQUAL(handles[0], events[0].handle);
+
+    // Destroying audio which is waiting its turn doesn't change what's playing
+    builder.Clear();
+    builder.Destroy(handles[1]);
+    CHECK_EQUAL(1, engine.SubmitCommands(builder.GetData(), builder.GetLength()));
+    engine.UpdateGeometry(55.9, -4.3, 90.0);
+    size_t count = engine.DrainEvents(events, 8);
+    for(size_t i = 0; i < count; ++i)
+        CHECK(events[i].type != EventType::QueueAdvanced);
+
+    // Destroying the audio which is playing moves the queue on, skipping the destroyed audio
+    builder.Clear();
+    builder.Destroy(handles[0]);
+    CHECK_EQUAL(1, engine.SubmitCommands(builder.GetData(), builder.GetLength()));
+    count = engine.DrainEvents(events, 8);
+    size_t advanced = 0;
+    for(size_t i = 0; i < count; ++i) {
+        if(events[i].type == EventType::QueueAdvanced) {
+            CHECK_EQUAL(handles[2], events[i].handle);
+            ++advanced;
+        }
+    }
+    CHECK_EQUAL(1u, advanced);
+    engine.UpdateGeometry(55.9, -4.3, 90.0);
+
+    // And the last one empties it
+    builder.Clear();
+    builder.Destroy(handles[2]);
+    CHECK_EQUAL(1, engine.SubmitCommands(builder.GetData(), builder.GetLength()));
+    engine.UpdateGeometry(55.9, -4.3, 90.0);
+
+    for(int i = 0; i < COUNT; ++i) {
+        close(sockets[i][0]);
+        close(sockets[i][1]);
+    }
+}
+
+TEST_MAIN()
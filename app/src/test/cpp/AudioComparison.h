@@ -0,0 +1,171 @@
+#pragma once
+
+//
+// Comparison of rendered audio against a golden render with perceptual tolerances rather than
+// bit exactness, so that changes to the audio paths which don't change what's heard can be
+// landed without regenerating the golden files. Both renders are cut into blocks and for each
+// block and channel the RMS level and the levels in a set of logarithmically spaced frequency
+// bands are compared in dB. Anything below the floor is treated as silence.
+//
+#include <algorithm>
+#include <cmath>
+#include <complex>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+#include "WavFile.h"
+
+namespace soundscape::test {
+
+    struct AudioTolerances {
+        double rms_db = 1.0;
+        double band_db = 3.0;
+        double floor_db = -60.0;
+    };
+
+    struct AudioComparison {
+        bool passed = true;
+        double max_rms_difference_db = 0.0;
+        double max_band_difference_db = 0.0;
+        std::string message;
+    };
+
+    const size_t COMPARISON_BLOCK_FRAMES = 1024;
+    const int COMPARISON_BANDS = 16;
+    const double COMPARISON_LOWEST_FREQUENCY = 100.0;
+
+    // In place radix-2 FFT, the size must be a power of two
+    inline void Fft(std::vector<std::complex<double>> &data)
+    {
+        auto n = data.size();
+        for(size_t i = 1, j = 0; i < n; ++i) {
+            auto bit = n >> 1;
+            for(; j & bit; bit >>= 1)
+                j ^= bit;
+            j ^= bit;
+            if(i < j)
+                std::swap(data[i], data[j]);
+        }
+        for(size_t length = 2; length <= n; length <<= 1) {
+            auto angle = -2.0 * M_PI / static_cast<double>(length);
+            std::complex<double> step(cos(angle), sin(angle));
+            for(size_t i = 0; i < n; i += length) {
+                std::complex<double> w(1.0, 0.0);
+                for(size_t k = 0; k < length / 2; ++k) {
+                    auto even = data[i + k];
+                    auto odd = data[i + k + length / 2] * w;
+                    data[i + k] = even + odd;
+                    data[i + k + length / 2] = even - odd;
+                    w *= step;
+                }
+            }
+        }
+    }
+
+    inline double ToDb(double power)
+    {
+        return 10.0 * log10(power + 1e-20);
+    }
+
+    // The RMS level and band levels of one channel of a block, in dB relative to full scale
+    inline void AnalyseBlock(const WavData &wav, size_t first_frame, int channel,
+                             double &rms_db, std::vector<double> &band_db)
+    {
+        const auto N = COMPARISON_BLOCK_FRAMES;
+        std::vector<std::complex<double>> spectrum(N);
+        double sum_squares = 0.0;
+        double window_power = 0.0;
+        for(size_t i = 0; i < N; ++i) {
+            auto sample = wav.samples[(first_frame + i) * wav.channels + channel] / 32768.0;
+            sum_squares += sample * sample;
+            auto window = 0.5 - 0.5 * cos(2.0 * M_PI * static_cast<double>(i) / N);
+            window_power += window * window;
+            spectrum[i] = sample * window;
+        }
+        rms_db = ToDb(sum_squares / N);
+
+        Fft(spectrum);
+        band_db.assign(COMPARISON_BANDS, 0.0);
+        std::vector<double> band_power(COMPARISON_BANDS, 0.0);
+        auto nyquist = wav.sample_rate / 2.0;
+        for(size_t bin = 1; bin < N / 2; ++bin) {
+            auto frequency = static_cast<double>(bin) * wav.sample_rate / N;
+            if(frequency < COMPARISON_LOWEST_FREQUENCY)
+                continue;
+            auto band = static_cast<int>(COMPARISON_BANDS * log(frequency / COMPARISON_LOWEST_FREQUENCY) /
+                                         log(nyquist / COMPARISON_LOWEST_FREQUENCY));
+            band = std::min(band, COMPARISON_BANDS - 1);
+            // Scaled so that the band powers of a block add up to its mean square
+            band_power[band] += 2.0 * std::norm(spectrum[bin]) / (N * window_power);
+        }
+        for(int band = 0; band < COMPARISON_BANDS; ++band)
+            band_db[band] = ToDb(band_power[band]);
+    }
+
+    // The difference between two levels, or zero if they're both below the floor
+    inline double LevelDifference(double expected_db, double actual_db, double floor_db)
+    {
+        if((expected_db < floor_db) && (actual_db < floor_db))
+            return 0.0;
+        return fabs(std::max(expected_db, floor_db) - std::max(actual_db, floor_db));
+    }
+
+    inline AudioComparison CompareAudio(const WavData &expected, const WavData &actual,
+                                        const AudioTolerances &tolerances = AudioTolerances())
+    {
+        AudioComparison result;
+        char message[256];
+        if((expected.sample_rate != actual.sample_rate) || (expected.channels != actual.channels) ||
+           (expected.samples.size() != actual.samples.size())) {
+            snprintf(message, sizeof(message), "format differs: %dHz %d channels %zu samples vs "
+                                               "%dHz %d channels %zu samples",
+                     expected.sample_rate, expected.channels, expected.samples.size(),
+                     actual.sample_rate, actual.channels, actual.samples.size());
+            result.passed = false;
+            result.message = message;
+            return result;
+        }
+
+        auto frames = expected.samples.size() / expected.channels;
+        std::vector<double> expected_bands, actual_bands;
+        for(size_t frame = 0; frame + COMPARISON_BLOCK_FRAMES <= frames; frame += COMPARISON_BLOCK_FRAMES) {
+            for(int channel = 0; channel < expected.channels; ++channel) {
+                double expected_rms, actual_rms;
+                AnalyseBlock(expected, frame, channel, expected_rms, expected_bands);
+                AnalyseBlock(actual, frame, channel, actual_rms, actual_bands);
+
+                auto rms_difference = LevelDifference(expected_rms, actual_rms, tolerances.floor_db);
+                if(rms_difference > result.max_rms_difference_db) {
+                    result.max_rms_difference_db = rms_difference;
+                    if(rms_difference > tolerances.rms_db) {
+                        snprintf(message, sizeof(message),
+                                 "RMS at %.3fs on channel %d is %.1fdB, expected %.1fdB",
+                                 static_cast<double>(frame) / expected.sample_rate, channel,
+                                 actual_rms, expected_rms);
+                        result.message = message;
+                    }
+                }
+
+                for(int band = 0; band < COMPARISON_BANDS; ++band) {
+                    auto band_difference = LevelDifference(expected_bands[band], actual_bands[band],
+                                                           tolerances.floor_db);
+                    if(band_difference > result.max_band_difference_db) {
+                        result.max_band_difference_db = band_difference;
+                        if((band_difference > tolerances.band_db) &&
+                           (result.max_rms_difference_db <= tolerances.rms_db)) {
+                            snprintf(message, sizeof(message),
+                                     "band %d at %.3fs on channel %d is %.1fdB, expected %.1fdB",
+                                     band, static_cast<double>(frame) / expected.sample_rate,
+                                     channel, actual_bands[band], expected_bands[band]);
+                            result.message = message;
+                        }
+                    }
+                }
+            }
+        }
+        result.passed = (result.max_rms_difference_db <= tolerances.rms_db) &&
+                        (result.max_band_difference_db <= tolerances.band_db);
+        return result;
+    }
+}
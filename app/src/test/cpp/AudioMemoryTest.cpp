@@ -0,0 +1,180 @@
+#include <vector>
+
+#include "TestHarness.h"
+#include "AudioBeacon.h"
+#include "AudioEngine.h"
+#include "AudioMemory.h"
+#include "OfflineAudioBackend.h"
+#include "soundscape_engine.h"
+
+using namespace soundscape;
+
+const double LISTENER_LATITUDE = 55.9473;
+const double LISTENER_LONGITUDE = -4.3112;
+
+class TestObject : public ArenaObject {
+public:
+    explicit TestObject(int value) : m_Value(value) {}
+    int m_Value;
+    char m_Padding[100]{};
+};
+
+TEST(arenaTest)
+{
+    AudioMemory memory(1024 * 1024, 5 * 1024);
+    MemoryStats stats;
+    memory.GetStats(stats);
+    CHECK_EQUAL(5U * 1024, stats.arena_size);
+    CHECK_EQUAL(stats.arena_size, stats.used);
+    CHECK_EQUAL(0U, stats.arena_used);
+
+    // Each class gets 1KB, so there's room for 16 of the smallest blocks
+    std::vector<void *> blocks;
+    for(int i = 0; i < 16; ++i) {
+        auto block = memory.Allocate(8);
+        CHECK(block != nullptr);
+        CHECK_EQUAL(0U, reinterpret_cast<uintptr_t>(block) % alignof(std::max_align_t));
+        blocks.push_back(block);
+    }
+    memory.GetStats(stats);
+    CHECK_EQUAL(16U * AudioMemory::MIN_BLOCK, stats.arena_used);
+    CHECK_EQUAL(0U, stats.overflows);
+    CHECK_EQUAL(stats.arena_size, stats.used);
+
+    // The next goes to the heap and is charged to the budget
+    auto overflow = memory.Allocate(8);
+    CHECK(overflow != nullptr);
+    memory.GetStats(stats);
+    CHECK_EQUAL(1U, stats.overflows);
+    CHECK(stats.used > stats.arena_size);
+    AudioMemory::Free(overflow);
+    memory.GetStats(stats);
+    CHECK_EQUAL(stats.arena_size, stats.used);
+
+    // Freed blocks are reused
+    auto freed = blocks.back();
+    AudioMemory::Free(freed);
+    CHECK(memory.Allocate(8) == freed);
+
+    for(auto block: blocks)
+        AudioMemory::Free(block);
+    memory.GetStats(stats);
+    CHECK_EQUAL(0U, stats.arena_used);
+    CHECK_EQUAL(16U * AudioMemory::MIN_BLOCK, stats.arena_high_water);
+}
+
+TEST(budgetTest)
+{
+    AudioMemory memory(64 * 1024, 0);
+    CHECK(memory.Reserve(60 * 1024));
+    CHECK(!memory.Reserve(8 * 1024));
+    CHECK(memory.Reserve(4 * 1024));
+
+    // Blocks which don't fit in the arena are refused once the budget is used up
+    CHECK(memory.Allocate(8) == nullptr);
+    CHECK(new(&memory) TestObject(1) == nullptr);
+
+    MemoryStats stats;
+    memory.GetStats(stats);
+    CHECK_EQUAL(64U * 1024, stats.used);
+    CHECK_EQUAL(64U * 1024, stats.high_water);
+    CHECK_EQUAL(3U, stats.refused);
+
+    memory.Release(64 * 1024);
+    auto object = new(&memory) TestObject(2);
+    CHECK(object != nullptr);
+    CHECK_EQUAL(2, object->m_Value);
+    delete object;
+    memory.GetStats(stats);
+    CHECK_EQUAL(0U, stats.used);
+
+    // Objects created without an AudioMemory come from the heap
+    auto heap_object = new TestObject(3);
+    CHECK_EQUAL(3, heap_object->m_Value);
+    delete heap_object;
+}
+
+TEST(engineBudgetTest)
+{
+    auto backend = std::make_unique<OfflineAudioBackend>();
+    auto offline = backend.get();
+    AudioEngine engine(std::move(backend));
+
+    // A budget which has room for the beacon objects in the arena but not for their assets
+    MemoryStats stats;
+    engine.GetMemoryStats(stats);
+    engine.GetMemory()->SetBudget(stats.used + 64 * 1024);
+
+    double latitude, longitude;
+    getDestinationCoordinate(LISTENER_LATITUDE, LISTENER_LONGITUDE, 0.0, 20.0, latitude, longitude);
+    auto beacon = new(engine.GetMemory()) Beacon(&engine, latitude, longitude);
+    CHECK(beacon != nullptr);
+
+    // The assets are refused and play as silence
+    engine.GetMemoryStats(stats);
+    CHECK(stats.refused > 0);
+    CHECK(stats.arena_used > 0);
+    CHECK(stats.used <= stats.budget);
+    CHECK_EQUAL(0U, stats.backend_pool);
+
+    Event events[16];
+    auto count = engine.DrainEvents(events, 16);
+    CHECK(count > 0);
+    for(size_t i = 0; i < count; ++i) {
+        CHECK(events[i].type == EventType::AssetLoaded);
+        CHECK_EQUAL(0, events[i].value);
+    }
+
+    std::vector<int16_t> output(offline->GetSampleRate() * OfflineAudioBackend::CHANNELS);
+    offline->Render(output.data(), offline->GetSampleRate());
+    for(auto sample: output)
+        CHECK_EQUAL(0, sample);
+
+    // With the budget raised the assets are loaded and charged to it
+    engine.GetMemory()->SetBudget(AudioMemory::DEFAULT_BUDGET);
+    auto old_handle = beacon->GetHandle();
+    auto old_beacon = beacon;
+    CHECK(engine.DestroyAudio(old_handle));
+    engine.GetMemoryStats(stats);
+    CHECK_EQUAL(0U, stats.arena_used);
+    auto used = stats.used;
+
+    beacon = new(engine.GetMemory()) Beacon(&engine, latitude, longitude);
+    engine.GetMemoryStats(stats);
+    CHECK(stats.used > used + 64 * 1024);
+    // The arena hands back the same block, but the new beacon has a new handle so the old one
+    // can't be used to destroy it
+    CHECK(beacon == old_beacon);
+    CHECK(beacon->GetHandle() != old_handle);
+    CHECK(!engine.DestroyAudio(old_handle));
+    CHECK(engine.DestroyAudio(beacon->GetHandle()));
+    engine.GetMemoryStats(stats);
+    CHECK_EQUAL(used, stats.used);
+}
+
+TEST(engineApiTest)
+{
+    soundscape_memory_stats stats{};
+    CHECK_EQUAL(-1, soundscape_engine_get_memory_stats(nullptr, &stats));
+    CHECK_EQUAL(-1, soundscape_engine_set_memory_budget(nullptr, 0));
+
+    auto engine = soundscape_engine_create();
+    CHECK_EQUAL(0, soundscape_engine_set_memory_budget(engine, 32 * 1024 * 1024));
+    auto beacon = soundscape_engine_create_beacon(engine, LISTENER_LATITUDE, LISTENER_LONGITUDE);
+    CHECK(beacon != 0);
+    CHECK_EQUAL(0, soundscape_engine_get_memory_stats(engine, &stats));
+    CHECK_EQUAL(32U * 1024 * 1024, stats.budget);
+    CHECK(stats.used > stats.arena_size);
+    CHECK(stats.high_water >= stats.used);
+    CHECK(stats.arena_used > 0);
+    CHECK_EQUAL(0U, stats.refused);
+
+    // Once the budget is used up beacons still come from the arena, but their assets are refused
+    CHECK_EQUAL(0, soundscape_engine_set_memory_budget(engine, 0));
+    CHECK(soundscape_engine_create_beacon(engine, LISTENER_LATITUDE, LISTENER_LONGITUDE) != 0);
+    CHECK_EQUAL(0, soundscape_engine_get_memory_stats(engine, &stats));
+    CHECK(stats.refused > 0);
+    soundscape_engine_destroy(engine);
+}
+
+TEST_MAIN()
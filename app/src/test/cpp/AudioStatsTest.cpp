@@ -0,0 +1,193 @@
+#include <sys/socket.h>
+#include <unistd.h>
+#include <vector>
+
+#include "TestHarness.h"
+#include "AudioBeacon.h"
+#include "AudioEngine.h"
+#include "AudioStats.h"
+#include "OfflineAudioBackend.h"
+#include "soundscape_engine.h"
+
+using namespace soundscape;
+
+const double LISTENER_LATITUDE = 55.9473;
+const double LISTENER_LONGITUDE = -4.3112;
+
+static AudioStreamFormat GetBeaconFormat(AudioEngine &engine, PositionedAudio *parent)
+{
+    BeaconBufferGroup group(&engine, parent);
+    return group.GetStreamFormat();
+}
+
+TEST(bucketTest)
+{
+    // Small values are exact, and larger ones are within the precision of their bucket
+    for(uint64_t value = 0; value < 16; ++value) {
+        CHECK_EQUAL(value, LatencyHistogramSnapshot::GetBucket(value));
+        CHECK_EQUAL(value, LatencyHistogramSnapshot::GetBucketLimit(value));
+    }
+    for(uint64_t value = 16; value < (uint64_t(1) << 37); value = value * 9 / 8 + 1) {
+        auto bucket = LatencyHistogramSnapshot::GetBucket(value);
+        auto limit = LatencyHistogramSnapshot::GetBucketLimit(bucket);
+        CHECK(limit >= value);
+        CHECK(limit - value <= value / 16);
+        CHECK(LatencyHistogramSnapshot::GetBucketLimit(bucket - 1) < value);
+    }
+
+    // The buckets run on from each other without gaps
+    for(size_t bucket = 1; bucket < LatencyHistogramSnapshot::BUCKETS; ++bucket) {
+        auto start = LatencyHistogramSnapshot::GetBucketLimit(bucket - 1) + 1;
+        CHECK_EQUAL(bucket, LatencyHistogramSnapshot::GetBucket(start));
+    }
+
+    // Values which are too large go in the last bucket
+    CHECK_EQUAL(LatencyHistogramSnapshot::BUCKETS - 1, LatencyHistogramSnapshot::GetBucket(UINT64_MAX));
+}
+
+TEST(percentileTest)
+{
+    LatencyHistogram histogram;
+    LatencyHistogramSnapshot snapshot;
+    histogram.GetSnapshot(snapshot, false);
+    CHECK_EQUAL(0U, snapshot.count);
+    CHECK_EQUAL(0U, snapshot.GetPercentile(50.0));
+
+    // 1000 callbacks of 10us to 10ms
+    for(uint64_t i = 1; i <= 1000; ++i)
+        histogram.Record(i * 10000);
+    histogram.GetSnapshot(snapshot, false);
+    CHECK_EQUAL(1000U, snapshot.count);
+    CHECK_EQUAL(10000000U, snapshot.max);
+    CHECK_NEAR(5000000.0, static_cast<double>(snapshot.GetPercentile(50.0)), 5000000.0 / 16);
+    CHECK_NEAR(9900000.0, static_cast<double>(snapshot.GetPercentile(99.0)), 9900000.0 / 16);
+    CHECK_EQUAL(snapshot.max, snapshot.GetPercentile(100.0));
+    CHECK_NEAR(10000.0, static_cast<double>(snapshot.GetPercentile(0.0)), 10000.0 / 16);
+
+    // Resetting returns what was there and clears it
+    histogram.Record(20000000);
+    histogram.GetSnapshot(snapshot, true);
+    CHECK_EQUAL(1001U, snapshot.count);
+    CHECK_EQUAL(20000000U, snapshot.max);
+    histogram.GetSnapshot(snapshot, false);
+    CHECK_EQUAL(0U, snapshot.count);
+    CHECK_EQUAL(0U, snapshot.max);
+}
+
+TEST(engineStatsTest)
+{
+    auto backend = std::make_unique<OfflineAudioBackend>();
+    auto offline = backend.get();
+    AudioEngine engine(std::move(backend));
+
+    double latitude, longitude;
+    getDestinationCoordinate(LISTENER_LATITUDE, LISTENER_LONGITUDE, 0.0, 20.0, latitude, longitude);
+    new Beacon(&engine, latitude, longitude);
+
+    // Speech whose socket is still open but which hasn't sent anything yet is starved
+    int sockets[2];
+    CHECK_EQUAL(0, socketpair(AF_UNIX, SOCK_STREAM, 0, sockets));
+    new TextToSpeech(&engine, latitude, longitude, sockets[0]);
+
+    std::vector<int16_t> output(offline->GetSampleRate() * OfflineAudioBackend::CHANNELS);
+    offline->Render(output.data(), offline->GetSampleRate() / 2);
+    engine.UpdateGeometry(LISTENER_LATITUDE, LISTENER_LONGITUDE, 0.0);
+
+    AudioStatsSnapshot snapshot;
+    engine.GetStats()->GetSnapshot(snapshot, true);
+    auto &beacon = snapshot.callbacks[static_cast<size_t>(AudioSourceType::Beacon)];
+    auto &speech = snapshot.callbacks[static_cast<size_t>(AudioSourceType::TextToSpeech)];
+    CHECK(beacon.durations.count > 0);
+    CHECK_EQUAL(0U, beacon.padded);
+    CHECK(speech.durations.count > 0);
+    CHECK_EQUAL(speech.durations.count, speech.padded);
+    CHECK(beacon.durations.GetPercentile(50.0) > 0);
+
+    // The CPU usage was sampled from the backend by the geometry update
+    CHECK(snapshot.dsp_cpu > 0.0f);
+    CHECK(snapshot.stream_cpu > 0.0f);
+    CHECK_EQUAL(snapshot.dsp_cpu, snapshot.peak_dsp_cpu);
+
+    // Once the speech arrives the callbacks stop padding
+    std::vector<int16_t> tone(offline->GetSampleRate());
+    for(size_t i = 0; i < tone.size(); ++i)
+        tone[i] = ((i / 50) & 1) ? 8000 : -8000;
+    auto bytes = static_cast<ssize_t>(tone.size() * sizeof(int16_t));
+    CHECK_EQUAL(bytes, write(sockets[1], tone.data(), bytes));
+    offline->Render(output.data(), offline->GetSampleRate() / 4);
+    engine.GetStats()->GetSnapshot(snapshot, false);
+    CHECK(speech.durations.count > 0);
+    CHECK_EQUAL(0U, speech.padded);
+    CHECK_EQUAL(0.0f, snapshot.peak_dsp_cpu);
+
+    close(sockets[0]);
+    close(sockets[1]);
+}
+
+TEST(motionLatencyTest)
+{
+    auto backend = std::make_unique<OfflineAudioBackend>();
+    auto offline = backend.get();
+    AudioEngine engine(std::move(backend));
+    engine.SetBeaconType(0);
+
+    // The Classic beacon switches between its two layers at 22.5 degrees off axis
+    double latitude, longitude;
+    getDestinationCoordinate(LISTENER_LATITUDE, LISTENER_LONGITUDE, 0.0, 20.0, latitude, longitude);
+    auto beacon = new Beacon(&engine, latitude, longitude);
+    auto format = GetBeaconFormat(engine, beacon);
+    auto block_ns = static_cast<uint64_t>(format.decode_buffer_size) * 1000000000ULL / format.sample_rate;
+
+    std::vector<int16_t> output(offline->GetSampleRate() * OfflineAudioBackend::CHANNELS);
+    auto render = [&](double seconds) {
+        offline->Render(output.data(), static_cast<size_t>(seconds * offline->GetSampleRate()));
+    };
+    engine.UpdateGeometry(LISTENER_LATITUDE, LISTENER_LONGITUDE, 0.0);
+    render(0.5);
+
+    // Turning away and back again before the next block doesn't switch layer
+    engine.UpdateGeometry(LISTENER_LATITUDE, LISTENER_LONGITUDE, 90.0);
+    engine.UpdateGeometry(LISTENER_LATITUDE, LISTENER_LONGITUDE, 0.0);
+    render(1.0);
+
+    // Turning away switches layer at the start of the next block
+    engine.UpdateGeometry(LISTENER_LATITUDE, LISTENER_LONGITUDE, 90.0);
+    // Poses that aren't new and further turns don't change when the switch was asked for
+    engine.UpdateGeometry(LISTENER_LATITUDE, LISTENER_LONGITUDE, 100.0, 0);
+    engine.UpdateGeometry(LISTENER_LATITUDE, LISTENER_LONGITUDE, 120.0);
+    render(1.0);
+
+    // The listener is picked up at the start of the next render, so a pose which was captured
+    // 10ms before it was applied is heard 10ms later
+    engine.UpdateGeometry(LISTENER_LATITUDE, LISTENER_LONGITUDE, 120.0, offline->GetTime() - 10000000);
+    render(0.5);
+
+    AudioStatsSnapshot snapshot;
+    engine.GetStats()->GetSnapshot(snapshot, false);
+    auto &layer = snapshot.motion[static_cast<size_t>(MotionPath::LayerSwitch)];
+    auto &listener = snapshot.motion[static_cast<size_t>(MotionPath::Listener)];
+    CHECK_EQUAL(1U, layer.count);
+    CHECK(layer.max > 0);
+    CHECK(layer.max <= block_ns);
+    // Only the last pose before each render is heard, so there's one latency for each render
+    // after the first, whose pose was at time zero and so has no time
+    CHECK_EQUAL(3U, listener.count);
+    CHECK_NEAR(10000000.0, static_cast<double>(listener.max), 10000000.0 / 16);
+    CHECK_EQUAL(0U, listener.GetPercentile(50.0));
+}
+
+TEST(engineApiTest)
+{
+    soundscape_stats stats{};
+    CHECK_EQUAL(-1, soundscape_engine_get_stats(nullptr, &stats, 0));
+
+    auto engine = soundscape_engine_create();
+    stats.callbacks[SOUNDSCAPE_SOURCE_BEACON].callbacks = 1;
+    CHECK_EQUAL(0, soundscape_engine_get_stats(engine, &stats, 1));
+    CHECK_EQUAL(0U, stats.callbacks[SOUNDSCAPE_SOURCE_BEACON].callbacks);
+    CHECK_EQUAL(0U, stats.callbacks[SOUNDSCAPE_SOURCE_TEXT_TO_SPEECH].max_ns);
+    CHECK_EQUAL(0.0f, stats.dsp_cpu);
+    soundscape_engine_destroy(engine);
+}
+
+TEST_MAIN()
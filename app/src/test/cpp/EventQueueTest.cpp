@@ -0,0 +1,134 @@
+#include <thread>
+#include <vector>
+
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "TestHarness.h"
+#include "AudioCommands.h"
+#include "AudioEngine.h"
+#include "EventQueue.h"
+#include "OfflineAudioBackend.h"
+
+using namespace soundscape;
+
+TEST(pushPopTest)
+{
+    EventQueue queue;
+    CHECK(queue.IsEmpty());
+
+    CHECK(queue.Push({EventType::SourceFinished, 0x1000, 0}));
+    CHECK(queue.Push({EventType::AssetLoaded, 0x2000, 4096}));
+    CHECK(!queue.IsEmpty());
+
+    Event event{};
+    CHECK(queue.Pop(event));
+    CHECK(event.type == EventType::SourceFinished);
+    CHECK_EQUAL(0x1000, event.handle);
+    CHECK(queue.Pop(event));
+    CHECK(event.type == EventType::AssetLoaded);
+    CHECK_EQUAL(4096, event.value);
+    CHECK(!queue.Pop(event));
+    CHECK(queue.IsEmpty());
+}
+
+TEST(fullQueueDropsEventsTest)
+{
+    EventQueue queue;
+    for(size_t i = 0; i < EventQueue::CAPACITY; ++i)
+        CHECK(queue.Push({EventType::Underrun, static_cast<int64_t>(i), 0}));
+
+    CHECK(!queue.Push({EventType::Underrun, -1, 0}));
+    CHECK_EQUAL(1u, queue.GetDroppedCount());
+
+    // Draining makes space again and the order is preserved
+    Event event{};
+    for(size_t i = 0; i < EventQueue::CAPACITY; ++i) {
+        CHECK(queue.Pop(event));
+        CHECK_EQUAL(static_cast<int64_t>(i), event.handle);
+    }
+    CHECK(queue.Push({EventType::Underrun, 0, 0}));
+}
+
+TEST(multipleProducersTest)
+{
+    EventQueue queue;
+    const int PRODUCERS = 4;
+    const int EVENTS_PER_PRODUCER = 5000;
+
+    std::vector<std::thread> producers;
+    for(int producer = 0; producer < PRODUCERS; ++producer) {
+        producers.emplace_back([&queue, producer]() {
+            for(int i = 0; i < EVENTS_PER_PRODUCER; ++i) {
+                // Spin until there's space so that nothing is dropped
+                while(!queue.Push({EventType::QueueAdvanced, producer, i}))
+                    std::this_thread::yield();
+            }
+        });
+    }
+
+    // Events from each producer must arrive in the order that producer pushed them
+    std::vector<int64_t> next_value(PRODUCERS, 0);
+    int received = 0;
+    bool out_of_order = false;
+    while(received < PRODUCERS * EVENTS_PER_PRODUCER) {
+        Event event{};
+        if(queue.Pop(event)) {
+            if(event.value != next_value[event.handle])
+                out_of_order = true;
+            next_value[event.handle] = event.value + 1;
+            ++received;
+        }
+    }
+    for(auto &producer: producers)
+        producer.join();
+
+    CHECK(!out_of_order);
+    CHECK(queue.IsEmpty());
+}
+
+TEST(destroyedQueuedSourceEventsTest)
+{
+    AudioEngine engine(std::make_unique<OfflineAudioBackend>());
+
+    int first_sockets[2];
+    int second_sockets[2];
+    CHECK_EQUAL(0, socketpair(AF_UNIX, SOCK_STREAM, 0, first_sockets));
+    CHECK_EQUAL(0, socketpair(AF_UNIX, SOCK_STREAM, 0, second_sockets));
+    CommandListBuilder builder;
+    auto first_index = builder.CreateTextToSpeech(55.9, -4.31, first_sockets[0]);
+    auto second_index = builder.CreateTextToSpeech(55.9, -4.31, second_sockets[0]);
+    CHECK_EQUAL(2, engine.SubmitCommands(builder.GetData(), builder.GetLength()));
+    auto first = builder.GetHandle(first_index);
+    auto second = builder.GetHandle(second_index);
+
+    Event events[8];
+    CHECK_EQUAL(1u, engine.DrainEvents(events, 8));
+    CHECK(events[0].type == EventType::QueueAdvanced);
+    CHECK_EQUAL(first, events[0].handle);
+
+    // Destroying the playing source finishes it and then starts the next one
+    builder.Clear();
+    builder.Destroy(first);
+    CHECK_EQUAL(1, engine.SubmitCommands(builder.GetData(), builder.GetLength()));
+    CHECK_EQUAL(2u, engine.DrainEvents(events, 8));
+    CHECK(events[0].type == EventType::SourceFinished);
+    CHECK_EQUAL(first, events[0].handle);
+    CHECK(events[1].type == EventType::QueueAdvanced);
+    CHECK_EQUAL(second, events[1].handle);
+
+    // The last one finishes with nothing to follow it
+    builder.Clear();
+    builder.Destroy(second);
+    CHECK_EQUAL(1, engine.SubmitCommands(builder.GetData(), builder.GetLength()));
+    CHECK_EQUAL(1u, engine.DrainEvents(events, 8));
+    CHECK(events[0].type == EventType::SourceFinished);
+    CHECK_EQUAL(second, events[0].handle);
+
+    close(first_sockets[0]);
+    close(first_sockets[1]);
+    close(second_sockets[0]);
+    close(second_sockets[1]);
+}
+
+TEST_MAIN()
@@ -0,0 +1,368 @@
+#include <algorithm>
+#include <cmath>
+#include <random>
+#include <vector>
+
+#include "FeatureIndex.h"
+#include "FeatureStore.h"
+#include "TestHarness.h"
+#include "TestTiles.h"
+#include "TileClipper.h"
+#include "soundscape_engine.h"
+
+using namespace soundscape;
+using namespace soundscape::test;
+
+// The nearest features found by measuring the distance to every one of them
+static std::vector<NearestFeature> FindNearestByScanning(const FeatureIndex &index,
+                                                         double latitude, double longitude,
+                                                         size_t count, uint32_t categories)
+{
+    std::vector<NearestFeature> nearest;
+    const auto &features = index.GetFeatures().features;
+    for(uint32_t feature = 0; feature < features.size(); ++feature) {
+        if((features[feature].part_count != 0) &&
+           (FeatureCategoryMask(features[feature].category) & categories))
+            nearest.push_back({feature, index.GetDistance(latitude, longitude, feature)});
+    }
+    std::sort(nearest.begin(), nearest.end(), [](const NearestFeature &a, const NearestFeature &b) {
+        return a.distance < b.distance;
+    });
+    nearest.resize(std::min(nearest.size(), count));
+    return nearest;
+}
+
+// On the equator a degree is the same distance in both directions
+const double METRES_PER_DEGREE = EARTH_RADIUS_METERS * DEGREES_TO_RADIANS;
+
+TEST(distanceTest)
+{
+    const char *json = R"({"type": "FeatureCollection", "features": [
+        {"type": "Feature", "geometry": {"type": "Point", "coordinates": [0.0, 0.0]}},
+        {"type": "Feature", "geometry": {"type": "LineString", "coordinates": [[0.01, -0.001], [0.01, 0.001]]}},
+        {"type": "Feature", "geometry": {"type": "Polygon", "coordinates": [
+            [[0.02, -0.002], [0.024, -0.002], [0.024, 0.002], [0.02, 0.002], [0.02, -0.002]],
+            [[0.021, -0.001], [0.023, -0.001], [0.023, 0.001], [0.021, 0.001], [0.021, -0.001]]]}},
+        {"type": "Feature", "geometry": {"type": "MultiPoint", "coordinates": [[0.03, 0.0], [0.031, 0.0]]}},
+        {"type": "Feature", "geometry": null}
+    ]})";
+    auto features = std::make_shared<FeatureCollection>();
+    GeoJsonParser parser;
+    CHECK(parser.Parse(json, *features));
+    FeatureIndex index(features, {0.0, -0.002, 0.031, 0.002});
+    CHECK_EQUAL(4u, index.GetSize());
+
+    // The point, and the line from the side and from past its end
+    CHECK_NEAR(0.001 * METRES_PER_DEGREE, index.GetDistance(0.0, 0.001, 0), 1e-3);
+    CHECK_NEAR(0.0005 * METRES_PER_DEGREE, index.GetDistance(0.0005, 0.0105, 1), 1e-3);
+    CHECK_NEAR(0.001 * METRES_PER_DEGREE, index.GetDistance(0.002, 0.01, 1), 1e-3);
+    // Outside the polygon, inside it, and inside its hole
+    CHECK_NEAR(0.001 * METRES_PER_DEGREE, index.GetDistance(0.0, 0.019, 2), 1e-3);
+    CHECK_EQUAL(0.0, index.GetDistance(0.0015, 0.022, 2));
+    CHECK_NEAR(0.0005 * METRES_PER_DEGREE, index.GetDistance(0.0, 0.0215, 2), 1e-3);
+    // The nearer of the points
+    CHECK_NEAR(0.0005 * METRES_PER_DEGREE, index.GetDistance(0.0, 0.0315, 3), 1e-3);
+
+    NearestFeature nearest;
+    CHECK(index.FindNearest(0.0, 0.022, ALL_FEATURE_CATEGORIES, nearest));
+    CHECK_EQUAL(2u, nearest.feature);
+    CHECK(index.FindNearest(0.0, 0.008, ALL_FEATURE_CATEGORIES, nearest));
+    CHECK_EQUAL(1u, nearest.feature);
+    CHECK(!index.FindNearest(0.0, 0.008, ALL_FEATURE_CATEGORIES, nearest, 100.0));
+    CHECK(!index.FindNearest(0.0, 0.008, FeatureCategoryMask(FeatureCategory::Road), nearest));
+
+    std::vector<NearestFeature> found;
+    index.FindNearest(0.0, 0.0, 10, ALL_FEATURE_CATEGORIES, found);
+    CHECK_EQUAL(4u, found.size());
+    for(size_t rank = 0; rank < found.size(); ++rank)
+        CHECK_EQUAL(rank, found[rank].feature);
+
+    FeatureIndex empty(std::make_shared<FeatureCollection>(), {});
+    CHECK_EQUAL(0u, empty.GetSize());
+    CHECK(!empty.FindNearest(0.0, 0.0, ALL_FEATURE_CATEGORIES, nearest));
+}
+
+TEST(originTest)
+{
+    // A road which runs a long way north out of the tile doesn't move the projection away from
+    // the tile, so distances in it stay close to the haversine distance
+    const char *json = R"({"type": "FeatureCollection", "features": [
+        {"type": "Feature", "geometry": {"type": "Point", "coordinates": [-3.185, 55.95]}},
+        {"type": "Feature", "geometry": {"type": "LineString", "coordinates": [[-3.19, 55.95], [-3.19, 56.95]]}}
+    ]})";
+    auto features = std::make_shared<FeatureCollection>();
+    GeoJsonParser parser;
+    CHECK(parser.Parse(json, *features));
+    FeatureIndex index(features, {-3.1925, 55.9475, -3.1825, 55.9525});
+    CHECK_EQUAL(2u, index.GetSize());
+
+    auto expected = distance(55.95, -3.188, 55.95, -3.185);
+    CHECK_NEAR(expected, index.GetDistance(55.95, -3.188, 0), expected * 0.001);
+    NearestFeature nearest;
+    CHECK(index.FindNearest(55.951, -3.1855, ALL_FEATURE_CATEGORIES, nearest));
+    CHECK_EQUAL(0u, nearest.feature);
+}
+
+// The queries find the same features as scanning all of them, around every test tile
+TEST(nearestTest)
+{
+    const uint32_t CATEGORIES[] = {
+        ALL_FEATURE_CATEGORIES,
+        FeatureCategoryMask(FeatureCategory::Road) | FeatureCategoryMask(FeatureCategory::Path),
+        FeatureCategoryMask(FeatureCategory::Intersection),
+        FeatureCategoryMask(FeatureCategory::Poi),
+    };
+    std::mt19937 random(42);
+    std::uniform_real_distribution<double> unit(-0.25, 1.25);
+    std::vector<NearestFeature> found;
+    for(const auto &test_tile: TEST_TILES) {
+        auto box = tileToBoundingBox(test_tile.tile.x, test_tile.tile.y, test_tile.tile.zoom);
+        FeatureIndex index(LoadClippedTile(test_tile), box);
+        CHECK(index.GetSize() > 0);
+        for(int query = 0; query < 100; ++query) {
+            auto latitude = box.southLatitude + unit(random) * (box.northLatitude - box.southLatitude);
+            auto longitude = box.westLongitude + unit(random) * (box.eastLongitude - box.westLongitude);
+            for(auto categories: CATEGORIES) {
+                for(size_t count: {1, 5, 20}) {
+                    auto expected = FindNearestByScanning(index, latitude, longitude, count, categories);
+                    index.FindNearest(latitude, longitude, count, categories, found);
+                    CHECK_EQUAL(expected.size(), found.size());
+                    for(size_t rank = 0; rank < std::min(expected.size(), found.size()); ++rank)
+                        CHECK_NEAR(expected[rank].distance, found[rank].distance, 1e-9);
+                }
+            }
+
+            // Nothing further away than the limit
+            auto limit = 50.0;
+            index.FindNearest(latitude, longitude, 1000, ALL_FEATURE_CATEGORIES, found, limit);
+            auto expected = FindNearestByScanning(index, latitude, longitude, 1000, ALL_FEATURE_CATEGORIES);
+            auto within = std::count_if(expected.begin(), expected.end(), [&](const NearestFeature &f) {
+                return f.distance <= limit;
+            });
+            CHECK_EQUAL(static_cast<size_t>(within), found.size());
+        }
+    }
+}
+
+TEST(fieldOfViewTest)
+{
+    // Around a listener at 0, 0: points 100m away to the north, east, south and west and 300m
+    // to the north, a road 50m to the north whose ends are outside a 90 degree field of view,
+    // and a building that the listener is inside
+    const char *json = R"({"type": "FeatureCollection", "features": [
+        {"type": "Feature", "geometry": {"type": "Point", "coordinates": [0.0, 1.0]}},
+        {"type": "Feature", "geometry": {"type": "Point", "coordinates": [1.0, 0.0]}},
+        {"type": "Feature", "geometry": {"type": "Point", "coordinates": [0.0, -1.0]}},
+        {"type": "Feature", "geometry": {"type": "Point", "coordinates": [-1.0, 0.0]}},
+        {"type": "Feature", "geometry": {"type": "LineString", "coordinates": [[-2.0, 0.5], [2.0, 0.5]]}},
+        {"type": "Feature", "geometry": {"type": "Polygon", "coordinates": [
+            [[-0.2, -0.2], [0.2, -0.2], [0.2, 0.2], [-0.2, 0.2], [-0.2, -0.2]]]}},
+        {"type": "Feature", "geometry": {"type": "Point", "coordinates": [0.0, 3.0]}}
+    ]})";
+    // Scale the coordinates so that 1 is 100m
+    auto features = std::make_shared<FeatureCollection>();
+    GeoJsonParser parser;
+    CHECK(parser.Parse(json, *features));
+    const double SCALE = 100.0 / METRES_PER_DEGREE;
+    for(auto &latitude: features->latitudes)
+        latitude *= SCALE;
+    for(auto &longitude: features->longitudes)
+        longitude *= SCALE;
+    FeatureIndex index(features, {-2.0 * SCALE, -1.0 * SCALE, 2.0 * SCALE, 3.0 * SCALE});
+
+    struct Expected {
+        uint32_t feature;
+        double distance;
+    };
+    auto check = [&](double heading, double width, double range, std::vector<Expected> expected) {
+        std::vector<NearestFeature> found;
+        index.FindInFieldOfView(0.0, 0.0, heading, width, range, ALL_FEATURE_CATEGORIES, found);
+        CHECK_EQUAL(expected.size(), found.size());
+        for(size_t rank = 0; rank < std::min(expected.size(), found.size()); ++rank) {
+            CHECK_NEAR(expected[rank].distance, found[rank].distance, 1e-3);
+            // Points at the same distance can be in any order
+            auto tied = std::count_if(expected.begin(), expected.end(), [&](const Expected &other) {
+                return other.distance == expected[rank].distance;
+            });
+            if(tied == 1)
+                CHECK_EQUAL(expected[rank].feature, found[rank].feature);
+        }
+    };
+    check(0.0, 90.0, 200.0, {{5, 0.0}, {4, 50.0}, {0, 100.0}});
+    // The nearest part of the road in view is where it crosses the left edge
+    check(90.0, 90.0, 200.0, {{5, 0.0}, {4, 50.0 * sqrt(2.0)}, {1, 100.0}});
+    check(180.0, 10.0, 200.0, {{5, 0.0}, {2, 100.0}});
+    check(0.0, 270.0, 200.0, {{5, 0.0}, {4, 50.0}, {0, 100.0}, {1, 100.0}, {3, 100.0}});
+    check(0.0, 360.0, 400.0, {{5, 0.0}, {4, 50.0}, {0, 100.0}, {1, 100.0}, {2, 100.0}, {3, 100.0},
+                              {6, 300.0}});
+    check(0.0, 90.0, 10.0, {{5, 0.0}});
+    CHECK_NEAR(50.0 * sqrt(2.0), index.GetDistanceInFieldOfView(0.0, 0.0, -90.0, 90.0, 4), 1e-3);
+    CHECK(std::isinf(index.GetDistanceInFieldOfView(0.0, 0.0, 180.0, 90.0, 4)));
+}
+
+// The culling of the tree doesn't lose any features in view, around every test tile
+TEST(fieldOfViewTilesTest)
+{
+    std::mt19937 random(42);
+    std::uniform_real_distribution<double> unit(0.0, 1.0);
+    std::vector<NearestFeature> found;
+    for(const auto &test_tile: TEST_TILES) {
+        auto box = tileToBoundingBox(test_tile.tile.x, test_tile.tile.y, test_tile.tile.zoom);
+        FeatureIndex index(LoadClippedTile(test_tile), box);
+        const auto &features = index.GetFeatures().features;
+        for(int query = 0; query < 100; ++query) {
+            auto latitude = box.southLatitude + unit(random) * (box.northLatitude - box.southLatitude);
+            auto longitude = box.westLongitude + unit(random) * (box.eastLongitude - box.westLongitude);
+            auto heading = unit(random) * 360.0 - 180.0;
+            const double WIDTHS[] = {30.0, 90.0, 180.0, 270.0, 360.0};
+            auto width = WIDTHS[query % 5];
+            auto range = (query % 2) ? 50.0 : 150.0;
+            auto categories = (query % 3) ? ALL_FEATURE_CATEGORIES : FeatureCategoryMask(FeatureCategory::Road);
+
+            std::vector<NearestFeature> expected;
+            for(uint32_t feature = 0; feature < features.size(); ++feature) {
+                if(!(FeatureCategoryMask(features[feature].category) & categories))
+                    continue;
+                auto distance = index.GetDistanceInFieldOfView(latitude, longitude, heading, width, feature);
+                if(distance <= range)
+                    expected.push_back({feature, distance});
+            }
+            index.FindInFieldOfView(latitude, longitude, heading, width, range, categories, found);
+            CHECK_EQUAL(expected.size(), found.size());
+            CHECK(std::is_sorted(found.begin(), found.end(), [](const NearestFeature &a, const NearestFeature &b) {
+                return a.distance < b.distance;
+            }));
+            std::sort(found.begin(), found.end(), [](const NearestFeature &a, const NearestFeature &b) {
+                return a.feature < b.feature;
+            });
+            for(size_t rank = 0; rank < std::min(expected.size(), found.size()); ++rank) {
+                CHECK_EQUAL(expected[rank].feature, found[rank].feature);
+                CHECK_EQUAL(expected[rank].distance, found[rank].distance);
+            }
+        }
+    }
+}
+
+TEST(searchTest)
+{
+    std::mt19937 random(42);
+    std::uniform_real_distribution<double> unit(0.0, 1.0);
+    std::vector<uint32_t> found;
+    for(const auto &test_tile: TEST_TILES) {
+        auto tile = tileToBoundingBox(test_tile.tile.x, test_tile.tile.y, test_tile.tile.zoom);
+        FeatureIndex index(LoadClippedTile(test_tile), tile);
+        const auto &collection = index.GetFeatures();
+        for(int query = 0; query < 50; ++query) {
+            BoundingBox box;
+            box.southLatitude = tile.southLatitude + unit(random) * (tile.northLatitude - tile.southLatitude);
+            box.westLongitude = tile.westLongitude + unit(random) * (tile.eastLongitude - tile.westLongitude);
+            box.northLatitude = box.southLatitude + unit(random) * (tile.northLatitude - tile.southLatitude) / 4.0;
+            box.eastLongitude = box.westLongitude + unit(random) * (tile.eastLongitude - tile.westLongitude) / 4.0;
+
+            std::vector<uint32_t> expected;
+            for(uint32_t feature = 0; feature < collection.features.size(); ++feature) {
+                const auto &details = collection.features[feature];
+                if(details.part_count == 0)
+                    continue;
+                BoundingBox bounds{180.0, 90.0, -180.0, -90.0};
+                for(uint32_t part = 0; part < details.part_count; ++part) {
+                    const auto &geometry = collection.parts[details.first_part + part];
+                    for(uint32_t coordinate = geometry.first_coordinate;
+                        coordinate < geometry.first_coordinate + geometry.coordinate_count;
+                        ++coordinate) {
+                        bounds.westLongitude = std::min(bounds.westLongitude, collection.longitudes[coordinate]);
+                        bounds.eastLongitude = std::max(bounds.eastLongitude, collection.longitudes[coordinate]);
+                        bounds.southLatitude = std::min(bounds.southLatitude, collection.latitudes[coordinate]);
+                        bounds.northLatitude = std::max(bounds.northLatitude, collection.latitudes[coordinate]);
+                    }
+                }
+                if((bounds.westLongitude <= box.eastLongitude) && (bounds.eastLongitude >= box.westLongitude) &&
+                   (bounds.southLatitude <= box.northLatitude) && (bounds.northLatitude >= box.southLatitude))
+                    expected.push_back(feature);
+            }
+
+            found.clear();
+            index.Search(box, ALL_FEATURE_CATEGORIES, found);
+            std::sort(found.begin(), found.end());
+            CHECK(expected == found);
+        }
+    }
+}
+
+// A road which is in two tiles is only found once. Points are never in more than one tile.
+TEST(storeTest)
+{
+    FeatureStore store;
+    std::vector<TileFeature> nearest;
+    store.FindNearest(51.4, -2.6, 5, ALL_FEATURE_CATEGORIES, nearest);
+    CHECK(nearest.empty());
+
+    auto features = LoadClippedTile(TEST_TILES[4]);
+    store.AddTile({1, 1, 16}, features);
+    auto index = store.GetIndex({1, 1, 16});
+    CHECK(index != nullptr);
+    CHECK(store.GetTile({1, 1, 16}).get() == &index->GetFeatures());
+    CHECK(store.GetIndex({2, 2, 16}) == nullptr);
+
+    auto box = tileToBoundingBox(TEST_TILES[4].tile.x, TEST_TILES[4].tile.y, 16);
+    auto latitude = (box.southLatitude + box.northLatitude) / 2.0;
+    auto longitude = (box.westLongitude + box.eastLongitude) / 2.0;
+    auto roads = FeatureCategoryMask(FeatureCategory::Road) | FeatureCategoryMask(FeatureCategory::Path);
+    std::vector<NearestFeature> expected;
+    index->FindNearest(latitude, longitude, 10, roads, expected);
+
+    store.AddTile({2, 2, 16}, features);
+    store.FindNearest(latitude, longitude, 10, roads, nearest);
+    CHECK_EQUAL(10u, nearest.size());
+    std::vector<int64_t> osm_ids;
+    for(size_t rank = 0; rank < nearest.size(); ++rank) {
+        CHECK_NEAR(expected[rank].distance, nearest[rank].distance, 1e-9);
+        const auto &feature = features->features[nearest[rank].feature];
+        if(feature.osm_id_count != 0)
+            osm_ids.push_back(features->osm_ids[feature.first_osm_id]);
+    }
+    std::sort(osm_ids.begin(), osm_ids.end());
+    CHECK(std::adjacent_find(osm_ids.begin(), osm_ids.end()) == osm_ids.end());
+}
+
+TEST(engineApiTest)
+{
+    auto json = ReadTile("real.geojson");
+    soundscape_tile tile{32277, 21812, 16, json.data(), json.size()};
+    soundscape_nearest_feature nearest[4];
+    CHECK_EQUAL(-1, soundscape_engine_find_nearest(nullptr, 0.0, 0.0, ~0u, 1000.0, nearest, 4));
+
+    auto engine = soundscape_engine_create();
+    auto box = tileToBoundingBox(tile.x, tile.y, tile.zoom);
+    auto latitude = (box.southLatitude + box.northLatitude) / 2.0;
+    auto longitude = (box.westLongitude + box.eastLongitude) / 2.0;
+    CHECK_EQUAL(0, soundscape_engine_find_nearest(engine, latitude, longitude, ~0u, 1000.0, nearest, 4));
+    CHECK_EQUAL(1, soundscape_engine_load_tiles(engine, &tile, 1));
+
+    auto roads = (1u << SOUNDSCAPE_CATEGORY_ROAD);
+    CHECK_EQUAL(4, soundscape_engine_find_nearest(engine, latitude, longitude, roads, 1000.0, nearest, 4));
+    for(size_t rank = 0; rank < 4; ++rank) {
+        CHECK_EQUAL(tile.x, nearest[rank].x);
+        CHECK_EQUAL(tile.y, nearest[rank].y);
+        CHECK(nearest[rank].osm_id != 0);
+        if(rank > 0)
+            CHECK(nearest[rank - 1].distance <= nearest[rank].distance);
+    }
+    CHECK_EQUAL(0, soundscape_engine_find_nearest(engine, latitude, longitude, roads, 0.0, nearest, 4));
+
+    // Everything within 100m, and then only what's ahead
+    soundscape_nearest_feature around[256];
+    auto all = soundscape_engine_find_in_field_of_view(engine, latitude, longitude, 0.0, 360.0, 100.0,
+                                                       ~0u, around, 256);
+    auto ahead = soundscape_engine_find_in_field_of_view(engine, latitude, longitude, 0.0, 90.0, 100.0,
+                                                         ~0u, around, 256);
+    CHECK(all > ahead);
+    CHECK(ahead > 0);
+    for(int64_t rank = 1; rank < ahead; ++rank)
+        CHECK(around[rank - 1].distance <= around[rank].distance);
+    CHECK_EQUAL(-1, soundscape_engine_find_in_field_of_view(nullptr, latitude, longitude, 0.0, 90.0, 100.0,
+                                                            ~0u, around, 256));
+    soundscape_engine_destroy(engine);
+}
+
+TEST_MAIN()
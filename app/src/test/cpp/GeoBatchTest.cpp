@@ -0,0 +1,158 @@
+#include <random>
+#include <vector>
+
+#include "TestHarness.h"
+#include "GeoBatch.h"
+#include "GeoUtils.h"
+
+using namespace soundscape;
+
+static double AngleDifference(double a, double b)
+{
+    auto difference = fmod(fabs(a - b), 360.0);
+    return (difference > 180.0) ? 360.0 - difference : difference;
+}
+
+static std::vector<GeoBatchKernel> GetSupportedKernels()
+{
+    std::vector<GeoBatchKernel> kernels = {GeoBatchKernel::Generic};
+    if(GetBestGeoBatchKernel() != GeoBatchKernel::Generic)
+        kernels.push_back(GetBestGeoBatchKernel());
+    return kernels;
+}
+
+// Checks a batch of sources placed at random bearings and ranges up to max_range from each of
+// the listener locations against the double precision calculations.
+static void CheckAccuracy(double min_range, double max_range)
+{
+    const double listeners[][2] = {
+            {55.9473, -4.3112},     // Glasgow
+            {-33.8568, 151.2153},   // Sydney
+            {0.0, 0.0},
+            {70.0, 25.0},
+            {-60.0, 179.99},        // Across the antimeridian
+    };
+    const size_t count = 1003;      // Not a multiple of the vector width
+
+    std::mt19937 random(42);
+    std::uniform_real_distribution<double> random_bearing(0.0, 360.0);
+    std::uniform_real_distribution<double> random_range(min_range, max_range);
+
+    for(auto &listener: listeners) {
+        std::vector<double> latitudes(count), longitudes(count);
+        for(size_t i = 0; i < count; ++i)
+            getDestinationCoordinate(listener[0], listener[1],
+                                     random_bearing(random), random_range(random),
+                                     latitudes[i], longitudes[i]);
+
+        for(auto kernel: GetSupportedKernels()) {
+            std::vector<float> bearings(count), distances(count);
+            BatchBearingAndDistance(kernel, listener[0], listener[1],
+                                    latitudes.data(), longitudes.data(), count,
+                                    bearings.data(), distances.data());
+
+            double worst_distance = 0.0;
+            double worst_bearing = 0.0;
+            for(size_t i = 0; i < count; ++i) {
+                auto expected_distance = distance(listener[0], listener[1],
+                                                  latitudes[i], longitudes[i]);
+                auto allowed = 0.001 + expected_distance * 1e-5;
+                worst_distance = std::max(worst_distance,
+                                          fabs(distances[i] - expected_distance) / allowed);
+
+                if(expected_distance > 1.0) {
+                    auto expected_bearing = geo::bearing<geo::Haversine>(listener[0], listener[1],
+                                                                         latitudes[i], longitudes[i]);
+                    worst_bearing = std::max(worst_bearing,
+                                             AngleDifference(expected_bearing, bearings[i]));
+                }
+            }
+            if((worst_distance > 1.0) || (worst_bearing > 0.01))
+                printf("%s: %.0fm to %.0fm from %.4f,%.4f: distance %.2f of allowed, bearing %.5f degrees\n",
+                       GetGeoBatchKernelName(kernel), min_range, max_range, listener[0], listener[1],
+                       worst_distance, worst_bearing);
+            CHECK(worst_distance <= 1.0);
+            CHECK(worst_bearing <= 0.01);
+        }
+    }
+}
+
+TEST(batchNearbyAccuracyTest)
+{
+    // All within EQUIRECTANGULAR_MAX_DISTANCE
+    CheckAccuracy(0.0, 5.0);
+    CheckAccuracy(0.5, 100.0);
+    CheckAccuracy(1.0, EQUIRECTANGULAR_MAX_DISTANCE);
+}
+
+TEST(batchDistantAccuracyTest)
+{
+    CheckAccuracy(1.0, 50000.0);
+    CheckAccuracy(1000.0, 2000000.0);
+}
+
+TEST(batchCompassPointsTest)
+{
+    const double listener_latitude = 55.9473;
+    const double listener_longitude = -4.3112;
+    const size_t count = 8;
+    double latitudes[count], longitudes[count];
+    for(size_t i = 0; i < count; ++i)
+        getDestinationCoordinate(listener_latitude, listener_longitude, i * 45.0, 100.0,
+                                 latitudes[i], longitudes[i]);
+
+    float bearings[count], distances[count];
+    BatchBearingAndDistance(listener_latitude, listener_longitude, latitudes, longitudes, count,
+                            bearings, distances);
+    for(size_t i = 0; i < count; ++i) {
+        CHECK(AngleDifference(i * 45.0, bearings[i]) < 0.01);
+        CHECK_NEAR(100.0, distances[i], 0.01);
+    }
+}
+
+TEST(batchListenerPositionTest)
+{
+    // A source on top of the listener has no bearing, but it must not produce NaNs
+    const double latitude = 55.9473;
+    const double longitude = -4.3112;
+    float bearing = -1.0f, range = -1.0f;
+    BatchBearingAndDistance(latitude, longitude, &latitude, &longitude, 1, &bearing, &range);
+    CHECK_EQUAL(0.0f, range);
+    CHECK(!std::isnan(bearing));
+}
+
+TEST(batchEmptyTest)
+{
+    BatchBearingAndDistance(0.0, 0.0, nullptr, nullptr, 0, nullptr, nullptr);
+}
+
+TEST(findInBoxTest)
+{
+    // Points either side of each edge of the box, and on it, at every position in a block
+    const double south = 55.0, west = -4.0, north = 56.0, east = -3.0;
+    std::vector<double> latitudes(40, 50.0);
+    std::vector<double> longitudes(40, -3.5);
+    CHECK_EQUAL(40U, BatchFindInBox(latitudes.data(), longitudes.data(), 40, south, west, north, east));
+    CHECK_EQUAL(0U, BatchFindInBox(nullptr, nullptr, 0, south, west, north, east));
+
+    const double inside[][2] = {{55.0, -3.5}, {56.0, -3.5}, {55.5, -4.0}, {55.5, -3.0}};
+    const double outside[][2] = {{54.999, -3.5}, {56.001, -3.5}, {55.5, -4.001}, {55.5, -2.999}};
+    for(size_t index = 0; index < latitudes.size(); ++index) {
+        for(auto point: outside) {
+            latitudes[index] = point[0];
+            longitudes[index] = point[1];
+            CHECK_EQUAL(40U, BatchFindInBox(latitudes.data(), longitudes.data(), 40,
+                                            south, west, north, east));
+        }
+        for(auto point: inside) {
+            latitudes[index] = point[0];
+            longitudes[index] = point[1];
+            CHECK_EQUAL(index, BatchFindInBox(latitudes.data(), longitudes.data(), 40,
+                                              south, west, north, east));
+        }
+        latitudes[index] = 50.0;
+        longitudes[index] = -3.5;
+    }
+}
+
+TEST_MAIN()
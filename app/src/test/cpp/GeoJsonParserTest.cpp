@@ -0,0 +1,301 @@
+#include <clocale>
+#include <cstring>
+#include <string>
+
+#include "TestHarness.h"
+#include "TestTiles.h"
+#include "GeoJsonParser.h"
+
+using namespace soundscape;
+using namespace soundscape::test;
+
+// The members are in a different order from the tiles, and there's a foreign member and a bbox
+const char *GEOMETRY_GEOJSON = R"({
+  "type": "FeatureCollection",
+  "generator": {"name": "test", "versions": [1, 2.5, true, null]},
+  "features": [
+    {"type": "Feature", "geometry": {"type": "Point", "coordinates": [-4.3112, 55.9473, 12.0]},
+     "properties": {"name": "Fish & Chips \"Plaice\"", "level": 1, "indoor": false, "tags": {"a": [1]}, "note": null}},
+    {"geometry": {"coordinates": [[-4.3, 55.9], [-4.2, 55.8]], "type": "LineString", "bbox": [-4.3, 55.8, -4.2, 55.9]},
+     "type": "Feature", "properties": {}, "osm_ids": [1, -100000000016193528]},
+    {"type": "Feature", "geometry": {"type": "Polygon", "coordinates": [
+        [[0, 0], [1, 0], [1, 1], [0, 0]],
+        [[0.2, 0.2], [0.5, 0.2], [0.2, 0.5], [0.2, 0.2]]]},
+     "properties": null},
+    {"type": "Feature", "geometry": {"type": "MultiPolygon", "coordinates": [
+        [[[0, 0], [1, 0], [1, 1], [0, 0]]],
+        [[[2, 2], [3, 2], [3, 3], [2, 2]], [[2.1, 2.1], [2.5, 2.1], [2.1, 2.5], [2.1, 2.1]]]]},
+     "properties": {}},
+    {"type": "Feature", "geometry": {"type": "MultiPoint", "coordinates": [[1e1, -2.5E-1], [0.001, 1.5e+2]]}, "properties": {}},
+    {"type": "Feature", "geometry": null, "properties": {}},
+    {"type": "Feature", "geometry": {"type": "GeometryCollection", "geometries": [
+        {"type": "Point", "coordinates": [0, 0]}]}, "properties": {}}
+  ]
+})";
+
+TEST(geometryTest)
+{
+    GeoJsonParser parser;
+    FeatureCollection features;
+    CHECK(parser.Parse(GEOMETRY_GEOJSON, features));
+    CHECK_EQUAL(7U, features.features.size());
+
+    auto &point = features.features[0];
+    CHECK(point.geometry == GeometryType::Point);
+    CHECK_EQUAL(1U, point.part_count);
+    auto &point_part = features.parts[point.first_part];
+    CHECK_EQUAL(1U, point_part.coordinate_count);
+    CHECK_NEAR(-4.3112, features.longitudes[point_part.first_coordinate], 1e-12);
+    CHECK_NEAR(55.9473, features.latitudes[point_part.first_coordinate], 1e-12);
+
+    auto &line = features.features[1];
+    CHECK(line.geometry == GeometryType::LineString);
+    CHECK_EQUAL(1U, line.part_count);
+    CHECK_EQUAL(2U, features.parts[line.first_part].coordinate_count);
+    CHECK_EQUAL(2U, line.osm_id_count);
+    CHECK_EQUAL(int64_t(1), features.osm_ids[line.first_osm_id]);
+    CHECK_EQUAL(int64_t(-100000000016193528), features.osm_ids[line.first_osm_id + 1]);
+
+    auto &polygon = features.features[2];
+    CHECK(polygon.geometry == GeometryType::Polygon);
+    CHECK_EQUAL(2U, polygon.part_count);
+    CHECK_EQUAL(4U, features.parts[polygon.first_part + 1].coordinate_count);
+    CHECK_EQUAL(0U, features.parts[polygon.first_part + 1].polygon);
+    CHECK_EQUAL(0U, polygon.property_count);
+
+    // The second polygon has a hole
+    auto &multi_polygon = features.features[3];
+    CHECK(multi_polygon.geometry == GeometryType::MultiPolygon);
+    CHECK_EQUAL(3U, multi_polygon.part_count);
+    CHECK_EQUAL(0U, features.parts[multi_polygon.first_part].polygon);
+    CHECK_EQUAL(1U, features.parts[multi_polygon.first_part + 1].polygon);
+    CHECK_EQUAL(1U, features.parts[multi_polygon.first_part + 2].polygon);
+    CHECK_NEAR(2.5, features.longitudes[features.parts[multi_polygon.first_part + 2].first_coordinate + 1], 1e-12);
+
+    auto &multi_point = features.features[4];
+    CHECK(multi_point.geometry == GeometryType::MultiPoint);
+    CHECK_EQUAL(1U, multi_point.part_count);
+    auto first = features.parts[multi_point.first_part].first_coordinate;
+    CHECK_EQUAL(10.0, features.longitudes[first]);
+    CHECK_EQUAL(-0.25, features.latitudes[first]);
+    CHECK_EQUAL(0.001, features.longitudes[first + 1]);
+    CHECK_EQUAL(150.0, features.latitudes[first + 1]);
+
+    CHECK(features.features[5].geometry == GeometryType::None);
+    CHECK(features.features[6].geometry == GeometryType::None);
+    CHECK_EQUAL(0U, features.features[6].part_count);
+    // The coordinates of the GeometryCollection are skipped
+    CHECK_EQUAL(25U, features.longitudes.size());
+
+    // Even if it has a coordinates member, before or after its type
+    CHECK(parser.Parse(R"({"type": "FeatureCollection", "features": [
+        {"type": "Feature", "geometry": {"coordinates": [[1, 2], [3, 4]], "type": "GeometryCollection"}},
+        {"type": "Feature", "geometry": {"type": "GeometryCollection", "coordinates": [5, 6]}}]})", features));
+    CHECK_EQUAL(9U, features.features.size());
+    CHECK(features.features[7].geometry == GeometryType::None);
+    CHECK_EQUAL(0U, features.features[7].part_count);
+    CHECK_EQUAL(0U, features.features[8].part_count);
+    CHECK_EQUAL(25U, features.longitudes.size());
+}
+
+TEST(propertiesTest)
+{
+    GeoJsonParser parser;
+    FeatureCollection features;
+    CHECK(parser.Parse(GEOMETRY_GEOJSON, features));
+
+    auto &feature = features.features[0];
+    CHECK_EQUAL(5U, feature.property_count);
+    CHECK(features.GetProperty(feature, "name") == "Fish & Chips \"Plaice\"");
+    CHECK(features.GetProperty(feature, "missing").empty());
+
+    // Other values are kept as their JSON
+    auto property = features.properties[feature.first_property + 1];
+    CHECK(property.type == PropertyType::Number);
+    CHECK(features.GetString(property.value) == "1");
+    property = features.properties[feature.first_property + 2];
+    CHECK(property.type == PropertyType::Boolean);
+    CHECK(features.GetString(property.value) == "false");
+    property = features.properties[feature.first_property + 3];
+    CHECK(property.type == PropertyType::Json);
+    CHECK(features.GetString(property.value) == "{\"a\": [1]}");
+    property = features.properties[feature.first_property + 4];
+    CHECK(property.type == PropertyType::Null);
+}
+
+TEST(escapesTest)
+{
+    GeoJsonParser parser;
+    FeatureCollection features;
+    CHECK(parser.Parse(R"({"type": "FeatureCollection", "features": [{"typ\u0065": "Feature", "geometry": null,
+        "feature_type": "amenity", "feature_value": "caf\u00e9",
+        "properties": {"name:zh": "\u5c0f\u5289", "name": "a\\b\/c\td", "emoji": "\ud83d\ude00"}}]})",
+        features));
+
+    // Including in the keys
+    CHECK_EQUAL(1U, features.features.size());
+    auto &feature = features.features[0];
+    CHECK(features.GetString(feature.feature_type) == "amenity");
+    CHECK(features.GetString(feature.feature_value) == "caf\xc3\xa9");
+    CHECK(features.GetProperty(feature, "name:zh") == "\xe5\xb0\x8f\xe5\x8a\x89");
+    CHECK(features.GetProperty(feature, "name") == "a\\b/c\td");
+    CHECK(features.GetProperty(feature, "emoji") == "\xf0\x9f\x98\x80");
+}
+
+TEST(errorsTest)
+{
+    GeoJsonParser parser;
+    FeatureCollection features;
+    CHECK(parser.Parse(GEOMETRY_GEOJSON, features));
+    auto feature_count = features.features.size();
+    auto coordinate_count = features.longitudes.size();
+    auto strings_length = features.strings.size();
+
+    const char *invalid[] = {
+        "",
+        "[]",
+        R"({"type": "Feature"})",
+        R"({"features": []})",
+        R"({"type": "FeatureCollection", "features": [{"type": "Feature", "geometry": null}],})",
+        R"({"type": "FeatureCollection", "features": []} x)",
+        R"({"type": "FeatureCollection", "features": [{"type": "Feature",
+            "geometry": {"type": "Point", "coordinates": [[1, 2]]}}]})",
+        R"({"type": "FeatureCollection", "features": [{"type": "Feature",
+            "geometry": {"type": "LineString", "coordinates": [[1, 2], [[3, 4]]]}}]})",
+        R"({"type": "FeatureCollection", "features": [{"type": "Feature",
+            "geometry": {"type": "LineString", "coordinates": [[1, 2] [3, 4]]}}]})",
+        R"({"type": "FeatureCollection", "features": [{"type": "Feature",
+            "geometry": {"type": "Circle", "coordinates": [1, 2]}}]})",
+        R"({"type": "FeatureCollection", "features": [{"type": "Feature",
+            "geometry": {"type": "Point", "coordinates": [1, 2]}, "osm_ids": [1.5]}]})",
+        R"({"type": "FeatureCollection", "features": [{"type": "Feature",
+            "geometry": {"type": "Point", "coordinates": [1, 2]}, "osm_ids": [9223372036854775808]}]})",
+        R"({"type": "FeatureCollection", "features": [{"type": "Feature", "geometry": null,
+            "properties": {"name": "\x"}}]})",
+        R"({"type": "FeatureCollection", "features": [{"type": "Feature", "geometry": null,
+            "properties": {"name": "unterminated}}]})",
+        R"({"type": "FeatureCollection", "features": [{"type": "Feature", "geometry": null,
+            "properties": {"level": 1.}}]})",
+        R"({"type": "FeatureCollection", "features": [{"type": "Feature", "geometry": null,
+            "properties": {"name": "a"}, "properties": {"name": "b", "level": "2"}}]})",
+        R"({"type": "FeatureCollection", "features": [{"type": "Feature",
+            "geometry": {"type": "Point", "coordinates": [1, 2]}, "geometry": null}]})",
+        R"({"type": "FeatureCollection", "features": [{"type": "Feature", "geometry": null,
+            "osm_ids": [1], "osm_ids": [2, 3]}]})",
+    };
+    for(auto json: invalid) {
+        CHECK(!parser.Parse(json, strlen(json), features));
+        CHECK(!parser.GetError().empty());
+    }
+    CHECK(parser.GetError().find("offset") != std::string::npos);
+
+    // Nothing is left behind by the features that were rejected
+    CHECK_EQUAL(feature_count, features.features.size());
+    CHECK_EQUAL(coordinate_count, features.longitudes.size());
+    CHECK_EQUAL(coordinate_count, features.latitudes.size());
+    CHECK_EQUAL(strings_length, features.strings.size());
+
+    // Clearing keeps the space
+    auto capacity = features.longitudes.capacity();
+    features.Clear();
+    CHECK(features.features.empty());
+    CHECK_EQUAL(capacity, features.longitudes.capacity());
+}
+
+TEST(localeTest)
+{
+    // Numbers which don't fit the fast path are parsed by the C library, which mustn't use the
+    // process locale. The test only changes anything where a locale with a decimal comma is
+    // installed.
+    const char *json = R"({"type": "FeatureCollection", "features": [{"type": "Feature",
+        "geometry": {"type": "Point", "coordinates": [-4.31123456789012345678, 5.5e-30]}}]})";
+    std::string previous = setlocale(LC_NUMERIC, nullptr);
+    for(auto name: {"de_DE.UTF-8", "fr_FR.UTF-8", "C"}) {
+        if(setlocale(LC_NUMERIC, name))
+            break;
+    }
+
+    GeoJsonParser parser;
+    FeatureCollection features;
+    bool parsed = parser.Parse(json, strlen(json), features);
+    setlocale(LC_NUMERIC, previous.c_str());
+    CHECK(parsed);
+    CHECK_EQUAL(1U, features.longitudes.size());
+    CHECK_NEAR(-4.31123456789012345678, features.longitudes[0], 1e-12);
+    CHECK_NEAR(5.5e-30, features.latitudes[0], 1e-40);
+}
+
+TEST(tilesTest)
+{
+    // The feature, coordinate, part, property and OSM id counts of each tile
+    struct Tile {
+        const char *name;
+        size_t features, coordinates, parts, properties, osm_ids;
+    };
+    const Tile tiles[] = {
+        {"entrances.geojson", 407, 1952, 422, 1477, 508},
+        {"intersection_cross1.geojson", 573, 4760, 620, 2494, 669},
+        {"intersection_loop_back.geojson", 887, 4306, 891, 1629, 1215},
+        {"intersection_t2.geojson", 278, 3096, 323, 580, 341},
+        {"real.geojson", 149, 2461, 194, 749, 159},
+    };
+
+    GeoJsonParser parser;
+    FeatureCollection features;
+    for(auto &tile: tiles) {
+        auto json = ReadTile(tile.name);
+        CHECK(!json.empty());
+        features.Clear();
+        CHECK(parser.Parse(json, features));
+        CHECK_EQUAL(tile.features, features.features.size());
+        CHECK_EQUAL(tile.coordinates, features.longitudes.size());
+        CHECK_EQUAL(tile.parts, features.parts.size());
+        CHECK_EQUAL(tile.properties, features.properties.size());
+        CHECK_EQUAL(tile.osm_ids, features.osm_ids.size());
+    }
+
+    // The first feature of real.geojson is a university split across seven sites
+    auto &university = features.features[0];
+    CHECK(features.GetString(university.feature_type) == "amenity");
+    CHECK(features.GetString(university.feature_value) == "university");
+    CHECK(features.GetProperty(university, "name") == "University of Law");
+    CHECK(university.geometry == GeometryType::MultiPolygon);
+    CHECK_EQUAL(7U, university.part_count);
+    CHECK_EQUAL(6U, features.parts[university.first_part + 6].polygon);
+    CHECK_EQUAL(34U, features.parts[university.first_part + 6].coordinate_count);
+    CHECK_NEAR(-2.239529, features.longitudes[0], 1e-12);
+    CHECK_NEAR(53.480343, features.latitudes[0], 1e-12);
+    CHECK_EQUAL(int64_t(-100000000016193528), features.osm_ids[university.first_osm_id]);
+}
+
+TEST(categoriesTest)
+{
+    CHECK(GetFeatureCategory("highway", "gd_intersection") == FeatureCategory::Intersection);
+    CHECK(GetFeatureCategory("highway", "footway") == FeatureCategory::Path);
+    CHECK(GetFeatureCategory("highway", "bridleway") == FeatureCategory::Path);
+    CHECK(GetFeatureCategory("highway", "bus_stop") == FeatureCategory::BusStop);
+    CHECK(GetFeatureCategory("highway", "crossing") == FeatureCategory::Crossing);
+    CHECK(GetFeatureCategory("highway", "primary") == FeatureCategory::Road);
+    CHECK(GetFeatureCategory("gd_entrance_list", "") == FeatureCategory::Entrance);
+    CHECK(GetFeatureCategory("amenity", "footway") == FeatureCategory::Poi);
+    CHECK(GetFeatureCategory("", "") == FeatureCategory::Poi);
+
+    // Each feature is categorized as it's parsed
+    GeoJsonParser parser;
+    FeatureCollection features;
+    CHECK(parser.Parse(ReadTile("entrances.geojson"), features));
+    size_t counts[size_t(FeatureCategory::Count)] = {};
+    for(const auto &feature: features.features) {
+        CHECK(feature.category == GetFeatureCategory(features.GetString(feature.feature_type),
+                                                     features.GetString(feature.feature_value)));
+        ++counts[size_t(feature.category)];
+    }
+    CHECK_EQUAL(225U, counts[size_t(FeatureCategory::Poi)]);
+    CHECK_EQUAL(39U, counts[size_t(FeatureCategory::Road)]);
+    CHECK_EQUAL(54U, counts[size_t(FeatureCategory::Path)]);
+    CHECK_EQUAL(81U, counts[size_t(FeatureCategory::Intersection)]);
+    CHECK_EQUAL(1U, counts[size_t(FeatureCategory::Entrance)]);
+    CHECK_EQUAL(7U, counts[size_t(FeatureCategory::Crossing)]);
+}
+
+TEST_MAIN()
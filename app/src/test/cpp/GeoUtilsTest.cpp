@@ -0,0 +1,150 @@
+#include "TestHarness.h"
+#include "GeoUtils.h"
+
+TEST(localFrameOriginTest)
+{
+    LocalFrame frame;
+    CHECK(!frame.IsValid());
+    frame.SetOrigin(55.9473, -4.3112);
+    CHECK(frame.IsValid());
+
+    double east, north;
+    frame.ToLocal(55.9473, -4.3112, east, north);
+    CHECK_NEAR(0.0, east, 1e-6);
+    CHECK_NEAR(0.0, north, 1e-6);
+}
+
+TEST(localFrameDirectionsTest)
+{
+    const double origin_latitude = 55.9473;
+    const double origin_longitude = -4.3112;
+    LocalFrame frame;
+    frame.SetOrigin(origin_latitude, origin_longitude);
+
+    // Points 100m away on each of the compass points
+    const double expected[4][2] = {{0.0, 100.0}, {100.0, 0.0}, {0.0, -100.0}, {-100.0, 0.0}};
+    for(int i = 0; i < 4; ++i) {
+        double latitude, longitude;
+        getDestinationCoordinate(origin_latitude, origin_longitude, i * 90.0, 100.0,
+                                 latitude, longitude);
+        double east, north;
+        frame.ToLocal(latitude, longitude, east, north);
+        CHECK_NEAR(expected[i][0], east, 0.01);
+        CHECK_NEAR(expected[i][1], north, 0.01);
+    }
+}
+
+TEST(localFrameDistanceTest)
+{
+    // Distances in the local frame should match the haversine distance over the range that we
+    // keep beacons in the frame for.
+    const double origin_latitude = -33.8568;
+    const double origin_longitude = 151.2153;
+    LocalFrame frame;
+    frame.SetOrigin(origin_latitude, origin_longitude);
+
+    for(double bearing = 0.0; bearing < 360.0; bearing += 15.0) {
+        for(double range: {1.0, 50.0, 500.0, 5000.0}) {
+            double latitude, longitude;
+            getDestinationCoordinate(origin_latitude, origin_longitude, bearing, range,
+                                     latitude, longitude);
+            double east, north;
+            frame.ToLocal(latitude, longitude, east, north);
+            auto local_distance = sqrt((east * east) + (north * north));
+            CHECK_NEAR(distance(origin_latitude, origin_longitude, latitude, longitude),
+                       local_distance, range * 1e-5);
+        }
+    }
+}
+
+TEST(localFramePrecisionTest)
+{
+    // At longitudes near 180 degrees a float can't resolve much less than a metre, but positions
+    // relative to a nearby origin can still be resolved to well under a centimetre.
+    LocalFrame frame;
+    frame.SetOrigin(-16.5, 179.9);
+
+    double latitude, longitude;
+    getDestinationCoordinate(-16.5, 179.9, 90.0, 300.0, latitude, longitude);
+    double east1, north1;
+    frame.ToLocal(latitude, longitude, east1, north1);
+
+    double latitude2, longitude2;
+    getDestinationCoordinate(latitude, longitude, 90.0, 0.01, latitude2, longitude2);
+    double east2, north2;
+    frame.ToLocal(latitude2, longitude2, east2, north2);
+
+    CHECK_NEAR(0.01, static_cast<float>(east2) - static_cast<float>(east1), 0.001);
+}
+
+TEST(wrapDegreesTest)
+{
+    static_assert(geo::wrapDegrees(190.0) == -170.0);
+    static_assert(geo::wrapDegrees(-190.0f) == 170.0f);
+    static_assert(geo::wrapDegrees(540.0) == 180.0);
+    static_assert(geo::toRadians(180.0) == M_PI);
+    CHECK_NEAR(45.0, geo::wrapDegrees(45.0), 0.0);
+}
+
+TEST(bearingFromTwoPointsTest)
+{
+    // The bearing is from the first point to the second, in the range 0 to 360 and not truncated
+    double latitude, longitude;
+    getDestinationCoordinate(55.9473, -4.3112, 45.5, 100.0, latitude, longitude);
+    CHECK_NEAR(45.5, bearingFromTwoPoints(55.9473, -4.3112, latitude, longitude), 0.001);
+
+    getDestinationCoordinate(55.9473, -4.3112, 270.25, 100.0, latitude, longitude);
+    CHECK_NEAR(270.25, bearingFromTwoPoints(55.9473, -4.3112, latitude, longitude), 0.001);
+}
+
+TEST(ellipsoidalKnownValueTest)
+{
+    // Flinders Peak to Buninyong, the worked example from Vincenty's paper
+    const double lat1 = -(37.0 + 57.0 / 60.0 + 3.72030 / 3600.0);
+    const double lon1 = 144.0 + 25.0 / 60.0 + 29.52440 / 3600.0;
+    const double lat2 = -(37.0 + 39.0 / 60.0 + 10.15610 / 3600.0);
+    const double lon2 = 143.0 + 55.0 / 60.0 + 35.38390 / 3600.0;
+
+    CHECK_NEAR(54972.271, geo::distance<geo::Ellipsoidal>(lat1, lon1, lat2, lon2), 0.001);
+    const double azimuth = 306.0 + 52.0 / 60.0 + 5.37 / 3600.0;
+    CHECK_NEAR(azimuth - 360.0, geo::bearing<geo::Ellipsoidal>(lat1, lon1, lat2, lon2), 1e-5);
+
+    CHECK_EQUAL(0.0, geo::distance<geo::Ellipsoidal>(lat1, lon1, lat1, lon1));
+}
+
+template<typename Formula, typename T>
+static void CheckPolicy(double lat1, double lon1, double bearing, double range,
+                        double distance_tolerance, double bearing_tolerance)
+{
+    double lat2, lon2;
+    getDestinationCoordinate(lat1, lon1, bearing, range, lat2, lon2);
+    auto expected_distance = geo::distance<geo::Ellipsoidal>(lat1, lon1, lat2, lon2);
+    auto expected_bearing = geo::bearing<geo::Ellipsoidal>(lat1, lon1, lat2, lon2);
+
+    auto d = geo::distance<Formula>(static_cast<T>(lat1), static_cast<T>(lon1),
+                                    static_cast<T>(lat2), static_cast<T>(lon2));
+    auto b = geo::bearing<Formula>(static_cast<T>(lat1), static_cast<T>(lon1),
+                                   static_cast<T>(lat2), static_cast<T>(lon2));
+    CHECK_NEAR(expected_distance, d, distance_tolerance);
+    CHECK_NEAR(0.0, geo::wrapDegrees(b - expected_bearing), bearing_tolerance);
+}
+
+TEST(policyAccuracyTest)
+{
+    // The spherical formulas use the equatorial radius and so differ from the ellipsoid by up to
+    // 0.7%. A float coordinate has around a metre of error on top of that.
+    const double SPHERE_ERROR = 0.007;
+    for(double bearing = 0.0; bearing < 360.0; bearing += 30.0) {
+        for(double range: {10.0, 500.0, 5000.0}) {
+            CheckPolicy<geo::Equirectangular, double>(55.9473, -4.3112, bearing, range, range * SPHERE_ERROR, 0.25);
+            CheckPolicy<geo::Haversine, double>(55.9473, -4.3112, bearing, range, range * SPHERE_ERROR, 0.2);
+            CheckPolicy<geo::Haversine, float>(55.9473, -4.3112, bearing, range, range * SPHERE_ERROR + 2.0, 10.0);
+            CheckPolicy<geo::Ellipsoidal, float>(-33.8568, 151.2153, bearing, range, 3.0, 10.0);
+        }
+        // Across the antimeridian
+        CheckPolicy<geo::Equirectangular, double>(-16.5, 179.999, bearing, 1000.0, 1000.0 * SPHERE_ERROR, 0.25);
+        CheckPolicy<geo::Haversine, double>(-16.5, 179.999, bearing, 1000.0, 1000.0 * SPHERE_ERROR, 0.2);
+    }
+}
+
+TEST_MAIN()
@@ -0,0 +1,232 @@
+//
+// Renders fixed scenarios on the offline backend and compares them against the golden renders in
+// the golden directory, see AudioComparison.h for the tolerances. After an intentional change to
+// what's heard, regenerate the golden renders by running the test with SOUNDSCAPE_UPDATE_GOLDEN
+// set in the environment, and listen to them before checking them in.
+//
+#include <cstdlib>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <vector>
+
+#include "TestHarness.h"
+#include "AudioBeacon.h"
+#include "AudioComparison.h"
+#include "AudioEngine.h"
+#include "OfflineAudioBackend.h"
+#include "WavFile.h"
+
+using namespace soundscape;
+using namespace soundscape::test;
+
+#ifndef SOUNDSCAPE_GOLDEN_DIRECTORY
+#define SOUNDSCAPE_GOLDEN_DIRECTORY "golden"
+#endif
+
+const double LISTENER_LATITUDE = 55.9473;
+const double LISTENER_LONGITUDE = -4.3112;
+// The interval between geometry updates, as from the app
+const double TICK_SECONDS = 0.05;
+
+class GoldenRender {
+public:
+    GoldenRender()
+    {
+        auto backend = std::make_unique<OfflineAudioBackend>();
+        m_pBackend = backend.get();
+        m_pEngine = std::make_unique<AudioEngine>(std::move(backend));
+        m_Render.sample_rate = m_pBackend->GetSampleRate();
+        m_Render.channels = OfflineAudioBackend::CHANNELS;
+    }
+
+    // Update the geometry every tick with the heading from the function and render the audio
+    template<typename HeadingFunction>
+    void Run(double seconds, HeadingFunction heading)
+    {
+        auto ticks = static_cast<int>(lround(seconds / TICK_SECONDS));
+        auto frames = static_cast<size_t>(lround(TICK_SECONDS * m_Render.sample_rate));
+        for(int tick = 0; tick < ticks; ++tick) {
+            m_pEngine->UpdateGeometry(LISTENER_LATITUDE, LISTENER_LONGITUDE, heading(tick * TICK_SECONDS));
+
+            auto offset = m_Render.samples.size();
+            m_Render.samples.resize(offset + frames * OfflineAudioBackend::CHANNELS);
+            m_pBackend->Render(m_Render.samples.data() + offset, frames);
+        }
+    }
+
+    AudioEngine &GetEngine() { return *m_pEngine; }
+    const WavData &GetRender() const { return m_Render; }
+
+private:
+    OfflineAudioBackend *m_pBackend;
+    std::unique_ptr<AudioEngine> m_pEngine;
+    WavData m_Render;
+};
+
+static void Destination(double bearing, double range, double &latitude, double &longitude)
+{
+    getDestinationCoordinate(LISTENER_LATITUDE, LISTENER_LONGITUDE, bearing, range,
+                             latitude, longitude);
+}
+
+static void CheckGolden(const std::string &name, const WavData &render)
+{
+    auto path = std::string(SOUNDSCAPE_GOLDEN_DIRECTORY) + "/" + name + ".wav";
+    if(getenv("SOUNDSCAPE_UPDATE_GOLDEN")) {
+        printf("Updating %s\n", path.c_str());
+        CHECK(WriteWavFile(path, render));
+        return;
+    }
+
+    WavData golden;
+    CHECK(ReadWavFile(path, golden));
+    auto comparison = CompareAudio(golden, render);
+    if(!comparison.passed)
+        printf("%s: %s\n", name.c_str(), comparison.message.c_str());
+    CHECK(comparison.passed);
+}
+
+// Queue a callout, with a tone at the frequency standing in for the speech
+static void QueueCallout(AudioEngine &engine, double bearing, double frequency, double seconds)
+{
+    int sockets[2];
+    CHECK_EQUAL(0, socketpair(AF_UNIX, SOCK_STREAM, 0, sockets));
+
+    std::vector<int16_t> speech(static_cast<size_t>(seconds * 22050));
+    for(size_t i = 0; i < speech.size(); ++i)
+        speech[i] = static_cast<int16_t>(8000.0 * sin(2.0 * M_PI * frequency * i / 22050.0));
+    auto bytes = static_cast<ssize_t>(speech.size() * sizeof(int16_t));
+    CHECK_EQUAL(bytes, write(sockets[1], speech.data(), bytes));
+    close(sockets[1]);
+
+    double latitude, longitude;
+    Destination(bearing, 5.0, latitude, longitude);
+    new TextToSpeech(&engine, latitude, longitude, sockets[0]);
+    close(sockets[0]);
+}
+
+// Setting a beacon type that doesn't exist leaves the type unchanged
+static int GetBeaconStyleCount()
+{
+    AudioEngine engine(std::make_unique<OfflineAudioBackend>());
+    const BeaconDescriptor *last_descriptor = nullptr;
+    int count = 0;
+    for(;; ++count) {
+        engine.SetBeaconType(count);
+        if(engine.GetBeaconDescriptor() == last_descriptor)
+            return count;
+        last_descriptor = engine.GetBeaconDescriptor();
+    }
+}
+
+// The name of a beacon style's golden render comes from the directory that its assets are in
+static std::string GetBeaconStyleName(const AudioEngine &engine)
+{
+    const std::string ASSET_PREFIX = "file:///android_asset/";
+    auto name = engine.GetBeaconDescriptor()->m_Beacons[0].m_Filename.substr(ASSET_PREFIX.size());
+    name = name.substr(0, name.find('/'));
+    for(auto &c: name) {
+        if(c == ' ')
+            c = '_';
+    }
+    return "beacon_" + name;
+}
+
+TEST(beaconStylesTest)
+{
+    // Each style plays ahead and slightly to the right, so that the render is on both channels
+    // but not balanced between them.
+    auto styles = GetBeaconStyleCount();
+    CHECK(styles > 1);
+    for(int style = 0; style < styles; ++style) {
+        GoldenRender render;
+        render.GetEngine().SetBeaconType(style);
+
+        double latitude, longitude;
+        Destination(10.0, 20.0, latitude, longitude);
+        new Beacon(&render.GetEngine(), latitude, longitude);
+        render.Run(1.5, [](double) { return 0.0; });
+        CheckGolden(GetBeaconStyleName(render.GetEngine()), render.GetRender());
+    }
+}
+
+TEST(beaconSweepTest)
+{
+    // Turning a full circle in four seconds takes the beacon through each of its assets and
+    // around the stereo field
+    GoldenRender render;
+    double latitude, longitude;
+    Destination(0.0, 20.0, latitude, longitude);
+    new Beacon(&render.GetEngine(), latitude, longitude);
+    render.Run(4.0, [](double seconds) { return seconds * 90.0; });
+    CheckGolden("beacon_sweep", render.GetRender());
+}
+
+TEST(textToSpeechQueueTest)
+{
+    // Two callouts are queued, the second starting after the first has finished, over a beacon
+    GoldenRender render;
+    auto &engine = render.GetEngine();
+    double latitude, longitude;
+    Destination(180.0, 50.0, latitude, longitude);
+    new Beacon(&engine, latitude, longitude);
+    QueueCallout(engine, 270.0, 440.0, 0.4);
+    QueueCallout(engine, 90.0, 660.0, 0.4);
+    render.Run(1.5, [](double) { return 0.0; });
+    CheckGolden("tts_queue", render.GetRender());
+
+    // Both callouts finished and were removed
+    size_t finished = 0;
+    Event event{};
+    while(engine.DrainEvents(&event, 1)) {
+        if(event.type == EventType::SourceFinished)
+            ++finished;
+    }
+    CHECK_EQUAL(2U, finished);
+}
+
+TEST(comparisonDetectsChangesTest)
+{
+    WavData golden;
+    CHECK(ReadWavFile(SOUNDSCAPE_GOLDEN_DIRECTORY "/beacon_sweep.wav", golden));
+    CHECK(CompareAudio(golden, golden).passed);
+
+    // Dither sized changes pass
+    auto changed = golden;
+    for(size_t i = 0; i < changed.samples.size(); ++i)
+        changed.samples[i] = static_cast<int16_t>(changed.samples[i] + ((i & 1) ? 1 : -1));
+    CHECK(CompareAudio(golden, changed).passed);
+
+    // A change in level of 2dB fails on the RMS
+    changed = golden;
+    for(auto &sample: changed.samples)
+        sample = static_cast<int16_t>(lrint(sample * 0.794));
+    auto comparison = CompareAudio(golden, changed);
+    CHECK(!comparison.passed);
+    CHECK_NEAR(2.0, comparison.max_rms_difference_db, 0.1);
+
+    // Swapping the channels fails
+    changed = golden;
+    for(size_t i = 0; i < changed.samples.size(); i += 2)
+        std::swap(changed.samples[i], changed.samples[i + 1]);
+    CHECK(!CompareAudio(golden, changed).passed);
+
+    // Negating every other frame mirrors the spectrum around a quarter of the sample rate, which
+    // keeps the level the same but fails on the spectrum
+    changed = golden;
+    for(size_t i = 0; i < changed.samples.size(); ++i) {
+        if((i / 2) & 1)
+            changed.samples[i] = static_cast<int16_t>(std::max(-32767, -golden.samples[i]));
+    }
+    comparison = CompareAudio(golden, changed);
+    CHECK(!comparison.passed);
+    CHECK(comparison.max_rms_difference_db < 0.01);
+    CHECK(comparison.max_band_difference_db > AudioTolerances().band_db);
+
+    // And so does a different length
+    changed = golden;
+    changed.samples.resize(changed.samples.size() - 2);
+    CHECK(!CompareAudio(golden, changed).passed);
+}
+
+TEST_MAIN()
@@ -0,0 +1,140 @@
+#include "TestHarness.h"
+#include "GeoUtils.h"
+#include "GpxFile.h"
+
+using namespace soundscape;
+
+#ifndef SOUNDSCAPE_ASSET_DIRECTORY
+#define SOUNDSCAPE_ASSET_DIRECTORY "assets"
+#endif
+
+const char *TRACK_GPX = R"(<?xml version="1.0" encoding="UTF-8"?>
+<gpx version="1.1" creator="test">
+  <!-- <trkpt lat="1" lon="1"></trkpt> is commented out -->
+  <wpt lat='55.9473' lon='-4.3112'/>
+  <trk>
+    <name>Walk</name>
+    <trkseg>
+      <trkpt lat="55.9473" lon="-4.3112">
+        <time>2024-05-15T16:03:07.5Z</time>
+        <name>Fish &amp; Chips</name>
+      </trkpt>
+      <trkpt
+          lat="55.9482" lon="-4.3112">
+        <time>2024-05-15T17:04:07.5+01:00</time>
+      </trkpt>
+    </trkseg>
+    <trkseg>
+      <trkpt lat="55.9482" lon="-4.3100"><time>2024-05-15T16:05:07.5Z</time></trkpt>
+    </trkseg>
+  </trk>
+</gpx>
+)";
+
+TEST(readTestGpxTest)
+{
+    GpxData gpx;
+    CHECK(ReadGpxFile(SOUNDSCAPE_ASSET_DIRECTORY "/Test.gpx", gpx));
+    CHECK(gpx.name == "Test");
+    CHECK(gpx.waypoints.empty());
+    CHECK(gpx.track.empty());
+    CHECK_EQUAL(5U, gpx.route.size());
+
+    CHECK(gpx.route[0].name == "George Square, Glasgow");
+    CHECK_NEAR(55.8610697, gpx.route[0].latitude, 1e-9);
+    CHECK_NEAR(-4.2499327, gpx.route[0].longitude, 1e-9);
+    CHECK(gpx.route[4].name == "Inverness");
+    CHECK(!gpx.route[4].has_time);
+
+    CHECK(!ReadGpxFile(SOUNDSCAPE_ASSET_DIRECTORY "/Missing.gpx", gpx));
+}
+
+TEST(parseTrackTest)
+{
+    GpxData gpx;
+    CHECK(ParseGpx(TRACK_GPX, gpx));
+    CHECK_EQUAL(1U, gpx.waypoints.size());
+    CHECK_NEAR(-4.3112, gpx.waypoints[0].longitude, 1e-9);
+    CHECK(gpx.route.empty());
+
+    // Both track segments are joined, and the track name isn't taken for a point name
+    CHECK_EQUAL(3U, gpx.track.size());
+    CHECK(gpx.track[0].name == "Fish & Chips");
+    CHECK(gpx.track[1].name.empty());
+
+    // 2024-05-15T16:03:07.5Z, with the offset time a minute later
+    CHECK(gpx.track[0].has_time);
+    CHECK_NEAR(1715788987.5, gpx.track[0].time, 1e-3);
+    CHECK_NEAR(60.0, gpx.track[1].time - gpx.track[0].time, 1e-3);
+    CHECK_NEAR(120.0, gpx.track[2].time - gpx.track[0].time, 1e-3);
+}
+
+TEST(parseErrorsTest)
+{
+    GpxData gpx;
+    CHECK(ParseGpx("", gpx));
+    CHECK(!ParseGpx("<gpx><rtept lat=\"55.0\"></rtept></gpx>", gpx));
+    CHECK(!ParseGpx("<gpx><rtept lat=\"55.0\" lon=\"x\"></rtept></gpx>", gpx));
+    CHECK(!ParseGpx("<gpx><rtept lat=\"55.0\" lon=\"-4.0\"><name>", gpx));
+    CHECK(!ParseGpx("<gpx><rtept lat=\"55.0\" lon=\"-4.0\"", gpx));
+
+    // A time that can't be parsed leaves the point untimed
+    CHECK(ParseGpx("<rtept lat=\"55.0\" lon=\"-4.0\"><time>soon</time></rtept>", gpx));
+    CHECK_EQUAL(1U, gpx.route.size());
+    CHECK(!gpx.route[0].has_time);
+}
+
+TEST(timedTimelineTest)
+{
+    GpxData gpx;
+    CHECK(ParseGpx(TRACK_GPX, gpx));
+    GpxTimeline timeline(gpx.track, 1.0);
+    CHECK(timeline.HasTimes());
+    CHECK_NEAR(120.0, timeline.GetDuration(), 1e-3);
+
+    // Half way along the first leg, which is 100m due north
+    double latitude, longitude, course;
+    timeline.GetPosition(30.0, latitude, longitude, course);
+    CHECK_EQUAL(0U, timeline.GetLeg(30.0));
+    CHECK_NEAR(55.94775, latitude, 1e-9);
+    CHECK_NEAR(-4.3112, longitude, 1e-9);
+    CHECK_NEAR(0.0, course, 0.01);
+
+    // The second leg heads east, and positions past the end stay at the last point
+    CHECK_EQUAL(1U, timeline.GetLeg(90.0));
+    timeline.GetPosition(90.0, latitude, longitude, course);
+    CHECK_NEAR(90.0, course, 0.1);
+    CHECK_EQUAL(1U, timeline.GetLeg(1000.0));
+    timeline.GetPosition(1000.0, latitude, longitude, course);
+    CHECK_NEAR(55.9482, latitude, 1e-9);
+    CHECK_NEAR(-4.3100, longitude, 1e-9);
+    CHECK_NEAR(90.0, course, 0.1);
+}
+
+TEST(untimedTimelineTest)
+{
+    GpxData gpx;
+    CHECK(ReadGpxFile(SOUNDSCAPE_ASSET_DIRECTORY "/Test.gpx", gpx));
+
+    // Route points are spaced out by their distances at the speed
+    GpxTimeline timeline(gpx.route, 10.0);
+    CHECK(!timeline.HasTimes());
+    auto first_leg = distance(gpx.route[0].latitude, gpx.route[0].longitude,
+                              gpx.route[1].latitude, gpx.route[1].longitude);
+    CHECK_EQUAL(0U, timeline.GetLeg(first_leg / 10.0 - 1.0));
+    CHECK_EQUAL(1U, timeline.GetLeg(first_leg / 10.0 + 1.0));
+
+    double latitude, longitude, course;
+    timeline.GetPosition(0.0, latitude, longitude, course);
+    CHECK_NEAR(gpx.route[0].latitude, latitude, 1e-9);
+    CHECK_NEAR(bearingFromTwoPoints(gpx.route[0].latitude, gpx.route[0].longitude,
+                                    gpx.route[1].latitude, gpx.route[1].longitude), course, 1e-6);
+
+    // An empty path stays at 0,0
+    GpxTimeline empty({}, 1.0);
+    CHECK_EQUAL(0.0, empty.GetDuration());
+    empty.GetPosition(10.0, latitude, longitude, course);
+    CHECK_EQUAL(0.0, latitude);
+}
+
+TEST_MAIN()
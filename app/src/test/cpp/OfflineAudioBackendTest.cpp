@@ -0,0 +1,222 @@
+#include <cstdio>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <vector>
+
+#include "TestHarness.h"
+#include "AudioBeacon.h"
+#include "AudioEngine.h"
+#include "OfflineAudioBackend.h"
+#include "WavFile.h"
+
+using namespace soundscape;
+
+const double LISTENER_LATITUDE = 55.9473;
+const double LISTENER_LONGITUDE = -4.3112;
+
+// Runs an engine on the offline backend and renders its output
+class OfflineEngine {
+public:
+    OfflineEngine()
+    {
+        auto backend = std::make_unique<OfflineAudioBackend>();
+        m_pBackend = backend.get();
+        m_pEngine = std::make_unique<AudioEngine>(std::move(backend));
+    }
+
+    // Renders the audio and returns the RMS level of the left and right channels
+    void Render(double seconds, double &left, double &right)
+    {
+        auto frames = static_cast<size_t>(seconds * m_pBackend->GetSampleRate());
+        std::vector<int16_t> output(frames * OfflineAudioBackend::CHANNELS);
+        m_pBackend->Render(output.data(), frames);
+
+        double left_sum = 0.0, right_sum = 0.0;
+        for(size_t frame = 0; frame < frames; ++frame) {
+            left_sum += static_cast<double>(output[frame * 2]) * output[frame * 2];
+            right_sum += static_cast<double>(output[frame * 2 + 1]) * output[frame * 2 + 1];
+        }
+        left = sqrt(left_sum / frames);
+        right = sqrt(right_sum / frames);
+    }
+
+    AudioEngine &GetEngine() { return *m_pEngine; }
+    OfflineAudioBackend &GetBackend() { return *m_pBackend; }
+
+private:
+    OfflineAudioBackend *m_pBackend;
+    std::unique_ptr<AudioEngine> m_pEngine;
+};
+
+static void Destination(double bearing, double range, double &latitude, double &longitude)
+{
+    getDestinationCoordinate(LISTENER_LATITUDE, LISTENER_LONGITUDE, bearing, range,
+                             latitude, longitude);
+}
+
+TEST(wavRoundTripTest)
+{
+    WavData wav;
+    wav.sample_rate = 22050;
+    wav.channels = 2;
+    for(int i = 0; i < 1000; ++i)
+        wav.samples.push_back(static_cast<int16_t>(i * 31 - 15000));
+
+    auto path = std::string(P_tmpdir) + "/OfflineAudioBackendTest.wav";
+    CHECK(WriteWavFile(path, wav));
+
+    WavData read;
+    CHECK(ReadWavFile(path, read));
+    CHECK_EQUAL(22050, read.sample_rate);
+    CHECK_EQUAL(2, read.channels);
+    CHECK(read.samples == wav.samples);
+    remove(path.c_str());
+
+    CHECK(!ReadWavFile(path, read));
+}
+
+TEST(beaconAssetsLoadedTest)
+{
+    OfflineEngine offline;
+    auto &engine = offline.GetEngine();
+    engine.SetBeaconType(0);
+
+    double latitude, longitude;
+    Destination(0.0, 50.0, latitude, longitude);
+    auto beacon = new Beacon(&engine, latitude, longitude);
+    CHECK_EQUAL(1U, offline.GetBackend().GetPlayingCount());
+
+    // The Classic beacon has two assets of 103764 bytes each
+    Event events[4];
+    CHECK_EQUAL(2U, engine.DrainEvents(events, 4));
+    for(size_t i = 0; i < 2; ++i) {
+        CHECK(events[i].type == EventType::AssetLoaded);
+        CHECK_EQUAL(beacon->GetHandle(), events[i].handle);
+        CHECK_EQUAL(103764, events[i].value);
+    }
+
+    CHECK(engine.DestroyAudio(beacon->GetHandle()));
+    CHECK_EQUAL(0U, offline.GetBackend().GetPlayingCount());
+}
+
+TEST(beaconPanningTest)
+{
+    OfflineEngine offline;
+    auto &engine = offline.GetEngine();
+
+    // A beacon to the east is on the right when facing north and on the left facing south
+    double latitude, longitude;
+    Destination(90.0, 20.0, latitude, longitude);
+    new Beacon(&engine, latitude, longitude);
+
+    double left, right;
+    engine.UpdateGeometry(LISTENER_LATITUDE, LISTENER_LONGITUDE, 0.0);
+    offline.Render(1.0, left, right);
+    CHECK(right > 0.0);
+    CHECK(right > left * 10.0);
+
+    engine.UpdateGeometry(LISTENER_LATITUDE, LISTENER_LONGITUDE, 180.0);
+    offline.Render(1.0, left, right);
+    CHECK(left > right * 10.0);
+
+    // Facing the beacon it's in the middle
+    engine.UpdateGeometry(LISTENER_LATITUDE, LISTENER_LONGITUDE, 90.0);
+    offline.Render(1.0, left, right);
+    CHECK_NEAR(1.0, left / right, 0.01);
+    CHECK(offline.GetBackend().GetUpdateCount() == 3);
+}
+
+TEST(beaconRolloffTest)
+{
+    OfflineEngine offline;
+    auto &engine = offline.GetEngine();
+
+    // Both beacons play the same audio, so the difference in level is only from the rolloff.
+    // Facing them with one to either side keeps the panning the same too.
+    double latitude, longitude;
+    Destination(90.0, 20.0, latitude, longitude);
+    auto near_beacon = new Beacon(&engine, latitude, longitude);
+    Destination(270.0, 200.0, latitude, longitude);
+    new Beacon(&engine, latitude, longitude);
+
+    double left, right;
+    engine.UpdateGeometry(LISTENER_LATITUDE, LISTENER_LONGITUDE, 0.0);
+    offline.Render(1.0, left, right);
+    CHECK_NEAR(10.0, right / left, 0.5);
+
+    // Moving the near beacon to the same distance balances them
+    Destination(90.0, 200.0, latitude, longitude);
+    near_beacon->SetLocation(latitude, longitude);
+    offline.Render(1.0, left, right);
+    CHECK_NEAR(1.0, right / left, 0.05);
+}
+
+TEST(textToSpeechEofTest)
+{
+    OfflineEngine offline;
+    auto &engine = offline.GetEngine();
+
+    int sockets[2];
+    CHECK_EQUAL(0, socketpair(AF_UNIX, SOCK_STREAM, 0, sockets));
+
+    // A quarter of a second of a square wave and then the end of the speech
+    std::vector<int16_t> speech(22050 / 4);
+    for(size_t i = 0; i < speech.size(); ++i)
+        speech[i] = ((i / 50) & 1) ? 8000 : -8000;
+    CHECK_EQUAL(static_cast<ssize_t>(speech.size() * sizeof(int16_t)),
+                write(sockets[1], speech.data(), speech.size() * sizeof(int16_t)));
+    close(sockets[1]);
+
+    double latitude, longitude;
+    Destination(0.0, 5.0, latitude, longitude);
+    auto tts = new TextToSpeech(&engine, latitude, longitude, sockets[0]);
+    auto tts_handle = tts->GetHandle();
+    close(sockets[0]);
+
+    double left, right;
+    offline.Render(0.25, left, right);
+    CHECK(left > 1000.0);
+    CHECK_NEAR(left, right, 1.0);
+
+    // The EOF is found on the next read, and the next geometry update removes the finished audio
+    offline.Render(0.25, left, right);
+    engine.UpdateGeometry(LISTENER_LATITUDE, LISTENER_LONGITUDE, 0.0);
+    CHECK_EQUAL(0U, offline.GetBackend().GetPlayingCount());
+
+    bool finished = false;
+    Event event{};
+    while(engine.DrainEvents(&event, 1)) {
+        if((event.type == EventType::SourceFinished) &&
+           (event.handle == tts_handle))
+            finished = true;
+    }
+    CHECK(finished);
+}
+
+TEST(listenerVelocityTest)
+{
+    OfflineEngine offline;
+    auto &engine = offline.GetEngine();
+    const uint64_t SECOND = 1000000000;
+
+    // The velocity is worked out from the time between the poses, 10m north in 2 seconds
+    double latitude, longitude;
+    Destination(0.0, 10.0, latitude, longitude);
+    engine.UpdateGeometry(LISTENER_LATITUDE, LISTENER_LONGITUDE, 0.0, 5 * SECOND);
+    CHECK_NEAR(0.0, offline.GetBackend().GetListenerVelocity().z, 0.0);
+    engine.UpdateGeometry(latitude, longitude, 0.0, 7 * SECOND);
+    CHECK_NEAR(5.0, offline.GetBackend().GetListenerVelocity().z, 0.01);
+    CHECK_NEAR(0.0, offline.GetBackend().GetListenerVelocity().x, 0.01);
+
+    // Repeats of the same pose keep the velocity rather than dropping it to zero
+    for(int repeat = 0; repeat < 5; ++repeat) {
+        engine.UpdateGeometry(latitude, longitude, 0.0, 0);
+        CHECK_NEAR(5.0, offline.GetBackend().GetListenerVelocity().z, 0.01);
+    }
+
+    // Standing still for a second
+    engine.UpdateGeometry(latitude, longitude, 0.0, 8 * SECOND);
+    CHECK_NEAR(0.0, offline.GetBackend().GetListenerVelocity().z, 0.0);
+}
+
+TEST_MAIN()
@@ -0,0 +1,82 @@
+#include <thread>
+
+#include "TestHarness.h"
+#include "PoseMailbox.h"
+
+using namespace soundscape;
+
+TEST(emptyMailboxTest)
+{
+    PoseMailboxLayout memory{};
+    PoseMailbox mailbox(&memory);
+
+    Pose pose{};
+    CHECK(!mailbox.Read(pose));
+}
+
+TEST(latestPoseWinsTest)
+{
+    PoseMailboxLayout memory{};
+    PoseMailbox writer(&memory);
+    PoseMailbox reader(&memory);
+
+    writer.Write({55.9, -4.3, 10.0, 1000});
+    writer.Write({55.8, -4.2, 20.0, 2000});
+    writer.Write({55.7, -4.1, 30.0, 3000});
+
+    // Only the last of the three poses is read, and only once
+    Pose pose{};
+    CHECK(reader.Read(pose));
+    CHECK_NEAR(55.7, pose.latitude, 0.0);
+    CHECK_NEAR(-4.1, pose.longitude, 0.0);
+    CHECK_NEAR(30.0, pose.heading, 0.0);
+    CHECK_EQUAL(3000, pose.timestamp);
+    CHECK(!reader.Read(pose));
+
+    writer.Write({55.6, -4.0, 40.0, 4000});
+    CHECK(reader.Read(pose));
+    CHECK_EQUAL(4000, pose.timestamp);
+}
+
+TEST(concurrentWriterTest)
+{
+    // Every pose written has all fields derived from the same value, so a torn read would show
+    // up as a mismatch between them.
+    PoseMailboxLayout memory{};
+    PoseMailbox writer(&memory);
+    PoseMailbox reader(&memory);
+
+    const int WRITES = 200000;
+    std::thread writer_thread([&writer]() {
+        for(int i = 1; i <= WRITES; ++i) {
+            auto value = static_cast<double>(i);
+            writer.Write({value / 10000.0, -value / 10000.0, value, i});
+        }
+    });
+
+    int reads = 0;
+    int torn = 0;
+    int64_t last_timestamp = 0;
+    bool backwards = false;
+    while(last_timestamp < WRITES) {
+        Pose pose{};
+        if(reader.Read(pose)) {
+            ++reads;
+            auto value = static_cast<double>(pose.timestamp);
+            if((pose.heading != value) ||
+               (pose.latitude != value / 10000.0) ||
+               (pose.longitude != -value / 10000.0))
+                ++torn;
+            if(pose.timestamp <= last_timestamp)
+                backwards = true;
+            last_timestamp = pose.timestamp;
+        }
+    }
+    writer_thread.join();
+
+    CHECK(reads > 0);
+    CHECK_EQUAL(0, torn);
+    CHECK(!backwards);
+}
+
+TEST_MAIN()
@@ -0,0 +1,128 @@
+#include <cstdlib>
+#include <memory>
+#include <mutex>
+#include <sys/socket.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+#include "TestHarness.h"
+#include "AudioBeacon.h"
+#include "AudioEngine.h"
+#include "OfflineAudioBackend.h"
+#include "RealtimeCheck.h"
+#include "Trace.h"
+
+using namespace soundscape;
+
+const double LISTENER_LATITUDE = 55.9473;
+const double LISTENER_LONGITUDE = -4.3112;
+
+// Called through volatile pointers so that the compiler can't leave out the allocation
+static void *(*volatile s_Malloc)(size_t) = malloc;
+static void (*volatile s_Free)(void *) = free;
+
+static uint64_t GetViolations()
+{
+    return GetRealtimeViolations(RealtimeViolation::Allocation) +
+           GetRealtimeViolations(RealtimeViolation::Lock) +
+           GetRealtimeViolations(RealtimeViolation::Syscall);
+}
+
+TEST(scopeTest)
+{
+    ResetRealtimeViolations();
+
+    // Outside of a scope anything goes
+    auto outside = std::make_unique<int>(1);
+    std::mutex mutex;
+    mutex.lock();
+    mutex.unlock();
+    CHECK_EQUAL(0U, GetViolations());
+
+    int sockets[2];
+    CHECK_EQUAL(0, socketpair(AF_UNIX, SOCK_STREAM, 0, sockets));
+    {
+        REALTIME_SCOPE();
+        CHECK(InRealtimeScope());
+
+        auto block = s_Malloc(16);
+        CHECK(block != nullptr);
+        s_Free(block);
+        CHECK_EQUAL(2U, GetRealtimeViolations(RealtimeViolation::Allocation));
+
+        std::lock_guard<std::mutex> guard(mutex);
+        CHECK_EQUAL(1U, GetRealtimeViolations(RealtimeViolation::Lock));
+
+        char byte = 0;
+        CHECK_EQUAL(1, write(sockets[1], &byte, 1));
+        CHECK_EQUAL(1, read(sockets[0], &byte, 1));
+        CHECK_EQUAL(2U, GetRealtimeViolations(RealtimeViolation::Syscall));
+    }
+    CHECK(!InRealtimeScope());
+    close(sockets[0]);
+    close(sockets[1]);
+    CHECK_EQUAL(2U, GetRealtimeViolations(RealtimeViolation::Syscall));
+
+    ResetRealtimeViolations();
+    CHECK_EQUAL(0U, GetViolations());
+}
+
+TEST(beaconCallbackTest)
+{
+    auto backend = std::make_unique<OfflineAudioBackend>();
+    auto offline = backend.get();
+    AudioEngine engine(std::move(backend));
+
+    double latitude, longitude;
+    getDestinationCoordinate(LISTENER_LATITUDE, LISTENER_LONGITUDE, 45.0, 20.0, latitude, longitude);
+    new Beacon(&engine, latitude, longitude);
+
+    // The beacon callbacks only copy from the loaded assets, including when they switch layer
+    ResetRealtimeViolations();
+    std::vector<int16_t> output(offline->GetSampleRate() * OfflineAudioBackend::CHANNELS);
+    for(double heading = 0.0; heading < 360.0; heading += 45.0) {
+        engine.UpdateGeometry(LISTENER_LATITUDE, LISTENER_LONGITUDE, heading);
+        offline->Render(output.data(), offline->GetSampleRate() / 2);
+    }
+    CHECK(offline->GetStreamReadStats().reads > 0);
+    CHECK_EQUAL(0U, GetViolations());
+}
+
+TEST(textToSpeechCallbackTest)
+{
+    auto backend = std::make_unique<OfflineAudioBackend>();
+    auto offline = backend.get();
+    AudioEngine engine(std::move(backend));
+
+    int sockets[2];
+    CHECK_EQUAL(0, socketpair(AF_UNIX, SOCK_STREAM, 0, sockets));
+    new TextToSpeech(&engine, LISTENER_LATITUDE, LISTENER_LONGITUDE, sockets[0]);
+
+    // The speech is read from its socket in the callback, which is a known violation
+    ResetRealtimeViolations();
+    std::vector<int16_t> output(offline->GetSampleRate() * OfflineAudioBackend::CHANNELS);
+    offline->Render(output.data(), offline->GetSampleRate() / 4);
+    CHECK(GetRealtimeViolations(RealtimeViolation::Syscall) > 0);
+    CHECK_EQUAL(0U, GetRealtimeViolations(RealtimeViolation::Allocation));
+    CHECK_EQUAL(0U, GetRealtimeViolations(RealtimeViolation::Lock));
+
+    close(sockets[0]);
+    close(sockets[1]);
+    ResetRealtimeViolations();
+}
+
+TEST(firstTraceTest)
+{
+    // A thread's first trace takes a ring from the pool without allocating or locking
+    ResetRealtimeViolations();
+    std::thread thread([]() {
+        REALTIME_SCOPE();
+        TRACE("First trace from a real-time thread");
+    });
+    thread.join();
+    CHECK_EQUAL(0U, GetRealtimeViolations(RealtimeViolation::Allocation));
+    CHECK_EQUAL(0U, GetRealtimeViolations(RealtimeViolation::Lock));
+}
+
+TEST_MAIN()
@@ -0,0 +1,249 @@
+#include <cmath>
+#include <string>
+#include <vector>
+
+#include "FeatureStore.h"
+#include "RoadGraph.h"
+#include "TestHarness.h"
+#include "TestTiles.h"
+#include "TileClipper.h"
+#include "soundscape_engine.h"
+
+using namespace soundscape;
+using namespace soundscape::test;
+
+// The direction of a road relative to the heading, as the relative direction polygons in
+// IntersectionsTest.kt number them: 0 is behind, 2 left, 4 ahead and 6 right
+static int GetDirection(double bearing, double heading)
+{
+    auto relative = std::fmod(bearing - heading + 360.0 + 180.0, 360.0);
+    return static_cast<int>(std::lround(relative / 45.0)) % 8;
+}
+
+struct ExpectedRoad {
+    int direction;
+    const char *name;
+};
+
+// Check the roads at the nearest intersection to the location against those found by
+// getIntersectionRoadNamesRelativeDirections in IntersectionsTest.kt
+static void CheckIntersection(const char *name, const TileId &tile, double latitude,
+                              double longitude, double heading,
+                              const std::vector<ExpectedRoad> &expected)
+{
+    auto features = LoadClippedTile(ReadTile(name), tile);
+    FeatureStore store;
+    store.AddTile(tile, features);
+
+    std::vector<TileFeature> nearest;
+    store.FindNearest(latitude, longitude, 1, FeatureCategoryMask(FeatureCategory::Intersection),
+                      nearest, 50.0);
+    CHECK_EQUAL(1u, nearest.size());
+    if(nearest.empty())
+        return;
+    std::vector<IntersectionRoad> roads;
+    CHECK(store.GetIntersectionRoads(tile, nearest[0].feature, roads));
+    CHECK_EQUAL(expected.size(), roads.size());
+
+    for(const auto &road: expected) {
+        auto found = false;
+        for(const auto &leg: roads) {
+            auto road_name = features->GetProperty(features->features[leg.feature], "name");
+            if((road_name == road.name) && (GetDirection(leg.bearing, heading) == road.direction))
+                found = true;
+        }
+        CHECK(found);
+    }
+    for(size_t index = 1; index < roads.size(); ++index)
+        CHECK(roads[index - 1].bearing <= roads[index].bearing);
+}
+
+TEST(crossTest)
+{
+    CheckIntersection("intersection_cross1.geojson", {32291, 21807, 16},
+                      51.456953686378085, -2.61850147329568, 340.0,
+                      {{0, "Grange Road"}, {2, "Manilla Road"}, {4, "Grange Road"}, {6, "Manilla Road"}});
+}
+
+TEST(tJunctionTest)
+{
+    CheckIntersection("intersection_t2.geojson", {32287, 21802, 16},
+                      51.472589063821175, -2.637514213827643, 225.0,
+                      {{0, "Goodeve Road"}, {2, "Seawalls Road"}, {6, "Knoll Hill"}});
+}
+
+// Two tiles side by side on the equator, with a road running east through an intersection in
+// each of them, and a side road at each intersection
+const TileId WEST_TILE = {32768, 32767, 16};
+const TileId EAST_TILE = {32769, 32767, 16};
+const char *TWO_TILE_JSON = R"({"type": "FeatureCollection", "features": [
+    {"type": "Feature", "feature_type": "highway", "feature_value": "primary", "osm_ids": [100],
+     "properties": {"name": "Main Street"},
+     "geometry": {"type": "LineString", "coordinates": [[0.001, 0.002], [0.003, 0.002], [0.008, 0.002], [0.009, 0.002], [0.010, 0.002]]}},
+    {"type": "Feature", "feature_type": "highway", "feature_value": "residential", "osm_ids": [101],
+     "properties": {"name": "West Lane"},
+     "geometry": {"type": "LineString", "coordinates": [[0.003, 0.002], [0.003, 0.004]]}},
+    {"type": "Feature", "feature_type": "highway", "feature_value": "footway", "osm_ids": [102],
+     "geometry": {"type": "LineString", "coordinates": [[0.009, 0.002], [0.009, 0.001]]}},
+    {"type": "Feature", "feature_type": "highway", "feature_value": "gd_intersection", "osm_ids": [200],
+     "geometry": {"type": "Point", "coordinates": [0.003, 0.002]}},
+    {"type": "Feature", "feature_type": "highway", "feature_value": "gd_intersection", "osm_ids": [201],
+     "geometry": {"type": "Point", "coordinates": [0.009, 0.002]}}]})";
+
+TEST(graphTest)
+{
+    auto features = LoadClippedTile(TWO_TILE_JSON, WEST_TILE);
+    auto bounds = tileToBoundingBox(WEST_TILE.x, WEST_TILE.y, WEST_TILE.zoom);
+    RoadGraph graph(*features, bounds);
+
+    // Main Street is split at the intersection and cut off at the tile edge, and West Lane
+    // starts at the intersection
+    CHECK_EQUAL(3u, graph.GetEdges().size());
+    uint32_t intersection = UINT32_MAX;
+    for(uint32_t feature = 0; feature < features->features.size(); ++feature) {
+        if(features->features[feature].category == FeatureCategory::Intersection)
+            intersection = feature;
+    }
+    auto node_index = graph.GetIntersectionNode(intersection);
+    CHECK(node_index != NO_ROAD_NODE);
+    CHECK_EQUAL(NO_ROAD_NODE, graph.GetIntersectionNode(intersection + 1));
+    const auto &node = graph.GetNodes()[node_index];
+    CHECK(node.type == RoadNodeType::Intersection);
+    CHECK_EQUAL(3u, node.leg_count);
+
+    // North up West Lane, east along Main Street to the tile edge and west to its end
+    const double bearings[] = {0.0, 90.0, 270.0};
+    const RoadNodeType ends[] = {RoadNodeType::End, RoadNodeType::Border, RoadNodeType::End};
+    const double lengths[] = {0.002, bounds.eastLongitude - 0.003, 0.002};
+    for(uint32_t leg_index = 0; leg_index < node.leg_count; ++leg_index) {
+        const auto &leg = graph.GetLegs()[node.first_leg + leg_index];
+        const auto &end = graph.GetNodes()[leg.node];
+        CHECK_NEAR(bearings[leg_index], leg.bearing, 0.01);
+        CHECK(end.type == ends[leg_index]);
+        CHECK_NEAR(lengths[leg_index] * EARTH_RADIUS_METERS * DEGREES_TO_RADIANS,
+                   graph.GetEdges()[leg.edge].length, 0.1);
+    }
+
+    // The border node is exactly on the tile edge, and can be found by the road's OSM id
+    auto border = graph.FindBorderNode(100, 0.002, bounds.eastLongitude, 0.5);
+    CHECK(border != NO_ROAD_NODE);
+    CHECK_EQUAL(bounds.eastLongitude, graph.GetNodes()[border].longitude);
+    CHECK_EQUAL(NO_ROAD_NODE, graph.FindBorderNode(101, 0.002, bounds.eastLongitude, 0.5));
+    CHECK_EQUAL(NO_ROAD_NODE, graph.FindBorderNode(100, 0.003, bounds.eastLongitude, 0.5));
+}
+
+TEST(stitchTest)
+{
+    auto west = LoadClippedTile(TWO_TILE_JSON, WEST_TILE);
+    auto east = LoadClippedTile(TWO_TILE_JSON, EAST_TILE);
+    FeatureStore store;
+    store.AddTile(WEST_TILE, west);
+
+    std::vector<TileFeature> nearest;
+    store.FindNearest(0.002, 0.003, 1, FeatureCategoryMask(FeatureCategory::Intersection), nearest);
+    CHECK_EQUAL(1u, nearest.size());
+    auto intersection = nearest[0].feature;
+
+    // With only the west tile, Main Street runs off the edge of it
+    const double metres_per_degree = EARTH_RADIUS_METERS * DEGREES_TO_RADIANS;
+    std::vector<IntersectionRoad> roads;
+    CHECK(store.GetIntersectionRoads(WEST_TILE, intersection, roads));
+    CHECK_EQUAL(3u, roads.size());
+    CHECK_EQUAL(100, roads[1].osm_id);
+    CHECK(roads[1].end_type == RoadNodeType::Border);
+    CHECK(roads[1].end_tile == WEST_TILE);
+
+    // With both, it's followed across the edge to the intersection in the east tile
+    store.AddTile(EAST_TILE, east);
+    CHECK(store.GetIntersectionRoads(WEST_TILE, intersection, roads));
+    CHECK_EQUAL(3u, roads.size());
+    const auto &main_street = roads[1];
+    CHECK_EQUAL(100, main_street.osm_id);
+    CHECK_NEAR(90.0, main_street.bearing, 0.01);
+    CHECK(main_street.end_type == RoadNodeType::Intersection);
+    CHECK(main_street.end_tile == EAST_TILE);
+    CHECK_EQUAL(201, east->osm_ids[east->features[main_street.end_feature].first_osm_id]);
+    CHECK_NEAR(0.006 * metres_per_degree, main_street.length, 0.1);
+    CHECK_NEAR(0.009, main_street.end_longitude, 1e-12);
+
+    // And back again from the east tile
+    store.FindNearest(0.002, 0.009, 1, FeatureCategoryMask(FeatureCategory::Intersection), nearest);
+    CHECK(nearest[0].tile == EAST_TILE);
+    CHECK(store.GetIntersectionRoads(EAST_TILE, nearest[0].feature, roads));
+    CHECK_EQUAL(3u, roads.size());
+    CHECK_NEAR(270.0, roads[2].bearing, 0.01);
+    CHECK(roads[2].end_tile == WEST_TILE);
+    CHECK_NEAR(0.006 * metres_per_degree, roads[2].length, 0.1);
+
+    // A feature which isn't an intersection, and a tile that isn't loaded
+    CHECK(!store.GetIntersectionRoads(WEST_TILE, intersection + 100, roads));
+    CHECK(roads.empty());
+    CHECK(!store.GetIntersectionRoads({1, 1, 16}, intersection, roads));
+}
+
+TEST(engineApiTest)
+{
+    soundscape_nearest_feature intersection;
+    soundscape_intersection_road roads[8];
+    CHECK_EQUAL(-1, soundscape_engine_get_nearest_intersection(nullptr, 0.0, 0.0, 100.0,
+                                                               &intersection, roads, 8));
+
+    auto engine = soundscape_engine_create();
+    auto json = ReadTile("intersection_cross1.geojson");
+    soundscape_tile tile{32291, 21807, 16, json.data(), json.size()};
+    CHECK_EQUAL(0, soundscape_engine_get_nearest_intersection(engine, 51.456953686378085,
+                                                              -2.61850147329568, 100.0,
+                                                              &intersection, roads, 8));
+    CHECK(std::isinf(intersection.distance));
+    CHECK_EQUAL(1, soundscape_engine_load_tiles(engine, &tile, 1));
+    CHECK_EQUAL(4, soundscape_engine_get_nearest_intersection(engine, 51.456953686378085,
+                                                              -2.61850147329568, 100.0,
+                                                              &intersection, roads, 8));
+    CHECK_EQUAL(tile.x, intersection.x);
+    CHECK(intersection.distance < 100.0);
+    for(int road = 0; road < 4; ++road) {
+        CHECK(roads[road].osm_id != 0);
+        CHECK(roads[road].length > 0.0);
+        CHECK((roads[road].end_type >= SOUNDSCAPE_ROAD_NODE_INTERSECTION) &&
+              (roads[road].end_type <= SOUNDSCAPE_ROAD_NODE_BORDER));
+    }
+    CHECK_EQUAL(2, soundscape_engine_get_nearest_intersection(engine, 51.456953686378085,
+                                                              -2.61850147329568, 100.0,
+                                                              &intersection, roads, 2));
+    // Asking for no roads still finds the intersection
+    CHECK_EQUAL(0, soundscape_engine_get_nearest_intersection(engine, 51.456953686378085,
+                                                              -2.61850147329568, 100.0,
+                                                              &intersection, roads, 0));
+    CHECK(intersection.distance < 100.0);
+    soundscape_engine_destroy(engine);
+}
+
+TEST(intersectionCandidatesTest)
+{
+    // Intersections which aren't points aren't in the road graph, and there are more of them
+    // nearer than the first one that is than are asked for at a time
+    std::string json = R"({"type": "FeatureCollection", "features": [)";
+    for(int index = 0; index < 10; ++index) {
+        auto longitude = std::to_string(-2.6180 + index * 0.00001);
+        json += R"({"type": "Feature", "geometry": {"type": "MultiPoint", "coordinates": [[)" +
+                longitude + R"(, 51.4560]]}, "feature_type": "highway", "feature_value": "gd_intersection"},)";
+    }
+    json += R"({"type": "Feature", "geometry": {"type": "Point", "coordinates": [-2.6170, 51.4560]},
+        "feature_type": "highway", "feature_value": "gd_intersection", "osm_ids": [7]},
+        {"type": "Feature", "geometry": {"type": "LineString", "coordinates": [[-2.6175, 51.4560], [-2.6170, 51.4560], [-2.6165, 51.4560]]},
+        "feature_type": "highway", "feature_value": "primary", "osm_ids": [8]}]})";
+
+    auto engine = soundscape_engine_create();
+    soundscape_tile tile{32291, 21807, 16, json.data(), json.size()};
+    CHECK_EQUAL(1, soundscape_engine_load_tiles(engine, &tile, 1));
+    soundscape_nearest_feature intersection;
+    soundscape_intersection_road roads[8];
+    CHECK_EQUAL(2, soundscape_engine_get_nearest_intersection(engine, 51.4560, -2.6180, 500.0,
+                                                              &intersection, roads, 8));
+    CHECK_EQUAL(7, intersection.osm_id);
+    CHECK_EQUAL(8, roads[0].osm_id);
+    CHECK_EQUAL(8, roads[1].osm_id);
+    soundscape_engine_destroy(engine);
+}
+
+TEST_MAIN()
@@ -0,0 +1,86 @@
+#pragma once
+
+//
+// Minimal test harness for the native host tests. Each test source file builds into its own
+// executable which runs every TEST in the file and returns non-zero if any of them failed.
+//
+#include <cmath>
+#include <cstdio>
+#include <functional>
+#include <vector>
+
+namespace soundscape::test {
+
+    struct TestCase {
+        const char *name;
+        std::function<void()> function;
+    };
+
+    inline std::vector<TestCase> &GetTests()
+    {
+        static std::vector<TestCase> tests;
+        return tests;
+    }
+
+    inline int &GetFailureCount()
+    {
+        static int failures = 0;
+        return failures;
+    }
+
+    struct TestRegistration {
+        TestRegistration(const char *name, std::function<void()> function)
+        {
+            GetTests().push_back({name, std::move(function)});
+        }
+    };
+
+    inline int RunAllTests()
+    {
+        int failed_tests = 0;
+        for(const auto &test: GetTests()) {
+            auto failures_before = GetFailureCount();
+            test.function();
+            bool passed = (GetFailureCount() == failures_before);
+            if(!passed)
+                ++failed_tests;
+            printf("%s %s\n", passed ? "PASS" : "FAIL", test.name);
+        }
+        printf("%zu tests, %d failed\n", GetTests().size(), failed_tests);
+        return failed_tests ? 1 : 0;
+    }
+}
+
+#define TEST(name) \
+    static void name(); \
+    static soundscape::test::TestRegistration name##_registration(#name, name); \
+    static void name()
+
+#define CHECK(condition) \
+    do { \
+        if(!(condition)) { \
+            printf("%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, #condition); \
+            ++soundscape::test::GetFailureCount(); \
+        } \
+    } while(0)
+
+#define CHECK_EQUAL(expected, actual) \
+    do { \
+        if(!((expected) == (actual))) { \
+            printf("%s:%d: CHECK_EQUAL(%s, %s) failed\n", __FILE__, __LINE__, #expected, #actual); \
+            ++soundscape::test::GetFailureCount(); \
+        } \
+    } while(0)
+
+#define CHECK_NEAR(expected, actual, tolerance) \
+    do { \
+        double e_ = (expected), a_ = (actual); \
+        if(!(std::fabs(e_ - a_) <= (tolerance))) { \
+            printf("%s:%d: CHECK_NEAR(%s, %s) failed: %f vs %f\n", \
+                   __FILE__, __LINE__, #expected, #actual, e_, a_); \
+            ++soundscape::test::GetFailureCount(); \
+        } \
+    } while(0)
+
+#define TEST_MAIN() \
+    int main() { return soundscape::test::RunAllTests(); }
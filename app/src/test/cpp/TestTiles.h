@@ -0,0 +1,72 @@
+#pragma once
+
+//
+// The GeoJSON test tiles in the tiles directory, and the helpers that the tests which load them
+// or which use a tile cache share.
+//
+#include <cstdio>
+#include <fstream>
+#include <memory>
+#include <sstream>
+#include <string>
+
+#include <unistd.h>
+
+#include "TestHarness.h"
+#include "TileClipper.h"
+
+#ifndef SOUNDSCAPE_TILE_DIRECTORY
+#define SOUNDSCAPE_TILE_DIRECTORY "tiles"
+#endif
+
+namespace soundscape::test {
+
+    // The zoom 16 tile each test tile came from, and how many of its features have a vertex
+    // inside it
+    struct TestTile {
+        const char *name;
+        TileId tile;
+        size_t features;
+    };
+    const TestTile TEST_TILES[] = {
+        {"entrances.geojson", {32295, 21787, 16}, 399},
+        {"intersection_cross1.geojson", {32291, 21807, 16}, 563},
+        {"intersection_loop_back.geojson", {10551, 25431, 16}, 880},
+        {"intersection_t2.geojson", {32287, 21802, 16}, 270},
+        {"real.geojson", {32277, 21812, 16}, 146},
+    };
+    const size_t TEST_TILE_COUNT = sizeof(TEST_TILES) / sizeof(TEST_TILES[0]);
+
+    inline std::string ReadTile(const char *name)
+    {
+        std::ifstream file(std::string(SOUNDSCAPE_TILE_DIRECTORY "/") + name, std::ios::binary);
+        std::stringstream contents;
+        contents << file.rdbuf();
+        return contents.str();
+    }
+
+    inline std::shared_ptr<FeatureCollection> LoadClippedTile(const std::string &json, const TileId &tile)
+    {
+        GeoJsonParser parser;
+        FeatureCollection features;
+        CHECK(parser.Parse(json, features));
+        auto clipped = std::make_shared<FeatureCollection>();
+        ClipFeatures(features, tileToBoundingBox(tile.x, tile.y, tile.zoom), *clipped);
+        return clipped;
+    }
+
+    inline std::shared_ptr<FeatureCollection> LoadClippedTile(const TestTile &test_tile)
+    {
+        return LoadClippedTile(ReadTile(test_tile.name), test_tile.tile);
+    }
+
+    // A tile cache directory with nothing left in it from an earlier run
+    inline std::string CacheDirectory(const char *name)
+    {
+        auto directory = std::string(P_tmpdir) + "/" + name;
+        remove((directory + "/tiles.log").c_str());
+        rmdir(directory.c_str());
+        return directory;
+    }
+
+} // soundscape::test
@@ -0,0 +1,341 @@
+#include <chrono>
+#include <fstream>
+#include <thread>
+
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "TestHarness.h"
+#include "TestTiles.h"
+#include "TileCache.h"
+#include "TileClipper.h"
+#include "soundscape_engine.h"
+
+using namespace soundscape;
+using namespace soundscape::test;
+
+static uint64_t LogSize(const std::string &directory)
+{
+    struct stat status{};
+    stat((directory + "/tiles.log").c_str(), &status);
+    return static_cast<uint64_t>(status.st_size);
+}
+
+static void AddTestTiles(FileTileSource &source)
+{
+    for(const auto &test_tile: TEST_TILES)
+        source.AddTile(test_tile.tile, test_tile.name);
+}
+
+TEST(quadKeyTest)
+{
+    // The example from the Bing Maps tile system documentation, whose quadkey is "213"
+    TileId tile{3, 5, 3};
+    CHECK_EQUAL((uint64_t(3) << 56) | (2 << 4) | (1 << 2) | 3, tile.GetQuadKey());
+    CHECK(TileId::FromQuadKey(tile.GetQuadKey()) == tile);
+
+    for(const auto &test_tile: TEST_TILES)
+        CHECK(TileId::FromQuadKey(test_tile.tile.GetQuadKey()) == test_tile.tile);
+
+    // A tile's quadkey differs from its parent's only in the last level
+    const auto &child = TEST_TILES[0].tile;
+    TileId parent{child.x / 2, child.y / 2, 15};
+    CHECK_EQUAL(parent.GetQuadKey() & ((uint64_t(1) << 56) - 1),
+                (child.GetQuadKey() & ((uint64_t(1) << 56) - 1)) >> 2);
+}
+
+TEST(fetchTest)
+{
+    auto directory = CacheDirectory("TileCacheFetchTest");
+    FileTileSource source(SOUNDSCAPE_TILE_DIRECTORY);
+    AddTestTiles(source);
+    {
+        TileCache cache;
+        CHECK(cache.Open(directory, 64 * 1024 * 1024));
+
+        // The first time around the tiles come from the source, and then from the cache
+        FeatureCollection features;
+        for(int pass = 0; pass < 2; ++pass) {
+            for(const auto &test_tile: TEST_TILES) {
+                CHECK(cache.GetOrFetch(test_tile.tile, source, features));
+                CHECK_EQUAL(test_tile.features, features.features.size());
+            }
+        }
+        CHECK_EQUAL(unsigned(TEST_TILE_COUNT), source.GetFetchCount());
+
+        // Tiles which the source doesn't have
+        CHECK(!cache.GetOrFetch({1, 1, 16}, source, features));
+        CHECK(features.features.empty());
+
+        TileCacheStats stats;
+        cache.GetStats(stats);
+        CHECK_EQUAL(uint64_t(TEST_TILE_COUNT), stats.hits);
+        CHECK_EQUAL(uint64_t(TEST_TILE_COUNT + 1), stats.misses);
+        CHECK_EQUAL(uint64_t(TEST_TILE_COUNT), stats.tiles);
+        CHECK_EQUAL(0U, stats.dead_bytes);
+        CHECK_EQUAL(LogSize(directory), stats.live_bytes + 16);
+    }
+
+    // The tiles are still there when the cache is opened again, so aren't fetched again
+    TileCache cache;
+    CHECK(cache.Open(directory, 64 * 1024 * 1024));
+    FeatureCollection features;
+    for(const auto &test_tile: TEST_TILES) {
+        CHECK(cache.Contains(test_tile.tile));
+        CHECK(cache.GetOrFetch(test_tile.tile, source, features));
+        CHECK_EQUAL(test_tile.features, features.features.size());
+    }
+    CHECK_EQUAL(unsigned(TEST_TILE_COUNT), source.GetFetchCount());
+
+    // Removals are remembered too
+    CHECK(cache.Remove(TEST_TILES[0].tile));
+    CHECK(!cache.Remove(TEST_TILES[0].tile));
+    CHECK(!cache.Get(TEST_TILES[0].tile, features));
+    cache.Close();
+    CHECK(!cache.IsOpen());
+    CHECK(cache.Open(directory, 64 * 1024 * 1024));
+    CHECK(!cache.Contains(TEST_TILES[0].tile));
+    CHECK(cache.Contains(TEST_TILES[1].tile));
+    cache.Close();
+    CacheDirectory("TileCacheFetchTest");
+}
+
+TEST(crashTest)
+{
+    auto directory = CacheDirectory("TileCacheCrashTest");
+    FileTileSource source(SOUNDSCAPE_TILE_DIRECTORY);
+    AddTestTiles(source);
+    FeatureCollection features;
+    uint64_t first_size;
+    {
+        TileCache cache;
+        CHECK(cache.Open(directory, 64 * 1024 * 1024));
+        CHECK(cache.GetOrFetch(TEST_TILES[4].tile, source, features));
+        first_size = LogSize(directory);
+        CHECK(cache.GetOrFetch(TEST_TILES[3].tile, source, features));
+    }
+
+    // The app was killed part way through writing the second tile
+    CHECK_EQUAL(0, truncate((directory + "/tiles.log").c_str(), static_cast<off_t>(LogSize(directory) - 100)));
+    {
+        TileCache cache;
+        CHECK(cache.Open(directory, 64 * 1024 * 1024));
+        CHECK_EQUAL(first_size, LogSize(directory));
+        CHECK(cache.Get(TEST_TILES[4].tile, features));
+        CHECK_EQUAL(TEST_TILES[4].features, features.features.size());
+        CHECK(!cache.Contains(TEST_TILES[3].tile));
+
+        // It carries on from the end of the last whole record
+        CHECK(cache.GetOrFetch(TEST_TILES[3].tile, source, features));
+    }
+
+    // A byte of the first tile is changed on disk, which is found when it's read
+    {
+        std::fstream file(directory + "/tiles.log", std::ios::binary | std::ios::in | std::ios::out);
+        file.seekp(1000);
+        file.put('\xff');
+    }
+    TileCache cache;
+    CHECK(cache.Open(directory, 64 * 1024 * 1024));
+    CHECK(cache.Contains(TEST_TILES[4].tile));
+    CHECK(!cache.Get(TEST_TILES[4].tile, features));
+    CHECK(features.features.empty());
+    CHECK(!cache.Contains(TEST_TILES[4].tile));
+    CHECK(cache.Get(TEST_TILES[3].tile, features));
+    CHECK_EQUAL(TEST_TILES[3].features, features.features.size());
+    TileCacheStats stats;
+    cache.GetStats(stats);
+    CHECK_EQUAL(1U, stats.corrupt);
+    cache.Close();
+
+    // Anything which isn't a tile cache is replaced
+    std::ofstream(directory + "/tiles.log", std::ios::binary) << "not a tile cache";
+    CHECK(cache.Open(directory, 64 * 1024 * 1024));
+    cache.GetStats(stats);
+    CHECK_EQUAL(0U, stats.tiles);
+    cache.Close();
+    CacheDirectory("TileCacheCrashTest");
+}
+
+TEST(evictionTest)
+{
+    auto directory = CacheDirectory("TileCacheEvictionTest");
+    FileTileSource source(SOUNDSCAPE_TILE_DIRECTORY);
+    AddTestTiles(source);
+    int64_t now = 1000000;
+    TileCache cache([&now]() { return now; });
+    CHECK(cache.Open(directory, 64 * 1024 * 1024));
+
+    FeatureCollection features;
+    for(size_t index: {0, 1, 3}) {
+        CHECK(cache.GetOrFetch(TEST_TILES[index].tile, source, features));
+        now += 100;
+    }
+    CHECK(cache.Get(TEST_TILES[0].tile, features));
+
+    // Without a location the least recently used goes first
+    TileCacheStats stats;
+    cache.GetStats(stats);
+    cache.SetBudget(stats.live_bytes - 1);
+    CHECK(cache.Contains(TEST_TILES[0].tile));
+    CHECK(!cache.Contains(TEST_TILES[1].tile));
+    CHECK(cache.Contains(TEST_TILES[3].tile));
+
+    // With a location, a tile on another continent goes before one nearby, even though it's the
+    // most recently used. A tile which is added is never evicted to make room for itself.
+    cache.SetLocation(tileToLat(TEST_TILES[3].tile.y, 16), tileToLon(TEST_TILES[3].tile.x, 16));
+    cache.SetBudget(64 * 1024 * 1024);
+    now += 100;
+    CHECK(cache.GetOrFetch(TEST_TILES[2].tile, source, features));
+    cache.GetStats(stats);
+    cache.SetBudget(stats.live_bytes - 1);
+    CHECK(!cache.Contains(TEST_TILES[2].tile));
+    CHECK(cache.Contains(TEST_TILES[0].tile));
+    CHECK(cache.Contains(TEST_TILES[3].tile));
+
+    cache.SetBudget(1);
+    CHECK(cache.GetOrFetch(TEST_TILES[4].tile, source, features));
+    cache.GetStats(stats);
+    CHECK_EQUAL(1U, stats.tiles);
+    CHECK(cache.Contains(TEST_TILES[4].tile));
+    CHECK_EQUAL(4U, stats.evictions);
+
+    // The budget is applied when the cache is opened
+    cache.Close();
+    CHECK(cache.Open(directory, 0));
+    cache.GetStats(stats);
+    CHECK_EQUAL(0U, stats.tiles);
+    cache.Close();
+    CacheDirectory("TileCacheEvictionTest");
+}
+
+TEST(compactionTest)
+{
+    auto directory = CacheDirectory("TileCacheCompactionTest");
+    FileTileSource source(SOUNDSCAPE_TILE_DIRECTORY);
+    AddTestTiles(source);
+    TileCache cache;
+    CHECK(cache.Open(directory, 64 * 1024 * 1024));
+
+    FeatureCollection features;
+    for(const auto &test_tile: TEST_TILES)
+        CHECK(cache.GetOrFetch(test_tile.tile, source, features));
+    CHECK(cache.Remove(TEST_TILES[0].tile));
+
+    // Compacting leaves only the live tiles in the log
+    CHECK(cache.Compact());
+    TileCacheStats stats;
+    cache.GetStats(stats);
+    CHECK_EQUAL(1U, stats.compactions);
+    CHECK_EQUAL(0U, stats.dead_bytes);
+    CHECK_EQUAL(LogSize(directory), stats.live_bytes + 16);
+    for(size_t index = 1; index < TEST_TILE_COUNT; ++index) {
+        CHECK(cache.Get(TEST_TILES[index].tile, features));
+        CHECK_EQUAL(TEST_TILES[index].features, features.features.size());
+    }
+
+    // Rewriting the same tiles builds up dead records until the background thread compacts them
+    const auto &tile = TEST_TILES[2].tile;
+    CHECK(cache.Get(tile, features));
+    for(int count = 0; count < 15; ++count)
+        CHECK(cache.Put(tile, features));
+    for(int wait = 0; wait < 500; ++wait) {
+        cache.GetStats(stats);
+        if(stats.compactions > 1)
+            break;
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    CHECK_EQUAL(2U, stats.compactions);
+    CHECK(stats.dead_bytes < 1024 * 1024);
+
+    // Everything is still there when the cache is opened again, and the removed tile is still
+    // removed
+    cache.Close();
+    CHECK(cache.Open(directory, 64 * 1024 * 1024));
+    CHECK(!cache.Contains(TEST_TILES[0].tile));
+    for(size_t index = 1; index < TEST_TILE_COUNT; ++index) {
+        CHECK(cache.Get(TEST_TILES[index].tile, features));
+        CHECK_EQUAL(TEST_TILES[index].features, features.features.size());
+    }
+    cache.Close();
+    CacheDirectory("TileCacheCompactionTest");
+}
+
+TEST(compactionReplaceTest)
+{
+    auto directory = CacheDirectory("TileCacheCompactionReplaceTest");
+    FileTileSource source(SOUNDSCAPE_TILE_DIRECTORY);
+    AddTestTiles(source);
+    TileCache cache;
+    CHECK(cache.Open(directory, 64 * 1024 * 1024));
+
+    FeatureCollection features;
+    for(const auto &test_tile: TEST_TILES)
+        CHECK(cache.GetOrFetch(test_tile.tile, source, features));
+
+    // A tile which is replaced while the log is being compacted keeps its new contents when the
+    // cache is opened again, whether the replacement is before or after the compaction's snapshot
+    const auto &test_tile = TEST_TILES[2];
+    FeatureCollection all;
+    CHECK(cache.Get(test_tile.tile, all));
+    // More tiles make the compaction take long enough for the replacement to happen during it
+    for(int index = 1; index <= 100; ++index)
+        CHECK(cache.Put({test_tile.tile.x + index, test_tile.tile.y, test_tile.tile.zoom}, all));
+    for(size_t round = 1; round <= 10; ++round) {
+        // Clipped to a smaller part of the tile each time, so that each version is different
+        auto box = tileToBoundingBox(test_tile.tile.x, test_tile.tile.y, test_tile.tile.zoom);
+        box.eastLongitude = box.westLongitude + (box.eastLongitude - box.westLongitude) * round / 10;
+        FeatureCollection some;
+        ClipFeatures(all, box, some);
+
+        std::thread compaction([&cache] { cache.Compact(); });
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        CHECK(cache.Put(test_tile.tile, some));
+        compaction.join();
+
+        cache.Close();
+        CHECK(cache.Open(directory, 64 * 1024 * 1024));
+        CHECK(cache.Get(test_tile.tile, features));
+        CHECK_EQUAL(some.features.size(), features.features.size());
+        CHECK(cache.Get(TEST_TILES[0].tile, features));
+        CHECK_EQUAL(TEST_TILES[0].features, features.features.size());
+    }
+    cache.Close();
+    CacheDirectory("TileCacheCompactionReplaceTest");
+}
+
+TEST(engineApiTest)
+{
+    auto json = ReadTile("real.geojson");
+    soundscape_tile tile{32277, 21812, 16, json.data(), json.size()};
+
+    auto directory = CacheDirectory("TileCacheEngineTest");
+    CHECK_EQUAL(-1, soundscape_engine_open_tile_cache(nullptr, directory.c_str(), 1024 * 1024));
+    CHECK_EQUAL(-1, soundscape_engine_load_cached_tile(nullptr, 32277, 21812, 16));
+    soundscape_tile_cache_stats stats;
+    CHECK_EQUAL(-1, soundscape_engine_get_tile_cache_stats(nullptr, &stats));
+
+    // Tiles are written to the cache as they're loaded
+    auto engine = soundscape_engine_create();
+    CHECK_EQUAL(-1, soundscape_engine_load_cached_tile(engine, 32277, 21812, 16));
+    CHECK_EQUAL(0, soundscape_engine_open_tile_cache(engine, directory.c_str(), 1024 * 1024));
+    CHECK_EQUAL(1, soundscape_engine_load_tiles(engine, &tile, 1));
+    CHECK_EQUAL(0, soundscape_engine_get_tile_cache_stats(engine, &stats));
+    CHECK_EQUAL(1U, stats.tiles);
+    CHECK_EQUAL(1024U * 1024U, stats.budget);
+    soundscape_engine_destroy(engine);
+
+    // And a new engine loads them without the GeoJSON
+    engine = soundscape_engine_create();
+    CHECK_EQUAL(0, soundscape_engine_open_tile_cache(engine, directory.c_str(), 1024 * 1024));
+    CHECK_EQUAL(0, soundscape_engine_load_cached_tile(engine, 32277, 21812, 16));
+    CHECK_EQUAL(146, soundscape_engine_get_tile_feature_count(engine, 32277, 21812, 16));
+    CHECK_EQUAL(-1, soundscape_engine_load_cached_tile(engine, 32278, 21812, 16));
+    CHECK_EQUAL(0, soundscape_engine_get_tile_cache_stats(engine, &stats));
+    CHECK_EQUAL(1U, stats.hits);
+    CHECK_EQUAL(1U, stats.misses);
+    soundscape_engine_destroy(engine);
+    CacheDirectory("TileCacheEngineTest");
+}
+
+TEST_MAIN()
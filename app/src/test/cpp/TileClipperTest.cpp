@@ -0,0 +1,132 @@
+#include <cstring>
+#include <vector>
+
+#include "TestHarness.h"
+#include "TestTiles.h"
+#include "TileClipper.h"
+#include "soundscape_engine.h"
+
+using namespace soundscape;
+using namespace soundscape::test;
+
+TEST(tileBoundsTest)
+{
+    // The tile that GeoJsonDataReal is from
+    int x, y;
+    getXYTile(51.43860066718254, -2.69439697265625, 16, x, y);
+    CHECK_EQUAL(32277, x);
+    CHECK_EQUAL(21812, y);
+
+    auto box = tileToBoundingBox(x, y, 16);
+    CHECK(box.contains(51.43860066718254, -2.69439697265625));
+    CHECK_NEAR(-2.6971435546875, box.westLongitude, 1e-12);
+    CHECK_NEAR(-2.691650390625, box.eastLongitude, 1e-12);
+    CHECK(box.northLatitude > box.southLatitude);
+    CHECK_NEAR(box.southLatitude, tileToBoundingBox(x, y + 1, 16).northLatitude, 1e-12);
+
+    // Locations off the map are clamped to the edge tiles
+    getXYTile(89.9, 180.0, 16, x, y);
+    CHECK_EQUAL(65535, x);
+    CHECK_EQUAL(0, y);
+}
+
+TEST(clipTest)
+{
+    auto json = ReadTile("real.geojson");
+    GeoJsonParser parser;
+    FeatureCollection features;
+    CHECK(parser.Parse(json, features));
+
+    auto box = tileToBoundingBox(32277, 21812, 16);
+    FeatureCollection clipped;
+    ClipFeatures(features, box, clipped);
+    CHECK_EQUAL(146U, clipped.features.size());
+
+    // The University of Law is around the country rather than in the tile
+    for(const auto &feature: clipped.features)
+        CHECK(clipped.GetProperty(feature, "name") != "University of Law");
+
+    // Kept features are whole, with every part, property and id copied
+    size_t coordinates = 0;
+    for(const auto &feature: clipped.features) {
+        bool inside = false;
+        for(uint32_t part = 0; part < feature.part_count; ++part) {
+            const auto &geometry = clipped.parts[feature.first_part + part];
+            coordinates += geometry.coordinate_count;
+            for(uint32_t index = 0; index < geometry.coordinate_count; ++index) {
+                auto coordinate = geometry.first_coordinate + index;
+                inside |= box.contains(clipped.latitudes[coordinate], clipped.longitudes[coordinate]);
+            }
+        }
+        CHECK(inside);
+        CHECK(!clipped.GetString(feature.feature_type).empty());
+    }
+    CHECK_EQUAL(coordinates, clipped.longitudes.size());
+    for(const auto &feature: features.features) {
+        const auto &first = clipped.features[0];
+        if(features.osm_ids[feature.first_osm_id] == clipped.osm_ids[first.first_osm_id]) {
+            CHECK_EQUAL(feature.property_count, first.property_count);
+            CHECK(features.GetProperty(feature, "name") == clipped.GetProperty(first, "name"));
+        }
+    }
+
+    // Nothing is kept from a tile somewhere else
+    FeatureCollection elsewhere;
+    ClipFeatures(features, tileToBoundingBox(0, 0, 16), elsewhere);
+    CHECK(elsewhere.features.empty());
+    CHECK(elsewhere.strings.empty());
+}
+
+TEST(loadTilesTest)
+{
+    std::vector<std::string> json;
+    std::vector<TileJson> tiles;
+    for(const auto &tile: TEST_TILES)
+        json.push_back(ReadTile(tile.name));
+    for(size_t index = 0; index < json.size(); ++index)
+        tiles.push_back({TEST_TILES[index].tile, json[index].data(), json[index].size()});
+
+    // The same whatever the number of threads
+    for(unsigned threads: {1U, 2U, 0U}) {
+        FeatureStore store;
+        CHECK_EQUAL(tiles.size(), LoadTiles(tiles.data(), tiles.size(), store, threads));
+        CHECK_EQUAL(tiles.size(), store.GetTileCount());
+        for(const auto &tile: TEST_TILES) {
+            auto features = store.GetTile(tile.tile);
+            CHECK(features != nullptr);
+            if(features)
+                CHECK_EQUAL(tile.features, features->features.size());
+        }
+    }
+
+    // A tile which isn't valid isn't added, and the others still are
+    FeatureStore store;
+    const char *invalid = "{\"type\": \"FeatureCollection\", \"features\": [";
+    tiles[0] = {{1, 2, 16}, invalid, strlen(invalid)};
+    CHECK_EQUAL(tiles.size() - 1, LoadTiles(tiles.data(), tiles.size(), store));
+    CHECK(store.GetTile({1, 2, 16}) == nullptr);
+
+    // A tile that's looked up stays valid after it's removed
+    auto tile = store.GetTile(TEST_TILES[4].tile);
+    CHECK(store.RemoveTile(TEST_TILES[4].tile));
+    CHECK(!store.RemoveTile(TEST_TILES[4].tile));
+    CHECK_EQUAL(146U, tile->features.size());
+    CHECK_EQUAL(tiles.size() - 2, store.GetTileIds().size());
+}
+
+TEST(engineApiTest)
+{
+    auto json = ReadTile("real.geojson");
+    soundscape_tile tile{32277, 21812, 16, json.data(), json.size()};
+    CHECK_EQUAL(-1, soundscape_engine_load_tiles(nullptr, &tile, 1));
+    CHECK_EQUAL(-1, soundscape_engine_get_tile_feature_count(nullptr, 32277, 21812, 16));
+
+    auto engine = soundscape_engine_create();
+    CHECK_EQUAL(-1, soundscape_engine_get_tile_feature_count(engine, 32277, 21812, 16));
+    CHECK_EQUAL(1, soundscape_engine_load_tiles(engine, &tile, 1));
+    CHECK_EQUAL(146, soundscape_engine_get_tile_feature_count(engine, 32277, 21812, 16));
+    CHECK_EQUAL(0, soundscape_engine_load_tiles(engine, nullptr, 0));
+    soundscape_engine_destroy(engine);
+}
+
+TEST_MAIN()
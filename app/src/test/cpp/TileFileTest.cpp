@@ -0,0 +1,216 @@
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <vector>
+
+#include "TestHarness.h"
+#include "TestTiles.h"
+#include "TileClipper.h"
+#include "TileFile.h"
+#include "soundscape_engine.h"
+
+using namespace soundscape;
+using namespace soundscape::test;
+
+// Everything which was parsed from the GeoJSON is the same when it's decoded
+static void CheckSameFeatures(const FeatureCollection &expected, const FeatureCollection &actual)
+{
+    CHECK_EQUAL(expected.features.size(), actual.features.size());
+    CHECK(expected.longitudes == actual.longitudes);
+    CHECK(expected.latitudes == actual.latitudes);
+    CHECK(expected.osm_ids == actual.osm_ids);
+    for(size_t index = 0; index < expected.features.size(); ++index) {
+        const auto &a = expected.features[index];
+        const auto &b = actual.features[index];
+        CHECK(a.geometry == b.geometry);
+        CHECK(a.category == b.category);
+        CHECK(expected.GetString(a.feature_type) == actual.GetString(b.feature_type));
+        CHECK(expected.GetString(a.feature_value) == actual.GetString(b.feature_value));
+        CHECK_EQUAL(a.first_osm_id, b.first_osm_id);
+        CHECK_EQUAL(a.osm_id_count, b.osm_id_count);
+
+        CHECK_EQUAL(a.part_count, b.part_count);
+        for(uint32_t part = 0; part < a.part_count; ++part) {
+            const auto &pa = expected.parts[a.first_part + part];
+            const auto &pb = actual.parts[b.first_part + part];
+            CHECK_EQUAL(pa.first_coordinate, pb.first_coordinate);
+            CHECK_EQUAL(pa.coordinate_count, pb.coordinate_count);
+            CHECK_EQUAL(pa.polygon, pb.polygon);
+        }
+        CHECK_EQUAL(a.property_count, b.property_count);
+        for(uint32_t property = 0; property < a.property_count; ++property) {
+            const auto &pa = expected.properties[a.first_property + property];
+            const auto &pb = actual.properties[b.first_property + property];
+            CHECK(expected.GetString(pa.key) == actual.GetString(pb.key));
+            CHECK(expected.GetString(pa.value) == actual.GetString(pb.value));
+            CHECK(pa.type == pb.type);
+        }
+    }
+}
+
+TEST(roundTripTest)
+{
+    for(const auto &test_tile: TEST_TILES) {
+        auto clipped = *LoadClippedTile(test_tile);
+
+        std::vector<uint8_t> data;
+        CHECK(EncodeTileFile(test_tile.tile, clipped, data));
+        // The file is much smaller than the GeoJSON that it came from
+        CHECK(data.size() * 2 < ReadTile(test_tile.name).size());
+
+        TileFile file;
+        CHECK(file.Open(data.data(), data.size()));
+        CHECK(file.GetTile() == test_tile.tile);
+        CHECK_EQUAL(data.size(), file.GetSize());
+        CHECK_EQUAL(clipped.features.size(), size_t(file.GetFeatureCount()));
+
+        FeatureCollection decoded;
+        CHECK(file.Decode(decoded));
+        CheckSameFeatures(clipped, decoded);
+
+        // The bounding boxes hold all of the coordinates of their features, to within the
+        // precision of the file
+        for(uint32_t index = 0; index < file.GetFeatureCount(); ++index) {
+            const auto &feature = file.GetFeature(index);
+            CHECK(file.GetString(feature.feature_type) ==
+                  clipped.GetString(clipped.features[index].feature_type));
+            auto box = file.GetBounds(feature);
+            const auto &decoded_feature = decoded.features[index];
+            for(uint32_t part = 0; part < decoded_feature.part_count; ++part) {
+                const auto &geometry = decoded.parts[decoded_feature.first_part + part];
+                for(uint32_t point = 0; point < geometry.coordinate_count; ++point) {
+                    auto coordinate = geometry.first_coordinate + point;
+                    CHECK(box.contains(decoded.latitudes[coordinate], decoded.longitudes[coordinate]));
+                }
+            }
+        }
+
+        // Decoding adds to the features which are already there
+        CHECK(file.Decode(decoded));
+        CHECK_EQUAL(clipped.features.size() * 2, decoded.features.size());
+        const auto &second = decoded.features[clipped.features.size()];
+        CHECK_EQUAL(uint32_t(clipped.parts.size()), second.first_part);
+        CHECK_EQUAL(clipped.longitudes.size(), size_t(decoded.parts[second.first_part].first_coordinate));
+        CHECK(decoded.GetString(second.feature_type) ==
+              clipped.GetString(clipped.features[0].feature_type));
+    }
+}
+
+TEST(emptyTileTest)
+{
+    FeatureCollection empty;
+    std::vector<uint8_t> data;
+    CHECK(EncodeTileFile({1, 2, 16}, empty, data));
+
+    TileFile file;
+    CHECK(file.Open(data.data(), data.size()));
+    CHECK_EQUAL(0U, file.GetFeatureCount());
+    FeatureCollection decoded;
+    CHECK(file.Decode(decoded));
+    CHECK(decoded.features.empty());
+}
+
+TEST(corruptFileTest)
+{
+    auto clipped = *LoadClippedTile(TEST_TILES[4]);
+    std::vector<uint8_t> data;
+    CHECK(EncodeTileFile(TEST_TILES[4].tile, clipped, data));
+    TileFileHeader header;
+    memcpy(&header, data.data(), sizeof(header));
+
+    TileFile file;
+    auto corrupt = data;
+    corrupt[0] = 'X';
+    CHECK(!file.Open(corrupt.data(), corrupt.size()));
+    CHECK(!file.IsOpen());
+
+    // Another version
+    corrupt = data;
+    corrupt[4] = TILE_FILE_VERSION + 1;
+    CHECK(!file.Open(corrupt.data(), corrupt.size()));
+
+    // Truncated anywhere
+    for(size_t length: {size_t(0), size_t(16), sizeof(TileFileHeader), data.size() / 2, data.size() - 1})
+        CHECK(!file.Open(data.data(), length));
+
+    // An index out of range
+    corrupt = data;
+    auto first_feature = reinterpret_cast<TileFileFeature *>(corrupt.data() + header.features.offset);
+    first_feature->feature_value = header.string_count;
+    CHECK(!file.Open(corrupt.data(), corrupt.size()));
+    corrupt = data;
+    first_feature = reinterpret_cast<TileFileFeature *>(corrupt.data() + header.features.offset);
+    first_feature->part_count = header.part_count + 1;
+    CHECK(!file.Open(corrupt.data(), corrupt.size()));
+
+    // Coordinates which run off the end are only found when they're decoded, and then nothing is
+    // added to the features
+    corrupt = data;
+    memset(corrupt.data() + header.coordinates.offset, 0xff, header.coordinates.size);
+    CHECK(file.Open(corrupt.data(), corrupt.size()));
+    FeatureCollection decoded;
+    CHECK(file.Decode(decoded) == false);
+    CHECK(decoded.features.empty());
+    CHECK(decoded.longitudes.empty());
+    CHECK(decoded.strings.empty());
+
+    CHECK(file.Open(data.data(), data.size()));
+    CHECK(file.IsOpen());
+    file.Close();
+    CHECK(!file.IsOpen());
+}
+
+TEST(fileTest)
+{
+    auto clipped = *LoadClippedTile(TEST_TILES[0]);
+
+    auto path = std::string(P_tmpdir) + "/TileFileTest.sstf";
+    remove(path.c_str());
+    TileFile file;
+    CHECK(!file.Open(path));
+
+    CHECK(WriteTileFile(path, TEST_TILES[0].tile, clipped));
+    CHECK(file.Open(path));
+    CHECK(file.GetTile() == TEST_TILES[0].tile);
+    FeatureCollection decoded;
+    CHECK(file.Decode(decoded));
+    CheckSameFeatures(clipped, decoded);
+
+    // Reopening unmaps the file that was open
+    CHECK(file.Open(path));
+    file.Close();
+
+    // No temporary file is left behind
+    std::ifstream temporary(path + ".tmp");
+    CHECK(!temporary);
+
+    std::ofstream(path, std::ios::binary) << "not a tile file";
+    CHECK(!file.Open(path));
+    remove(path.c_str());
+}
+
+TEST(engineApiTest)
+{
+    auto json = ReadTile("real.geojson");
+    soundscape_tile tile{32277, 21812, 16, json.data(), json.size()};
+    auto path = std::string(P_tmpdir) + "/TileFileEngineTest.sstf";
+    remove(path.c_str());
+    CHECK_EQUAL(-1, soundscape_engine_save_tile_file(nullptr, 32277, 21812, 16, path.c_str()));
+    CHECK_EQUAL(-1, soundscape_engine_load_tile_file(nullptr, path.c_str()));
+
+    auto engine = soundscape_engine_create();
+    CHECK_EQUAL(-1, soundscape_engine_save_tile_file(engine, 32277, 21812, 16, path.c_str()));
+    CHECK_EQUAL(-1, soundscape_engine_load_tile_file(engine, path.c_str()));
+    CHECK_EQUAL(1, soundscape_engine_load_tiles(engine, &tile, 1));
+    CHECK_EQUAL(0, soundscape_engine_save_tile_file(engine, 32277, 21812, 16, path.c_str()));
+    soundscape_engine_destroy(engine);
+
+    // A new engine loads the tile from the file without the GeoJSON
+    engine = soundscape_engine_create();
+    CHECK_EQUAL(0, soundscape_engine_load_tile_file(engine, path.c_str()));
+    CHECK_EQUAL(146, soundscape_engine_get_tile_feature_count(engine, 32277, 21812, 16));
+    soundscape_engine_destroy(engine);
+    remove(path.c_str());
+}
+
+TEST_MAIN()
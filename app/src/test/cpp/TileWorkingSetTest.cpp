@@ -0,0 +1,452 @@
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <map>
+#include <mutex>
+#include <set>
+#include <thread>
+
+
+#include "GeoUtils.h"
+#include "TestHarness.h"
+#include "TestTiles.h"
+#include "TileWorkingSet.h"
+#include "soundscape_engine.h"
+
+using namespace soundscape;
+using namespace soundscape::test;
+
+const double START_LATITUDE = 55.9533;
+const double START_LONGITUDE = -3.1883;
+const char *EMPTY_TILE = R"({"type": "FeatureCollection", "features": []})";
+
+// Tiles with nothing in them
+class EmptyTileSource : public ITileSource {
+public:
+    bool FetchTile(const TileId &tile, std::string &json) override
+    {
+        (void)tile;
+        ++m_FetchCount;
+        json = EMPTY_TILE;
+        return true;
+    }
+
+    std::atomic<unsigned> m_FetchCount{0};
+};
+
+static bool IsLoaded(const FeatureStore &store, const std::vector<TileId> &tiles)
+{
+    return std::all_of(tiles.begin(), tiles.end(), [&store](const TileId &tile) {
+        return store.GetIndex(tile) != nullptr;
+    });
+}
+
+TEST(circleTest)
+{
+    // Near the north west corner of a tile, a small circle overlaps it and the three next to it
+    int x;
+    int y;
+    getXYTile(START_LATITUDE, START_LONGITUDE, 16, x, y);
+    auto box = tileToBoundingBox(x, y, 16);
+    auto latitude = box.northLatitude - 0.0001;
+    auto longitude = box.westLongitude + 0.0001;
+    std::vector<TileId> tiles;
+    TileWorkingSet::GetTilesInCircle(latitude, longitude, 50.0, tiles);
+    CHECK_EQUAL(4u, tiles.size());
+    CHECK(tiles[0] == TileId({x, y, 16}));
+    std::set<std::pair<int, int>> found;
+    for(const auto &tile: tiles)
+        found.insert({tile.x, tile.y});
+    const std::set<std::pair<int, int>> expected = {{x, y}, {x - 1, y}, {x, y - 1}, {x - 1, y - 1}};
+    CHECK(found == expected);
+
+    // In the middle of the tile it's only that one
+    TileWorkingSet::GetTilesInCircle((box.northLatitude + box.southLatitude) / 2.0,
+                                     (box.westLongitude + box.eastLongitude) / 2.0, 50.0, tiles);
+    CHECK_EQUAL(1u, tiles.size());
+
+    // A bigger circle leaves out the corners of the square around it
+    latitude = (box.northLatitude + box.southLatitude) / 2.0;
+    longitude = (box.westLongitude + box.eastLongitude) / 2.0;
+    TileWorkingSet::GetTilesInCircle(latitude, longitude, 1000.0, tiles);
+    CHECK(tiles.size() > 4);
+    for(const auto &tile: tiles) {
+        auto tile_box = tileToBoundingBox(tile.x, tile.y, tile.zoom);
+        auto nearest = distance(latitude, longitude,
+                                std::clamp(latitude, tile_box.southLatitude, tile_box.northLatitude),
+                                std::clamp(longitude, tile_box.westLongitude, tile_box.eastLongitude));
+        CHECK(nearest <= 1000.0);
+    }
+    int min_x = INT32_MAX;
+    int max_x = INT32_MIN;
+    for(const auto &tile: tiles) {
+        min_x = std::min(min_x, tile.x);
+        max_x = std::max(max_x, tile.x);
+    }
+    auto width = max_x - min_x + 1;
+    CHECK(static_cast<int>(tiles.size()) < width * width);
+
+    // Either side of the antimeridian, the circle takes in tiles from the last column and the
+    // first, with the nearest ones first
+    const int columns = 1 << 16;
+    for(auto antimeridian_longitude: {179.9995, -179.9995}) {
+        TileWorkingSet::GetTilesInCircle(-17.0, antimeridian_longitude, 300.0, tiles);
+        size_t last_column = 0;
+        size_t first_column = 0;
+        for(const auto &tile: tiles) {
+            CHECK((tile.x == 0) || (tile.x == columns - 1));
+            if(tile.x == 0)
+                ++first_column;
+            else
+                ++last_column;
+        }
+        CHECK(first_column > 0);
+        CHECK(last_column > 0);
+        getXYTile(-17.0, antimeridian_longitude, 16, x, y);
+        CHECK(tiles[0] == TileId({x, y, 16}));
+        std::set<uint64_t> keys;
+        for(const auto &tile: tiles)
+            keys.insert(tile.GetKey());
+        CHECK_EQUAL(tiles.size(), keys.size());
+    }
+}
+
+TEST(loadTest)
+{
+    auto directory = CacheDirectory("soundscape_working_set_test");
+    FeatureStore store;
+    TileCache cache;
+    CHECK(cache.Open(directory, 64 * 1024 * 1024));
+    auto source = std::make_shared<EmptyTileSource>();
+    TileWorkingSet working_set(store, cache);
+
+    // Nothing happens until it's started
+    working_set.SetLocation(START_LATITUDE, START_LONGITUDE);
+    CHECK(!working_set.IsRunning());
+    CHECK_EQUAL(0u, store.GetTileCount());
+
+    working_set.Start(300.0, source);
+    CHECK(working_set.WaitUntilIdle(5000));
+    std::vector<TileId> wanted;
+    TileWorkingSet::GetTilesInCircle(START_LATITUDE, START_LONGITUDE, 300.0, wanted);
+    CHECK(IsLoaded(store, wanted));
+    CHECK_EQUAL(wanted.size(), store.GetTileCount());
+    TileWorkingSetStats stats;
+    working_set.GetStats(stats);
+    CHECK_EQUAL(0u, stats.hits);
+    CHECK_EQUAL(wanted.size(), stats.misses);
+    CHECK_EQUAL(wanted.size(), stats.fetches);
+    CHECK_EQUAL(wanted.size(), stats.tiles);
+    CHECK_EQUAL(0u, stats.missing);
+    CHECK_EQUAL(wanted.size(), source->m_FetchCount.load());
+
+    // Small movements don't cause any more loading
+    working_set.SetLocation(START_LATITUDE + 0.00001, START_LONGITUDE);
+    CHECK(working_set.WaitUntilIdle(5000));
+    CHECK_EQUAL(wanted.size(), source->m_FetchCount.load());
+
+    // Starting again from scratch, the fetched tiles come from the cache
+    working_set.Stop();
+    store.Clear();
+    working_set.Start(300.0, source);
+    CHECK(working_set.WaitUntilIdle(5000));
+    working_set.GetStats(stats);
+    CHECK_EQUAL(wanted.size(), stats.hits);
+    CHECK_EQUAL(wanted.size(), source->m_FetchCount.load());
+    CHECK(IsLoaded(store, wanted));
+    working_set.Stop();
+    cache.Close();
+    CacheDirectory("soundscape_working_set_test");
+}
+
+TEST(moveTest)
+{
+    FeatureStore store;
+    TileCache cache;
+    auto source = std::make_shared<EmptyTileSource>();
+    TileWorkingSet working_set(store, cache);
+    working_set.Start(200.0, source);
+
+    // Walk 3km east in 10m steps, letting the working set catch up after each one
+    double latitude = START_LATITUDE;
+    double longitude = START_LONGITUDE;
+    size_t most_tiles = 0;
+    for(int step = 0; step < 300; ++step) {
+        working_set.SetLocation(latitude, longitude);
+        CHECK(working_set.WaitUntilIdle(5000));
+        most_tiles = std::max(most_tiles, store.GetTileCount());
+        getDestinationCoordinate(latitude, longitude, 90.0, 10.0, latitude, longitude);
+    }
+
+    TileWorkingSetStats stats;
+    working_set.GetStats(stats);
+    // Around 3km is more than 5 zoom 16 tiles at this latitude
+    CHECK(stats.crossings >= 5);
+    CHECK_EQUAL(0u, stats.stalls);
+    CHECK(stats.prefetches > 0);
+    CHECK(stats.evictions > 0);
+    CHECK_EQUAL(0u, stats.failures);
+    CHECK_EQUAL(stats.misses, stats.fetches);
+    // The tiles behind are unloaded, so there are only ever a few loaded
+    CHECK(most_tiles <= 9);
+    std::vector<TileId> around;
+    TileWorkingSet::GetTilesInCircle(latitude - 0.0001, longitude - 0.0001, 1.0, around);
+    CHECK(IsLoaded(store, around));
+
+    // The tile ahead was loaded before the listener got to it, so crossing into it didn't stall
+    std::vector<TileId> ahead;
+    double ahead_latitude;
+    double ahead_longitude;
+    getDestinationCoordinate(latitude, longitude, 90.0, 150.0, ahead_latitude, ahead_longitude);
+    TileWorkingSet::GetTilesInCircle(ahead_latitude, ahead_longitude, 1.0, ahead);
+    CHECK(IsLoaded(store, ahead));
+}
+
+// Counts how many times each tile is fetched
+class CountingTileSource : public EmptyTileSource {
+public:
+    bool FetchTile(const TileId &tile, std::string &json) override
+    {
+        std::lock_guard<std::mutex> guard(m_Mutex);
+        ++m_Fetches[tile.GetKey()];
+        return EmptyTileSource::FetchTile(tile, json);
+    }
+
+    unsigned GetMostFetches()
+    {
+        std::lock_guard<std::mutex> guard(m_Mutex);
+        unsigned most = 0;
+        for(const auto &fetches: m_Fetches)
+            most = std::max(most, fetches.second);
+        return most;
+    }
+
+private:
+    std::mutex m_Mutex;
+    std::map<uint64_t, unsigned> m_Fetches;
+};
+
+TEST(wavingCourseTest)
+{
+    FeatureStore store;
+    TileCache cache;
+    auto source = std::make_shared<CountingTileSource>();
+    TileWorkingSet working_set(store, cache);
+    working_set.Start(200.0, source);
+
+    // Walk east, veering 10 degrees to either side every 40m as a noisy course does. The circle
+    // ahead swings from side to side, but the tiles near it stay loaded, so none of them are
+    // fetched more than once.
+    double latitude = START_LATITUDE;
+    double longitude = START_LONGITUDE;
+    for(int step = 0; step < 200; ++step) {
+        working_set.SetLocation(latitude, longitude);
+        CHECK(working_set.WaitUntilIdle(5000));
+        auto bearing = ((step / 4) % 2) ? 100.0 : 80.0;
+        getDestinationCoordinate(latitude, longitude, bearing, 10.0, latitude, longitude);
+    }
+    CHECK_EQUAL(1u, source->GetMostFetches());
+}
+
+TEST(restartTest)
+{
+    FeatureStore store;
+    TileCache cache;
+    auto source = std::make_shared<EmptyTileSource>();
+    TileWorkingSet working_set(store, cache);
+    working_set.Start(200.0, source);
+
+    // Walk far enough east to have a course
+    double latitude = START_LATITUDE;
+    double longitude = START_LONGITUDE;
+    for(int step = 0; step < 10; ++step) {
+        working_set.SetLocation(latitude, longitude);
+        CHECK(working_set.WaitUntilIdle(5000));
+        getDestinationCoordinate(latitude, longitude, 90.0, 10.0, latitude, longitude);
+    }
+    TileWorkingSetStats before;
+    working_set.GetStats(before);
+    CHECK(before.prefetches > 0);
+
+    // Starting again somewhere else isn't crossing into another tile, and there's no course to
+    // prefetch along until the listener has moved there
+    working_set.Stop();
+    working_set.SetLocation(START_LATITUDE + 0.1, START_LONGITUDE);
+    working_set.Start(200.0, source);
+    CHECK(working_set.WaitUntilIdle(5000));
+    TileWorkingSetStats after;
+    working_set.GetStats(after);
+    CHECK_EQUAL(before.crossings, after.crossings);
+    CHECK_EQUAL(before.stalls, after.stalls);
+    CHECK_EQUAL(before.prefetches, after.prefetches);
+    std::vector<TileId> wanted;
+    TileWorkingSet::GetTilesInCircle(START_LATITUDE + 0.1, START_LONGITUDE, 200.0, wanted);
+    CHECK(IsLoaded(store, wanted));
+}
+
+TEST(concurrentStartStopTest)
+{
+    FeatureStore store;
+    TileCache cache;
+    auto source = std::make_shared<EmptyTileSource>();
+    TileWorkingSet working_set(store, cache);
+    working_set.SetLocation(START_LATITUDE, START_LONGITUDE);
+
+    // Stops racing each other and starts racing stops mustn't join the worker twice or leave
+    // the working set marked as running without one
+    for(int round = 0; round < 20; ++round) {
+        std::vector<std::thread> threads;
+        for(int t = 0; t < 4; ++t) {
+            threads.emplace_back([&working_set, &source, t]() {
+                if(t & 1)
+                    working_set.Stop();
+                else
+                    working_set.Start(200.0, source);
+            });
+        }
+        for(auto &thread: threads)
+            thread.join();
+    }
+
+    // Whatever order they ran in, a final start leaves a worker which loads the tiles
+    working_set.Start(200.0, source);
+    CHECK(working_set.IsRunning());
+    working_set.SetLocation(START_LATITUDE + 0.01, START_LONGITUDE);
+    CHECK(working_set.WaitUntilIdle(5000));
+    std::vector<TileId> wanted;
+    TileWorkingSet::GetTilesInCircle(START_LATITUDE + 0.01, START_LONGITUDE, 200.0, wanted);
+    CHECK(IsLoaded(store, wanted));
+    working_set.Stop();
+    CHECK(!working_set.IsRunning());
+}
+
+TEST(missingTest)
+{
+    FeatureStore store;
+    TileCache cache;
+    TileWorkingSet working_set(store, cache);
+    std::atomic<size_t> reported{0};
+    working_set.SetMissingCallback([&reported](size_t missing) { reported = missing; });
+
+    // With no source and nothing in the cache, every tile is missing. It starts in the middle of
+    // a tile, so that moving a little doesn't change the tiles wanted.
+    int x;
+    int y;
+    getXYTile(START_LATITUDE, START_LONGITUDE, 16, x, y);
+    auto box = tileToBoundingBox(x, y, 16);
+    auto latitude = (box.northLatitude + box.southLatitude) / 2.0;
+    auto longitude = (box.westLongitude + box.eastLongitude) / 2.0;
+    working_set.Start(300.0);
+    working_set.SetLocation(latitude, longitude);
+    CHECK(working_set.WaitUntilIdle(5000));
+    std::vector<TileId> wanted;
+    TileWorkingSet::GetTilesInCircle(latitude, longitude, 300.0, wanted);
+    std::vector<TileId> missing;
+    working_set.GetMissingTiles(missing);
+    CHECK_EQUAL(wanted.size(), missing.size());
+    CHECK_EQUAL(wanted.size(), reported.load());
+    CHECK(missing[0] == wanted[0]);
+    TileWorkingSetStats stats;
+    working_set.GetStats(stats);
+    CHECK_EQUAL(wanted.size(), stats.failures);
+    CHECK_EQUAL(wanted.size(), stats.missing);
+
+    // They're not tried again as the listener moves about in the same tile
+    working_set.SetLocation(latitude + 0.0001, longitude);
+    CHECK(working_set.WaitUntilIdle(5000));
+    working_set.GetStats(stats);
+    CHECK_EQUAL(wanted.size(), stats.failures);
+
+    // Once the client has loaded them, they aren't missing any more
+    for(const auto &tile: missing)
+        CHECK(working_set.AddTile(tile, std::make_shared<FeatureCollection>()));
+    working_set.GetMissingTiles(missing);
+    CHECK(missing.empty());
+    working_set.GetStats(stats);
+    CHECK_EQUAL(0u, stats.missing);
+}
+
+TEST(clientTileTest)
+{
+    FeatureStore store;
+    TileCache cache;
+    TileWorkingSet working_set(store, cache);
+    int x;
+    int y;
+    getXYTile(START_LATITUDE, START_LONGITUDE, 16, x, y);
+    TileId wanted{x, y, 16};
+    TileId unwanted{x + 100, y, 16};
+    TileId other_zoom{x / 2, y / 2, 15};
+
+    // Until it's running the client owns all of the tiles
+    CHECK(!working_set.AddTile(unwanted, std::make_shared<FeatureCollection>()));
+    CHECK(store.GetIndex(unwanted) == nullptr);
+
+    working_set.Start(200.0);
+    working_set.SetLocation(START_LATITUDE, START_LONGITUDE);
+    CHECK(working_set.WaitUntilIdle(5000));
+    CHECK(working_set.AddTile(wanted, std::make_shared<FeatureCollection>()));
+    CHECK(store.GetIndex(wanted) != nullptr);
+    // A tile it doesn't want isn't added, so it can't be left in the store after the working
+    // set has moved on
+    CHECK(working_set.AddTile(unwanted, std::make_shared<FeatureCollection>()));
+    CHECK(store.GetIndex(unwanted) == nullptr);
+    // It only owns the zoom 16 tiles
+    CHECK(!working_set.AddTile(other_zoom, std::make_shared<FeatureCollection>()));
+
+    working_set.Stop();
+    CHECK(!working_set.AddTile(unwanted, std::make_shared<FeatureCollection>()));
+}
+
+TEST(engineApiTest)
+{
+    soundscape_tile_working_set_stats stats;
+    soundscape_tile_id tiles[64];
+    CHECK_EQUAL(-1, soundscape_engine_start_tile_working_set(nullptr, 300.0));
+    CHECK_EQUAL(-1, soundscape_engine_get_missing_tiles(nullptr, tiles, 64));
+    CHECK_EQUAL(-1, soundscape_engine_get_tile_working_set_stats(nullptr, &stats));
+
+    auto engine = soundscape_engine_create();
+    CHECK_EQUAL(-1, soundscape_engine_start_tile_working_set(engine, -1.0));
+    CHECK_EQUAL(0, soundscape_engine_start_tile_working_set(engine, 300.0));
+    soundscape_engine_update_geometry(engine, START_LATITUDE, START_LONGITUDE, 0.0);
+
+    // The tiles aren't in the cache, so the client is told that they're missing
+    int64_t missing_event = 0;
+    soundscape_event events[16];
+    for(int attempt = 0; (attempt < 500) && (missing_event == 0); ++attempt) {
+        auto count = soundscape_engine_drain_events(engine, events, 16);
+        for(size_t index = 0; index < count; ++index) {
+            if(events[index].type == SOUNDSCAPE_EVENT_TILES_MISSING)
+                missing_event = events[index].value;
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    auto found = soundscape_engine_get_missing_tiles(engine, tiles, 64);
+    CHECK(found > 0);
+    CHECK_EQUAL(found, missing_event);
+
+    // The client fetches them and loads them
+    std::vector<soundscape_tile> loaded;
+    for(int64_t index = 0; index < found; ++index)
+        loaded.push_back({tiles[index].x, tiles[index].y, tiles[index].zoom, EMPTY_TILE, strlen(EMPTY_TILE)});
+    CHECK_EQUAL(static_cast<int>(found), soundscape_engine_load_tiles(engine, loaded.data(), loaded.size()));
+    CHECK_EQUAL(0, soundscape_engine_get_missing_tiles(engine, tiles, 64));
+    CHECK_EQUAL(0, soundscape_engine_get_tile_working_set_stats(engine, &stats));
+    CHECK_EQUAL(static_cast<uint64_t>(found), stats.failures);
+    CHECK_EQUAL(0u, stats.missing);
+
+    // A tile the working set doesn't want isn't loaded while it's running, but is once it's
+    // stopped
+    soundscape_tile far = {tiles[0].x + 100, tiles[0].y, 16, EMPTY_TILE, strlen(EMPTY_TILE)};
+    CHECK_EQUAL(1, soundscape_engine_load_tiles(engine, &far, 1));
+    CHECK_EQUAL(-1, soundscape_engine_get_tile_feature_count(engine, far.x, far.y, far.zoom));
+
+    CHECK_EQUAL(0, soundscape_engine_start_tile_working_set(engine, 0.0));
+    CHECK_EQUAL(1, soundscape_engine_load_tiles(engine, &far, 1));
+    CHECK_EQUAL(0, soundscape_engine_get_tile_feature_count(engine, far.x, far.y, far.zoom));
+    soundscape_engine_destroy(engine);
+}
+
+TEST_MAIN()
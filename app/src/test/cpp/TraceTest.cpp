@@ -0,0 +1,247 @@
+// Trace at warning level and above, to check that the lower levels are compiled out
+#undef SOUNDSCAPE_TRACE_LEVEL
+#define SOUNDSCAPE_TRACE_LEVEL TRACE_LEVEL_WARNING
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <pthread.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "TestHarness.h"
+#include "Trace.h"
+#include "TraceRing.h"
+
+using namespace soundscape;
+
+// Run the traces with the output going to a temporary file, and return what was written
+template<typename Function>
+static std::string CaptureTrace(Function function)
+{
+    auto file = tmpfile();
+    SetTraceFile(file);
+    function();
+    TraceFlush();
+    SetTraceFile(nullptr);
+
+    std::string output;
+    rewind(file);
+    char line[512];
+    while(fgets(line, sizeof(line), file))
+        output += line;
+    fclose(file);
+    return output;
+}
+
+static size_t CountLines(const std::string &text, const std::string &contains)
+{
+    size_t count = 0;
+    size_t start = 0;
+    while(start < text.size()) {
+        auto end = text.find('\n', start);
+        if(end == std::string::npos)
+            end = text.size();
+        if(text.substr(start, end - start).find(contains) != std::string::npos)
+            ++count;
+        start = end + 1;
+    }
+    return count;
+}
+
+TEST(ringTest)
+{
+    TraceRing ring(64);
+    uint8_t record[32];
+    uint8_t read[32];
+    CHECK_EQUAL(0U, ring.Read(read, sizeof(read)));
+
+    // Records wrap around the end of the buffer
+    for(int i = 0; i < 10; ++i) {
+        memset(record, i, sizeof(record));
+        CHECK(ring.Write(record, 20));
+        CHECK_EQUAL(20U, ring.Read(read, sizeof(read)));
+        CHECK_EQUAL(i, read[0]);
+        CHECK_EQUAL(i, read[19]);
+    }
+
+    // Two records of 20 bytes and their sizes fit, a third doesn't
+    CHECK(ring.Write(record, 20));
+    CHECK(ring.Write(record, 20));
+    CHECK(!ring.Write(record, 20));
+    CHECK_EQUAL(1U, ring.GetDroppedCount());
+
+    // Reads are truncated to the buffer they're read into
+    CHECK_EQUAL(8U, ring.Read(read, 8));
+    CHECK_EQUAL(20U, ring.Read(read, sizeof(read)));
+    CHECK_EQUAL(0U, ring.Read(read, sizeof(read)));
+}
+
+enum class Colour { Red = 3 };
+
+TEST(formatTest)
+{
+    std::string name = "beacon";
+    auto output = CaptureTrace([&]() {
+        TRACE_ERROR("int %d unsigned %u size %zu long %ld", -5, 7U, static_cast<size_t>(123), -9L);
+        TRACE_ERROR("double %.2f %g %5.1f|", 1.5, 0.25f, 2.0);
+        TRACE_ERROR("string %s %-8s| char %c percent %% hex %x %08X", name.c_str(), "left", 'x', 255, 0xabcU);
+        TRACE_WARNING("pointer %p enum %d bool %d", reinterpret_cast<void *>(0x1234),
+                      static_cast<int>(Colour::Red), true);
+        // Too few arguments is caught by the format check, but the drain copes with it anyway
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wformat"
+        TRACE_WARNING("missing %d %d", 1);
+#pragma GCC diagnostic pop
+    });
+
+    CHECK_EQUAL(1U, CountLines(output, "int -5 unsigned 7 size 123 long -9"));
+    CHECK_EQUAL(1U, CountLines(output, "double 1.50 0.25   2.0|"));
+    CHECK_EQUAL(1U, CountLines(output, "string beacon left    | char x percent % hex ff 00000ABC"));
+    CHECK_EQUAL(1U, CountLines(output, "pointer 0x1234 enum 3 bool 1"));
+    CHECK_EQUAL(1U, CountLines(output, "missing 1 <missing>"));
+}
+
+TEST(longStringTest)
+{
+    // Strings are truncated rather than the record being lost
+    std::string long_string(1000, 'a');
+    auto output = CaptureTrace([&]() {
+        TRACE_ERROR("%s|%d", long_string.c_str(), 42);
+    });
+    CHECK_EQUAL(1U, CountLines(output, std::string(TRACE_MAX_STRING, 'a') + "|42"));
+    CHECK_EQUAL(0U, CountLines(output, std::string(TRACE_MAX_STRING + 1, 'a')));
+}
+
+TEST(levelTest)
+{
+    int evaluated = 0;
+    auto output = CaptureTrace([&]() {
+        TRACE("debug %d", ++evaluated);
+        TRACE_INFO("info %d", ++evaluated);
+        TRACE_WARNING("warning %d", ++evaluated);
+    });
+
+    // The compiled out traces don't evaluate their arguments
+    CHECK_EQUAL(1, evaluated);
+    CHECK_EQUAL(0U, CountLines(output, "debug"));
+    CHECK_EQUAL(0U, CountLines(output, "info"));
+    CHECK_EQUAL(1U, CountLines(output, "warning 1"));
+}
+
+TEST(threadsTest)
+{
+    const int THREADS = 4;
+    const int TRACES = 200;
+
+    // Each round of threads reuses the rings of the previous round
+    for(int round = 0; round < 3; ++round) {
+        auto output = CaptureTrace([&]() {
+            std::vector<std::thread> threads;
+            for(int t = 0; t < THREADS; ++t) {
+                threads.emplace_back([t]() {
+                    for(int i = 0; i < TRACES; ++i)
+                        TRACE_WARNING("thread %d trace %d", t, i);
+                });
+            }
+            for(auto &thread: threads)
+                thread.join();
+        });
+
+        CHECK_EQUAL(static_cast<size_t>(THREADS * TRACES), CountLines(output, ": thread "));
+        CHECK_EQUAL(1U, CountLines(output, "thread 3 trace 199"));
+    }
+    CHECK_EQUAL(0U, GetTraceDroppedCount());
+}
+
+TEST(exitedThreadsTest)
+{
+    // Each thread takes the ring that the thread before it released
+    const int THREADS = 3;
+
+    for(int round = 0; round < 3; ++round) {
+        int tids[THREADS] = {};
+        auto output = CaptureTrace([&]() {
+            for(int t = 0; t < THREADS; ++t) {
+                std::thread thread([t, &tids]() {
+                    tids[t] = static_cast<int>(syscall(SYS_gettid));
+                    TRACE_WARNING("exited thread %d", t);
+                });
+                thread.join();
+            }
+        });
+
+        // The records of each thread are reported under its own id, even though the thread
+        // exited before they were drained
+        for(int t = 0; t < THREADS; ++t) {
+            char line[64];
+            snprintf(line, sizeof(line), "%6d: exited thread %d", tids[t], t);
+            CHECK_EQUAL(1U, CountLines(output, line));
+        }
+    }
+    CHECK_EQUAL(0U, GetTraceDroppedCount());
+}
+
+static std::string ReadFile(const std::string &path)
+{
+    std::string text;
+    auto file = fopen(path.c_str(), "r");
+    if(!file)
+        return text;
+    char buffer[512];
+    size_t size;
+    while((size = fread(buffer, 1, sizeof(buffer), file)) > 0)
+        text.append(buffer, size);
+    fclose(file);
+    return text;
+}
+
+TEST(eventsTest)
+{
+    auto path = std::string(P_tmpdir) + "/TraceTest.json";
+    CHECK(!TraceEventsEnabled());
+    {
+        // Not recorded as the events weren't started
+        TRACE_SCOPE("before");
+    }
+
+    CHECK(StartTraceEvents(path.c_str()));
+    CHECK(TraceEventsEnabled());
+    {
+        TRACE_SCOPE("outer");
+        std::thread thread([]() {
+            pthread_setname_np(pthread_self(), "EventThread");
+            for(int i = 0; i < 10; ++i) {
+                TRACE_SCOPE("inner \"quoted\"");
+                std::this_thread::sleep_for(std::chrono::microseconds(100));
+            }
+        });
+        thread.join();
+    }
+    StopTraceEvents();
+    CHECK(!TraceEventsEnabled());
+    {
+        TRACE_SCOPE("after");
+    }
+    TraceFlush();
+
+    auto json = ReadFile(path);
+    CHECK_EQUAL(0U, json.find("{\"displayTimeUnit\":\"ms\",\"traceEvents\":["));
+    CHECK(json.find("]}") != std::string::npos);
+    CHECK_EQUAL(1U, CountLines(json, "\"name\":\"outer\",\"cat\":\"soundscape\",\"ph\":\"X\""));
+    CHECK_EQUAL(10U, CountLines(json, "\"name\":\"inner \\\"quoted\\\"\""));
+    CHECK_EQUAL(1U, CountLines(json, "\"args\":{\"name\":\"EventThread\"}"));
+    CHECK_EQUAL(0U, CountLines(json, "before"));
+    CHECK_EQUAL(0U, CountLines(json, "after"));
+
+    // The outer event lasts longer than all of the inner ones
+    auto outer = json.find("\"name\":\"outer\"");
+    auto duration = json.find("\"dur\":", outer);
+    CHECK(atof(json.c_str() + duration + 6) >= 1000.0);
+    remove(path.c_str());
+}
+
+TEST_MAIN()